@@ -0,0 +1,552 @@
+/** @file call_log.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Recording and reading of SDK call logs.  See call_log.h.
+
+*/
+
+#include "call_log.h"
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+  constexpr size_t CB_BUFFER = 64*1024;
+  constexpr int C_STATES_MAX = 255;
+
+  std::mutex lock$;             // Guards the log file and the states
+  FILE* fp$;
+  std::vector<const haptic_device_state_t*> states$;
+
+  // Arguments of the record being written by this thread.
+  thread_local std::vector<uint8_t> args$;
+
+  void put_u8 (uint8_t v) {
+    args$.push_back (v); }
+
+  void put_u32 (uint32_t v) {
+    for (int i = 0; i < 4; ++i)
+      args$.push_back (uint8_t (v >> (8*i))); }
+
+  void put_u64 (uint64_t v) {
+    for (int i = 0; i < 8; ++i)
+      args$.push_back (uint8_t (v >> (8*i))); }
+
+  void put_i32 (int v) {
+    put_u32 (uint32_t (v)); }
+
+  void put_float (float v) {
+    uint32_t u;
+    memcpy (&u, &v, sizeof (u));
+    put_u32 (u); }
+
+  void put_double (double v) {
+    uint64_t u;
+    memcpy (&u, &v, sizeof (u));
+    put_u64 (u); }
+
+  void put_vec3 (const vec3_t v) {
+    for (int i = 0; i < 3; ++i)
+      put_float (v[i]); }
+
+  // The fields of a target that the application sets, 36 bytes.
+  void put_target (const haptic_target_t& target) {
+    put_i32 (target.type);
+    put_vec3 (target.location);
+    put_vec3 (target.viewangles_deg);
+    put_i32 (target.healthvalue);
+    put_i32 (target.index); }
+
+  void begin () {
+    args$.clear (); }
+
+  // Append the record whose arguments are in args$.
+  void end (CallLog::Op op, const haptic_device_state_t* state) {
+    std::lock_guard<std::mutex> guard (lock$);
+    if (!fp$)
+      return;
+
+    size_t id = 0;
+    while (id < states$.size () && states$[id] != state)
+      ++id;
+    if (id == states$.size ()) {
+      if (states$.size () >= C_STATES_MAX)
+        return;
+      states$.push_back (state);
+    }
+
+    uint8_t header[10];
+    header[0] = uint8_t (op);
+    header[1] = uint8_t (id);
+    uint32_t volume = uint32_t (state->haptic_volume);
+    uint32_t cb = uint32_t (args$.size ());
+    for (int i = 0; i < 4; ++i) {
+      header[2 + i] = uint8_t (volume >> (8*i));
+      header[6 + i] = uint8_t (cb >> (8*i));
+    }
+    fwrite (header, sizeof (header), 1, fp$);
+    if (cb)
+      fwrite (&args$[0], cb, 1, fp$);
+  }
+
+  struct Parser {
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok = true;
+
+    bool need (size_t cb) {
+      if (size_t (end - p) < cb)
+        ok = false;
+      return ok; }
+
+    uint32_t u32 () {
+      if (!need (4))
+        return 0;
+      uint32_t v = 0;
+      for (int i = 0; i < 4; ++i)
+        v |= uint32_t (p[i]) << (8*i);
+      p += 4;
+      return v; }
+
+    uint64_t u64 () {
+      uint64_t lo = u32 ();
+      return lo | (uint64_t (u32 ()) << 32); }
+
+    int i32 () {
+      return int (u32 ()); }
+
+    float f32 () {
+      uint32_t u = u32 ();
+      float v;
+      memcpy (&v, &u, sizeof (v));
+      return v; }
+
+    double f64 () {
+      uint64_t u = u64 ();
+      double v;
+      memcpy (&v, &u, sizeof (v));
+      return v; }
+
+    void vec3 (vec3_t v) {
+      for (int i = 0; i < 3; ++i)
+        v[i] = f32 (); }
+
+    void target (haptic_target_t& target) {
+      memset (&target, 0, sizeof (target));
+      target.type = i32 ();
+      vec3 (target.location);
+      vec3 (target.viewangles_deg);
+      target.healthvalue = i32 ();
+      target.index = i32 (); }
+  };
+
+}
+
+namespace CallLog {
+
+  std::atomic<bool> enabled$;
+  thread_local int depth$;
+
+  void write_state (Op op, const haptic_device_state_t* state) {
+    if (!state)
+      return;
+    begin ();
+    end (op, state); }
+
+  // origin, viewangles, count, then per target type, location,
+  // viewangles, healthvalue and index.
+  void write_radar (const haptic_device_state_t* state,
+                    const haptic_target_t* targets, int len,
+                    const vec3_t origin, const vec3_t viewangles_deg) {
+    if (!state || (len && !targets) || len < 0 || len > MAX_TARGETS
+        || !origin || !viewangles_deg)
+      return;
+    begin ();
+    put_vec3 (origin);
+    put_vec3 (viewangles_deg);
+    put_i32 (len);
+    for (int i = 0; i < len; ++i)
+      put_target (targets[i]);
+    end (op_radar, state);
+  }
+
+  // One target, as in write_radar.
+  void write_target (Op op, const haptic_device_state_t* state,
+                     const haptic_target_t* target) {
+    if (!state || !target)
+      return;
+    begin ();
+    put_target (*target);
+    end (op, state);
+  }
+
+  // count, then the values.
+  void write_ints (Op op, const haptic_device_state_t* state,
+                   const int* values, int count) {
+    if (!state || count < 0 || (count && !values))
+      return;
+    begin ();
+    put_i32 (count);
+    for (int i = 0; i < count; ++i)
+      put_i32 (values[i]);
+    end (op, state);
+  }
+
+  // target_type, effect, period.
+  void write_effect (const haptic_device_state_t* state, int target_type,
+                     int effect, float period) {
+    if (!state)
+      return;
+    begin ();
+    put_i32 (target_type);
+    put_i32 (effect);
+    put_float (period);
+    end (op_effect, state);
+  }
+
+  // curve, count, then the samples.
+  void write_falloff_curve (const haptic_device_state_t* state, int curve,
+                            const float* samples, int count) {
+    if (!state || count < 0 || (count && !samples))
+      return;
+    begin ();
+    put_i32 (curve);
+    put_i32 (count);
+    for (int i = 0; i < count; ++i)
+      put_float (samples[i]);
+    end (op_falloff_curve, state);
+  }
+
+  // intensity_ceiling, period, game_time.
+  void write_throb (const haptic_device_state_t* state,
+                    unsigned intensity_ceiling, float period,
+                    double game_time) {
+    if (!state)
+      return;
+    begin ();
+    put_u32 (intensity_ceiling);
+    put_float (period);
+    put_double (game_time);
+    end (op_throb, state);
+  }
+
+  // game_time.
+  void write_execute (const haptic_device_state_t* state, double game_time) {
+    if (!state)
+      return;
+    begin ();
+    put_double (game_time);
+    end (op_execute, state);
+  }
+
+  // count, then motor and intensity of each.
+  void write_motors (const haptic_device_state_t* state,
+                     const haptic_motor_config_t* configs, int count) {
+    if (!state || count < 0 || (count && !configs))
+      return;
+    begin ();
+    put_i32 (count);
+    for (int i = 0; i < count; ++i) {
+      put_i32 (configs[i].motor);
+      put_i32 (configs[i].intensity);
+    }
+    end (op_motors, state);
+  }
+
+  // count, then the duties.
+  void write_packed_mapping (const haptic_device_state_t* state,
+                             const uint8_t* duties, int count) {
+    if (!state || count < 0 || (count && !duties))
+      return;
+    begin ();
+    put_i32 (count);
+    for (int i = 0; i < count; ++i)
+      put_u8 (duties[i]);
+    end (op_packed_mapping, state);
+  }
+
+  // motor, waveform, period_sec, amplitude, phase.
+  void write_oscillator (const haptic_device_state_t* state, int motor,
+                         int waveform, float period_sec, int amplitude,
+                         float phase) {
+    if (!state)
+      return;
+    begin ();
+    put_i32 (motor);
+    put_i32 (waveform);
+    put_float (period_sec);
+    put_i32 (amplitude);
+    put_float (phase);
+    end (op_oscillator, state);
+  }
+
+  // count, then the values.
+  void write_floats (Op op, const haptic_device_state_t* state,
+                     const float* values, int count) {
+    if (!state || count < 0 || (count && !values))
+      return;
+    begin ();
+    put_i32 (count);
+    for (int i = 0; i < count; ++i)
+      put_float (values[i]);
+    end (op, state);
+  }
+
+  // flags, latency_sec.
+  void write_prediction (const haptic_device_state_t* state, int flags,
+                         float latency_sec) {
+    if (!state)
+      return;
+    begin ();
+    put_i32 (flags);
+    put_float (latency_sec);
+    end (op_prediction, state);
+  }
+
+  // game_time, length of the path, then the path.
+  void write_pattern (const haptic_device_state_t* state, const char* path,
+                      double game_time) {
+    if (!state)
+      return;
+    size_t cb = path ? strlen (path) : 0;
+    begin ();
+    put_double (game_time);
+    put_i32 (int (cb));
+    for (size_t i = 0; i < cb; ++i)
+      put_u8 (uint8_t (path[i]));
+    end (op_play_pattern, state);
+  }
+
+  bool Reader::open (const std::string& path) {
+    data_.clear ();
+    auto fp = fopen (path.c_str (), "rb");
+    if (!fp)
+      return false;
+    uint8_t buffer[CB_BUFFER];
+    size_t cb;
+    while ((cb = fread (buffer, 1, sizeof (buffer), fp)) > 0)
+      data_.insert (data_.end (), buffer, buffer + cb);
+    fclose (fp);
+
+    Parser parser { data_.data (), data_.data () + data_.size () };
+    if (data_.size () < CB_HEADER || memcmp (data_.data (), MAGIC, 8) != 0)
+      return false;
+    parser.p += 8;
+    if (parser.u32 () != VERSION || parser.u32 () != CB_HEADER)
+      return false;
+    rewind ();
+    return true;
+  }
+
+  bool Reader::next (Record& record) {
+    if (data_.size () < offset_ + 10)
+      return false;
+
+    const uint8_t* p = &data_[offset_];
+    Parser header { p + 2, p + 10 };
+    record.op = Op (p[0]);
+    record.state = p[1];
+    record.volume = header.i32 ();
+    uint32_t cb = header.u32 ();
+    if (data_.size () - offset_ - 10 < cb)
+      return false;
+
+    Parser args { p + 10, p + 10 + cb };
+    record.ints.clear ();
+    record.floats.clear ();
+    record.targets.clear ();
+    record.configs.clear ();
+    record.bytes.clear ();
+
+    switch (record.op) {
+    case op_init:
+    case op_open:
+    case op_close:
+    case op_reset:
+    case op_stop_radar:
+    case op_stop_throbbing:
+    case op_stop_pattern:
+      break;
+
+    case op_radar:
+      {
+        args.vec3 (record.origin);
+        args.vec3 (record.viewangles_deg);
+        int len = args.i32 ();
+        if (len < 0 || len > MAX_TARGETS || !args.need (size_t (len)*36))
+          return false;
+        record.targets.resize (len);
+        for (auto& target : record.targets)
+          args.target (target);
+      }
+      break;
+
+    case op_add_target:
+    case op_move_target:
+      if (!args.need (36))
+        return false;
+      record.targets.resize (1);
+      args.target (record.targets[0]);
+      break;
+
+    case op_clear_effect:
+    case op_mixing:
+    case op_spatialization:
+    case op_motor:
+    case op_motors_packed:
+    case op_linear_packed_mapping:
+    case op_priority:
+    case op_report_budget:
+    case op_remove_target:
+      {
+        int count = args.i32 ();
+        if (count < 0 || !args.need (size_t (count)*4))
+          return false;
+        for (int i = 0; i < count; ++i)
+          record.ints.push_back (args.i32 ());
+      }
+      break;
+
+    case op_effect:
+      record.ints.push_back (args.i32 ());
+      record.ints.push_back (args.i32 ());
+      record.floats.push_back (args.f32 ());
+      break;
+
+    case op_falloff_curve:
+      {
+        record.ints.push_back (args.i32 ());
+        int count = args.i32 ();
+        if (count < 0 || !args.need (size_t (count)*4))
+          return false;
+        for (int i = 0; i < count; ++i)
+          record.floats.push_back (args.f32 ());
+      }
+      break;
+
+    case op_throb:
+      record.ints.push_back (int (args.u32 ()));
+      record.floats.push_back (args.f32 ());
+      record.game_time = args.f64 ();
+      break;
+
+    case op_execute:
+      record.game_time = args.f64 ();
+      break;
+
+    case op_oscillator:
+      record.ints.push_back (args.i32 ());
+      record.ints.push_back (args.i32 ());
+      record.floats.push_back (args.f32 ());
+      record.ints.push_back (args.i32 ());
+      record.floats.push_back (args.f32 ());
+      break;
+
+    case op_waveform:
+    case op_player_pose:
+    case op_delta_threshold:
+      {
+        int count = args.i32 ();
+        if (count < 0 || !args.need (size_t (count)*4))
+          return false;
+        for (int i = 0; i < count; ++i)
+          record.floats.push_back (args.f32 ());
+      }
+      break;
+
+    case op_prediction:
+      record.ints.push_back (args.i32 ());
+      record.floats.push_back (args.f32 ());
+      break;
+
+    case op_motors:
+      {
+        int count = args.i32 ();
+        if (count < 0 || !args.need (size_t (count)*8))
+          return false;
+        record.configs.resize (count);
+        for (auto& config : record.configs) {
+          config.motor = args.i32 ();
+          config.intensity = args.i32 ();
+        }
+      }
+      break;
+
+    case op_packed_mapping:
+      {
+        int count = args.i32 ();
+        if (count < 0 || !args.need (size_t (count)))
+          return false;
+        record.bytes.assign (args.p, args.p + count);
+        args.p += count;
+      }
+      break;
+
+    case op_play_pattern:
+      {
+        record.game_time = args.f64 ();
+        int count = args.i32 ();
+        if (count < 0 || !args.need (size_t (count)))
+          return false;
+        record.bytes.assign (args.p, args.p + count);
+        args.p += count;
+      }
+      break;
+
+    default:
+      return false;
+    }
+
+    if (!args.ok)
+      return false;
+    offset_ += 10 + cb;
+    return true;
+  }
+
+}
+
+OMNI_RESULT start_omniwear_call_log (const char* path) {
+  if (!path)
+    return OMNI_ERROR_INVALID_ARGUMENT;
+
+  std::lock_guard<std::mutex> guard (lock$);
+  if (fp$)
+    return OMNI_ERROR_INVALID_ARGUMENT;
+
+  auto fp = fopen (path, "wb");
+  if (!fp)
+    return OMNI_ERROR_IO;
+  setvbuf (fp, nullptr, _IOFBF, CB_BUFFER);
+
+  uint8_t header[CallLog::CB_HEADER] = {};
+  memcpy (header, CallLog::MAGIC, 8);
+  for (int i = 0; i < 4; ++i) {
+    header[8 + i] = uint8_t (CallLog::VERSION >> (8*i));
+    header[12 + i] = uint8_t (CallLog::CB_HEADER >> (8*i));
+  }
+  if (fwrite (header, sizeof (header), 1, fp) != 1) {
+    fclose (fp);
+    return OMNI_ERROR_IO;
+  }
+
+  fp$ = fp;
+  states$.clear ();
+  CallLog::enabled$.store (true, std::memory_order_release);
+  return OMNI_SUCCESS;
+}
+
+OMNI_RESULT stop_omniwear_call_log (void) {
+  std::lock_guard<std::mutex> guard (lock$);
+  if (!fp$)
+    return OMNI_SUCCESS;
+
+  CallLog::enabled$.store (false, std::memory_order_release);
+  bool ok = !ferror (fp$);
+  ok = fclose (fp$) == 0 && ok;
+  fp$ = nullptr;
+  return ok ? OMNI_SUCCESS : OMNI_ERROR_IO;
+}
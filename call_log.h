@@ -0,0 +1,186 @@
+/** @file call_log.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Recording of the calls an application makes to the SDK.  While a
+   recording is open, each call that changes a haptic_device_state_t
+   is appended to a call log with its arguments, e.g. the whole
+   target list of update_haptic_radar and the game_time of
+   execute_haptic_effects.  omni-callreplay runs a call log against
+   the engine and a null device.
+
+   NOTES
+   =====
+
+   o Determinism.  The engine's time comes from the game_time
+     arguments, which are recorded.  haptic_volume is a field that the
+     application sets directly, so it is recorded with every call.
+     Replaying a log therefore sends the same reports to the device
+     every time, with two exceptions that read the clock: the
+     adaptive report budget and the latency of the prediction both
+     follow the measured time to send reports.  A log made with a
+     fixed budget and without prediction replays exactly.
+
+   o Nesting.  Only the outermost call is recorded.  The calls that
+     execute_haptic_effects and open_omniwear_device make to other
+     exported functions are not, nor are the calls that
+     drain_haptic_command_queue and apply_haptic_snapshot make on
+     behalf of the queue and the snapshot, which are recorded as the
+     calls they are.  execute_haptic_radar_batch
+     is not recorded.
+
+   o Format.  A log is a header followed by records, byte-packed with
+     little-endian integers and IEEE floats.
+
+       header   8   magic "OMNICALL"
+                4   version, 1
+                4   size of the header, 16
+
+       record   1   call, an Op
+                1   state, numbered in the order first seen
+                4   haptic_volume of the state
+                4   length of the arguments
+                n   arguments
+
+     The arguments of each call are listed by the write functions in
+     call_log.cc.  Targets are recorded without the fields that the
+     engine computes.
+
+*/
+
+#if !defined (CALL_LOG_H_INCLUDED)
+#    define   CALL_LOG_H_INCLUDED
+
+/* ----- Includes */
+
+#include "omniwear_SDK.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+/* ----- Types */
+
+namespace CallLog {
+
+  constexpr char MAGIC[] = "OMNICALL";
+  constexpr uint32_t VERSION = 1;
+  constexpr size_t CB_HEADER = 16;
+
+  enum Op {
+    op_init = 1,
+    op_open,
+    op_close,
+    op_reset,
+    op_radar,
+    op_stop_radar,
+    op_effect,
+    op_clear_effect,
+    op_mixing,
+    op_spatialization,
+    op_falloff_curve,
+    op_throb,
+    op_stop_throbbing,
+    op_execute,
+    op_motor,
+    op_motors,
+    op_motors_packed,
+    op_packed_mapping,
+    op_linear_packed_mapping,
+    op_oscillator,
+    op_waveform,
+    op_priority,
+    op_report_budget,
+    op_prediction,
+    op_add_target,
+    op_move_target,
+    op_remove_target,
+    op_player_pose,
+    op_delta_threshold,
+    op_play_pattern,
+    op_stop_pattern,
+  };
+
+  extern std::atomic<bool> enabled$;
+  extern thread_local int depth$;
+
+  inline bool enabled () {
+    return enabled$.load (std::memory_order_relaxed); }
+
+  // Marks an exported call for the extent of its scope.  recording
+  // is true only for the outermost call while a log is open.
+  struct Call {
+    bool counted;
+    bool recording;
+
+    Call ()
+      : counted (enabled ()), recording (counted && depth$++ == 0) {}
+    ~Call () {
+      if (counted)
+        --depth$; }
+  };
+
+  void write_state (Op, const haptic_device_state_t*);
+  void write_radar (const haptic_device_state_t*,
+                    const haptic_target_t* targets, int len,
+                    const vec3_t origin, const vec3_t viewangles_deg);
+  void write_ints (Op, const haptic_device_state_t*,
+                   const int* values, int count);
+  void write_effect (const haptic_device_state_t*, int target_type,
+                     int effect, float period);
+  void write_falloff_curve (const haptic_device_state_t*, int curve,
+                            const float* samples, int count);
+  void write_throb (const haptic_device_state_t*, unsigned intensity_ceiling,
+                    float period, double game_time);
+  void write_execute (const haptic_device_state_t*, double game_time);
+  void write_motors (const haptic_device_state_t*,
+                     const haptic_motor_config_t* configs, int count);
+  void write_packed_mapping (const haptic_device_state_t*,
+                             const uint8_t* duties, int count);
+  void write_oscillator (const haptic_device_state_t*, int motor,
+                         int waveform, float period_sec, int amplitude,
+                         float phase);
+  void write_floats (Op, const haptic_device_state_t*,
+                     const float* values, int count);
+  void write_prediction (const haptic_device_state_t*, int flags,
+                         float latency_sec);
+  void write_target (Op, const haptic_device_state_t*,
+                     const haptic_target_t* target);
+  void write_pattern (const haptic_device_state_t*, const char* path,
+                      double game_time);
+
+  // One recorded call.  Only the members that the call uses are set.
+  struct Record {
+    Op op;
+    int state;
+    int volume;
+    std::vector<int> ints;
+    std::vector<float> floats;
+    double game_time;
+    std::vector<haptic_target_t> targets;
+    vec3_t origin;
+    vec3_t viewangles_deg;
+    std::vector<haptic_motor_config_t> configs;
+    std::vector<uint8_t> bytes;         // Also the path of a pattern
+  };
+
+  class Reader {
+  public:
+    bool open (const std::string& path);
+
+    // The next call, or false at the end of the log or at a
+    // truncated or unknown record.
+    bool next (Record& record);
+
+    void rewind () {
+      offset_ = CB_HEADER; }
+
+  private:
+    std::vector<uint8_t> data_;
+    size_t offset_ = CB_HEADER;
+  };
+
+}
+
+#endif  /* CALL_LOG_H_INCLUDED */
@@ -0,0 +1,254 @@
+/** @file capture.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Capture of HID reports to a file and reading of captures.  See
+   capture.h.
+
+*/
+
+#include "capture.h"
+#include "omniwear_SDK.h"
+#include "telemetry.h"
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined (_WIN32)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+namespace {
+
+  constexpr size_t CB_BUFFER = 64*1024;
+
+  std::mutex lock$;             // Guards the capture file
+  FILE* fp$;
+  int64_t last_ns$;
+
+  void put_u32 (uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i)
+      p[i] = uint8_t (v >> (8*i)); }
+
+  void put_u64 (uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; ++i)
+      p[i] = uint8_t (v >> (8*i)); }
+
+  uint64_t get_u64 (const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i)
+      v |= uint64_t (p[i]) << (8*i);
+    return v; }
+
+  uint32_t get_u32 (const uint8_t* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i)
+      v |= uint32_t (p[i]) << (8*i);
+    return v; }
+
+  int64_t wall_ns () {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>
+      (system_clock::now ().time_since_epoch ()).count (); }
+
+}
+
+namespace Capture {
+
+  std::atomic<bool> enabled$;
+
+  void record (int64_t time_ns, const char* rgb, size_t cb) {
+    if (!cb || cb > 256)
+      return;
+
+    uint8_t record[10 + 3 + 255];
+    std::lock_guard<std::mutex> guard (lock$);
+    if (!fp$)
+      return;
+
+    uint64_t delta = time_ns > last_ns$ ? time_ns - last_ns$ : 0;
+    if (time_ns > last_ns$)
+      last_ns$ = time_ns;
+
+    size_t i = 0;
+    do {
+      record[i++] = uint8_t (delta & 0x7f) | (delta > 0x7f ? 0x80 : 0);
+      delta >>= 7;
+    } while (delta);
+
+    size_t cb_rest = cb - 1;
+    size_t cb_stored = cb_rest;
+    while (cb_stored && !rgb[cb_stored])
+      --cb_stored;
+
+    record[i++] = uint8_t (rgb[0]);
+    record[i++] = uint8_t (cb_rest);
+    record[i++] = uint8_t (cb_stored);
+    memcpy (record + i, rgb + 1, cb_stored);
+    fwrite (record, i + cb_stored, 1, fp$);
+  }
+
+  Reader::~Reader () {
+    close (); }
+
+  void Reader::close () {
+    if (!data_)
+      return;
+#if defined (_WIN32)
+    free ((void*) data_);
+#else
+    if (mapped_)
+      munmap ((void*) data_, cb_);
+    else
+      free ((void*) data_);
+#endif
+    data_ = nullptr;
+    cb_ = 0;
+  }
+
+  bool Reader::open (const std::string& path) {
+    close ();
+
+#if !defined (_WIN32)
+    int fd = ::open (path.c_str (), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat (fd, &st) == 0 && st.st_size > 0) {
+      auto p = mmap (nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        data_ = (const uint8_t*) p;
+        cb_ = st.st_size;
+        mapped_ = true;
+      }
+    }
+    ::close (fd);
+#endif
+
+    if (!data_) {
+      auto fp = fopen (path.c_str (), "rb");
+      if (!fp)
+        return false;
+      size_t cb_alloc = 0;
+      uint8_t* p = nullptr;
+      size_t cb = 0;
+      for (;;) {
+        if (cb == cb_alloc) {
+          cb_alloc = cb_alloc ? cb_alloc*2 : CB_BUFFER;
+          auto q = (uint8_t*) realloc (p, cb_alloc);
+          if (!q)
+            break;
+          p = q;
+        }
+        auto cb_read = fread (p + cb, 1, cb_alloc - cb, fp);
+        if (!cb_read)
+          break;
+        cb += cb_read;
+      }
+      fclose (fp);
+      data_ = p;
+      cb_ = cb;
+      mapped_ = false;
+    }
+
+    if (cb_ < CB_HEADER || memcmp (data_, MAGIC, 8) != 0
+        || get_u32 (data_ + 8) != VERSION
+        || get_u32 (data_ + 12) < CB_HEADER
+        || get_u32 (data_ + 12) > cb_) {
+      close ();
+      return false;
+    }
+
+    start_ns_ = int64_t (get_u64 (data_ + 16));
+    start_wall_ns_ = int64_t (get_u64 (data_ + 24));
+    rewind ();
+    return true;
+  }
+
+  void Reader::rewind () {
+    offset_ = data_ ? get_u32 (data_ + 12) : CB_HEADER;
+    time_ns_ = 0; }
+
+  bool Reader::next (Report& report) {
+    if (!data_)
+      return false;
+
+    size_t i = offset_;
+    uint64_t delta = 0;
+    for (int shift = 0; ; shift += 7) {
+      if (i >= cb_ || shift > 63)
+        return false;
+      uint8_t b = data_[i++];
+      delta |= uint64_t (b & 0x7f) << shift;
+      if (!(b & 0x80))
+        break;
+    }
+
+    if (i + 3 > cb_)
+      return false;
+    size_t cb_rest = data_[i + 1];
+    size_t cb_stored = data_[i + 2];
+    if (cb_stored > cb_rest || i + 3 + cb_stored > cb_)
+      return false;
+
+    report.rgb[0] = data_[i];
+    memcpy (report.rgb + 1, data_ + i + 3, cb_stored);
+    memset (report.rgb + 1 + cb_stored, 0, cb_rest - cb_stored);
+    report.cb = 1 + cb_rest;
+    time_ns_ += delta;
+    report.time_ns = time_ns_;
+
+    offset_ = i + 3 + cb_stored;
+    return true;
+  }
+
+}
+
+OMNI_RESULT start_omniwear_capture (const char* path) {
+  if (!path)
+    return OMNI_ERROR_INVALID_ARGUMENT;
+
+  std::lock_guard<std::mutex> guard (lock$);
+  if (fp$)
+    return OMNI_ERROR_INVALID_ARGUMENT;
+
+  auto fp = fopen (path, "wb");
+  if (!fp)
+    return OMNI_ERROR_IO;
+  setvbuf (fp, nullptr, _IOFBF, CB_BUFFER);
+
+  uint8_t header[Capture::CB_HEADER] = {};
+  memcpy (header, Capture::MAGIC, 8);
+  put_u32 (header + 8, Capture::VERSION);
+  put_u32 (header + 12, Capture::CB_HEADER);
+  last_ns$ = Telemetry::now_ns ();
+  put_u64 (header + 16, last_ns$);
+  put_u64 (header + 24, wall_ns ());
+  if (fwrite (header, sizeof (header), 1, fp) != 1) {
+    fclose (fp);
+    return OMNI_ERROR_IO;
+  }
+
+  fp$ = fp;
+  Capture::enabled$.store (true, std::memory_order_release);
+  return OMNI_SUCCESS;
+}
+
+OMNI_RESULT stop_omniwear_capture (void) {
+  std::lock_guard<std::mutex> guard (lock$);
+  if (!fp$)
+    return OMNI_SUCCESS;
+
+  Capture::enabled$.store (false, std::memory_order_release);
+  bool ok = !ferror (fp$);
+  ok = fclose (fp$) == 0 && ok;
+  fp$ = nullptr;
+  return ok ? OMNI_SUCCESS : OMNI_ERROR_IO;
+}
@@ -0,0 +1,108 @@
+/** @file capture.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Capture of the reports handed to HID::write.  While a capture is
+   open, every report is appended to a capture file that omni-replay
+   can play back into any HID backend.
+
+   NOTES
+   =====
+
+   o Format.  A capture is a header followed by records, all
+     byte-packed with little-endian integers, so that a capture can be
+     mapped and read in place.
+
+       header   8   magic "OMNICAP1"
+                4   version, 1
+                4   size of the header, 32
+                8   monotonic time of the start of the capture, ns
+                8   wall clock time of the start, ns since 1970
+
+       record   1-10  time since the previous record, or since the
+                      start of the capture, ns, LEB128
+                1     report type, the first byte of the report
+                1     length of the rest of the report
+                1     bytes of the rest of the report that follow;
+                      the bytes beyond are zero
+                0-255 the bytes
+
+     Trailing zeros are not stored because most reports are padded
+     with them.
+
+   o Append-only.  Records are only appended, so a capture cut short
+     by a crash is readable up to its last complete record.
+
+   o Cost.  While no capture is open, a report costs one relaxed load.
+     While one is open, a report is encoded into a stdio buffer under
+     a lock.
+
+*/
+
+#if !defined (CAPTURE_H_INCLUDED)
+#    define   CAPTURE_H_INCLUDED
+
+/* ----- Includes */
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/* ----- Types */
+
+namespace Capture {
+
+  constexpr char MAGIC[] = "OMNICAP1";
+  constexpr uint32_t VERSION = 1;
+  constexpr size_t CB_HEADER = 32;
+
+  extern std::atomic<bool> enabled$;
+
+  inline bool enabled () {
+    return enabled$.load (std::memory_order_relaxed); }
+
+  // Append a report submitted at time_ns.
+  void record (int64_t time_ns, const char* rgb, size_t cb);
+
+  struct Report {
+    int64_t time_ns;            // Since the start of the capture
+    uint8_t rgb[256];
+    size_t cb;
+  };
+
+  // Reads a capture file.  The file is mapped where the platform
+  // allows it, and read into memory otherwise.
+  class Reader {
+  public:
+    ~Reader ();
+
+    bool open (const std::string& path);
+
+    int64_t start_ns () const { return start_ns_; }
+    int64_t start_wall_ns () const { return start_wall_ns_; }
+
+    // The next report, or false at the end of the capture or at a
+    // truncated record.
+    bool next (Report& report);
+
+    // Start again from the first report.
+    void rewind ();
+
+  private:
+    const uint8_t* data_ = nullptr;
+    size_t cb_ = 0;
+    size_t offset_ = CB_HEADER;
+    int64_t time_ns_ = 0;
+    int64_t start_ns_ = 0;
+    int64_t start_wall_ns_ = 0;
+    bool mapped_ = false;
+
+    void close ();
+  };
+
+}
+
+#endif  /* CAPTURE_H_INCLUDED */
@@ -0,0 +1,126 @@
+/** @file fixed_point.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Fixed point arithmetic for the fixed point build of the haptic
+   engine.  See fixed_point.h.
+
+*/
+
+#include "fixed_point.h"
+
+namespace {
+
+  // 1/sqrt (x), Q16.16, at the middle of each step of 1/64 from 1 to 4.
+  const uint16_t RSQRT_TABLE[192] = {
+    65281, 64781, 64292, 63814, 63347, 62889, 62442, 62004, 61575, 61154,
+    60742, 60339, 59943, 59555, 59175, 58801, 58435, 58075, 57722, 57376,
+    57035, 56700, 56372, 56049, 55731, 55419, 55112, 54810, 54513, 54221,
+    53933, 53650, 53371, 53097, 52826, 52560, 52298, 52040, 51785, 51535,
+    51288, 51044, 50804, 50567, 50333, 50103, 49876, 49652, 49430, 49212,
+    48997, 48784, 48574, 48367, 48163, 47961, 47761, 47564, 47370, 47178,
+    46988, 46800, 46615, 46432, 46251, 46072, 45895, 45720, 45547, 45376,
+    45207, 45040, 44875, 44711, 44550, 44390, 44232, 44075, 43920, 43767,
+    43615, 43465, 43316, 43169, 43024, 42879, 42737, 42595, 42456, 42317,
+    42180, 42044, 41910, 41776, 41644, 41514, 41384, 41256, 41129, 41003,
+    40878, 40754, 40631, 40510, 40390, 40270, 40152, 40035, 39919, 39803,
+    39689, 39576, 39464, 39352, 39242, 39133, 39024, 38916, 38810, 38704,
+    38599, 38494, 38391, 38289, 38187, 38086, 37986, 37887, 37788, 37690,
+    37593, 37497, 37401, 37307, 37213, 37119, 37027, 36935, 36843, 36753,
+    36663, 36573, 36485, 36397, 36309, 36222, 36136, 36051, 35966, 35882,
+    35798, 35715, 35632, 35550, 35469, 35388, 35307, 35228, 35148, 35070,
+    34991, 34914, 34837, 34760, 34684, 34608, 34533, 34458, 34384, 34310,
+    34237, 34164, 34092, 34020, 33949, 33878, 33807, 33737, 33668, 33599,
+    33530, 33461, 33393, 33326, 33259, 33192, 33126, 33060, 32994, 32929,
+    32864, 32800,
+  };
+
+}
+
+namespace Fixed {
+
+  // sin, Q1.15, of each whole degree from 0 to 90.
+  const uint16_t SIN_TABLE[91] = {
+    0, 572, 1144, 1715, 2286, 2856, 3425, 3993, 4560, 5126,
+    5690, 6252, 6813, 7371, 7927, 8481, 9032, 9580, 10126, 10668,
+    11207, 11743, 12275, 12803, 13328, 13848, 14365, 14876, 15384, 15886,
+    16384, 16877, 17364, 17847, 18324, 18795, 19261, 19720, 20174, 20622,
+    21063, 21498, 21926, 22348, 22763, 23170, 23571, 23965, 24351, 24730,
+    25102, 25466, 25822, 26170, 26510, 26842, 27166, 27482, 27789, 28088,
+    28378, 28660, 28932, 29197, 29452, 29698, 29935, 30163, 30382, 30592,
+    30792, 30983, 31164, 31336, 31499, 31651, 31795, 31928, 32052, 32166,
+    32270, 32365, 32449, 32524, 32588, 32643, 32688, 32723, 32748, 32763,
+    32768,
+  };
+
+  q16 rsqrt (q16 x) {
+    int i = (x >> 10) - 64;
+    i = i < 0 ? 0 : i > 191 ? 191 : i;
+    int64_t y = RSQRT_TABLE[i];
+
+    // One Newton step, y = y*(3 - x*y*y)/2.
+    int64_t t = (int64_t (x)*((y*y) >> 16)) >> 16;
+    return q16 ((y*(3*Q16_ONE - t)) >> 17);
+  }
+
+  uint32_t isqrt (uint64_t x) {
+    uint64_t root = 0;
+    uint64_t bit = uint64_t (1) << 62;
+    while (bit > x)
+      bit >>= 2;
+    while (bit) {
+      if (x >= root + bit) {
+        x -= root + bit;
+        root = (root >> 1) + bit;
+      }
+      else
+        root >>= 1;
+      bit >>= 2;
+    }
+    return uint32_t (root);
+  }
+
+  int64_t normalize (const int64_t v[3], q15 out[3]) {
+    uint64_t largest = 0;
+    for (int i = 0; i < 3; ++i) {
+      uint64_t a = v[i] < 0 ? uint64_t (-v[i]) : uint64_t (v[i]);
+      largest = a > largest ? a : largest;
+    }
+    if (!largest) {
+      out[0] = out[1] = out[2] = 0;
+      return 0;
+    }
+
+    // Scale so that the largest component has 15 bits and the sum of
+    // the squares fits in 32.
+    int shift = 0;
+    while (largest >= (1 << 15)) {
+      largest >>= 1;
+      ++shift;
+    }
+    while (largest < (1 << 14)) {
+      largest <<= 1;
+      --shift;
+    }
+    int32_t a[3];
+    for (int i = 0; i < 3; ++i)
+      a[i] = int32_t (shift >= 0 ? v[i] >> shift : v[i]*(int64_t (1) << -shift));
+    uint32_t sumsq = uint32_t (a[0]*a[0]) + uint32_t (a[1]*a[1])
+      + uint32_t (a[2]*a[2]);
+
+    // Scale the sum of squares into [1, 4) by an even shift so that
+    // the root can be unscaled.
+    int e = sumsq < (1u << 30) ? 12 : 14;
+    q16 r = rsqrt (q16 (sumsq >> e));
+    int s = 1 + (e + 16)/2;
+    for (int i = 0; i < 3; ++i)
+      out[i] = q15 ((int64_t (a[i])*r + (int64_t (1) << (s - 1))) >> s);
+
+    // Length of a, Q1.15, is sumsq*r unscaled.
+    int64_t length = int64_t ((uint64_t (sumsq)*uint64_t (r)) >> s);
+    return shift >= 15 ? length << (shift - 15) : length >> (15 - shift);
+  }
+
+}
@@ -0,0 +1,92 @@
+/** @file fixed_point.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Fixed point arithmetic for the fixed point build of the haptic
+   engine, see haptic_fixed.h.  Unit vectors, trigonometric values
+   and gains are Q1.15, positions are Q16.16.  Nothing here uses
+   floating point except the conversions from the floats of the SDK
+   interface.
+
+   NOTES
+   =====
+
+   o Q1.15 in 32 bits.  Q1.15 values are held in int32_t so that 1.0
+     is exact and so that the product of two of them, Q2.30, does not
+     overflow.
+
+   o Sine table.  The engine truncates view angles to whole degrees,
+     so sin and cos come from a quarter wave table of 91 entries
+     without interpolation.  The table is exact to the rounding of
+     Q1.15.
+
+   o Reciprocal square root.  rsqrt takes its argument scaled into
+     [1, 4), looks up a first estimate in a table of 192 entries and
+     refines it with one Newton step.  The result is accurate to
+     about 2e-5, the resolution of Q1.15.  normalize does the
+     scaling for vectors of any magnitude.
+
+*/
+
+#if !defined (FIXED_POINT_H_INCLUDED)
+#    define   FIXED_POINT_H_INCLUDED
+
+/* ----- Includes */
+
+#include <stdint.h>
+
+/* ----- Types */
+
+namespace Fixed {
+
+  typedef int32_t q15;          // Q1.15
+  typedef int32_t q16;          // Q16.16
+
+  constexpr q15 Q15_ONE = 1 << 15;
+  constexpr q16 Q16_ONE = 1 << 16;
+
+  extern const uint16_t SIN_TABLE[91];
+
+  inline q15 to_q15 (float v) {
+    return q15 (v*Q15_ONE + (v < 0 ? -0.5f : 0.5f)); }
+
+  inline int64_t to_q16 (float v) {
+    return int64_t (v*Q16_ONE); }
+
+  inline float to_float (q15 v) {
+    return v*(1.0f/Q15_ONE); }
+
+  // Product of two Q1.15 values, rounded.
+  inline q15 mul (q15 a, q15 b) {
+    return (a*b + (1 << 14)) >> 15; }
+
+  inline q15 sin_deg (int deg) {
+    deg %= 360;
+    if (deg < 0)
+      deg += 360;
+    if (deg < 90)
+      return SIN_TABLE[deg];
+    if (deg < 180)
+      return SIN_TABLE[180 - deg];
+    if (deg < 270)
+      return -q15 (SIN_TABLE[deg - 180]);
+    return -q15 (SIN_TABLE[360 - deg]); }
+
+  inline q15 cos_deg (int deg) {
+    return sin_deg (deg + 90); }
+
+  // 1/sqrt (x) for x in [1, 4), both Q16.16.
+  q16 rsqrt (q16 x);
+
+  // Integer square root, rounded down.
+  uint32_t isqrt (uint64_t x);
+
+  // Scale v to a Q1.15 unit vector and return its length in the
+  // units of v.  The zero vector has length zero and no direction.
+  int64_t normalize (const int64_t v[3], q15 out[3]);
+
+}
+
+#endif  /* FIXED_POINT_H_INCLUDED */
@@ -0,0 +1,179 @@
+/** @file frame_server.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Wire format and playout buffer of motor frames sent over the
+   network.  See frame_server.h.
+
+*/
+
+#include "frame_server.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+  void put_u16 (uint8_t* p, uint16_t v) {
+    p[0] = uint8_t (v);
+    p[1] = uint8_t (v >> 8); }
+
+  void put_u32 (uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i)
+      p[i] = uint8_t (v >> (8*i)); }
+
+  void put_u64 (uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; ++i)
+      p[i] = uint8_t (v >> (8*i)); }
+
+  uint16_t get_u16 (const uint8_t* p) {
+    return uint16_t (p[0] | (p[1] << 8)); }
+
+  uint32_t get_u32 (const uint8_t* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i)
+      v |= uint32_t (p[i]) << (8*i);
+    return v; }
+
+  uint64_t get_u64 (const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i)
+      v |= uint64_t (p[i]) << (8*i);
+    return v; }
+
+  // Order of sequence numbers that wrap.
+  int32_t distance (uint32_t from, uint32_t to) {
+    return int32_t (to - from); }
+
+}
+
+namespace FrameServer {
+
+  size_t encode (const Frame& frame, uint8_t* rgb) {
+    int count = frame.count < 0 ? 0
+      : frame.count > C_MOTORS_MAX ? C_MOTORS_MAX : frame.count;
+    memcpy (rgb, MAGIC, 4);
+    put_u16 (rgb + 4, VERSION);
+    rgb[6] = uint8_t (count);
+    rgb[7] = 0;
+    put_u32 (rgb + 8, frame.sequence);
+    put_u64 (rgb + 12, uint64_t (frame.time_ns));
+    memcpy (rgb + CB_HEADER, &frame.intensities[0], count);
+    return CB_HEADER + count; }
+
+  bool decode (const uint8_t* rgb, size_t cb, Frame& frame) {
+    if (cb < CB_HEADER || memcmp (rgb, MAGIC, 4) != 0
+        || get_u16 (rgb + 4) != VERSION || rgb[6] > C_MOTORS_MAX
+        || cb != CB_HEADER + rgb[6])
+      return false;
+    frame.count = rgb[6];
+    frame.sequence = get_u32 (rgb + 8);
+    frame.time_ns = int64_t (get_u64 (rgb + 12));
+    frame.intensities.fill (0);
+    for (int i = 0; i < frame.count; ++i) {
+      if (rgb[CB_HEADER + i] > 100)
+        return false;
+      frame.intensities[i] = rgb[CB_HEADER + i];
+    }
+    return true; }
+
+  void Playout::receive (const uint8_t* rgb, size_t cb, int64_t now_ns) {
+    Frame frame;
+    if (!decode (rgb, cb, frame)) {
+      ++stats_.invalid;
+      return;
+    }
+    push (frame, now_ns); }
+
+  void Playout::push (const Frame& frame, int64_t now_ns) {
+    ++stats_.received;
+
+    // A sender that restarted, or a run of frames we can't play,
+    // starts the buffer over.
+    if (started_) {
+      int32_t d = distance (highest_, frame.sequence);
+      if (d > MAX_GAP || d <= -C_REORDER || late_run_ >= C_LATE_RESTART) {
+        ++stats_.restarts;
+        restart ();
+      }
+    }
+
+    int64_t transit = now_ns - frame.time_ns;
+    if (!started_) {
+      started_ = true;
+      highest_ = frame.sequence - 1;
+      seen_ = 0;
+      late_run_ = 0;
+      last_transit_ = transit;
+      window_start_ = now_ns;
+      min_current_ = min_last_ = transit;
+    }
+
+    // seen_ has a bit for each of the C_REORDER sequence numbers up
+    // to highest_, whatever became of the frames.
+    int32_t ahead = distance (highest_, frame.sequence);
+    if (ahead > 0) {
+      stats_.span += ahead;
+      seen_ = ahead < C_REORDER ? seen_ << ahead : 0;
+      seen_ |= 1;
+      highest_ = frame.sequence;
+    }
+    else {
+      uint64_t bit = uint64_t (1) << -ahead;
+      if (seen_ & bit) {
+        ++stats_.duplicate;
+        return;
+      }
+      seen_ |= bit;
+    }
+
+    int64_t d = transit - last_transit_;
+    stats_.jitter_ns += (llabs (d) - stats_.jitter_ns)/16;
+    last_transit_ = transit;
+
+    if (now_ns - window_start_ >= WINDOW_NS) {
+      min_last_ = min_current_;
+      min_current_ = transit;
+      window_start_ = now_ns;
+    }
+    else if (transit < min_current_)
+      min_current_ = transit;
+
+    Entry entry { frame, now_ns };
+    if ((any_played_ && distance (played_, frame.sequence) <= 0)
+        || playout_ns (entry) < now_ns) {
+      ++stats_.late;
+      ++late_run_;
+      return;
+    }
+    late_run_ = 0;
+
+    auto it = queue_.end ();
+    while (it != queue_.begin ()
+           && distance ((it - 1)->frame.sequence, frame.sequence) < 0)
+      --it;
+    queue_.insert (it, entry); }
+
+  bool Playout::take (int64_t now_ns, Frame& frame, int64_t& wait_ns) {
+    int c = 0;
+    while (!queue_.empty () && playout_ns (queue_.front ()) <= now_ns) {
+      frame = queue_.front ().frame;
+      wait_ns = now_ns - queue_.front ().arrival_ns;
+      queue_.pop_front ();
+      ++c;
+    }
+    if (!c)
+      return false;
+    stats_.coalesced += c - 1;
+    ++stats_.played;
+    played_ = frame.sequence;
+    any_played_ = true;
+    return true; }
+
+  void Playout::restart () {
+    queue_.clear ();
+    started_ = false;
+    any_played_ = false; }
+
+}
@@ -0,0 +1,159 @@
+/** @file frame_server.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Motor frames over the network, for caps on thin clients driven by
+   a game server that computes the haptics.  The game server sends a
+   datagram for each frame, stamped with its own clock, and
+   omni-server plays the frames into the cap through a playout buffer
+   that absorbs the jitter of the network.  This holds the wire
+   format and the playout buffer, apart from sockets, so that both
+   can be driven by tests with made-up times.
+
+   NOTES
+   =====
+
+   o Format.  One frame a datagram, little-endian.
+
+       4   magic "OMNF"
+       2   version, 1
+       1   count of motors, up to C_MOTORS_MAX
+       1   flags, none yet
+       4   sequence, counting up from any value
+       8   time of the frame on the sender's clock, ns
+       ... intensity of each motor, 0-100
+
+   o Playout.  The sender's clock and ours are unrelated, so the
+     buffer tracks the smallest difference between when a frame
+     arrives and its time, over the last two WINDOW_NS, and plays each
+     frame DELAY later than its time plus that difference.  Frames
+     that arrive past their playout time, or behind one already
+     played, are late and dropped.
+
+   o Restart.  A sequence number more than MAX_GAP ahead of the
+     highest seen, or C_REORDER or more behind it, means the sender
+     started over, as does a run of C_LATE_RESTART late frames, which
+     follows a jump of its clock.  The buffer then forgets the sender
+     and takes the frame as the first of a new one.
+
+   o Coalescing.  The caller takes frames at the cap's report rate,
+     which is usually below the sender's frame rate.  Of the frames
+     due at a tick only the last is played; those it supersedes are
+     counted as coalesced.
+
+   o Loss, as in RTP.  A frame is lost when its sequence number never
+     arrives; the count is the span of the sequence numbers seen
+     less the frames received other than duplicates, so reordering is
+     not loss.  A frame is a duplicate when its sequence number was
+     seen before, whether that frame was played, coalesced or
+     dropped.  Jitter is the smoothed difference in transit time
+     between frames, as in RFC 3550.
+
+*/
+
+#if !defined (FRAME_SERVER_H_INCLUDED)
+#    define   FRAME_SERVER_H_INCLUDED
+
+/* ----- Includes */
+
+#include <array>
+#include <deque>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ----- Types */
+
+namespace FrameServer {
+
+  constexpr char MAGIC[] = "OMNF";
+  constexpr uint16_t VERSION = 1;
+  constexpr int C_MOTORS_MAX = 14;      // Motors a packed report addresses
+  constexpr size_t CB_HEADER = 20;
+  constexpr size_t CB_FRAME_MAX = CB_HEADER + C_MOTORS_MAX;
+  constexpr int64_t WINDOW_NS = 2000000000;
+  constexpr int C_REORDER = 64;         // Sequence numbers told apart behind
+  constexpr int MAX_GAP = 1000;         // Sequence numbers skipped ahead
+  constexpr int C_LATE_RESTART = 16;    // Late frames in a row
+
+  struct Frame {
+    uint32_t sequence = 0;
+    int64_t time_ns = 0;                // Sender's clock
+    int count = 0;
+    std::array<uint8_t,C_MOTORS_MAX> intensities {};
+  };
+
+  // Write a frame into rgb, at least CB_FRAME_MAX long.  Returns the
+  // length of the datagram.
+  size_t encode (const Frame&, uint8_t* rgb);
+
+  bool decode (const uint8_t* rgb, size_t cb, Frame&);
+
+  struct Stats {
+    uint64_t received = 0;
+    uint64_t invalid = 0;
+    uint64_t duplicate = 0;
+    uint64_t late = 0;
+    uint64_t coalesced = 0;
+    uint64_t played = 0;
+    uint64_t restarts = 0;
+    uint64_t span = 0;                  // Sequence numbers seen
+    double jitter_ns = 0;
+
+    uint64_t lost () const {
+      return span + duplicate > received ? span + duplicate - received : 0; }
+  };
+
+  class Playout {
+  public:
+    explicit Playout (int64_t delay_ns) : delay_ns_ (delay_ns) {}
+
+    // A datagram arrived at now_ns on our clock.
+    void receive (const uint8_t* rgb, size_t cb, int64_t now_ns);
+    void push (const Frame&, int64_t now_ns);
+
+    // The last of the frames due by now_ns.  Returns false when none
+    // is due.  wait_ns is how long the frame waited in the buffer.
+    bool take (int64_t now_ns, Frame&, int64_t& wait_ns);
+
+    // Forget the sender, as after it stopped.  Stats are kept.
+    void restart ();
+
+    const Stats& stats () const { return stats_; }
+    void clear_stats () { stats_ = Stats (); }
+    size_t depth () const { return queue_.size (); }
+
+  private:
+    struct Entry {
+      Frame frame;
+      int64_t arrival_ns;
+    };
+
+    int64_t delay_ns_;
+    std::deque<Entry> queue_;           // In sequence order
+    Stats stats_;
+
+    bool started_ = false;              // A sender is known
+    uint32_t played_ = 0;               // Sequence last played
+    bool any_played_ = false;
+    uint32_t highest_ = 0;              // Highest sequence seen
+    uint64_t seen_ = 0;                 // Bit n for highest_ - n
+    int late_run_ = 0;                  // Late frames in a row
+    int64_t last_transit_ = 0;
+
+    // Smallest transit, arrival less the sender's time, in the
+    // current and the last windows.
+    int64_t window_start_ = 0;
+    int64_t min_current_ = 0;
+    int64_t min_last_ = 0;
+
+    int64_t offset () const {
+      return min_current_ < min_last_ ? min_current_ : min_last_; }
+    int64_t playout_ns (const Entry& e) const {
+      return e.frame.time_ns + offset () + delay_ns_; }
+  };
+
+}
+
+#endif  /* FRAME_SERVER_H_INCLUDED */
@@ -0,0 +1,123 @@
+/** @file haptic_arbiter.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Arbitration of the cap between the clients of omni-daemon.  See
+   haptic_arbiter.h.
+
+*/
+
+#include "haptic_arbiter.h"
+#include <stdlib.h>
+
+namespace {
+
+  // Code of the mapping nearest a duty byte.
+  int nearest_code (const std::array<uint8_t,16>& mapping, int duty) {
+    int best = 0;
+    for (int i = 1; i < int (mapping.size ()); ++i)
+      if (abs (mapping[i] - duty) < abs (mapping[best] - duty))
+        best = i;
+    return best; }
+
+}
+
+namespace HapticArbiter {
+
+  Arbiter::Arbiter (int c_clients) : clients_ (c_clients) {}
+
+  void Arbiter::join (int client, int priority) {
+    auto& c = clients_[client];
+    c.present = true;
+    c.priority = priority;
+    c.mapping = Omniwear::linear_mapping (127, 15, 128);
+    c.duties.fill (0);
+    c.stamps.fill (0); }
+
+  void Arbiter::leave (int client) {
+    clients_[client].present = false; }
+
+  void Arbiter::set (Client& c, int motor, int duty) {
+    if (motor < 0 || motor >= C_CHANNELS)
+      return;
+    c.duties[motor] = duty;
+    c.stamps[motor] = ++stamp_; }
+
+  bool Arbiter::apply (int client, const uint8_t* report) {
+    auto& c = clients_[client];
+    if (!c.present)
+      return false;
+
+    switch (report[0]) {
+    case 0x1:
+      if (report[1] != 0x11)
+        return false;
+      for (int m = 0; m < C_CHANNELS; ++m)
+        set (c, m, 0);
+      return true;
+
+    case 0x4:
+      if (report[1] == 0x10) {
+        set (c, report[2], report[3]);
+        return true;
+      }
+      if (report[1] == 0x21 && report[2] == 4 && report[3] < 16)
+        c.mapping[report[3]] = report[4];
+      return false;
+
+    case 0xf1:
+      for (int m = 0; m < C_CHANNELS; ++m)
+        set (c, m, c.mapping[(report[1 + m/2] >> ((m & 1) ? 0 : 4)) & 0xf]);
+      return true;
+    }
+    return false; }
+
+  void Arbiter::resolve (Duties& duties) const {
+    for (int m = 0; m < C_CHANNELS; ++m) {
+      const Client* winner = nullptr;
+      for (auto& c : clients_) {
+        if (!c.present || !c.duties[m])
+          continue;
+        if (!winner || c.priority > winner->priority
+            || (c.priority == winner->priority
+                && c.stamps[m] > winner->stamps[m]))
+          winner = &c;
+      }
+      duties[m] = winner ? winner->duties[m] : 0;
+    }
+  }
+
+  Output::Output (const std::array<uint8_t,16>& mapping)
+    : mapping_ (mapping) {
+    forget (); }
+
+  int Output::plan (const Duties& duties, Omniwear::Report* reports) {
+    auto changes = [&] {
+      int c = 0;
+      for (int m = 0; m < C_CHANNELS; ++m)
+        c += sent_[m] != duties[m];
+      return c; };
+
+    int count = 0;
+    if (changes () > C_SINGLE) {
+      auto& msg = reports[count++];
+      msg = Omniwear::Report { char (0xf1), 0, 0, 0, 0, 0, 0, 0 };
+      for (int m = 0; m < C_CHANNELS; ++m) {
+        int code = nearest_code (mapping_, duties[m]);
+        msg[1 + m/2] |= code << ((m & 1) ? 0 : 4);
+        sent_[m] = mapping_[code];
+      }
+      if (changes () > C_SINGLE)
+        return count;
+    }
+    for (int m = 0; m < C_CHANNELS; ++m) {
+      if (sent_[m] == duties[m])
+        continue;
+      reports[count++] = Omniwear::motor_duty_report (m, duties[m]);
+      sent_[m] = duties[m];
+    }
+    return count; }
+
+}
@@ -0,0 +1,107 @@
+/** @file haptic_arbiter.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Arbitration of one cap between the clients of omni-daemon.  Each
+   client writes reports as though it owned the cap.  The arbiter
+   decodes them into the duty the client wants of each motor, decides
+   which client drives each motor, and the Output turns the result
+   into the reports that take the cap there.
+
+   NOTES
+   =====
+
+   o Decoding.  0x10 reports set the duty of a motor and 0x11 resets
+     every motor.  Packed definitions set an entry of the client's own
+     mapping, which starts as the linear mapping (127, 15, 128), and
+     packed reports set the motors through it.  None of these reach
+     the cap as sent; the daemon owns the cap's mapping.  Other
+     reports, such as the version preamble, are dropped.
+
+   o Arbitration.  A motor goes to the client of the highest priority
+     that wants it on.  Between clients of equal priority the last to
+     set the motor wins.  A motor no client wants on is off, so a
+     client that leaves, or turns its motors off, hands them back to
+     whoever wants them next.
+
+   o Output.  Like compiled patterns, a change of more than C_SINGLE
+     motors is sent as one packed report, quantized to the daemon's
+     mapping, followed by 0x10 reports correcting the quantized motors
+     when there are no more than C_SINGLE of them.
+
+*/
+
+#if !defined (HAPTIC_ARBITER_H_INCLUDED)
+#    define   HAPTIC_ARBITER_H_INCLUDED
+
+/* ----- Includes */
+
+#include "omniwear.h"
+#include <array>
+#include <stdint.h>
+#include <vector>
+
+/* ----- Types */
+
+namespace HapticArbiter {
+
+  constexpr int C_CHANNELS = 14;        // Motors a packed report addresses
+  constexpr int C_SINGLE = 2;           // Changes sent as 0x10 reports
+
+  using Duties = std::array<int,C_CHANNELS>;  // Duty bytes 0-255
+
+  class Arbiter {
+  public:
+    explicit Arbiter (int c_clients);
+
+    // Start a client with every motor off, or end it.
+    void join (int client, int priority);
+    void leave (int client);
+    bool present (int client) const {
+      return clients_[client].present; }
+
+    // Apply a report of a client.  Returns false for reports that
+    // don't drive the motors.
+    bool apply (int client, const uint8_t* report);
+
+    // The duty of each motor, by arbitration.
+    void resolve (Duties&) const;
+
+  private:
+    struct Client {
+      bool present = false;
+      int priority = 0;
+      std::array<uint8_t,16> mapping;
+      Duties duties;
+      std::array<uint64_t,C_CHANNELS> stamps;   // When each duty was set
+    };
+
+    std::vector<Client> clients_;
+    uint64_t stamp_ = 0;
+
+    void set (Client&, int motor, int duty);
+  };
+
+  // Reports that take the cap from the duties it has to new ones.
+  class Output {
+  public:
+    explicit Output (const std::array<uint8_t,16>& mapping);
+
+    // Fill reports with what to send for duties.  Returns the count,
+    // at most C_SINGLE + 1.
+    int plan (const Duties&, Omniwear::Report* reports);
+
+    // Forget what the cap has, so the next plan sets every motor.
+    void forget () {
+      sent_.fill (-1); }
+
+  private:
+    std::array<uint8_t,16> mapping_;
+    Duties sent_;                       // -1 when unknown
+  };
+
+}
+
+#endif  /* HAPTIC_ARBITER_H_INCLUDED */
@@ -0,0 +1,173 @@
+/** @file haptic_budget.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Budget of motor reports per frame.  See haptic_budget.h.
+
+*/
+
+#include "haptic_budget.h"
+#include "telemetry.h"
+#include <stdlib.h>
+
+namespace {
+
+  constexpr double ALPHA = 1.0/16;      // Weight of a new measurement
+
+  double average (double mean, double v) {
+    return mean > 0 ? mean + (v - mean)*ALPHA : v; }
+
+  struct Change {
+    int motor;
+    bool overdue;
+    int priority;
+    int waiting;
+    int delta;
+
+    bool operator> (const Change& o) const {
+      if (overdue != o.overdue)
+        return overdue;
+      if (priority != o.priority)
+        return priority > o.priority;
+      if (waiting != o.waiting)
+        return waiting > o.waiting;
+      return delta > o.delta; }
+  };
+
+}
+
+namespace HapticBudget {
+
+  Scheduler::Scheduler () {
+    forget ();
+  }
+
+  int Scheduler::priority (int target_type) const {
+    for (auto& entry : priorities)
+      if (entry.first == target_type)
+        return entry.second;
+    return 0;
+  }
+
+  void Scheduler::set_priority (int target_type, int priority) {
+    for (auto it = priorities.begin (); it != priorities.end (); ++it)
+      if (it->first == target_type) {
+        if (priority)
+          it->second = priority;
+        else
+          priorities.erase (it);
+        return;
+      }
+    if (priority)
+      priorities.push_back (std::make_pair (target_type, priority));
+  }
+
+  int Scheduler::limit () const {
+    if (budget)
+      return budget;
+    if (!(report_ns > 0) || !(frame_ns > 0))
+      return NUMBER_OF_MOTORS;
+    double n = frame_ns*SHARE/report_ns;
+    return n < 1 ? 1 : n > NUMBER_OF_MOTORS ? NUMBER_OF_MOTORS : int (n);
+  }
+
+  int Scheduler::plan (double game_time, const int duties[],
+                       const int priorities_[], const int packed_duties[],
+                       int order[]) {
+    if (timed && game_time > last_time)
+      frame_ns = average (frame_ns, (game_time - last_time)*1e9);
+    if (!timed || game_time > last_time)
+      last_time = game_time;
+    timed = true;
+
+    Change changes[NUMBER_OF_MOTORS];
+    int count = 0;
+    bool packed_changes = false;
+    for (int m = 0; m < NUMBER_OF_MOTORS; ++m) {
+      int duty = to_device (duties[m]);
+      if (duty == sent[m]) {
+        shown[m] = priorities_[m];
+        waiting[m] = 0;
+        continue;
+      }
+      if (packed_duties && packed_duties[m] != sent[m])
+        packed_changes = true;
+      Change& c = changes[count++];
+      c.motor = m;
+      c.overdue = waiting[m] >= MAX_WAIT;
+      c.priority = priorities_[m] > shown[m] ? priorities_[m] : shown[m];
+      c.waiting = waiting[m];
+      c.delta = sent[m] < 0 ? 256 : abs (duty - sent[m]);
+    }
+    Telemetry::count (Telemetry::reports_unchanged, NUMBER_OF_MOTORS - count);
+
+    const int allowed = limit ();
+    if (count <= allowed) {
+      for (int i = 0; i < count; ++i)
+        order[i] = changes[i].motor;
+      return count;
+    }
+
+    // Over budget.  A packed report is worth sending only when it
+    // changes something; otherwise the changes are the residue of
+    // the last packed report and are refined one motor at a time.
+    if (packed_changes) {
+      Telemetry::count (Telemetry::packed_fallbacks);
+      return PACKED;
+    }
+
+    // Insertion sort, best first; there are at most NUMBER_OF_MOTORS.
+    for (int i = 1; i < count; ++i) {
+      Change c = changes[i];
+      int j = i;
+      for (; j > 0 && c > changes[j - 1]; --j)
+        changes[j] = changes[j - 1];
+      changes[j] = c;
+    }
+    for (int i = 0; i < allowed; ++i)
+      order[i] = changes[i].motor;
+    for (int i = allowed; i < count; ++i)
+      ++waiting[changes[i].motor];
+    Telemetry::count (Telemetry::reports_deferred, count - allowed);
+    return allowed;
+  }
+
+  void Scheduler::sent_motor (int motor, int duty, int priority) {
+    if (motor < 0 || motor >= NUMBER_OF_MOTORS)
+      return;
+    sent[motor] = to_device (duty);
+    shown[motor] = priority;
+    waiting[motor] = 0;
+  }
+
+  void Scheduler::sent_packed (const int packed_duties[],
+                               const int priorities_[], int count) {
+    for (int m = 0; m < count && m < NUMBER_OF_MOTORS; ++m) {
+      sent[m] = packed_duties[m];
+      shown[m] = priorities_ ? priorities_[m] : PRIORITY_AMBIENT;
+      waiting[m] = 0;
+    }
+  }
+
+  void Scheduler::reset () {
+    sent.fill (0);
+    shown.fill (PRIORITY_AMBIENT);
+    waiting.fill (0);
+  }
+
+  void Scheduler::forget () {
+    sent.fill (-1);
+    shown.fill (PRIORITY_AMBIENT);
+    waiting.fill (0);
+  }
+
+  void Scheduler::measure (int reports, int64_t ns) {
+    if (reports > 0 && ns > 0) {
+      report_ns = average (report_ns, double (ns)/reports);
+      send_ns = average (send_ns, double (ns));
+    }
+  }
+
+}
@@ -0,0 +1,117 @@
+/** @file haptic_budget.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Budget of motor reports per frame.  The cap accepts only so many
+   reports a second, and a frame that changes many motors can take
+   longer to send than the interval between frames.  The scheduler
+   decides which motors execute_haptic_effects reports in each frame
+   so that the frame fits the budget and the motors showing the most
+   important targets are updated first.
+
+   NOTES
+   =====
+
+   o Changes.  The scheduler tracks the duty last sent to each motor,
+     as the byte the device applies, and reports a motor only when
+     that would change.  Every path that writes a motor, including
+     command_haptic_motor and the packed commands, keeps it current.
+     A write that fails isn't recorded, so the change is sent again.
+
+   o Ranking.  When more motors change than the budget allows, the
+     changes are ranked by priority, then by how long they have
+     waited, then by their size.  The priority of a change is the
+     higher of the priority of the targets the motor will show and of
+     what it shows now, so that turning off a motor that shows an
+     important target is as urgent as turning it on.  Motors that no
+     target drives rank below every target.  A change that has waited
+     MAX_WAIT frames ranks above all others so that none starve.
+     Changes that wait are coalesced; only the latest duty is sent.
+
+   o Packed fallback.  When a packed mapping is defined and the
+     changes exceed the budget, the whole frame goes out as one
+     packed report, quantized to the sixteen codes of the mapping.
+     The quantization is corrected in later frames, within the
+     budget, by reports of single motors.
+
+   o Adaptation.  Unless the budget is fixed, it is the number of
+     reports that can be sent in SHARE of the interval between
+     frames.  Both the cost of a report, timed around the writes, and
+     the interval between frames, in game time, are moving averages.
+     With asynchronous HID writes the cost is that of submission, so
+     the budget adapts to the queue rather than to the wire.
+
+*/
+
+#if !defined (HAPTIC_BUDGET_H_INCLUDED)
+#    define   HAPTIC_BUDGET_H_INCLUDED
+
+/* ----- Includes */
+
+#include "omniwear_SDK.h"
+#include <array>
+#include <limits.h>
+#include <utility>
+#include <vector>
+
+/* ----- Types */
+
+namespace HapticBudget {
+
+  constexpr int PRIORITY_AMBIENT = INT_MIN; // Motors no target drives
+  constexpr int MIN_PRIORITY = -100;
+  constexpr int MAX_PRIORITY = 100;
+  constexpr int MAX_WAIT = 8;       // Frames before a change outranks all
+  constexpr double SHARE = 0.5;     // Of a frame spent sending reports
+  constexpr int PACKED = -1;        // Plan for a packed report
+
+  // Duty byte the device applies for a duty of 0-100.
+  inline int to_device (int duty) {
+    return duty*255/100; }
+
+  struct Scheduler {
+    std::array<int,NUMBER_OF_MOTORS> sent;     // Duty byte, -1 when unknown
+    std::array<int,NUMBER_OF_MOTORS> shown;    // Priority of what is shown
+    std::array<int,NUMBER_OF_MOTORS> waiting;  // Frames a change has waited
+    std::vector<std::pair<int,int>> priorities; // Target type, priority
+    int budget = 0;             // Reports a frame, 0 to adapt
+    double report_ns = 0;       // Average cost of a report
+    double send_ns = 0;         // Average time to send a frame
+    double frame_ns = 0;        // Average interval between frames
+    double last_time = 0;       // Game time of the last frame
+    bool timed = false;
+
+    Scheduler ();
+
+    // Priority of a type of target.  Setting 0 removes the entry.
+    int priority (int target_type) const;
+    void set_priority (int target_type, int priority);
+
+    // Reports allowed in a frame.
+    int limit () const;
+
+    // Plan the reports of a frame of duties, 0-100, and priorities of
+    // the targets shown on each motor.  Fills order with the motors
+    // to report, in order, and returns their number, or returns
+    // PACKED when the frame should be sent as one packed report.
+    // packed_duties are the duty bytes the packed report would
+    // apply, or null when there is no packed mapping.
+    int plan (double game_time, const int duties[], const int priorities[],
+              const int packed_duties[], int order[]);
+
+    // Record what was sent to the device.  duty is 0-100.
+    void sent_motor (int motor, int duty, int priority);
+    void sent_packed (const int packed_duties[], const int priorities[],
+                      int count);
+    void reset ();              // Every motor off
+    void forget ();             // Motors unknown
+
+    // Record the time to send the reports of a frame.
+    void measure (int reports, int64_t ns);
+  };
+
+}
+
+#endif  /* HAPTIC_BUDGET_H_INCLUDED */
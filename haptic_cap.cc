@@ -0,0 +1,26 @@
+/** @file haptic_cap.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Motor layouts of the wearables.  See haptic_cap.h.  The kernels
+   are templates in the header and are instantiated for each layout
+   here, so that their unrolled bodies don't count against the
+   inlining budget of omniwear_SDK.cc.
+
+*/
+
+#include "haptic_cap.h"
+
+namespace HapticCap {
+
+  constexpr Position Cap13::positions[];
+  constexpr Position Band8::positions[];
+  constexpr Position Vest24::positions[];
+
+  HAPTIC_CAP_INSTANCES (, Cap13)
+  HAPTIC_CAP_INSTANCES (, Band8)
+  HAPTIC_CAP_INSTANCES (, Vest24)
+
+}
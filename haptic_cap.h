@@ -0,0 +1,256 @@
+/** @file haptic_cap.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Motor layouts of the wearables, and kernels of the haptic radar
+   and of the packed encoder specialized for each layout.  A layout
+   is a type whose members are compile time constants: the motor
+   count, the position of each motor on the unit sphere around the
+   head, and the packed reports a frame of its motors takes.  The
+   kernels are templates on the layout, so every instance knows how
+   many motors it drives and where they are.
+
+   NOTES
+   =====
+
+   o Layouts.  Cap13 is the Omniwear cap and the source of the motor
+     positions of the engine, in the order of the LOW_N ... TOP
+     indices.  Band8 and Vest24 are the wearables on trial, a ring of
+     eight at the height of the ears and two rings of twelve.  A new
+     layout is a struct deriving from Motors<N> with a positions
+     array, plus a line in haptic_cap.cc and a shim in
+     omniwear_SDK.cc.
+
+   o Unrolled.  The loops over motors are expanded by unroll<N>, so
+     each motor's position is a constant in the generated code and
+     the terms of its zero coordinates disappear when it is carried
+     into the world by the rotation of the head.  The kernels are
+     instantiated once per layout in haptic_cap.cc; inlined into
+     omniwear_SDK.cc they crowd out the inlining of its other paths.
+
+   o Cone only.  mix<> implements SPATIAL_CONE with every combine
+     rule.  The panning tables of haptic_panner.h are built for the
+     cap and padded to C_GAINS motors; layouts use the cone.
+
+   o Packed reports.  A packed report holds the codes of C_PACKED
+     motors.  A layout with more motors takes one report per
+     C_PACKED, and report k carries the motors from k*C_PACKED with
+     the report code 0xf1 + k.  The cap needs one report, identical
+     to that of configure_motors_packed.
+
+*/
+
+#if !defined (HAPTIC_CAP_H_INCLUDED)
+#    define   HAPTIC_CAP_H_INCLUDED
+
+/* ----- Includes */
+
+#include "haptic_mixer.h"
+#include "omniwear.h"
+#include <limits.h>
+#include <utility>
+
+/* ----- Types */
+
+namespace HapticCap {
+
+  constexpr int C_PACKED = 14;    // Motors in a packed report
+
+  struct Position {
+    float x, y, z;
+  };
+
+  // Square root by Newton's method, for constant expressions.
+  constexpr float root (float v) {
+    float r = v > 1 ? v : 1;
+    for (int i = 0; i < 32; ++i)
+      r = 0.5f*(r + v/r);
+    return r; }
+
+  constexpr Position unit (Position p) {
+    const float n = root (p.x*p.x + p.y*p.y + p.z*p.z);
+    return Position { p.x/n, p.y/n, p.z/n }; }
+
+  template<int N>
+  struct Motors {
+    static constexpr int C_COUNT = N;
+    static constexpr int C_REPORTS = (N + C_PACKED - 1)/C_PACKED;
+  };
+
+  struct Cap13 : Motors<13> {
+    static constexpr Position positions[C_COUNT] = {
+      {  1,   0,  0 },              // LOW_N, the nose
+      { -1,   0,  0 },              // LOW_S
+      {  0,  -1,  0 },              // LOW_E
+      {  0,   1,  0 },              // LOW_W
+      { .7f, -.7f, 0 },             // LOW_NE
+      { .7f,  .7f, 0 },             // LOW_NW
+      { -.7f, -.7f, 0 },            // LOW_SE
+      { -.7f,  .7f, 0 },            // LOW_SW
+      { .7f,   0, .7f },            // MID_N
+      { -.7f,  0, .7f },            // MID_S
+      {  0, -.7f, .7f },            // MID_E
+      {  0,  .7f, .7f },            // MID_W
+      {  0,   0,  1 },              // TOP
+    };
+  };
+
+  struct Band8 : Motors<8> {
+    static constexpr Position positions[C_COUNT] = {
+      {  1,       0,      0 },
+      {  .7071f,  .7071f, 0 },
+      {  0,       1,      0 },
+      { -.7071f,  .7071f, 0 },
+      { -1,       0,      0 },
+      { -.7071f, -.7071f, 0 },
+      {  0,      -1,      0 },
+      {  .7071f, -.7071f, 0 },
+    };
+  };
+
+  struct Vest24 : Motors<24> {
+    static constexpr Position positions[C_COUNT] = {
+      {  .866f,  0,     .5f }, {  .75f,   .433f, .5f },
+      {  .433f,  .75f,  .5f }, {  0,      .866f, .5f },
+      { -.433f,  .75f,  .5f }, { -.75f,   .433f, .5f },
+      { -.866f,  0,     .5f }, { -.75f,  -.433f, .5f },
+      { -.433f, -.75f,  .5f }, {  0,     -.866f, .5f },
+      {  .433f, -.75f,  .5f }, {  .75f,  -.433f, .5f },
+      {  .866f,  0,    -.5f }, {  .75f,   .433f, -.5f },
+      {  .433f,  .75f, -.5f }, {  0,      .866f, -.5f },
+      { -.433f,  .75f, -.5f }, { -.75f,   .433f, -.5f },
+      { -.866f,  0,    -.5f }, { -.75f,  -.433f, -.5f },
+      { -.433f, -.75f, -.5f }, {  0,     -.866f, -.5f },
+      {  .433f, -.75f, -.5f }, {  .75f,  -.433f, -.5f },
+    };
+  };
+
+  // Call f (std::integral_constant<int,I> ()) for I from 0 to N - 1.
+  template<typename F, int... I>
+  inline void unroll (F&& f, std::integer_sequence<int,I...>) {
+    int expand[] = { 0, (f (std::integral_constant<int,I> ()), 0)... };
+    (void) expand; }
+
+  template<int N, typename F>
+  inline void unroll (F&& f) {
+    unroll (f, std::make_integer_sequence<int,N> ()); }
+
+  // Mix the targets onto the motors of Layout like HapticMixer::mix.
+  // to_body rotates world directions into the frame of the head, the
+  // frame of the positions.
+  template<typename Layout>
+  void mix (const HapticMixer::Config& config, const float (*to_body)[3],
+            const HapticMixer::Targets& targets, int* intensities,
+            bool* tracking, int* priorities = nullptr) {
+    using HapticMixer::C_LUT;
+
+    const float cos_max = config.cos_max_angle;
+    const float scale = (C_LUT - 1)/(1.0f - cos_max);
+    const int count = targets.count < MAX_TARGETS ? targets.count
+                                                  : MAX_TARGETS;
+
+    float range_gain[MAX_TARGETS];
+    for (int t = 0; t < count; ++t)
+      range_gain[t] = HapticMixer::range_gain (config, targets.range[t],
+                                               targets.on[t]);
+
+    unroll<Layout::C_COUNT> ([&] (auto m) {
+        constexpr int M = decltype (m)::value;
+
+        // Carry the motor into the world.  to_body is a rotation, so
+        // its transpose does that.
+        constexpr Position u = unit (Layout::positions[M]);
+        const float mx = to_body[0][0]*u.x + to_body[1][0]*u.y
+          + to_body[2][0]*u.z;
+        const float my = to_body[0][1]*u.x + to_body[1][1]*u.y
+          + to_body[2][1]*u.z;
+        const float mz = to_body[0][2]*u.x + to_body[1][2]*u.y
+          + to_body[2][2]*u.z;
+
+        if (config.combine == COMBINE_NEAREST) {
+          float gain = 0;
+          bool found = false;
+          int priority = 0;
+          for (int t = 0; t < count; ++t) {
+            const float d = targets.x[t]*mx + targets.y[t]*my
+              + targets.z[t]*mz;
+            if (d < cos_max)
+              continue;
+            int i = int ((d - cos_max)*scale + 0.5f);
+            i = i < C_LUT ? i : C_LUT - 1;
+            gain = config.angle_lut[i]*range_gain[t];
+            priority = targets.priority ? targets.priority[t] : 0;
+            found = true;
+            break;
+          }
+          tracking[M] = found;
+          intensities[M] = HapticMixer::to_intensity (gain);
+          if (priorities)
+            priorities[M] = priority;
+          return;
+        }
+
+        float peak = 0;
+        float sum = 0;
+        float energy = 0;
+        int in_cone = 0;
+        int priority = INT_MIN;
+        for (int t = 0; t < count; ++t) {
+          const float d = targets.x[t]*mx + targets.y[t]*my
+            + targets.z[t]*mz;
+          const bool in = d >= cos_max;
+          int i = in ? int ((d - cos_max)*scale + 0.5f) : 0;
+          i = i < C_LUT ? i : C_LUT - 1;
+          const float g = in ? config.angle_lut[i]*range_gain[t] : 0.0f;
+          const int p = !in ? INT_MIN
+            : targets.priority ? targets.priority[t] : 0;
+          priority = p > priority ? p : priority;
+          in_cone += in;
+          peak = g > peak ? g : peak;
+          sum += g;
+          energy += g*g;
+        }
+        tracking[M] = in_cone > 0;
+        intensities[M] = HapticMixer::to_intensity
+          (HapticMixer::combine (config.combine, peak, sum, energy));
+        if (priorities)
+          priorities[M] = priority;
+      });
+  }
+
+  // Encode intensities, 0-100, of the motors of Layout into
+  // Layout::C_REPORTS packed reports against the current mapping.
+  template<typename Layout>
+  void encode_packed (const int* intensities, Omniwear::Report* reports) {
+    unroll<Layout::C_REPORTS> ([&] (auto r) {
+        constexpr int R = decltype (r)::value;
+        reports[R] = Omniwear::Report { char (0xf1 + R) }; });
+    unroll<Layout::C_COUNT> ([&] (auto m) {
+        constexpr int M = decltype (m)::value;
+        constexpr int R = M/C_PACKED;
+        constexpr int B = 1 + (M % C_PACKED)/2;
+        constexpr int SHIFT = (M % C_PACKED) & 1 ? 0 : 4;
+        reports[R][B] |= (Omniwear::nearest_packed_code (intensities[M])
+                          & 0xf) << SHIFT;
+      });
+  }
+
+  // The kernels of the layouts are instantiated once, in
+  // haptic_cap.cc.
+#define HAPTIC_CAP_INSTANCES(EXTERN, Layout)                             \
+  EXTERN template void mix<Layout> (const HapticMixer::Config&,          \
+                                    const float (*)[3],                  \
+                                    const HapticMixer::Targets&, int*,   \
+                                    bool*, int*);                        \
+  EXTERN template void encode_packed<Layout> (const int*,                \
+                                              Omniwear::Report*);
+
+  HAPTIC_CAP_INSTANCES (extern, Cap13)
+  HAPTIC_CAP_INSTANCES (extern, Band8)
+  HAPTIC_CAP_INSTANCES (extern, Vest24)
+
+}
+
+#endif  /* HAPTIC_CAP_H_INCLUDED */
@@ -0,0 +1,289 @@
+/** @file haptic_fixed.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Fixed point haptic engine.  See haptic_fixed.h.
+
+   NOTES
+   =====
+
+   o Overflow.  Dot products of Q1.15 unit vectors are summed in
+     Q2.30 in 32 bits.  The magnitude of the sum is at most the
+     product of the lengths, so it stays below 2^31 for unit vectors
+     even with rounding.  Sums over the targets, which have no such
+     bound, are 64 bits.
+
+*/
+
+#define _USE_MATH_DEFINES
+
+#include "haptic_fixed.h"
+#include <limits.h>
+#include <math.h>
+
+namespace {
+
+  using Fixed::q15;
+  using Fixed::mul;
+  using Fixed::Q15_ONE;
+
+  constexpr int PITCH = 0;
+  constexpr int YAW = 1;
+  constexpr int ROLL = 2;
+
+  // Product of a Q1.15 matrix and vector.
+  void transform (const q15 (*m)[3], const q15 v[3], q15 out[3]) {
+    for (int r = 0; r < 3; ++r)
+      out[r] = (m[r][0]*v[0] + m[r][1]*v[1] + m[r][2]*v[2] + (1 << 14)) >> 15;
+  }
+
+  // Rotation about a unit axis by angle_deg, as
+  // create_rotation_matrix in omniwear_SDK.cc.
+  void rotation (q15 (*out)[3], int angle_deg, const q15 axis[3]) {
+    const q15 x = axis[0];
+    const q15 y = axis[1];
+    const q15 z = axis[2];
+    const q15 c = Fixed::cos_deg (angle_deg);
+    const q15 s = -Fixed::sin_deg (angle_deg);
+    const q15 t = Q15_ONE - c;
+
+    out[0][0] = mul (x, x) + mul (c, Q15_ONE - mul (x, x));
+    out[0][1] = mul (mul (x, y), t) + mul (z, s);
+    out[0][2] = mul (mul (z, x), t) - mul (y, s);
+    out[1][0] = mul (mul (x, y), t) - mul (z, s);
+    out[1][1] = mul (y, y) + mul (c, Q15_ONE - mul (y, y));
+    out[1][2] = mul (mul (y, z), t) + mul (x, s);
+    out[2][0] = mul (mul (z, x), t) + mul (y, s);
+    out[2][1] = mul (mul (y, z), t) - mul (x, s);
+    out[2][2] = mul (z, z) + mul (c, Q15_ONE - mul (z, z));
+  }
+
+  // Cosine of the angle from a target's forward vector to the
+  // player, Q2.30, at or below which the target is looking at us.
+  int32_t look_limit () {
+    static const int32_t limit
+      = int32_t (-cos (LOOK_ANGLE_LIMIT)*double (1 << 30));
+    return limit; }
+
+  int to_intensity (int32_t gain) {
+    int v = (gain*100 + (1 << 14)) >> 15;
+    return v < 0 ? 0 : v > 100 ? 100 : v; }
+
+  int range_gains (const HapticMixer::Config& config,
+                   const HapticFixed::Targets& targets, int32_t* gains) {
+    const int count = targets.count < MAX_TARGETS ? targets.count
+                                                  : MAX_TARGETS;
+    for (int t = 0; t < count; ++t) {
+      int i = HapticMixer::range_index (config, targets.range[t]);
+      gains[t] = targets.on[t] ? config.range_lut_fixed[i] : 0;
+    }
+    return count;
+  }
+
+  int32_t combine (haptic_combine_t rule, int32_t peak, int32_t sum,
+                   int64_t energy) {
+    switch (rule) {
+    default:
+    case COMBINE_MAX:
+      return peak;
+    case COMBINE_SUM_LIMITED:
+      return sum;
+    case COMBINE_LOUDNESS:
+      return int32_t (Fixed::isqrt (uint64_t (energy)));
+    }
+  }
+
+}
+
+namespace HapticFixed {
+
+  void angle_vectors (const int angles[3],
+                      q15 forward[3], q15 right[3], q15 up[3]) {
+    const q15 sy = Fixed::sin_deg (angles[YAW]);
+    const q15 cy = Fixed::cos_deg (angles[YAW]);
+    const q15 sp = Fixed::sin_deg (angles[PITCH]);
+    const q15 cp = Fixed::cos_deg (angles[PITCH]);
+
+    if (forward) {
+      forward[0] = mul (cp, cy);
+      forward[1] = mul (cp, sy);
+      forward[2] = -sp;
+    }
+    if (!right && !up)
+      return;
+
+    const q15 sr = Fixed::sin_deg (angles[ROLL]);
+    const q15 cr = Fixed::cos_deg (angles[ROLL]);
+    if (right) {
+      right[0] = -(mul (mul (sr, sp), cy) - mul (cr, sy));
+      right[1] = -(mul (mul (sr, sp), sy) + mul (cr, cy));
+      right[2] = -mul (sr, cp);
+    }
+    if (up) {
+      up[0] = mul (mul (cr, sp), cy) + mul (sr, sy);
+      up[1] = mul (mul (cr, sp), sy) - mul (sr, cy);
+      up[2] = mul (cr, cp);
+    }
+  }
+
+  int locate (const vec3_t location, const vec3_t origin, q15 direction[3]) {
+    int64_t v[3];
+    for (int i = 0; i < 3; ++i)
+      v[i] = Fixed::to_q16 (location[i]) - Fixed::to_q16 (origin[i]);
+    int64_t length = Fixed::normalize (v, direction);
+    return int (length >> 16);
+  }
+
+  bool is_facing (const q15 direction[3], const int viewangles[3]) {
+    q15 forward[3];
+    angle_vectors (viewangles, forward, nullptr, nullptr);
+    int32_t d = direction[0]*forward[0] + direction[1]*forward[1]
+      + direction[2]*forward[2];
+    return d <= look_limit ();
+  }
+
+  void motor_vectors (const int viewangles[3],
+                      const q15 (*positions)[3], int c_motors,
+                      q15 (*motor_vecs)[3], q15 (*to_body)[3]) {
+    q15 right[3], up[3];
+    angle_vectors (viewangles, nullptr, right, up);
+
+    q15 yaw[3][3], pitch[3][3];
+    rotation (yaw, viewangles[YAW], up);
+    rotation (pitch, viewangles[PITCH], right);
+
+    for (int m = 0; m < c_motors; ++m) {
+      q15 temp[3], v[3];
+      transform (yaw, positions[m], temp);
+      transform (pitch, temp, v);
+      int64_t wide[3] = { v[0], v[1], v[2] };
+      Fixed::normalize (wide, motor_vecs[m]);
+    }
+
+    // The transpose of pitch*yaw.
+    for (int r = 0; r < 3; ++r)
+      for (int c = 0; c < 3; ++c)
+        to_body[c][r] = (pitch[r][0]*yaw[0][c] + pitch[r][1]*yaw[1][c]
+                         + pitch[r][2]*yaw[2][c] + (1 << 14)) >> 15;
+  }
+
+  void mix (const HapticMixer::Config& config, const q15 (*motor_vecs)[3],
+            int c_motors, const Targets& targets,
+            int* intensities, bool* tracking, int* priorities) {
+    using HapticMixer::C_LUT;
+    const int32_t cos_max = config.cos_max_angle_fixed*(1 << 15);
+    const int32_t scale = config.angle_scale_fixed;
+
+    int32_t range_gain[MAX_TARGETS];
+    const int count = range_gains (config, targets, range_gain);
+
+    for (int m = 0; m < c_motors; ++m) {
+      const q15 mx = motor_vecs[m][0];
+      const q15 my = motor_vecs[m][1];
+      const q15 mz = motor_vecs[m][2];
+
+      if (config.combine == COMBINE_NEAREST) {
+        int32_t gain = 0;
+        bool found = false;
+        int priority = 0;
+        for (int t = 0; t < count; ++t) {
+          int32_t d = targets.x[t]*mx + targets.y[t]*my + targets.z[t]*mz;
+          if (d < cos_max)
+            continue;
+          int i = (((d - cos_max) >> 15)*scale + (1 << 21)) >> 22;
+          i = i < C_LUT ? i : C_LUT - 1;
+          gain = (config.angle_lut_fixed[i]*range_gain[t] + (1 << 14)) >> 15;
+          priority = targets.priority ? targets.priority[t] : 0;
+          found = true;
+          break;
+        }
+        tracking[m] = found;
+        intensities[m] = to_intensity (gain);
+        if (priorities)
+          priorities[m] = priority;
+        continue;
+      }
+
+      int32_t peak = 0;
+      int32_t sum = 0;
+      int64_t energy = 0;
+      int in_cone = 0;
+      int priority = INT_MIN;
+      for (int t = 0; t < count; ++t) {
+        int32_t d = targets.x[t]*mx + targets.y[t]*my + targets.z[t]*mz;
+        bool in = d >= cos_max;
+        int i = in ? (((d - cos_max) >> 15)*scale + (1 << 21)) >> 22 : 0;
+        i = i < C_LUT ? i : C_LUT - 1;
+        int32_t g = in ? (config.angle_lut_fixed[i]*range_gain[t]
+                          + (1 << 14)) >> 15 : 0;
+        int p = !in ? INT_MIN : targets.priority ? targets.priority[t] : 0;
+        priority = p > priority ? p : priority;
+        in_cone += in;
+        peak = g > peak ? g : peak;
+        sum += g;
+        energy += int64_t (g)*g;
+      }
+
+      tracking[m] = in_cone > 0;
+      intensities[m] = to_intensity (combine (config.combine,
+                                              peak, sum, energy));
+      if (priorities)
+        priorities[m] = priority;
+    }
+  }
+
+  void mix_panned (const HapticMixer::Config& config,
+                   const HapticPanner::Table& table,
+                   const q15 (*to_body)[3], int c_motors,
+                   const Targets& targets, int* intensities, bool* tracking,
+                   int* priorities) {
+    using HapticPanner::C_GAINS;
+
+    int32_t range_gain[MAX_TARGETS];
+    const int count = range_gains (config, targets, range_gain);
+
+    int32_t nearest[C_GAINS] = {};
+    int32_t peak[C_GAINS] = {};
+    int32_t sum[C_GAINS] = {};
+    int64_t energy[C_GAINS] = {};
+    bool found[C_GAINS] = {};
+    int priority[C_GAINS];
+    for (int m = 0; m < C_GAINS; ++m)
+      priority[m] = INT_MIN;
+    for (int t = 0; t < count; ++t) {
+      const q15 x = targets.x[t];
+      const q15 y = targets.y[t];
+      const q15 z = targets.z[t];
+      const uint8_t* gains
+        = table.gains ((to_body[0][0]*x + to_body[0][1]*y + to_body[0][2]*z) >> 15,
+                       (to_body[1][0]*x + to_body[1][1]*y + to_body[1][2]*z) >> 15,
+                       (to_body[2][0]*x + to_body[2][1]*y + to_body[2][2]*z) >> 15);
+
+      // g = gains*range_gain/255, with 1/255 as 257/65536.
+      const uint32_t scale = uint32_t (range_gain[t])*257;
+      const int p = targets.priority ? targets.priority[t] : 0;
+      for (int m = 0; m < C_GAINS; ++m) {
+        int32_t g = int32_t ((gains[m]*scale + (1u << 15)) >> 16);
+        bool first = !found[m] && gains[m];
+        nearest[m] = first ? g : nearest[m];
+        found[m] = found[m] || gains[m];
+        priority[m] = gains[m] && p > priority[m] ? p : priority[m];
+        peak[m] = g > peak[m] ? g : peak[m];
+        sum[m] += g;
+        energy[m] += int64_t (g)*g;
+      }
+    }
+
+    for (int m = 0; m < c_motors && m < C_GAINS; ++m) {
+      tracking[m] = found[m];
+      if (priorities)
+        priorities[m] = priority[m];
+      intensities[m] = to_intensity
+        (config.combine == COMBINE_NEAREST
+         ? nearest[m] : combine (config.combine, peak[m], sum[m], energy[m]));
+    }
+  }
+
+}
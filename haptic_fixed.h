@@ -0,0 +1,99 @@
+/** @file haptic_fixed.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Fixed point haptic engine.  When the SDK is built with
+   OMNIWEAR_FIXED_POINT ('make CONFIG_FIXED_POINT=y'), the range and
+   bearing of the targets, the orientation of the motors and the
+   mixing are computed with the integer kernels here instead of in
+   float and double.  This is for host boards without an FPU, where
+   soft float dominates the time of a frame.
+
+   NOTES
+   =====
+
+   o Formats.  Directions, matrices and gains are Q1.15, positions
+     are Q16.16.  See fixed_point.h.
+
+   o Boundaries.  Game time, haptic_volume and the public fields of
+     haptic_target_t stay float and double because they are the SDK
+     interface.  Each target is converted once on update and its
+     direction once per frame.  The pulse periods and the throb
+     ramp, which work in game time, stay float as well.
+
+   o Tolerance.  The kernels reproduce the float engine to within
+     the resolution of the lookup tables.  A target at the very edge
+     of a cone, or of a step in a falloff curve, may fall on the
+     other side in one engine than in the other, so a motor
+     occasionally differs by a whole step.  'omni-microbench
+     fixed_point' runs the benchmark scenes through both engines and
+     fails when the differences exceed the tolerance stated there.
+
+*/
+
+#if !defined (HAPTIC_FIXED_H_INCLUDED)
+#    define   HAPTIC_FIXED_H_INCLUDED
+
+/* ----- Includes */
+
+#include "fixed_point.h"
+#include "haptic_mixer.h"
+
+/* ----- Types */
+
+namespace HapticFixed {
+
+  using Fixed::q15;
+
+  // Targets for the mixing kernels, as HapticMixer::Targets with
+  // directions in Q1.15.
+  struct Targets {
+    int count = 0;
+    const q15* x = nullptr;
+    const q15* y = nullptr;
+    const q15* z = nullptr;
+    const int* range = nullptr;
+    const bool* on = nullptr;
+    const int* priority = nullptr;      // All 0 when null
+  };
+
+  // Canonical vectors for angles in whole degrees.  Any of the
+  // outputs may be null.
+  void angle_vectors (const int angles[3],
+                      q15 forward[3], q15 right[3], q15 up[3]);
+
+  // Range to location from origin and the unit vector toward it.
+  int locate (const vec3_t location, const vec3_t origin, q15 direction[3]);
+
+  // True when the target with viewangles, in whole degrees, is
+  // looking back along direction, within LOOK_ANGLE_LIMIT.
+  bool is_facing (const q15 direction[3], const int viewangles[3]);
+
+  // Carry the motor positions into the world for the player's
+  // viewangles, in whole degrees.  to_body is the inverse rotation.
+  void motor_vectors (const int viewangles[3],
+                      const q15 (*positions)[3], int c_motors,
+                      q15 (*motor_vecs)[3], q15 (*to_body)[3]);
+
+  // As HapticMixer::mix and HapticMixer::mix_panned.
+  void mix (const HapticMixer::Config&, const q15 (*motor_vecs)[3],
+            int c_motors, const Targets&, int* intensities, bool* tracking,
+            int* priorities = nullptr);
+  void mix_panned (const HapticMixer::Config&, const HapticPanner::Table&,
+                   const q15 (*to_body)[3], int c_motors,
+                   const Targets&, int* intensities, bool* tracking,
+                   int* priorities = nullptr);
+
+  // Compute the next frame of a state with the float engine and
+  // with the fixed point engine, leaving the state and its device
+  // unchanged.  Both start from the device's oscillators.  For
+  // checking the engines against each other.  Defined in
+  // omniwear_SDK.cc.
+  void compare (const haptic_device_state_t*, double game_time,
+                int float_frame[], int fixed_frame[]);
+
+}
+
+#endif  /* HAPTIC_FIXED_H_INCLUDED */
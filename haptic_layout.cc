@@ -0,0 +1,97 @@
+/** @file haptic_layout.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Hot columns of the target list.  See haptic_layout.h.
+
+*/
+
+#include "haptic_layout.h"
+#include <stdint.h>
+#include <string.h>
+
+namespace {
+
+  using HapticLayout::C_LINE;
+
+  // Bytes of a column of MAX_TARGETS of T, rounded up to whole lines.
+  template<typename T>
+  constexpr size_t column_size () {
+    return (sizeof (T)*MAX_TARGETS + C_LINE - 1)/C_LINE*C_LINE; }
+
+  // Shift elements slot + 1 to count - 1 of a column down by one.
+  template<typename T>
+  void shift (T* column, int slot, int count) {
+    memmove (column + slot, column + slot + 1, (count - slot - 1)*sizeof (T)); }
+
+}
+
+namespace HapticLayout {
+
+  Targets::Targets () {
+    const size_t size = 3*column_size<int> () + 3*column_size<float> ()
+      + column_size<bool> ();
+    block_.reset (new char[size + C_LINE]);
+    memset (block_.get (), 0, size + C_LINE);
+
+    char* p = block_.get ();
+    p += (C_LINE - uintptr_t (p) % C_LINE) % C_LINE;
+    index = reinterpret_cast<int*> (p);   p += column_size<int> ();
+    type  = reinterpret_cast<int*> (p);   p += column_size<int> ();
+    x     = reinterpret_cast<float*> (p); p += column_size<float> ();
+    y     = reinterpret_cast<float*> (p); p += column_size<float> ();
+    z     = reinterpret_cast<float*> (p); p += column_size<float> ();
+    range = reinterpret_cast<int*> (p);   p += column_size<int> ();
+    on    = reinterpret_cast<bool*> (p);
+  }
+
+  void Targets::load (const haptic_target_t* list, int count_) {
+    count = 0;
+    for (int slot = 0; slot < count_; ++slot)
+      store (slot, list[slot]);
+  }
+
+  void Targets::store (int slot, const haptic_target_t& target) {
+    if (slot < 0 || slot >= MAX_TARGETS || slot > count)
+      return;
+    index[slot] = target.index;
+    type[slot] = target.type;
+    x[slot] = target.vec_to_target[0];
+    y[slot] = target.vec_to_target[1];
+    z[slot] = target.vec_to_target[2];
+    range[slot] = target.range;
+    on[slot] = target.turn_motor_on;
+    if (slot == count)
+      ++count;
+  }
+
+  void Targets::erase (int slot) {
+    if (slot < 0 || slot >= count)
+      return;
+    shift (index, slot, count);
+    shift (type, slot, count);
+    shift (x, slot, count);
+    shift (y, slot, count);
+    shift (z, slot, count);
+    shift (range, slot, count);
+    shift (on, slot, count);
+    --count;
+  }
+
+  int Targets::find (int index_) const {
+    for (int slot = 0; slot < count; ++slot)
+      if (index[slot] == index_)
+        return slot;
+    return -1;
+  }
+
+  int Targets::in_range () const {
+    int slot = 0;
+    while (slot < count && range[slot] < MAX_RANGE)
+      ++slot;
+    return slot;
+  }
+
+}
@@ -0,0 +1,84 @@
+/** @file haptic_layout.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Hot columns of the target list.  haptic_target_t and
+   haptic_device_state_t are part of the C ABI, so their layout is
+   fixed.  A target is 72 bytes of which a frame reads about 20, and
+   the loops that search the list by index read 4.  The engine keeps
+   the fields it reads every frame in columns, one array per field,
+   in the order of haptic_target_list, and leaves the rest of each
+   target in the list.
+
+   NOTES
+   =====
+
+   o Columns.  index, type, the unit vector to the target, range and
+     whether the motor is on.  Each column starts on its own cache
+     line, so a loop over one field reads only the lines that hold
+     it.  The columns are one allocation aligned by hand; operator new
+     in C++14 doesn't honor alignas beyond that of max_align_t.
+
+   o Mirror.  haptic_target_list stays the record of the targets and
+     is what the game sees.  Every change to the list in
+     omniwear_SDK.cc updates the columns: changed values with store,
+     removals with erase, and reorders, which rewrite every slot,
+     with load.  The cold fields, location, view angles, health and
+     the toggle times, are read from the list only when a target is
+     recalculated.
+
+*/
+
+#if !defined (HAPTIC_LAYOUT_H_INCLUDED)
+#    define   HAPTIC_LAYOUT_H_INCLUDED
+
+/* ----- Includes */
+
+#include "omniwear_SDK.h"
+#include <memory>
+
+/* ----- Types */
+
+namespace HapticLayout {
+
+  constexpr int C_LINE = 64;      // Bytes in a cache line
+
+  struct Targets {
+    int* index;                 // haptic_target_t::index
+    int* type;
+    float* x;                   // Unit vector to the target
+    float* y;
+    float* z;
+    int* range;
+    bool* on;                   // haptic_target_t::turn_motor_on
+    int count = 0;
+
+    Targets ();
+    Targets (const Targets&) = delete;
+    Targets& operator= (const Targets&) = delete;
+
+    // Copy every target of the list.
+    void load (const haptic_target_t* list, int count);
+
+    // Copy the target in slot, which may be the one past the last.
+    void store (int slot, const haptic_target_t& target);
+
+    // Remove the target in slot, shifting the ones after it down.
+    void erase (int slot);
+
+    // Slot of the target with index, or -1.
+    int find (int index) const;
+
+    // Targets before the first out of range; the list is sorted by
+    // range.
+    int in_range () const;
+
+  private:
+    std::unique_ptr<char[]> block_;
+  };
+
+}
+
+#endif  /* HAPTIC_LAYOUT_H_INCLUDED */
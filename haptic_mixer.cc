@@ -0,0 +1,257 @@
+/** @file haptic_mixer.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Mixing stage of the haptic radar.  See haptic_mixer.h.
+
+   NOTES
+   =====
+
+   o Legacy defaults.  COMBINE_NEAREST with FALLOFF_STEP on both
+     curves is the original behavior: the closest in-cone target
+     drives the motor at 100, or at 50 beyond MAX_RANGE/2.
+
+   o Loudness.  COMBINE_LOUDNESS sums the energy of the
+     contributions, sqrt (sum (g*g)), so that two equal targets feel
+     about 1.4 times as strong as one instead of twice as strong.
+
+*/
+
+#define _USE_MATH_DEFINES
+
+#include "haptic_mixer.h"
+#include "fixed_point.h"
+#include <limits.h>
+#include <math.h>
+
+namespace {
+
+  // Evaluate a preset falloff curve at t, 0 at the center of the
+  // cone (or zero range) and 1 at its edge (or MAX_RANGE).
+  float falloff (haptic_curve_t curve, haptic_falloff_t falloff, float t) {
+    switch (falloff) {
+    default:
+    case FALLOFF_STEP:
+      if (curve == CURVE_RANGE)
+        return t > 0.5f ? 0.5f : 1.0f;
+      return 1.0f;
+    case FALLOFF_LINEAR:
+      return 1.0f - t;
+    case FALLOFF_SMOOTH:
+      return 1.0f - t*t*(3.0f - 2.0f*t);
+    }
+  }
+
+  // Parameter t, from 0 to 1, sampled by entry i of a table.
+  float lut_t (const HapticMixer::Config& config, haptic_curve_t curve,
+               int i) {
+    if (curve == CURVE_RANGE)
+      return float (i)/HapticMixer::C_LUT;
+
+    float d = config.cos_max_angle
+      + (1.0f - config.cos_max_angle)*i/(HapticMixer::C_LUT - 1);
+    if (d > 1.0f)
+      d = 1.0f;
+    return acosf (d)/MAX_ANGLE;
+  }
+
+  std::array<float,HapticMixer::C_LUT>& lut (HapticMixer::Config& config,
+                                              haptic_curve_t curve) {
+    return curve == CURVE_RANGE ? config.range_lut : config.angle_lut; }
+
+  // Copy a table for the fixed point engine.
+  void update_fixed (HapticMixer::Config& config, haptic_curve_t curve) {
+    auto& table = lut (config, curve);
+    auto& fixed = curve == CURVE_RANGE ? config.range_lut_fixed
+                                       : config.angle_lut_fixed;
+    for (int i = 0; i < HapticMixer::C_LUT; ++i)
+      fixed[i] = uint16_t (Fixed::to_q15 (table[i])); }
+
+  // Range gain depends only on the target, so look it up once.
+  // Targets that are switched off contribute nothing.
+  int range_gains (const HapticMixer::Config& config,
+                   const HapticMixer::Targets& targets, float* gains) {
+    const int count = targets.count < MAX_TARGETS ? targets.count
+                                                  : MAX_TARGETS;
+    for (int t = 0; t < count; ++t)
+      gains[t] = HapticMixer::range_gain (config, targets.range[t],
+                                          targets.on[t]);
+    return count;
+  }
+
+}
+
+namespace HapticMixer {
+
+  Config::Config () {
+    cos_max_angle = cosf (MAX_ANGLE);
+    cos_max_angle_fixed = Fixed::to_q15 (cos_max_angle);
+    angle_scale_fixed = int32_t ((C_LUT - 1)*float (1 << 22)
+                                 /(Fixed::Q15_ONE - cos_max_angle_fixed));
+    set_falloff (*this, CURVE_ANGLE, FALLOFF_STEP);
+    set_falloff (*this, CURVE_RANGE, FALLOFF_STEP);
+  }
+
+  bool set_falloff (Config& config, haptic_curve_t curve,
+                    haptic_falloff_t f) {
+    if (curve != CURVE_ANGLE && curve != CURVE_RANGE)
+      return false;
+    if (f != FALLOFF_STEP && f != FALLOFF_LINEAR && f != FALLOFF_SMOOTH)
+      return false;
+
+    auto& table = lut (config, curve);
+    for (int i = 0; i < C_LUT; ++i)
+      table[i] = falloff (curve, f, lut_t (config, curve, i));
+    update_fixed (config, curve);
+    if (curve == CURVE_RANGE)
+      config.range_step = f == FALLOFF_STEP;
+    return true;
+  }
+
+  /** Resample an arbitrary curve into a table.  The samples are
+      evenly spaced from the center of the cone (or zero range) to
+      its edge (or MAX_RANGE) and are interpolated linearly. */
+  bool set_curve (Config& config, haptic_curve_t curve,
+                  const float* samples, int count) {
+    if (curve != CURVE_ANGLE && curve != CURVE_RANGE)
+      return false;
+    if (!samples || count < 2)
+      return false;
+    for (int i = 0; i < count; ++i)
+      if (!(samples[i] >= 0.0f && samples[i] <= 1.0f))
+        return false;
+
+    auto& table = lut (config, curve);
+    for (int i = 0; i < C_LUT; ++i) {
+      float x = lut_t (config, curve, i)*(count - 1);
+      int j = int (x);
+      if (j >= count - 1)
+        j = count - 2;
+      float frac = x - j;
+      table[i] = samples[j] + (samples[j + 1] - samples[j])*frac;
+    }
+    update_fixed (config, curve);
+    if (curve == CURVE_RANGE)
+      config.range_step = false;
+    return true;
+  }
+
+  void mix (const Config& config, const float (*motor_vecs)[3], int c_motors,
+            const Targets& targets, int* intensities, bool* tracking,
+            int* priorities) {
+    const float cos_max = config.cos_max_angle;
+    const float scale = (C_LUT - 1)/(1.0f - cos_max);
+
+    float range_gain[MAX_TARGETS];
+    const int count = range_gains (config, targets, range_gain);
+
+    for (int m = 0; m < c_motors; ++m) {
+      const float mx = motor_vecs[m][0];
+      const float my = motor_vecs[m][1];
+      const float mz = motor_vecs[m][2];
+
+      if (config.combine == COMBINE_NEAREST) {
+        float gain = 0;
+        bool found = false;
+        int priority = 0;
+        for (int t = 0; t < count; ++t) {
+          float d = targets.x[t]*mx + targets.y[t]*my + targets.z[t]*mz;
+          if (d < cos_max)
+            continue;
+          int i = int ((d - cos_max)*scale + 0.5f);
+          i = i < C_LUT ? i : C_LUT - 1;
+          gain = config.angle_lut[i]*range_gain[t];
+          priority = targets.priority ? targets.priority[t] : 0;
+          found = true;
+          break;
+        }
+        tracking[m] = found;
+        intensities[m] = to_intensity (gain);
+        if (priorities)
+          priorities[m] = priority;
+        continue;
+      }
+
+      // No early exit and no data dependent branches so that the
+      // compiler can vectorize the loop.
+      float peak = 0;
+      float sum = 0;
+      float energy = 0;
+      int in_cone = 0;
+      int priority = INT_MIN;
+      for (int t = 0; t < count; ++t) {
+        float d = targets.x[t]*mx + targets.y[t]*my + targets.z[t]*mz;
+        bool in = d >= cos_max;
+        int i = in ? int ((d - cos_max)*scale + 0.5f) : 0;
+        i = i < C_LUT ? i : C_LUT - 1;
+        float g = in ? config.angle_lut[i]*range_gain[t] : 0.0f;
+        int p = !in ? INT_MIN : targets.priority ? targets.priority[t] : 0;
+        priority = p > priority ? p : priority;
+        in_cone += in;
+        peak = g > peak ? g : peak;
+        sum += g;
+        energy += g*g;
+      }
+
+      tracking[m] = in_cone > 0;
+      intensities[m] = to_intensity (combine (config.combine,
+                                              peak, sum, energy));
+      if (priorities)
+        priorities[m] = priority;
+    }
+  }
+
+  void mix_panned (const Config& config, const HapticPanner::Table& table,
+                   const float (*to_body)[3], int c_motors,
+                   const Targets& targets, int* intensities, bool* tracking,
+                   int* priorities) {
+    using HapticPanner::C_GAINS;
+
+    float range_gain[MAX_TARGETS];
+    const int count = range_gains (config, targets, range_gain);
+
+    // Targets in the outer loop so that each table fetch is used for
+    // all motors.  The inner loop runs over the padded gain vector.
+    float nearest[C_GAINS] = {};
+    float peak[C_GAINS] = {};
+    float sum[C_GAINS] = {};
+    float energy[C_GAINS] = {};
+    bool found[C_GAINS] = {};
+    int priority[C_GAINS];
+    for (int m = 0; m < C_GAINS; ++m)
+      priority[m] = INT_MIN;
+    for (int t = 0; t < count; ++t) {
+      const float x = targets.x[t];
+      const float y = targets.y[t];
+      const float z = targets.z[t];
+      const uint8_t* gains
+        = table.gains (to_body[0][0]*x + to_body[0][1]*y + to_body[0][2]*z,
+                       to_body[1][0]*x + to_body[1][1]*y + to_body[1][2]*z,
+                       to_body[2][0]*x + to_body[2][1]*y + to_body[2][2]*z);
+      const float scale = range_gain[t]*(1.0f/255.0f);
+      const int p = targets.priority ? targets.priority[t] : 0;
+      for (int m = 0; m < C_GAINS; ++m) {
+        float g = gains[m]*scale;
+        bool first = !found[m] && gains[m];
+        nearest[m] = first ? g : nearest[m];
+        found[m] = found[m] || gains[m];
+        priority[m] = gains[m] && p > priority[m] ? p : priority[m];
+        peak[m] = g > peak[m] ? g : peak[m];
+        sum[m] += g;
+        energy[m] += g*g;
+      }
+    }
+
+    for (int m = 0; m < c_motors && m < C_GAINS; ++m) {
+      tracking[m] = found[m];
+      if (priorities)
+        priorities[m] = priority[m];
+      intensities[m] = to_intensity
+        (config.combine == COMBINE_NEAREST
+         ? nearest[m] : combine (config.combine, peak[m], sum[m], energy[m]));
+    }
+  }
+
+}
@@ -0,0 +1,141 @@
+/** @file haptic_mixer.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Mixing stage of the haptic radar.  Every in-range target
+   contributes to every motor whose cone contains it.  The
+   contribution is the product of an angle falloff and a range
+   falloff, both sampled into lookup tables when the mixing is
+   configured.  The contributions on each motor are then combined by
+   one of the haptic_combine_t rules.
+
+   NOTES
+   =====
+
+   o Lookup tables.  The angle table is indexed by the cosine of the
+     angle between the motor normal and the target, the dot product
+     we already have, so the kernel never calls acos().  The range
+     table is indexed linearly from 0 to MAX_RANGE.  Curves are
+     accurate to the resolution of the tables, except that the range
+     step of FALLOFF_STEP is exact, as the legacy defaults need.
+
+   o Panning.  With SPATIAL_PANNING the cone test and the angle
+     falloff are replaced by the gains of the panning table, see
+     haptic_panner.h.  The range falloff and the combine rule apply
+     as before.
+
+   o Batched.  The kernel takes targets as structure-of-arrays and
+     runs one pass per motor over all targets.  The inner loop has no
+     early exit except for COMBINE_NEAREST, which reproduces the
+     original closest-target behavior.
+
+   o Fixed point.  The configuration carries Q1.15 copies of the
+     tables for the kernels of the fixed point engine, see
+     haptic_fixed.h.  They are kept in step with the float tables.
+
+*/
+
+#if !defined (HAPTIC_MIXER_H_INCLUDED)
+#    define   HAPTIC_MIXER_H_INCLUDED
+
+/* ----- Includes */
+
+#include "omniwear_SDK.h"
+#include "haptic_panner.h"
+#include <array>
+#include <math.h>
+
+/* ----- Types */
+
+namespace HapticMixer {
+
+  constexpr int C_LUT = 256;
+
+  struct Config {
+    haptic_combine_t combine = COMBINE_NEAREST;
+    haptic_spatial_t spatial = SPATIAL_CONE;
+    float cos_max_angle = 0;     // Cosine of MAX_ANGLE, edge of the cone
+    std::array<float,C_LUT> angle_lut;  // Gain 0-1 indexed by cosine
+    std::array<float,C_LUT> range_lut;  // Gain 0-1 indexed by range
+
+    // The same for the fixed point engine.  angle_scale_fixed is
+    // the table index per Q1.15 step above cos_max_angle_fixed,
+    // scaled by 2^22.
+    int32_t cos_max_angle_fixed = 0;
+    int32_t angle_scale_fixed = 0;
+    std::array<uint16_t,C_LUT> angle_lut_fixed;
+    std::array<uint16_t,C_LUT> range_lut_fixed;
+
+    // The range curve is FALLOFF_STEP, whose step at MAX_RANGE/2
+    // falls inside a table entry, so it is tested exactly.
+    bool range_step = false;
+
+    Config ();
+  };
+
+  // Targets in structure-of-arrays form, sorted by ascending range.
+  // Directions are unit vectors from the player to the target.
+  struct Targets {
+    int count = 0;
+    const float* x = nullptr;
+    const float* y = nullptr;
+    const float* z = nullptr;
+    const int* range = nullptr;
+    const bool* on = nullptr;
+    const int* priority = nullptr;      // All 0 when null
+  };
+
+  // Entry of the range table for a range.
+  inline int range_index (const Config& config, int range) {
+    if (config.range_step)
+      return range > MAX_RANGE/2 ? C_LUT - 1 : 0;
+    int i = range*C_LUT/MAX_RANGE;
+    return i < 0 ? 0 : i >= C_LUT ? C_LUT - 1 : i; }
+
+  // Gain of the range falloff for a target.  Targets that are
+  // switched off contribute nothing.
+  inline float range_gain (const Config& config, int range, bool on) {
+    return on ? config.range_lut[range_index (config, range)] : 0.0f; }
+
+  // Combine the contributions on a motor by a rule other than
+  // COMBINE_NEAREST.
+  inline float combine (haptic_combine_t rule, float peak, float sum,
+                        float energy) {
+    switch (rule) {
+    default:
+    case COMBINE_MAX:
+      return peak;
+    case COMBINE_SUM_LIMITED:
+      return sum;
+    case COMBINE_LOUDNESS:
+      return sqrtf (energy);
+    }
+  }
+
+  inline int to_intensity (float gain) {
+    int v = int (gain*100.0f + 0.5f);
+    return v < 0 ? 0 : v > 100 ? 100 : v; }
+
+  bool set_falloff (Config&, haptic_curve_t, haptic_falloff_t);
+  bool set_curve (Config&, haptic_curve_t, const float* samples, int count);
+
+  // Compute intensities (0-100) for c_motors motors with unit
+  // normals motor_vecs.  tracking[m] is set when at least one target
+  // is within the cone of motor m.  When priorities isn't null,
+  // priorities[m] is set to the highest priority of those targets.
+  void mix (const Config&, const float (*motor_vecs)[3], int c_motors,
+            const Targets&, int* intensities, bool* tracking,
+            int* priorities = nullptr);
+
+  // Compute intensities by panning each target across the motors.
+  // to_body rotates the target directions into the frame of the
+  // head, the frame of the motor positions used to build the table.
+  void mix_panned (const Config&, const HapticPanner::Table&,
+                   const float (*to_body)[3], int c_motors,
+                   const Targets&, int* intensities, bool* tracking,
+                   int* priorities = nullptr);
+}
+
+#endif  /* HAPTIC_MIXER_H_INCLUDED */
@@ -0,0 +1,118 @@
+/** @file haptic_motion.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Extrapolation of the targets and of the player.  See
+   haptic_motion.h.
+
+*/
+
+#include "haptic_motion.h"
+#include <algorithm>
+#include <math.h>
+
+namespace {
+
+  // Angle from a to b the short way around, degrees.
+  float turn (float a, float b) {
+    float d = fmodf (b - a, 360.0f);
+    return d >= 180.0f ? d - 360.0f : d < -180.0f ? d + 360.0f : d; }
+
+  bool by_index (const HapticMotion::Track& a, const HapticMotion::Track& b) {
+    return a.index < b.index; }
+
+}
+
+namespace HapticMotion {
+
+  Tracker::Tracker () {
+    tracks.reserve (MAX_TARGETS);
+    scratch.reserve (MAX_TARGETS);
+    for (int i = 0; i < 3; ++i)
+      origin[i] = origin_velocity[i] = viewangles[i] = angular_velocity[i] = 0;
+  }
+
+  void Tracker::record (double game_time, const haptic_target_t* targets,
+                        int count, const float origin_[3],
+                        const float viewangles_[3]) {
+    const float dt = recorded && game_time > time ? float (game_time - time) : 0;
+
+    scratch.clear ();
+    moving = false;
+    for (int t = 0; t < count; ++t) {
+      Track track;
+      track.index = targets[t].index;
+      for (int i = 0; i < 3; ++i) {
+        track.location[i] = targets[t].location[i];
+        track.velocity[i] = 0;
+      }
+
+      Track key;
+      key.index = track.index;
+      auto it = std::lower_bound (tracks.begin (), tracks.end (), key, by_index);
+      if (it != tracks.end () && it->index == track.index)
+        for (int i = 0; i < 3; ++i) {
+          track.velocity[i] = dt > 0
+            ? (track.location[i] - it->location[i])/dt : it->velocity[i];
+          moving = moving || track.velocity[i] != 0;
+        }
+      scratch.push_back (track);
+    }
+    std::sort (scratch.begin (), scratch.end (), by_index);
+    tracks.swap (scratch);
+
+    for (int i = 0; i < 3; ++i) {
+      if (dt > 0) {
+        origin_velocity[i] = (origin_[i] - origin[i])/dt;
+        angular_velocity[i] = turn (viewangles[i], viewangles_[i])/dt;
+      }
+      if (!recorded)
+        origin_velocity[i] = angular_velocity[i] = 0;
+      origin[i] = origin_[i];
+      viewangles[i] = viewangles_[i];
+      moving = moving
+        || ((flags & PREDICT_ORIGIN) && origin_velocity[i] != 0)
+        || ((flags & PREDICT_VIEWANGLES) && angular_velocity[i] != 0);
+    }
+
+    time = dt > 0 || !recorded ? game_time : time;
+    recorded = true;
+    pending = false;
+  }
+
+  double Tracker::horizon (double game_time, double send_sec) const {
+    if (!recorded)
+      return 0;
+    double h = game_time - time + send_sec + latency_sec;
+    return h < 0 ? 0 : h > MAX_PREDICTION_SEC ? MAX_PREDICTION_SEC : h;
+  }
+
+  void Tracker::extrapolate (int index, const float location[3],
+                             double horizon, float out[3]) const {
+    Track key;
+    key.index = index;
+    auto it = std::lower_bound (tracks.begin (), tracks.end (), key, by_index);
+    bool found = (flags & PREDICT_TARGETS)
+      && it != tracks.end () && it->index == index;
+    for (int i = 0; i < 3; ++i)
+      out[i] = found ? it->location[i] + float (it->velocity[i]*horizon)
+                     : location[i];
+  }
+
+  void Tracker::extrapolate_pose (const float origin_[3],
+                                  const float viewangles_[3], double horizon,
+                                  float origin_out[3],
+                                  float viewangles_out[3]) const {
+    const bool by_origin = (flags & PREDICT_ORIGIN) && recorded;
+    const bool by_angles = (flags & PREDICT_VIEWANGLES) && recorded;
+    for (int i = 0; i < 3; ++i) {
+      origin_out[i] = by_origin
+        ? origin[i] + float (origin_velocity[i]*horizon) : origin_[i];
+      viewangles_out[i] = by_angles
+        ? viewangles[i] + float (angular_velocity[i]*horizon) : viewangles_[i];
+    }
+  }
+
+}
@@ -0,0 +1,89 @@
+/** @file haptic_motion.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Motion of the targets and of the player, for extrapolating them to
+   the time the motor reports reach the cap.  See
+   set_haptic_prediction.
+
+   NOTES
+   =====
+
+   o Update times.  update_haptic_radar doesn't carry a game time.
+     An update is taken to be as of the game time of the
+     execute_haptic_effects that follows it, which is when the
+     tracker records it.  Several updates before a frame count as
+     one, the last.
+
+   o Velocities.  The velocity of a target is the difference of its
+     location between the last two updates that saw it over the game
+     time between them.  A target seen for the first time doesn't
+     move.  The angular velocity of the player is taken the short way
+     around, so yaw wraps.
+
+   o Horizon.  A frame extrapolates by the game time since the last
+     update plus the latency, never by more than MAX_PREDICTION_SEC,
+     so that targets the game has stopped updating don't drift away.
+
+*/
+
+#if !defined (HAPTIC_MOTION_H_INCLUDED)
+#    define   HAPTIC_MOTION_H_INCLUDED
+
+/* ----- Includes */
+
+#include "omniwear_SDK.h"
+#include <vector>
+
+/* ----- Types */
+
+namespace HapticMotion {
+
+  constexpr double MAX_PREDICTION_SEC = 0.25;
+
+  struct Track {
+    int index;                  // haptic_target_t::index
+    float location[3];
+    float velocity[3];          // Units per second of game time
+  };
+
+  struct Tracker {
+    int flags = PREDICT_NONE;   // haptic_prediction_t
+    float latency_sec = 0;      // Latency beyond sending the reports
+    bool pending = false;       // Updated since the last record
+    bool moving = false;        // Some velocity isn't zero
+    bool recorded = false;
+    double time = 0;            // Game time of the last record
+    std::vector<Track> tracks;  // Sorted by index
+    std::vector<Track> scratch;
+    float origin[3];
+    float origin_velocity[3];
+    float viewangles[3];
+    float angular_velocity[3];  // Degrees per second
+
+    Tracker ();
+
+    // Record the targets and pose of the last update as of game_time.
+    void record (double game_time, const haptic_target_t* targets, int count,
+                 const float origin[3], const float viewangles[3]);
+
+    // Game time to extrapolate by in a frame at game_time when sending
+    // takes send_sec.
+    double horizon (double game_time, double send_sec) const;
+
+    // Location of a target horizon seconds after the last record.
+    // location is where the target is now.
+    void extrapolate (int index, const float location[3], double horizon,
+                      float out[3]) const;
+
+    // Pose of the player horizon seconds after the last record.
+    void extrapolate_pose (const float origin[3], const float viewangles[3],
+                           double horizon,
+                           float origin_out[3], float viewangles_out[3]) const;
+  };
+
+}
+
+#endif  /* HAPTIC_MOTION_H_INCLUDED */
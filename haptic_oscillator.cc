@@ -0,0 +1,124 @@
+/** @file haptic_oscillator.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Bank of per-motor oscillators.  See haptic_oscillator.h.
+
+*/
+
+#define _USE_MATH_DEFINES
+
+#include "haptic_oscillator.h"
+#include <math.h>
+
+namespace {
+
+  using HapticOscillator::C_WAVE;
+  using HapticOscillator::Wave;
+
+  constexpr int C_WAVEFORMS = WAVEFORM_CUSTOM + 1;
+
+  uint8_t to_sample (float v) {
+    return uint8_t (v <= 0 ? 0 : v >= 1 ? 255 : v*255.0f + 0.5f); }
+
+  // Tables of the built in waveforms, built once.  The entry for
+  // WAVEFORM_CUSTOM is unused.
+  const std::array<Wave,C_WAVEFORMS>& builtin () {
+    static const std::array<Wave,C_WAVEFORMS>* waves = [] {
+      auto waves = new std::array<Wave,C_WAVEFORMS> ();
+      for (int i = 0; i < C_WAVE; ++i) {
+        float x = float (i)/C_WAVE;
+        (*waves)[WAVEFORM_OFF][i] = 0;
+        (*waves)[WAVEFORM_TRIANGLE][i]
+          = to_sample (x < 0.5f ? 2*x : 2 - 2*x);
+        (*waves)[WAVEFORM_SINE][i]
+          = to_sample (0.5f - 0.5f*cosf (float (2*M_PI)*x));
+        (*waves)[WAVEFORM_SQUARE][i]
+          = x >= 0.25f && x < 0.75f ? 255 : 0;
+        (*waves)[WAVEFORM_CUSTOM][i] = 0;
+      }
+      return waves;
+    }();
+    return *waves;
+  }
+
+}
+
+namespace HapticOscillator {
+
+  Bank::Bank () {
+    phase.fill (0);
+    rate.fill (0);
+    waveform.fill (WAVEFORM_OFF);
+    amplitude.fill (0);
+    fresh.fill (false);
+    custom.fill (0);
+    builtin ();
+  }
+
+  bool Bank::set (int motor, haptic_waveform_t wave, float period_sec,
+                  int amplitude_, float phase_) {
+    if (motor < 0 || motor >= NUMBER_OF_MOTORS)
+      return false;
+    if (wave < WAVEFORM_OFF || wave > WAVEFORM_CUSTOM)
+      return false;
+    if (wave != WAVEFORM_OFF && !(period_sec > 0))
+      return false;
+    if (amplitude_ < 0 || amplitude_ > 100)
+      return false;
+    if (!(phase_ >= 0 && phase_ <= 1))
+      return false;
+
+    running += (wave != WAVEFORM_OFF) - is_running (motor);
+    waveform[motor] = uint8_t (wave);
+    amplitude[motor] = uint8_t (amplitude_);
+    rate[motor] = wave == WAVEFORM_OFF ? 0
+      : uint64_t (double (uint64_t (1) << 40)/(period_sec*1e6) + 0.5);
+    phase[motor] = uint32_t (double (phase_)*4294967296.0);
+    fresh[motor] = true;
+    return true;
+  }
+
+  bool Bank::define (const float* samples, int count) {
+    if (!samples || count < 2)
+      return false;
+    for (int i = 0; i < count; ++i)
+      if (!(samples[i] >= 0.0f && samples[i] <= 1.0f))
+        return false;
+
+    for (int i = 0; i < C_WAVE; ++i) {
+      float x = float (i)*count/C_WAVE;
+      int j = int (x);
+      float frac = x - j;
+      float a = samples[j];
+      float b = samples[(j + 1) % count];
+      custom[i] = to_sample (a + (b - a)*frac);
+    }
+    return true;
+  }
+
+  void Bank::tick (double game_time, int intensities[NUMBER_OF_MOTORS]) {
+    // Microseconds of game time since the last tick.  Time is
+    // rounded to microseconds before the difference is taken so that
+    // the rounding doesn't accumulate.  The product with the rate may
+    // overflow 64 bits, but only its low 40 bits matter to the phase.
+    int64_t now_us = int64_t (floor (game_time*1e6 + 0.5));
+    uint64_t dt_us = ticked && now_us > last_us ? now_us - last_us : 0;
+    if (!ticked || now_us > last_us)
+      last_us = now_us;
+    ticked = true;
+
+    const auto& waves = builtin ();
+    for (int m = 0; m < NUMBER_OF_MOTORS; ++m) {
+      phase[m] += fresh[m] ? 0 : uint32_t ((rate[m]*dt_us) >> 8);
+      fresh[m] = false;
+      const Wave& wave = waveform[m] == WAVEFORM_CUSTOM
+        ? custom : waves[waveform[m]];
+      int sample = wave[phase[m] >> 24];
+      intensities[m] = (sample*amplitude[m]*257 + (1 << 15)) >> 16;
+    }
+  }
+
+}
@@ -0,0 +1,85 @@
+/** @file haptic_oscillator.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Bank of oscillators, one per motor, for ambient effects such as
+   the throb.  Each oscillator reads a waveform from a table of
+   C_WAVE samples at a phase that advances with game time.  Motors
+   that no target drives take the output of their oscillator.
+
+   NOTES
+   =====
+
+   o Phase accumulators.  The phase of each oscillator is a 32 bit
+     fraction of a cycle that wraps at the end of the cycle.  A tick
+     advances every phase by the game time since the previous tick
+     times the rate of the oscillator, so the waveform depends only
+     on game time and not on how often the bank is ticked.  Rates
+     are cycles per microsecond scaled by 2^40 so that a period is
+     exact to about one part in a million.
+
+   o Waveforms.  Every waveform, built in or custom, is a table of
+     C_WAVE gains from 0 to 255 indexed by the top bits of the
+     phase.  The built in waveforms start at 0 and peak at half a
+     cycle.  Evaluating the bank is a gather and a multiply per
+     motor without branches.
+
+   o Start.  An oscillator that is (re)configured starts at its
+     initial phase on the next tick; the time before that tick
+     doesn't advance it.
+
+*/
+
+#if !defined (HAPTIC_OSCILLATOR_H_INCLUDED)
+#    define   HAPTIC_OSCILLATOR_H_INCLUDED
+
+/* ----- Includes */
+
+#include "omniwear_SDK.h"
+#include <array>
+
+/* ----- Types */
+
+namespace HapticOscillator {
+
+  constexpr int C_WAVE = 256;   // Samples in a waveform table
+
+  typedef std::array<uint8_t,C_WAVE> Wave;
+
+  struct Bank {
+    std::array<uint32_t,NUMBER_OF_MOTORS> phase;
+    std::array<uint64_t,NUMBER_OF_MOTORS> rate;      // Cycles/us << 40
+    std::array<uint8_t,NUMBER_OF_MOTORS> waveform;   // haptic_waveform_t
+    std::array<uint8_t,NUMBER_OF_MOTORS> amplitude;  // 0-100
+    std::array<bool,NUMBER_OF_MOTORS> fresh;         // Don't advance on the next tick
+    Wave custom;                // Samples of WAVEFORM_CUSTOM
+    int64_t last_us = 0;        // Game time of the last tick
+    bool ticked = false;
+    int running = 0;            // Oscillators not WAVEFORM_OFF
+
+    Bank ();
+
+    // Configure the oscillator of one motor.  period_sec is the
+    // length of a cycle and phase is the starting fraction of a
+    // cycle.
+    bool set (int motor, haptic_waveform_t, float period_sec,
+              int amplitude, float phase);
+
+    // Resample a cycle of samples, 0 to 1, into the custom
+    // waveform.  The cycle wraps from the last sample to the first.
+    bool define (const float* samples, int count);
+
+    bool is_running (int motor) const {
+      return waveform[motor] != WAVEFORM_OFF; }
+
+    // Advance the oscillators to game_time and compute the intensity,
+    // 0-100, of each.  Intensities of motors without a running
+    // oscillator are 0.
+    void tick (double game_time, int intensities[NUMBER_OF_MOTORS]);
+  };
+
+}
+
+#endif  /* HAPTIC_OSCILLATOR_H_INCLUDED */
@@ -0,0 +1,117 @@
+/** @file haptic_panner.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Amplitude panning across the motors of the cap.  See
+   haptic_panner.h.
+
+*/
+
+#include "haptic_panner.h"
+#include <math.h>
+
+namespace {
+
+  float sign (float v) {
+    return v < 0 ? -1.0f : 1.0f; }
+
+  // Fold the lower hemisphere of the octahedral map over the upper.
+  void fold (float& u, float& v) {
+    float fu = (1.0f - fabsf (v))*sign (u);
+    float fv = (1.0f - fabsf (u))*sign (v);
+    u = fu;
+    v = fv; }
+
+  // Direction, normalized, at the center of a cell.
+  void decode (int cell, float d[3]) {
+    int i = cell % HapticPanner::C_GRID;
+    int j = cell / HapticPanner::C_GRID;
+    float u = (i + 0.5f)*2.0f/HapticPanner::C_GRID - 1.0f;
+    float v = (j + 0.5f)*2.0f/HapticPanner::C_GRID - 1.0f;
+    float z = 1.0f - fabsf (u) - fabsf (v);
+    if (z < 0)
+      fold (u, v);
+    float length = sqrtf (u*u + v*v + z*z);
+    d[0] = u/length;
+    d[1] = v/length;
+    d[2] = z/length;
+  }
+
+}
+
+namespace HapticPanner {
+
+  int Table::cell (float x, float y, float z) {
+    float s = fabsf (x) + fabsf (y) + fabsf (z);
+    if (s == 0)
+      return 0;
+    float u = x/s;
+    float v = y/s;
+    if (z < 0)
+      fold (u, v);
+    int i = int ((u + 1.0f)*(0.5f*C_GRID));
+    int j = int ((v + 1.0f)*(0.5f*C_GRID));
+    i = i < 0 ? 0 : i >= C_GRID ? C_GRID - 1 : i;
+    j = j < 0 ? 0 : j >= C_GRID ? C_GRID - 1 : j;
+    return j*C_GRID + i;
+  }
+
+  // As above with the division by s deferred to the cell index.  The
+  // components must be less than 2^29 in magnitude.
+  int Table::cell (int32_t x, int32_t y, int32_t z) {
+    int32_t ax = x < 0 ? -x : x;
+    int32_t ay = y < 0 ? -y : y;
+    int32_t s = ax + ay + (z < 0 ? -z : z);
+    if (s == 0)
+      return 0;
+    int32_t u = x;
+    int32_t v = y;
+    if (z < 0) {
+      u = x < 0 ? ay - s : s - ay;
+      v = y < 0 ? ax - s : s - ax;
+    }
+    int i = int (int64_t (u + s)*(C_GRID/2)/s);
+    int j = int (int64_t (v + s)*(C_GRID/2)/s);
+    i = i >= C_GRID ? C_GRID - 1 : i;
+    j = j >= C_GRID ? C_GRID - 1 : j;
+    return j*C_GRID + i;
+  }
+
+  void Table::build (const haptic_motor_t* motors, int c_motors) {
+    if (c_motors > C_GAINS)
+      c_motors = C_GAINS;
+
+    std::array<std::array<float,3>,C_GAINS> normals;
+    for (int m = 0; m < c_motors; ++m) {
+      const float* p = motors[m].position;
+      float length = sqrtf (p[0]*p[0] + p[1]*p[1] + p[2]*p[2]);
+      for (int k = 0; k < 3; ++k)
+        normals[m][k] = length ? p[k]/length : 0;
+    }
+
+    const float cos_max = cosf (MAX_ANGLE);
+    for (int c = 0; c < C_GRID*C_GRID; ++c) {
+      float d[3];
+      decode (c, d);
+
+      float weights[C_GAINS] = {};
+      float energy = 0;
+      for (int m = 0; m < c_motors; ++m) {
+        float dot = d[0]*normals[m][0] + d[1]*normals[m][1]
+          + d[2]*normals[m][2];
+        if (dot <= cos_max)
+          continue;
+        float w = (dot - cos_max)/(1.0f - cos_max);
+        weights[m] = w*w;
+        energy += weights[m]*weights[m];
+      }
+
+      float scale = energy > 0 ? 255.0f/sqrtf (energy) : 0;
+      for (int m = 0; m < C_GAINS; ++m)
+        cells[c][m] = uint8_t (weights[m]*scale + 0.5f);
+    }
+  }
+
+}
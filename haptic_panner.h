@@ -0,0 +1,69 @@
+/** @file haptic_panner.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Amplitude panning across the motors of the cap.  A direction
+   relative to the wearer's head maps to a vector of gains, one per
+   motor, so that a target between two motors drives both of them
+   and is felt as a phantom point in between.
+
+   NOTES
+   =====
+
+   o Table.  The gains are precomputed for a dense grid of
+     directions.  The grid is an octahedral map of the sphere, which
+     needs only absolute values and one division to find the cell for
+     a direction, so there is no trigonometry at runtime.
+
+   o Gains.  Every motor within MAX_ANGLE of a direction receives a
+     weight that rises with the square of its closeness to the
+     direction.  The weights are normalized for constant energy, the
+     sum of the squared gains is one, so that the felt strength of a
+     target doesn't depend on where it falls between motors.
+
+*/
+
+#if !defined (HAPTIC_PANNER_H_INCLUDED)
+#    define   HAPTIC_PANNER_H_INCLUDED
+
+/* ----- Includes */
+
+#include "omniwear_SDK.h"
+#include <array>
+
+/* ----- Types */
+
+namespace HapticPanner {
+
+  constexpr int C_GRID = 64;    // Cells along each axis of the map
+  constexpr int C_GAINS = 16;   // Gains per cell, padded from C_MOTORS
+
+  static_assert (C_MOTORS <= C_GAINS, "gain vector too short for the cap");
+
+  struct Table {
+    // Gains, 0-255, for each cell
+    std::array<std::array<uint8_t,C_GAINS>,C_GRID*C_GRID> cells;
+
+    // Build the table for motors at the given positions relative to
+    // the head.  The positions need not be normalized.
+    void build (const haptic_motor_t* motors, int c_motors);
+
+    // Gains for the direction (x, y, z) relative to the head.  The
+    // direction need not be normalized.
+    const uint8_t* gains (float x, float y, float z) const {
+      return &cells[cell (x, y, z)][0]; }
+
+    // The same for a direction in integers of any scale, e.g. Q1.15,
+    // for the fixed point engine.
+    const uint8_t* gains (int32_t x, int32_t y, int32_t z) const {
+      return &cells[cell (x, y, z)][0]; }
+
+    static int cell (float x, float y, float z);
+    static int cell (int32_t x, int32_t y, int32_t z);
+  };
+
+}
+
+#endif  /* HAPTIC_PANNER_H_INCLUDED */
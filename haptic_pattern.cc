@@ -0,0 +1,369 @@
+/** @file haptic_pattern.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Compilation and reading of haptic patterns.  See haptic_pattern.h.
+
+*/
+
+#include "haptic_pattern.h"
+#include "omniwear_SDK.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sstream>
+
+#if !defined (_WIN32)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+namespace {
+
+  using Frame = std::array<int,NUMBER_OF_MOTORS>;
+
+  constexpr size_t CB_BUFFER = 64*1024;
+
+  const char* motor_names[NUMBER_OF_MOTORS] = {
+    "LOW_N", "LOW_S", "LOW_E", "LOW_W", "LOW_NE", "LOW_NW", "LOW_SE",
+    "LOW_SW", "MID_N", "MID_S", "MID_E", "MID_W", "TOP",
+  };
+
+  void put_u32 (uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i)
+      p[i] = uint8_t (v >> (8*i)); }
+
+  void put_u64 (uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; ++i)
+      p[i] = uint8_t (v >> (8*i)); }
+
+  uint32_t get_u32 (const uint8_t* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i)
+      v |= uint32_t (p[i]) << (8*i);
+    return v; }
+
+  uint64_t get_u64 (const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i)
+      v |= uint64_t (p[i]) << (8*i);
+    return v; }
+
+  bool parse_int (const std::string& s, long min, long max, long& v) {
+    char* end;
+    v = strtol (s.c_str (), &end, 10);
+    return !s.empty () && !*end && v >= min && v <= max; }
+
+  // Motor index, or NUMBER_OF_MOTORS for all, or -1.
+  int parse_motor (const std::string& s) {
+    if (s == "all")
+      return NUMBER_OF_MOTORS;
+    for (int m = 0; m < NUMBER_OF_MOTORS; ++m)
+      if (s == motor_names[m])
+        return m;
+    long v;
+    return parse_int (s, 0, NUMBER_OF_MOTORS - 1, v) ? int (v) : -1; }
+
+  // Turns samples into the reports between them, tracking the duty
+  // byte each motor has on the cap.
+  struct Encoder {
+    HapticPattern::Compiled& out;
+    std::array<int,NUMBER_OF_MOTORS> duties;
+
+    explicit Encoder (HapticPattern::Compiled& out) : out (out) {
+      duties.fill (-1); }
+
+    static int to_device (int intensity) {
+      return intensity*255/100; }
+
+    int changes (const Frame& frame) const {
+      int c = 0;
+      for (int m = 0; m < NUMBER_OF_MOTORS; ++m)
+        c += duties[m] != to_device (frame[m]);
+      return c; }
+
+    void add (int64_t time_ns, const Frame& frame) {
+      if (changes (frame) > HapticPattern::C_SINGLE) {
+        std::array<int,NUMBER_OF_MOTORS> packed;
+        for (int m = 0; m < NUMBER_OF_MOTORS; ++m)
+          packed[m] = out.mapping[Omniwear::nearest_packed_code
+                                  (&out.mapping[0], frame[m])];
+
+        // A frame that quantizes to what the cap has is left out.
+        if (packed != duties) {
+          HapticPattern::Step step { time_ns, {} };
+          Omniwear::packed_report (step.report, &out.mapping[0], &frame[0],
+                                   NUMBER_OF_MOTORS);
+          out.steps.push_back (step);
+          duties = packed;
+        }
+      }
+      if (changes (frame) > HapticPattern::C_SINGLE)
+        return;
+      for (int m = 0; m < NUMBER_OF_MOTORS; ++m) {
+        if (duties[m] == to_device (frame[m]))
+          continue;
+        out.steps.push_back (HapticPattern::Step
+                             { time_ns, Omniwear::motor_report (m, frame[m]) });
+        duties[m] = to_device (frame[m]);
+      }
+    }
+  };
+
+}
+
+namespace HapticPattern {
+
+  bool compile (const std::string& source, Compiled& out,
+                std::string& error) {
+    out = Compiled ();
+    out.mapping = Omniwear::linear_mapping (127, 15, 128);
+    int rate = 50;
+    long end_ms = -1;
+    long last_ms = 0;
+
+    Frame frame {};
+    std::vector<std::pair<int64_t,Frame>> samples;
+
+    std::istringstream lines (source);
+    std::string line;
+    for (int number = 1; std::getline (lines, line); ++number) {
+      auto comment = line.find ('#');
+      if (comment != std::string::npos)
+        line.erase (comment);
+      std::istringstream words (line);
+      std::vector<std::string> w;
+      for (std::string word; words >> word; )
+        w.push_back (word);
+      if (w.empty ())
+        continue;
+
+      auto fail = [&] (const char* cause) {
+        error = "line " + std::to_string (number) + ": " + cause;
+        return false; };
+
+      long v;
+      if (w[0] == "mapping") {
+        if (w.size () == 5 && w[1] == "linear") {
+          long n, d, i;
+          if (!parse_int (w[2], -255*15, 255*15, n)
+              || !parse_int (w[3], 1, 255*15, d)
+              || !parse_int (w[4], -255, 255, i))
+            return fail ("invalid linear mapping");
+          out.mapping = Omniwear::linear_mapping (n, d, i);
+        }
+        else if (w.size () == 17) {
+          for (int i = 0; i < 16; ++i) {
+            if (!parse_int (w[1 + i], 0, 255, v))
+              return fail ("mapping duties must be from 0 to 255");
+            out.mapping[i] = uint8_t (v);
+          }
+        }
+        else
+          return fail ("mapping takes 'linear' and three values, or 16 duties");
+      }
+      else if (w[0] == "rate") {
+        if (w.size () != 2 || !parse_int (w[1], 1, 1000, v))
+          return fail ("rate must be from 1 to 1000 Hz");
+        rate = int (v);
+      }
+      else if (w[0] == "loop") {
+        if (w.size () != 1)
+          return fail ("loop takes no arguments");
+        out.loop = true;
+      }
+      else if (w[0] == "end") {
+        if (w.size () != 2 || !parse_int (w[1], 0, 24*3600*1000L, v))
+          return fail ("end takes a time in ms");
+        end_ms = v;
+      }
+      else if (parse_int (w[0], 0, 24*3600*1000L, v)) {
+        if (v < last_ms)
+          return fail ("keyframes must not go back in time");
+        if (w.size () < 4 || (w.size () & 1)
+            || (w[1] != "set" && w[1] != "ramp"))
+          return fail ("expected 'set' or 'ramp' and motor, intensity pairs");
+
+        Frame target = frame;
+        std::array<bool,NUMBER_OF_MOTORS> named {};
+        for (size_t i = 2; i < w.size (); i += 2) {
+          int motor = parse_motor (w[i]);
+          long intensity;
+          if (motor < 0)
+            return fail ("unknown motor");
+          if (!parse_int (w[i + 1], 0, 100, intensity))
+            return fail ("intensity must be from 0 to 100");
+          for (int m = 0; m < NUMBER_OF_MOTORS; ++m)
+            if (motor == m || motor == NUMBER_OF_MOTORS) {
+              target[m] = int (intensity);
+              named[m] = true;
+            }
+        }
+
+        if (w[1] == "ramp") {
+          long span = v - last_ms;
+          long c = (span*rate + 999)/1000;
+          for (long k = 1; k < c; ++k) {
+            Frame sample = frame;
+            for (int m = 0; m < NUMBER_OF_MOTORS; ++m)
+              if (named[m])
+                sample[m] = frame[m] + int (floor ((target[m] - frame[m])
+                                                   *double (k)/c + 0.5));
+            samples.push_back ({ last_ms*1000000LL + span*1000000LL*k/c,
+                                 sample });
+          }
+        }
+        frame = target;
+        samples.push_back ({ v*1000000LL, frame });
+        last_ms = v;
+      }
+      else
+        return fail ("unknown statement");
+    }
+
+    if (end_ms >= 0 && end_ms < last_ms) {
+      error = "end comes before the last keyframe";
+      return false;
+    }
+    out.duration_ns = (end_ms >= 0 ? end_ms : last_ms)*1000000LL;
+    if (out.loop && out.duration_ns == 0) {
+      error = "a pattern that loops must take time";
+      return false;
+    }
+
+    // Samples at the same time collapse into the last of them.
+    Encoder encoder (out);
+    for (size_t i = 0; i < samples.size (); ++i)
+      if (i + 1 == samples.size ()
+          || samples[i + 1].first != samples[i].first)
+        encoder.add (samples[i].first, samples[i].second);
+    return true;
+  }
+
+  bool write (const std::string& path, const Compiled& pattern) {
+    auto fp = fopen (path.c_str (), "wb");
+    if (!fp)
+      return false;
+
+    uint8_t header[CB_HEADER] = {};
+    memcpy (header, MAGIC, 8);
+    put_u32 (header + 8, VERSION);
+    put_u32 (header + 12, CB_HEADER);
+    put_u32 (header + 16, uint32_t (pattern.steps.size ()));
+    put_u32 (header + 20, pattern.loop ? FLAG_LOOP : 0);
+    put_u64 (header + 24, uint64_t (pattern.duration_ns));
+    memcpy (header + 32, &pattern.mapping[0], pattern.mapping.size ());
+    bool ok = fwrite (header, sizeof (header), 1, fp) == 1;
+
+    for (auto& step : pattern.steps) {
+      uint8_t record[CB_RECORD];
+      put_u64 (record, uint64_t (step.time_ns));
+      memcpy (record + 8, &step.report[0], CB_REPORT);
+      ok = ok && fwrite (record, sizeof (record), 1, fp) == 1;
+    }
+
+    ok = fclose (fp) == 0 && ok;
+    return ok;
+  }
+
+  File::~File () {
+    close (); }
+
+  void File::close () {
+    if (!data_)
+      return;
+#if defined (_WIN32)
+    free ((void*) data_);
+#else
+    if (mapped_)
+      munmap ((void*) data_, cb_);
+    else
+      free ((void*) data_);
+#endif
+    data_ = nullptr;
+    cb_ = 0;
+    count_ = 0;
+  }
+
+  int64_t File::time_ns (int i) const {
+    return int64_t (get_u64 (data_ + CB_HEADER + i*CB_RECORD)); }
+
+  bool File::open (const std::string& path) {
+    close ();
+
+#if !defined (_WIN32)
+    int fd = ::open (path.c_str (), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat (fd, &st) == 0 && st.st_size > 0) {
+      auto p = mmap (nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        data_ = (const uint8_t*) p;
+        cb_ = st.st_size;
+        mapped_ = true;
+      }
+    }
+    ::close (fd);
+#endif
+
+    if (!data_) {
+      auto fp = fopen (path.c_str (), "rb");
+      if (!fp)
+        return false;
+      size_t cb_alloc = 0;
+      uint8_t* p = nullptr;
+      size_t cb = 0;
+      for (;;) {
+        if (cb == cb_alloc) {
+          cb_alloc = cb_alloc ? cb_alloc*2 : CB_BUFFER;
+          auto q = (uint8_t*) realloc (p, cb_alloc);
+          if (!q)
+            break;
+          p = q;
+        }
+        auto cb_read = fread (p + cb, 1, cb_alloc - cb, fp);
+        if (!cb_read)
+          break;
+        cb += cb_read;
+      }
+      fclose (fp);
+      data_ = p;
+      cb_ = cb;
+      mapped_ = false;
+    }
+
+    if (cb_ < CB_HEADER || memcmp (data_, MAGIC, 8) != 0
+        || get_u32 (data_ + 8) != VERSION
+        || get_u32 (data_ + 12) != CB_HEADER
+        || (cb_ - CB_HEADER)/CB_RECORD < get_u32 (data_ + 16)
+        || get_u32 (data_ + 16) > INT32_MAX) {
+      close ();
+      return false;
+    }
+
+    count_ = int (get_u32 (data_ + 16));
+    loop_ = get_u32 (data_ + 20) & FLAG_LOOP;
+    duration_ns_ = int64_t (get_u64 (data_ + 24));
+
+    // The sequencer relies on the times being in order and within
+    // the pass.
+    bool ok = duration_ns_ >= 0 && !(loop_ && duration_ns_ == 0);
+    for (int i = 0; ok && i < count_; ++i)
+      ok = time_ns (i) >= (i ? time_ns (i - 1) : 0)
+        && time_ns (i) <= duration_ns_;
+    if (!ok) {
+      close ();
+      return false;
+    }
+
+    path_ = path;
+    return true;
+  }
+
+}
@@ -0,0 +1,208 @@
+/** @file haptic_pattern.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Canned haptic patterns.  A pattern is written as keyframes in a
+   text source and compiled offline by omni-pattern into a file of
+   ready-made reports, each with the time it is due.  The SDK maps
+   the file and its sequencer hands the reports to HID::write as they
+   fall due, so playing a pattern costs no mixing, quantization or
+   encoding per frame.
+
+   NOTES
+   =====
+
+   o Source.  One statement a line; '#' starts a comment.
+
+       mapping linear NUM DENOM INTERCEPT   packed mapping, as
+       mapping D0 D1 ... D15                define_packed_*
+       rate HZ                              samples a second of ramps
+       loop                                 play until stopped
+       end MS                               length of a pass
+       MS set MOTOR INTENSITY ...           step to the intensities
+       MS ramp MOTOR INTENSITY ...          ramp from the last keyframe
+
+     Times are milliseconds from the start and never go back.  MOTOR
+     is an index, one of the names LOW_N ... TOP, or 'all', and
+     INTENSITY is 0-100.  A ramp runs from the previous keyframe, or
+     from 0 ms, with the motors it names moving linearly and the
+     others holding.  The defaults are the linear mapping (127, 15,
+     128), 50 Hz, one pass, and the time of the last keyframe as the
+     length.  Every motor starts at 0.
+
+   o Reports.  Each sample becomes the reports that take the cap from
+     the previous sample to it.  When more than C_SINGLE motors
+     change, a packed report sets all of them, quantized to the
+     mapping, and the motors it quantized are then corrected by 0x10
+     reports of their exact duty if there are no more than C_SINGLE
+     of them.  The first sample always starts with a packed report,
+     so a pattern takes every motor over from whatever drove it
+     before.
+
+   o Format.  A header followed by fixed size records, little-endian,
+     so the file is mapped and read in place.
+
+       header   8   magic "OMNIPAT1"
+                4   version, 1
+                4   size of the header, 48
+                4   count of records
+                4   flags, FLAG_LOOP
+                8   length of a pass, ns
+                16  the packed mapping, a duty 0-255 for each code
+
+       record   8   time the report is due, ns from the start of a pass
+                8   the report
+
+   o Mapping.  The packed reports hold codes, so they mean what they
+     should only under the mapping they were compiled against.  The
+     SDK defines the pattern's mapping before it plays a pattern under
+     another one.
+
+   o Catching up.  A frame that is late sends the reports that fell
+     due since the last, from the last packed report among them on,
+     since it sets every motor the earlier reports set.
+
+*/
+
+#if !defined (HAPTIC_PATTERN_H_INCLUDED)
+#    define   HAPTIC_PATTERN_H_INCLUDED
+
+/* ----- Includes */
+
+#include "omniwear.h"
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/* ----- Types */
+
+namespace HapticPattern {
+
+  constexpr char MAGIC[] = "OMNIPAT1";
+  constexpr uint32_t VERSION = 1;
+  constexpr size_t CB_HEADER = 48;
+  constexpr size_t CB_RECORD = 16;
+  constexpr size_t CB_REPORT = 8;
+  constexpr uint32_t FLAG_LOOP = 1;
+  constexpr int C_SINGLE = 2;           // Changes sent as 0x10 reports
+
+  struct Step {
+    int64_t time_ns;
+    Omniwear::Report report;
+  };
+
+  struct Compiled {
+    std::array<uint8_t,16> mapping;
+    int64_t duration_ns = 0;
+    bool loop = false;
+    std::vector<Step> steps;
+  };
+
+  // Compile a pattern source.  On failure, error is set to the line
+  // and the cause.
+  bool compile (const std::string& source, Compiled&, std::string& error);
+
+  bool write (const std::string& path, const Compiled&);
+
+  // A compiled pattern.  The file is mapped where the platform allows
+  // it, and read into memory otherwise.
+  class File {
+  public:
+    ~File ();
+
+    bool open (const std::string& path);
+
+    const std::string& path () const { return path_; }
+    int count () const { return count_; }
+    int64_t duration_ns () const { return duration_ns_; }
+    bool loop () const { return loop_; }
+    const uint8_t* mapping () const { return data_ + 32; }
+
+    int64_t time_ns (int i) const;
+    const char* report (int i) const {
+      return (const char*) data_ + CB_HEADER + i*CB_RECORD + 8; }
+    bool packed (int i) const {
+      return uint8_t (*report (i)) == 0xf1; }
+
+  private:
+    std::string path_;
+    const uint8_t* data_ = nullptr;
+    size_t cb_ = 0;
+    int count_ = 0;
+    int64_t duration_ns_ = 0;
+    bool loop_ = false;
+    bool mapped_ = false;
+
+    void close ();
+  };
+
+  // Plays a File against the game time of the frames.
+  class Sequencer {
+  public:
+    void start (const File* file, double game_time) {
+      file_ = file;
+      start_ = game_time;
+      next_ = 0; }
+    void stop () {
+      file_ = nullptr; }
+    bool playing () const {
+      return file_ != nullptr; }
+
+    // Call send (report) with each report due by game_time, less
+    // those superseded by a later packed report.  Returns false once
+    // the pattern has ended.
+    template<typename F>
+    bool play (double game_time, F send);
+
+  private:
+    const File* file_ = nullptr;
+    double start_ = 0;          // Game time of the start of the pass
+    int next_ = 0;              // Next record of the pass
+  };
+
+  template<typename F>
+  bool Sequencer::play (double game_time, F send) {
+    if (!file_)
+      return false;
+
+    const int64_t duration = file_->duration_ns ();
+    for (;;) {
+      int64_t now = int64_t ((game_time - start_)*1e9);
+
+      // Skip the passes that went by without a frame.
+      if (file_->loop () && duration > 0 && now >= 2*duration) {
+        int64_t passes = now/duration - 1;
+        start_ += passes*duration*1e-9;
+        now -= passes*duration;
+        next_ = 0;
+      }
+
+      int first = next_;
+      int last = next_;
+      while (last < file_->count () && file_->time_ns (last) <= now) {
+        if (file_->packed (last))
+          first = last;
+        ++last;
+      }
+      for (int i = first; i < last; ++i)
+        send (file_->report (i));
+      next_ = last;
+
+      if (next_ < file_->count () || now < duration)
+        return true;
+      if (!file_->loop () || duration <= 0) {
+        file_ = nullptr;
+        return false;
+      }
+      start_ += duration*1e-9;
+      next_ = 0;
+    }
+  }
+
+}
+
+#endif  /* HAPTIC_PATTERN_H_INCLUDED */
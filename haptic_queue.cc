@@ -0,0 +1,235 @@
+/** @file haptic_queue.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Command queue in front of the SDK.  Any thread may queue motor,
+   effect map and radar commands without blocking.  The thread that
+   owns the haptic_device_state_t drains the queue and applies the
+   commands, so the state and the device are only touched by one
+   thread.
+
+   NOTES
+   =====
+
+   o Radar buffers.  A radar update carries a whole target list, far
+     too large for a queue cell.  The producer copies the list into
+     one of a few preallocated buffers, claimed with a
+     compare-and-swap, and queues the index of the buffer.  The owner
+     releases the buffer once the update has been applied.  When all
+     buffers are in flight, the update fails like a full queue.
+
+   o Batches.  Motor commands are coalesced while draining, the last
+     intensity queued for a motor wins, and are sent with one call to
+     command_haptic_motors at the end of the drain.  Effect map and
+     radar commands are applied in order as they are drained.
+
+*/
+
+#include "omniwear_SDK.h"
+#include "log_ring.h"
+#include "mpsc_ring.h"
+#include <array>
+#include <atomic>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+
+#define DBG(a ...) \
+//  printf(a)
+
+namespace {
+
+  constexpr int C_RADAR_BUFFERS = 4;
+
+  enum CommandKind {
+    command_motor,
+    command_effect,
+    command_clear_effect,
+    command_radar,
+  };
+
+  struct Command {
+    CommandKind kind;
+    union {
+      struct {
+        int motor;
+        int intensity;
+      } motor;
+      struct {
+        int target_type;
+        haptic_effect_t haptic_effect;
+        float period;
+      } effect;
+      int radar;                // Index of the radar buffer
+    };
+  };
+
+  struct RadarBuffer {
+    std::atomic<bool> busy { false };
+    int len = 0;
+    vec3_t player_origin;
+    vec3_t player_viewangles_deg;
+    haptic_target_t targets[MAX_TARGETS];
+  };
+
+}
+
+struct haptic_command_queue_s {
+  haptic_device_state_t* state;
+  MpscRing<Command> ring;
+  std::array<RadarBuffer,C_RADAR_BUFFERS> radar;
+
+  haptic_command_queue_s (haptic_device_state_t* state, int capacity)
+    : state (state), ring (capacity) {}
+};
+
+haptic_command_queue_t* create_haptic_command_queue (haptic_device_state_t*
+                                                     state, int capacity) {
+  if (!state || capacity <= 0) {
+    OMNI_LOG (OMNI_LOG_ERROR, "***ERR: invalid state or capacity");
+    return nullptr;
+  }
+  return new (std::nothrow) haptic_command_queue_s (state, capacity);
+}
+
+void destroy_haptic_command_queue (haptic_command_queue_t* queue) {
+  delete queue; }
+
+OMNI_RESULT queue_haptic_motor (haptic_command_queue_t* queue,
+                                int motor, int intensity) {
+  if (!queue)
+    return OMNI_ERROR_NULL_STATE;
+  if (motor < 0 || motor >= C_MOTORS)
+    return OMNI_ERROR_INVALID_MOTOR;
+  if (intensity < 0 || intensity > 100)
+    return OMNI_ERROR_INTENSITY_OUT_OF_RANGE;
+
+  Command command;
+  command.kind = command_motor;
+  command.motor.motor = motor;
+  command.motor.intensity = intensity;
+  return queue->ring.push (command) ? OMNI_SUCCESS : OMNI_ERROR_QUEUE_FULL;
+}
+
+OMNI_RESULT queue_haptic_effect (haptic_command_queue_t* queue,
+                                 int target_type,
+                                 haptic_effect_t haptic_effect,
+                                 float period) {
+  if (!queue)
+    return OMNI_ERROR_NULL_STATE;
+
+  Command command;
+  command.kind = command_effect;
+  command.effect.target_type = target_type;
+  command.effect.haptic_effect = haptic_effect;
+  command.effect.period = period;
+  return queue->ring.push (command) ? OMNI_SUCCESS : OMNI_ERROR_QUEUE_FULL;
+}
+
+OMNI_RESULT queue_clear_haptic_effect (haptic_command_queue_t* queue,
+                                       int target_type) {
+  if (!queue)
+    return OMNI_ERROR_NULL_STATE;
+
+  Command command;
+  command.kind = command_clear_effect;
+  command.effect.target_type = target_type;
+  return queue->ring.push (command) ? OMNI_SUCCESS : OMNI_ERROR_QUEUE_FULL;
+}
+
+OMNI_RESULT queue_haptic_radar (haptic_command_queue_t* queue,
+                                const haptic_target_t targets[],
+                                int targets_len,
+                                const vec3_t player_origin,
+                                const vec3_t player_viewangles_deg) {
+  if (!queue)
+    return OMNI_ERROR_NULL_STATE;
+  if (targets_len < 0 || targets_len > MAX_TARGETS
+      || (targets_len && !targets) || !player_origin
+      || !player_viewangles_deg)
+    return OMNI_ERROR_INVALID_ARGUMENT;
+
+  for (int i = 0; i < C_RADAR_BUFFERS; ++i) {
+    auto& buffer = queue->radar[i];
+    bool busy = false;
+    if (!buffer.busy.compare_exchange_strong (busy, true,
+                                              std::memory_order_acquire))
+      continue;
+
+    buffer.len = targets_len;
+    memcpy (buffer.player_origin, player_origin,
+            sizeof (buffer.player_origin));
+    memcpy (buffer.player_viewangles_deg, player_viewangles_deg,
+            sizeof (buffer.player_viewangles_deg));
+    if (targets_len)
+      memcpy (buffer.targets, targets, targets_len*sizeof (targets[0]));
+
+    Command command;
+    command.kind = command_radar;
+    command.radar = i;
+    if (queue->ring.push (command))
+      return OMNI_SUCCESS;
+
+    buffer.busy.store (false, std::memory_order_release);
+    break;
+  }
+  return OMNI_ERROR_QUEUE_FULL;
+}
+
+int drain_haptic_command_queue (haptic_command_queue_t* queue,
+                                int max_commands) {
+  if (!queue)
+    return 0;
+
+  auto state = queue->state;
+  int intensities[C_MOTORS];
+  bool pending[C_MOTORS] = {};
+
+  int count = 0;
+  Command command;
+  while ((max_commands <= 0 || count < max_commands)
+         && queue->ring.pop (command)) {
+    ++count;
+    switch (command.kind) {
+    case command_motor:
+      intensities[command.motor.motor] = command.motor.intensity;
+      pending[command.motor.motor] = true;
+      break;
+
+    case command_effect:
+      set_haptic_effect (state, command.effect.target_type,
+                         command.effect.haptic_effect, command.effect.period);
+      break;
+
+    case command_clear_effect:
+      clear_haptic_effect (state, command.effect.target_type);
+      break;
+
+    case command_radar:
+      {
+        auto& buffer = queue->radar[command.radar];
+        update_haptic_radar (state, buffer.targets, buffer.len,
+                             buffer.player_origin,
+                             buffer.player_viewangles_deg);
+        buffer.busy.store (false, std::memory_order_release);
+      }
+      break;
+    }
+  }
+
+  haptic_motor_config_t configs[C_MOTORS];
+  int config_count = 0;
+  for (int motor = 0; motor < C_MOTORS; ++motor)
+    if (pending[motor]) {
+      configs[config_count].motor = motor;
+      configs[config_count].intensity = intensities[motor];
+      ++config_count;
+    }
+  if (config_count)
+    command_haptic_motors (state, configs, config_count);
+
+  DBG ("=== %s: %d commands, %d motors\n", __FUNCTION__, count, config_count);
+  return count;
+}
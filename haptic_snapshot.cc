@@ -0,0 +1,219 @@
+/** @file haptic_snapshot.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Snapshot of the scene published by one thread, usually the game's,
+   and applied by the thread that owns the haptic_device_state_t at
+   its own rate.  Only the latest snapshot matters, so unlike the
+   command queue nothing waits to be applied; a snapshot that is
+   published before the previous one was applied replaces it.
+
+   NOTES
+   =====
+
+   o Seqlock.  There are two slots, each with a sequence number that
+     is odd while the slot is being written.  The publisher writes
+     the slot it didn't write last, so the most recently published
+     snapshot is never overwritten by the next publish, only by the
+     one after it.  The reader copies the latest slot and checks that
+     its sequence number is even and didn't change during the copy.
+     A torn copy means the publisher lapped the reader.  The reader
+     then retries with the newer snapshot, up to C_TRIES times, and
+     gives up until the next apply.  Neither side waits or takes a
+     lock.
+
+   o Memory model.  The copy reads memory that the publisher may be
+     writing at the same moment.  The acquire fence after the copy
+     and the release fence before the writes make a torn copy show up
+     in the sequence number; the torn copy is discarded without being
+     used.  This is the usual seqlock, and it is what the Linux
+     kernel does, though strictly the concurrent plain accesses are a
+     data race in C++.
+
+   o Allocation.  The slots and the reader's copy are allocated with
+     the snapshot.  publish and apply copy into them and don't
+     allocate, nor does update_haptic_radar once the state has seen
+     its first update.
+
+   o Effect maps.  A snapshot may carry the effect maps.  apply
+     brings the state's maps to match with set_haptic_effect and
+     clear_haptic_effect, and only when they differ from the maps it
+     applied last, so unchanged maps cost a compare.
+
+   o One publisher.  publish_haptic_snapshot may be called from any
+     thread, but from one at a time.
+
+*/
+
+#include "omniwear_SDK.h"
+#include "log_ring.h"
+#include <array>
+#include <atomic>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+
+#define DBG(a ...) \
+//  printf(a)
+
+namespace {
+
+  constexpr int C_TRIES = 4;
+
+  struct Scene {
+    int len = 0;
+    vec3_t player_origin;
+    vec3_t player_viewangles_deg;
+    haptic_target_t targets[MAX_TARGETS];
+    bool has_maps = false;
+    int maps_len = 0;
+    haptic_effect_map_t maps[MAX_TARGETS];
+  };
+
+  struct Slot {
+    std::atomic<uint32_t> sequence { 0 };
+    Scene scene;
+  };
+
+  // Copy the parts of a scene that are in use.
+  void copy_scene (Scene& to, const Scene& from) {
+    int len = from.len;
+    len = len < 0 ? 0 : len > MAX_TARGETS ? MAX_TARGETS : len;
+    int maps_len = from.maps_len;
+    maps_len = maps_len < 0 ? 0 : maps_len > MAX_TARGETS ? MAX_TARGETS
+      : maps_len;
+    to.len = len;
+    memcpy (to.player_origin, from.player_origin,
+            sizeof (to.player_origin));
+    memcpy (to.player_viewangles_deg, from.player_viewangles_deg,
+            sizeof (to.player_viewangles_deg));
+    memcpy (to.targets, from.targets, len*sizeof (to.targets[0]));
+    to.has_maps = from.has_maps;
+    to.maps_len = maps_len;
+    memcpy (to.maps, from.maps, maps_len*sizeof (to.maps[0]));
+  }
+
+  bool same_maps (const Scene& a, const Scene& b) {
+    return a.maps_len == b.maps_len
+      && !memcmp (a.maps, b.maps, a.maps_len*sizeof (a.maps[0])); }
+
+}
+
+struct haptic_snapshot_s {
+  haptic_device_state_t* state;
+  std::array<Slot,2> slots;
+  std::atomic<uint64_t> published { 0 }; // Generation of the latest
+
+  // Publisher
+  uint64_t generation = 0;
+
+  // Owner of the state
+  uint64_t applied = 0;         // Generation last applied
+  Scene copy;
+  Scene applied_maps;           // Only the effect maps last applied
+
+  explicit haptic_snapshot_s (haptic_device_state_t* state)
+    : state (state) {}
+};
+
+haptic_snapshot_t* create_haptic_snapshot (haptic_device_state_t* state) {
+  if (!state) {
+    OMNI_LOG (OMNI_LOG_ERROR, "***ERR: invalid state");
+    return nullptr;
+  }
+  return new (std::nothrow) haptic_snapshot_s (state);
+}
+
+void destroy_haptic_snapshot (haptic_snapshot_t* snapshot) {
+  delete snapshot; }
+
+OMNI_RESULT publish_haptic_snapshot (haptic_snapshot_t* snapshot,
+                                     const haptic_target_t targets[],
+                                     int targets_len,
+                                     const vec3_t player_origin,
+                                     const vec3_t player_viewangles_deg,
+                                     const haptic_effect_map_t effect_maps[],
+                                     int effect_maps_len) {
+  if (!snapshot)
+    return OMNI_ERROR_NULL_STATE;
+  if (targets_len < 0 || targets_len > MAX_TARGETS
+      || (targets_len && !targets) || !player_origin
+      || !player_viewangles_deg
+      || (effect_maps && (effect_maps_len < 0
+                          || effect_maps_len > MAX_TARGETS)))
+    return OMNI_ERROR_INVALID_ARGUMENT;
+
+  const uint64_t generation = ++snapshot->generation;
+  auto& slot = snapshot->slots[generation & 1];
+  const uint32_t sequence = slot.sequence.load (std::memory_order_relaxed);
+  slot.sequence.store (sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence (std::memory_order_release);
+
+  auto& scene = slot.scene;
+  scene.len = targets_len;
+  memcpy (scene.player_origin, player_origin, sizeof (scene.player_origin));
+  memcpy (scene.player_viewangles_deg, player_viewangles_deg,
+          sizeof (scene.player_viewangles_deg));
+  if (targets_len)
+    memcpy (scene.targets, targets, targets_len*sizeof (targets[0]));
+  scene.has_maps = effect_maps != nullptr;
+  scene.maps_len = effect_maps ? effect_maps_len : 0;
+  if (scene.maps_len)
+    memcpy (scene.maps, effect_maps, scene.maps_len*sizeof (effect_maps[0]));
+
+  slot.sequence.store (sequence + 2, std::memory_order_release);
+  snapshot->published.store (generation, std::memory_order_release);
+  return OMNI_SUCCESS;
+}
+
+int apply_haptic_snapshot (haptic_snapshot_t* snapshot) {
+  if (!snapshot)
+    return 0;
+
+  auto& copy = snapshot->copy;
+  uint64_t generation = 0;
+  bool consistent = false;
+  for (int i = 0; i < C_TRIES && !consistent; ++i) {
+    generation = snapshot->published.load (std::memory_order_acquire);
+    if (generation == snapshot->applied)
+      return 0;
+
+    auto& slot = snapshot->slots[generation & 1];
+    const uint32_t sequence = slot.sequence.load (std::memory_order_acquire);
+    if (sequence & 1)
+      continue;
+    copy_scene (copy, slot.scene);
+    std::atomic_thread_fence (std::memory_order_acquire);
+    consistent = slot.sequence.load (std::memory_order_relaxed) == sequence;
+  }
+  if (!consistent) {
+    DBG ("=== %s: lapped by the publisher\n", __FUNCTION__);
+    return 0;
+  }
+  snapshot->applied = generation;
+
+  auto state = snapshot->state;
+  auto& applied = snapshot->applied_maps;
+  if (copy.has_maps && (!applied.has_maps || !same_maps (copy, applied))) {
+    for (int i = state->haptic_effect_maps_len; i-- > 0; ) {
+      int target_type = state->haptic_effect_maps[i].target_type;
+      bool kept = false;
+      for (int j = 0; j < copy.maps_len && !kept; ++j)
+        kept = copy.maps[j].target_type == target_type;
+      if (!kept)
+        clear_haptic_effect (state, target_type);
+    }
+    for (int j = 0; j < copy.maps_len; ++j)
+      set_haptic_effect (state, copy.maps[j].target_type,
+                         copy.maps[j].haptic_effect, copy.maps[j].period);
+    applied.has_maps = true;
+    applied.maps_len = copy.maps_len;
+    memcpy (applied.maps, copy.maps, copy.maps_len*sizeof (copy.maps[0]));
+  }
+
+  update_haptic_radar (state, copy.targets, copy.len, copy.player_origin,
+                       copy.player_viewangles_deg);
+  return 1;
+}
@@ -0,0 +1,90 @@
+/** @file hid-hooks.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Instrumentation and helpers shared by the platform implementations
+   of HID::write.  Each implementation calls write_begin() before it
+   hands the report to the OS and write_end() once the OS has
+   completed it, so that what we measure doesn't depend on the
+   platform.
+
+   Deferred holds the completions of asynchronous writes until
+   service() delivers them, on the platforms that finish the write
+   before write_async returns and on those whose OS completes it
+   outside service().
+
+*/
+
+#if !defined (HID_HOOKS_H_INCLUDED)
+#    define   HID_HOOKS_H_INCLUDED
+
+/* ----- Includes */
+
+#include "hid.h"
+#include "capture.h"
+#include "probes.h"
+#include "telemetry.h"
+#include "trace.h"
+#include <stddef.h>
+#include <vector>
+
+/* ----- Types */
+
+namespace HID {
+  namespace Hooks {
+
+    inline int64_t write_begin (const char* rgb, size_t cb) {
+      OMNI_PROBE2 (hid_write_entry, cb ? uint8_t (rgb[0]) : -1, cb);
+      Telemetry::count (Telemetry::hid_writes_submitted);
+      auto start_ns = Telemetry::now_ns ();
+      if (Capture::enabled ())
+        Capture::record (start_ns, rgb, cb);
+      return start_ns; }
+
+    inline void write_end (int64_t start_ns, const char* rgb, size_t cb,
+                           bool success) {
+      OMNI_PROBE3 (hid_write_return, cb ? uint8_t (rgb[0]) : -1, cb,
+                   int (success));
+      auto end_ns = Telemetry::now_ns ();
+      Telemetry::record (Telemetry::hid_write_ns, end_ns - start_ns);
+      if (Trace::enabled ())
+        Trace::record ("HID::write", start_ns, end_ns,
+                       "report", cb ? uint8_t (rgb[0]) : -1, "bytes", cb);
+      if (success) {
+        Telemetry::count (Telemetry::hid_writes_completed);
+        Telemetry::count (Telemetry::hid_bytes_written, cb);
+      }
+      else
+        Telemetry::count (Telemetry::hid_writes_failed);
+    }
+
+    struct Deferred {
+      struct Completion {
+        WriteDone done;
+        void* context;
+        int result;
+      };
+      std::vector<Completion> pending;
+      std::vector<Completion> delivering;
+
+      void push (WriteDone done, void* context, int result) {
+        pending.push_back (Completion { done, context, result }); }
+
+      // Call the pending completions.  A completion may submit
+      // another write; that one waits for the next call.
+      bool deliver () {
+        if (pending.empty ())
+          return false;
+        pending.swap (delivering);
+        for (auto& c : delivering)
+          c.done (c.context, c.result);
+        delivering.clear ();
+        return true; }
+    };
+
+  }
+}
+
+#endif  /* HID_HOOKS_H_INCLUDED */
@@ -11,12 +11,23 @@
 
    Linux implementation of our HID interface.
 
+   NOTES
+   =====
+
+   o Asynchronous writes are libusb interrupt transfers on the same
+     endpoint as write().  libusb calls the transfer's callback from
+     any of its event handling, including the synchronous transfer in
+     write(), so the callback only queues the completion and service()
+     delivers it, as on the other platforms.
+
 */
 
 #include "hid.h"
+#include "hid-hooks.h"
 #include <libusb-1.0/libusb.h>
 
 #include <string.h>
+#include <sys/time.h>
 #include <functional>
 #include <iostream>
 #include <iomanip>
@@ -28,8 +39,34 @@ namespace {
   bool init_;
 
   libusb_context* ctx$;
+  HID::Hooks::Deferred deferred$;
 
   static constexpr auto MS_TIMEOUT = 10000;
+  static constexpr size_t CB_REPORT_MAX = 64;
+
+  // An asynchronous write in flight.  The report is copied here
+  // because libusb reads it when it sends the transfer, not when we
+  // submit it.
+  struct Write {
+    libusb_transfer* transfer;
+    HID::WriteDone done;
+    void* context;
+    int64_t start_ns;
+    uint8_t report[CB_REPORT_MAX];
+  };
+
+  void complete_write (libusb_transfer* transfer) {
+    auto w = static_cast<Write*> (transfer->user_data);
+    bool success = transfer->status == LIBUSB_TRANSFER_COMPLETED;
+    int result = success ? transfer->actual_length : -1;
+    OMNI_PROBE2 (libusb_complete, int (transfer->status),
+                 transfer->actual_length);
+    HID::Hooks::write_end (w->start_ns, (const char*) w->report,
+                           success ? transfer->actual_length : 0, success);
+    ::libusb_free_transfer (transfer);
+    deferred$.push (w->done, w->context, result);
+    delete w;
+  }
 
   namespace USB {
     using Device = struct libusb_device;
@@ -236,11 +273,22 @@ namespace HID {
 
   int write (const Device* d, const char* rgbPayload, size_t cbPayload) {
 #if 1
+    auto start_ns = Hooks::write_begin (rgbPayload, cbPayload);
     int cbWritten = 0;
-    auto result = ::libusb_interrupt_transfer (d->impl_->device_handle_,
-                                               2, (uint8_t*) rgbPayload,
-                                               cbPayload,
-                                               &cbWritten, MS_TIMEOUT);
+    int result;
+    {
+      Trace::Span span ("libusb_interrupt_transfer");
+      result = ::libusb_interrupt_transfer (d->impl_->device_handle_,
+                                            2, (uint8_t*) rgbPayload,
+                                            cbPayload,
+                                            &cbWritten, MS_TIMEOUT);
+      span.arg (0, "status", result);
+    }
+    OMNI_PROBE2 (libusb_complete, result, cbWritten);
+    Hooks::write_end (start_ns, rgbPayload, cbWritten, result == 0);
+    // Like the other platforms, return the bytes written on success.
+    if (result == 0)
+      result = cbWritten;
 //    printf ("write %d %d\n", result, cbWritten);
 #else
     static const int CONTROL_REQUEST_TYPE_OUT
@@ -259,4 +307,35 @@ namespace HID {
     return result;
   }
 
+  bool write_async (const Device* d, const char* rgb, size_t cb,
+                    WriteDone done, void* context) {
+    if (!d || !done || cb > CB_REPORT_MAX)
+      return false;
+    auto transfer = ::libusb_alloc_transfer (0);
+    if (!transfer)
+      return false;
+    auto w = new Write { transfer, done, context };
+    memcpy (w->report, rgb, cb);
+    w->start_ns = Hooks::write_begin (rgb, cb);
+    ::libusb_fill_interrupt_transfer (transfer, d->impl_->device_handle_, 2,
+                                      w->report, cb, complete_write, w,
+                                      MS_TIMEOUT);
+    if (::libusb_submit_transfer (transfer) < 0) {
+      Hooks::write_end (w->start_ns, rgb, 0, false);
+      ::libusb_free_transfer (transfer);
+      delete w;
+      return false;
+    }
+    return true;
+  }
+
+  bool service () {
+    if (!init ())
+      return false;
+    timeval zero = { 0, 0 };
+    ::libusb_handle_events_timeout_completed (ctx$, &zero, nullptr);
+    deferred$.deliver ();
+    return true;
+  }
+
 }
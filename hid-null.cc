@@ -0,0 +1,122 @@
+/** @file hid-null.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Null implementation of our HID interface.  There is always exactly
+   one device, an Omniwear cap, and it accepts every report
+   immediately and never has anything to read.  Benchmarks link with
+   this in place of a platform implementation so that they measure
+   our own code and not the USB stack.
+
+   NOTES
+   =====
+
+   o Writes go through the same hooks as the platform
+     implementations, so telemetry and traces of a benchmark count
+     the reports that would have been sent.
+
+   o Digest.  Each thread keeps a count and a digest of the reports
+     it writes, see hid-null.h, so that the sink needs no lock.
+
+   o Asynchronous writes are accepted immediately as well, and their
+     completions wait for the service() call of the thread that
+     submitted them.
+
+*/
+
+#include "hid.h"
+#include "hid-hooks.h"
+#include "hid-null.h"
+
+namespace {
+  constexpr uint16_t VID = 0x3eb;
+  constexpr uint16_t PID = 0x2402;
+  const char PATH[] = "null";
+
+  constexpr uint64_t FNV_BASIS = 0xcbf29ce484222325ULL;
+  constexpr uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+  thread_local uint64_t reports$;
+  thread_local uint64_t digest$ = FNV_BASIS;
+  thread_local HID::Hooks::Deferred deferred$;
+
+  void hash (uint8_t b) {
+    digest$ = (digest$ ^ b)*FNV_PRIME; }
+}
+
+namespace HID {
+
+  struct Device::Impl {};
+
+  Device::Device () {
+    impl_ = std::make_unique<Device::Impl> (); }
+  Device::~Device () {}         // Required for unique_ptr Impl
+
+  bool init () {
+    return true; }
+
+  void release () {}
+
+  DevicesP enumerate (uint16_t vid, uint16_t pid) {
+    auto devices
+      = std::make_unique <std::vector<std::unique_ptr<HID::DeviceInfo>>>();
+    if ((!vid || vid == VID) && (!pid || pid == PID))
+      devices->push_back (std::make_unique<HID::DeviceInfo>
+                          (VID, PID, PATH, "", 0, "Omniwear", "Null"));
+    return devices; }
+
+  DeviceP open (uint16_t vid, uint16_t pid, const std::string& serial) {
+    if (vid != VID || (pid && pid != PID) || !serial.empty ())
+      return nullptr;
+    return std::make_unique<HID::Device> (); }
+
+  DeviceP open (const std::string& path) {
+    if (path != PATH)
+      return nullptr;
+    return std::make_unique<HID::Device> (); }
+
+  int write (const Device* device, uint8_t report, const char* rgb, size_t cb) {
+    if (!device)
+      return -1;
+    auto start_ns = Hooks::write_begin (rgb, cb);
+    ++reports$;
+    hash (uint8_t (cb));
+    for (size_t i = 0; i < cb; ++i)
+      hash (uint8_t (rgb[i]));
+    Hooks::write_end (start_ns, rgb, cb, true);
+    return cb; }
+
+  int write (const Device* device, const char* rgb, size_t cb) {
+    return write (device, 0, rgb, cb); }
+
+  int read (const Device* device, char* rgb, size_t cb) {
+    return 0; }
+
+  bool write_async (const Device* device, const char* rgb, size_t cb,
+                    WriteDone done, void* context) {
+    if (!device || !done)
+      return false;
+    deferred$.push (done, context, write (device, 0, rgb, cb));
+    return true; }
+
+  bool service () {
+    deferred$.deliver ();
+    return true; }
+
+  namespace Null {
+
+    uint64_t reports () {
+      return reports$; }
+
+    uint64_t digest () {
+      return digest$; }
+
+    void reset () {
+      reports$ = 0;
+      digest$ = FNV_BASIS; }
+
+  }
+
+}
@@ -0,0 +1,34 @@
+/** @file hid-null.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Inspection of the reports written to the null HID sink in
+   hid-null.cc, so that tests and replays can tell whether two runs
+   sent the same reports.
+
+*/
+
+#if !defined (HID_NULL_H_INCLUDED)
+#    define   HID_NULL_H_INCLUDED
+
+/* ----- Includes */
+
+#include <stdint.h>
+
+/* ----- Types */
+
+namespace HID {
+  namespace Null {
+
+    // Count and FNV-1a digest of the reports written by the calling
+    // thread since the last reset.
+    uint64_t reports ();
+    uint64_t digest ();
+    void reset ();
+
+  }
+}
+
+#endif  /* HID_NULL_H_INCLUDED */
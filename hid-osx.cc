@@ -28,6 +28,7 @@
 */
 
 #include "hid.h"
+#include "hid-hooks.h"
 
 // From featureful implementation
 #include <IOKit/IOCFPlugIn.h>
@@ -143,6 +144,7 @@ namespace OSXHID {
 }
 
 namespace {
+  HID::Hooks::Deferred deferred$;
   IOHIDManagerRef hid_manager;
   auto constexpr MS_TIMEOUT = 10*1000;
 }
@@ -295,10 +297,12 @@ namespace HID {
   int write (const Device* device, uint8_t report, const char* rgb, size_t cb) {
     if (!device)
       return -1;
+    auto start_ns = Hooks::write_begin (rgb, cb);
     auto result = IOHIDDeviceSetReport (device->impl_->os_dev_,
                                         kIOHIDReportTypeOutput,
                                         report,
                                         (uint8_t*) rgb, cb);
+    Hooks::write_end (start_ns, rgb, cb, result == kIOReturnSuccess);
     return result == kIOReturnSuccess ? cb : -1; }
 
   int write (const Device* device, const char* rgb, size_t cb) {
@@ -315,10 +319,21 @@ namespace HID {
                                         (uint8_t*) rgb, &count);
     return result == kIOReturnSuccess ? count : -1; }
 
+  // IOHIDDeviceSetReport blocks, so the write is complete before we
+  // return and only its completion is deferred.
+  bool write_async (const Device* device, const char* rgb, size_t cb,
+                    WriteDone done, void* context) {
+    if (!device || !done)
+      return false;
+    deferred$.push (done, context, write (device, 0, rgb, cb));
+    return true; }
+
   bool service () {
     if (!init ())
       return false;
 
+    deferred$.deliver ();
+
     // *** FIXME: this should terminate even if there are events, no?
     while (1) {
       switch (CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0.001, FALSE)) {
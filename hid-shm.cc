@@ -0,0 +1,194 @@
+/** @file hid-shm.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Client implementation of our HID interface over the hub of
+   omni-daemon, see hid-shm.h.  There is one device, the cap that the
+   daemon owns, for as long as the daemon runs.  Opening it claims a
+   slot in the hub and writing puts the report in the slot's ring.
+
+   NOTES
+   =====
+
+   o Writes don't wait for the cap.  A write succeeds once the report
+     is in the ring, and fails when the ring is full, which means the
+     daemon has fallen C_RING reports behind, or when the daemon has
+     gone.  The hooks therefore time the submission, not the wire.
+
+   o A slot's ring carries on from its last owner.  Only the daemon
+     moves the head, so resetting the ring on open would race with a
+     drain of the last owner's reports.  Instead the client records
+     where its reports start, and the daemon skips what comes before.
+
+   o Asynchronous writes complete at once, like those of the null
+     sink, and their completions wait for service().
+
+*/
+
+#include "hid.h"
+#include "hid-hooks.h"
+#include "hid-shm.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <mutex>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+  constexpr uint16_t VID = 0x3eb;
+  constexpr uint16_t PID = 0x2402;
+  const char PATH[] = "shm";
+
+  thread_local HID::Hooks::Deferred deferred$;
+
+  // Map the hub of a running daemon, or return null.
+  HID::Shm::Hub* map_hub () {
+    int fd = shm_open (HID::Shm::NAME, O_RDWR, 0);
+    if (fd < 0)
+      return nullptr;
+    auto p = mmap (nullptr, sizeof (HID::Shm::Hub), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+    close (fd);
+    if (p == MAP_FAILED)
+      return nullptr;
+    auto hub = static_cast<HID::Shm::Hub*> (p);
+    auto daemon = hub->daemon_pid.load (std::memory_order_acquire);
+    if (hub->magic != HID::Shm::MAGIC || hub->version != HID::Shm::VERSION
+        || daemon <= 0 || (kill (daemon, 0) && errno == ESRCH)) {
+      munmap (p, sizeof (HID::Shm::Hub));
+      return nullptr;
+    }
+    return hub; }
+
+  int priority () {
+    auto s = getenv ("OMNIWEAR_PRIORITY");
+    int v = s ? atoi (s) : 0;
+    return v < HID::Shm::MIN_PRIORITY ? HID::Shm::MIN_PRIORITY
+      : v > HID::Shm::MAX_PRIORITY ? HID::Shm::MAX_PRIORITY : v; }
+}
+
+namespace HID {
+
+  struct Device::Impl {
+    Shm::Hub* hub = nullptr;
+    Shm::Slot* slot = nullptr;
+    std::mutex lock;            // Guards the tail of the ring
+
+    ~Impl () {
+      if (slot)
+        slot->state.store (Shm::slot_free, std::memory_order_release);
+      if (hub) {
+        Shm::wake (hub->doorbell);
+        munmap (hub, sizeof (Shm::Hub));
+      }
+    }
+  };
+
+  Device::Device () {
+    impl_ = std::make_unique<Device::Impl> (); }
+  Device::~Device () {}         // Required for unique_ptr Impl
+
+  bool init () {
+    return true; }
+
+  void release () {}
+
+  DevicesP enumerate (uint16_t vid, uint16_t pid) {
+    auto devices
+      = std::make_unique <std::vector<std::unique_ptr<HID::DeviceInfo>>>();
+    if ((!vid || vid == VID) && (!pid || pid == PID)) {
+      if (auto hub = map_hub ()) {
+        munmap (hub, sizeof (Shm::Hub));
+        devices->push_back (std::make_unique<HID::DeviceInfo>
+                            (VID, PID, PATH, "", 0, "Omniwear",
+                             "omni-daemon"));
+      }
+    }
+    return devices; }
+
+  DeviceP open (uint16_t vid, uint16_t pid, const std::string& serial) {
+    if (vid != VID || (pid && pid != PID) || !serial.empty ())
+      return nullptr;
+    return open (PATH); }
+
+  DeviceP open (const std::string& path) {
+    if (path != PATH)
+      return nullptr;
+    auto hub = map_hub ();
+    if (!hub)
+      return nullptr;
+
+    auto d = std::make_unique<HID::Device> ();
+    d->impl_->hub = hub;
+    for (auto& slot : hub->slots) {
+      uint32_t state = Shm::slot_free;
+      if (!slot.state.compare_exchange_strong (state, Shm::slot_claimed,
+                                               std::memory_order_acq_rel))
+        continue;
+      slot.generation.fetch_add (1, std::memory_order_relaxed);
+      slot.pid.store (getpid (), std::memory_order_relaxed);
+      slot.priority.store (priority (), std::memory_order_relaxed);
+      slot.start.store (slot.tail.load (std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+      slot.state.store (Shm::slot_live, std::memory_order_release);
+      d->impl_->slot = &slot;
+      return d;
+    }
+    return nullptr;             // Every slot taken
+  }
+
+  int write (const Device* device, uint8_t report, const char* rgb, size_t cb) {
+    if (!device || !device->impl_->slot || cb > Shm::CB_REPORT)
+      return -1;
+    auto& impl = *device->impl_;
+    auto& slot = *impl.slot;
+    auto start_ns = Hooks::write_begin (rgb, cb);
+
+    bool queued = false;
+    {
+      std::lock_guard<std::mutex> guard (impl.lock);
+      auto tail = slot.tail.load (std::memory_order_relaxed);
+      if (tail - slot.head.load (std::memory_order_acquire) < Shm::C_RING) {
+        auto& entry = slot.ring[tail & (Shm::C_RING - 1)];
+        entry.time_ns = start_ns;
+        memset (entry.report, 0, sizeof (entry.report));
+        memcpy (entry.report, rgb, cb);
+        slot.tail.store (tail + 1, std::memory_order_release);
+        queued = true;
+      }
+    }
+
+    // Pairs with the fence of the daemon between setting sleeping and
+    // looking at the rings a last time.
+    std::atomic_thread_fence (std::memory_order_seq_cst);
+    if (queued && impl.hub->sleeping.load (std::memory_order_relaxed)) {
+      impl.hub->doorbell.fetch_add (1, std::memory_order_relaxed);
+      Shm::wake (impl.hub->doorbell);
+    }
+
+    Hooks::write_end (start_ns, rgb, cb, queued);
+    return queued ? int (cb) : -1; }
+
+  int write (const Device* device, const char* rgb, size_t cb) {
+    return write (device, 0, rgb, cb); }
+
+  int read (const Device* device, char* rgb, size_t cb) {
+    return 0; }
+
+  bool write_async (const Device* device, const char* rgb, size_t cb,
+                    WriteDone done, void* context) {
+    if (!device || !done)
+      return false;
+    deferred$.push (done, context, write (device, 0, rgb, cb));
+    return true; }
+
+  bool service () {
+    deferred$.deliver ();
+    return true; }
+
+}
@@ -0,0 +1,123 @@
+/** @file hid-shm.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Shared memory between omni-daemon, which owns the cap, and the
+   processes that drive it through the daemon.  A client links
+   hid-shm.cc in place of the platform HID implementation, so the SDK
+   and the tools work unchanged: HID::open claims a slot in the hub
+   and HID::write puts the report in the slot's ring.  The daemon
+   takes the reports out, arbitrates between the clients, see
+   haptic_arbiter.h, and writes the result to the cap.
+
+   NOTES
+   =====
+
+   o Layout.  The hub is one shared memory object, NAME, created by
+     the daemon.  It holds C_CLIENTS slots, each with a ring of
+     C_RING reports and the head and tail of the ring on cache lines
+     of their own.  Everything a process shares is a lock-free atomic
+     of fixed size, so the hub means the same in every process that
+     maps it.
+
+   o Single producer.  A slot belongs to one client process, which
+     writes its ring under a lock of its own.  A client that dies
+     stalls nothing but its own slot, which the daemon frees when it
+     finds the process gone.
+
+   o Trust.  The hub is writable by every local user, so the daemon
+     checks what it reads.  A slot whose tail is more than C_RING
+     ahead of the head is broken and freed.
+
+   o Wakeups.  The daemon sleeps on the futex doorbell when every
+     ring is empty, having first set sleeping.  A client that
+     publishes a report while sleeping is set rings the doorbell and
+     wakes it.  While the daemon is busy, a report costs the client
+     no system call.
+
+   o Priority.  A client's priority is read from OMNIWEAR_PRIORITY
+     when it opens the hub, -100 to 100 and 0 by default.
+
+   o Linux only, for futexes.
+
+*/
+
+#if !defined (HID_SHM_H_INCLUDED)
+#    define   HID_SHM_H_INCLUDED
+
+/* ----- Includes */
+
+#include <atomic>
+#include <linux/futex.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* ----- Types */
+
+namespace HID {
+  namespace Shm {
+
+    constexpr char NAME[] = "/omniwear";
+    constexpr uint32_t MAGIC = 0x4f4d4855;      // "OMHU"
+    constexpr uint32_t VERSION = 1;
+    constexpr int C_CLIENTS = 8;
+    constexpr uint32_t C_RING = 256;            // Power of two
+    constexpr size_t CB_REPORT = 8;
+    constexpr int MIN_PRIORITY = -100;
+    constexpr int MAX_PRIORITY = 100;
+
+    enum SlotState : uint32_t {
+      slot_free = 0,
+      slot_claimed,             // Being set up by a client
+      slot_live,
+    };
+
+    struct Entry {
+      int64_t time_ns;          // When the client wrote the report
+      uint8_t report[CB_REPORT];
+    };
+
+    struct alignas (64) Slot {
+      std::atomic<uint32_t> state;
+      std::atomic<uint32_t> generation;       // Counts the claims
+      std::atomic<int32_t> pid;
+      std::atomic<int32_t> priority;
+      std::atomic<uint32_t> start;            // Tail when claimed
+      alignas (64) std::atomic<uint32_t> tail;  // Written by the client
+      alignas (64) std::atomic<uint32_t> head;  // Written by the daemon
+      alignas (64) Entry ring[C_RING];
+    };
+
+    struct Hub {
+      uint32_t magic;
+      uint32_t version;
+      std::atomic<int32_t> daemon_pid;
+      alignas (64) std::atomic<uint32_t> doorbell;
+      std::atomic<uint32_t> sleeping;
+      alignas (64) Slot slots[C_CLIENTS];
+    };
+
+    static_assert (ATOMIC_INT_LOCK_FREE == 2
+                   && sizeof (std::atomic<uint32_t>) == 4,
+                   "the hub needs address free atomics");
+
+    // Wait while word is value, or until timeout_ns passes.  The
+    // futex is shared between processes, so it isn't private.
+    inline void wait (std::atomic<uint32_t>& word, uint32_t value,
+                      int64_t timeout_ns) {
+      struct timespec timeout = { time_t (timeout_ns/1000000000),
+                                  long (timeout_ns % 1000000000) };
+      syscall (SYS_futex, &word, FUTEX_WAIT, value, &timeout, nullptr, 0); }
+
+    inline void wake (std::atomic<uint32_t>& word) {
+      syscall (SYS_futex, &word, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0); }
+
+  }
+}
+
+#endif  /* HID_SHM_H_INCLUDED */
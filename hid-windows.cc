@@ -28,6 +28,7 @@
 //#include <stdlib.h>
 
 #include "hid.h"
+#include "hid-hooks.h"
 #include <string.h>
 #include <functional>
 
@@ -58,6 +59,8 @@ namespace HID {
 
 namespace {
 
+  HID::Hooks::Deferred deferred$;
+
   inline void bzero (void* pv, size_t cb) {
     memset (pv, 0, cb); }
 
@@ -410,10 +413,12 @@ namespace HID {
   DeviceP open (const std::string& path) {
     return handler$.open (path); }
 
-  int write (const Device* device, uint8_t report, const char* rgb, size_t cb) {
-    if (!device)
-      return 0;
+  namespace {
 
+  // Writes a report of the full output length.  Returns cb, as on the
+  // other platforms, and not the length padded for Windows.
+  int write_report (const Device* device, uint8_t report,
+                    const char* rgb, size_t cb) {
     OVERLAPPED ol;
     bzero (&ol, sizeof (ol));
 
@@ -427,7 +432,7 @@ namespace HID {
     std::copy (rgb, rgb + cb, buffer + 1);
 
     if (WriteFile (device->impl_->h_, PVOID (&buffer[0]), length, NULL, &ol))
-      return length;
+      return int (cb);
 
     if (GetLastError () != ERROR_IO_PENDING) {
       print_error (GetLastError ());
@@ -436,12 +441,24 @@ namespace HID {
 
     DWORD cbWritten = 0;
     if (GetOverlappedResult (device->impl_->h_, &ol, &cbWritten, true))
-      return cbWritten;
+      return cbWritten == length ? int (cb) : -1;
 
     print_error (GetLastError ());
     return -1;
   }
 
+  }
+
+  int write (const Device* device, uint8_t report, const char* rgb, size_t cb) {
+    if (!device)
+      return 0;
+
+    auto start_ns = Hooks::write_begin (rgb, cb);
+    auto result = write_report (device, report, rgb, cb);
+    Hooks::write_end (start_ns, rgb, cb, result >= 0);
+    return result;
+  }
+
   int write (const Device* device, const char* rgb, size_t cb) {
     return write (device, 0, rgb, cb); }
 
@@ -450,6 +467,16 @@ namespace HID {
       return 0;
     return 0; }
 
+  // write_report waits for the overlapped write, so the write is
+  // complete before we return and only its completion is deferred.
+  bool write_async (const Device* device, const char* rgb, size_t cb,
+                    WriteDone done, void* context) {
+    if (!device || !done)
+      return false;
+    deferred$.push (done, context, write (device, 0, rgb, cb));
+    return true; }
+
   bool service () {
+    deferred$.deliver ();
     return handler$.service (); }
 }
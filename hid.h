@@ -35,6 +35,8 @@
      will be threadless.  Each platform specific interface sprouts a
      service() call that the user can either invoke by hand or place
      in a thread to perform operations that the library requires.
+     Completions of asynchronous writes are delivered from service()
+     as well, so the caller decides on which thread they run.
 
    o open with DeviceInfo?  This would be nice, to open a device
      during a scan of enumerated, connected devices.  Sadly, we don't
@@ -103,11 +105,23 @@ namespace HID {
                 const std::string& serial = std::string ());
   DeviceP  open (const std::string& path);
 
+  // Returns cb when the report was written, otherwise a short count
+  // or -1.
   int write (const Device*, uint8_t report, const char* rgb, size_t cb);
   int write (const Device*, const char* rgb, size_t cb);
 
   int read (const Device*, char* rgb, size_t cb);
 
+  // Called with the bytes written, or -1, when an asynchronous write
+  // completes.  Completions are delivered only from service ().
+  using WriteDone = void (*) (void* context, int result);
+
+  // Submit a write and return without waiting for it.  The report is
+  // copied, so rgb needn't outlive the call.  Returns false, and
+  // never calls done, when the write could not be submitted.
+  bool write_async (const Device*, const char* rgb, size_t cb,
+                    WriteDone done, void* context);
+
   bool service ();
 
 }
@@ -0,0 +1,189 @@
+/** @file log_ring.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Rate-limited binary log ring for SDK diagnostics.  See log_ring.h.
+
+   NOTES
+   =====
+
+   o Formatting.  A record is formatted when it is drained.  Each
+     conversion of the format string is handed to snprintf() with its
+     own argument, with the length modifier replaced by one that
+     matches the type the argument was stored as.
+
+*/
+
+#include "log_ring.h"
+#include "mpsc_ring.h"
+#include "telemetry.h"
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+namespace {
+
+  constexpr size_t C_RECORDS = 256;
+  constexpr int CB_MESSAGE_MAX = 512;
+
+  struct Record {
+    const LogRing::Site* site;
+    int64_t time_ns;
+    uint32_t suppressed;
+    int count;
+    LogRing::Arg args[LogRing::C_ARGS];
+  };
+
+  MpscRing<Record>& ring () {
+    static MpscRing<Record> ring (C_RECORDS);
+    return ring; }
+
+  std::atomic<uint32_t> dropped$;
+
+  std::mutex flush_lock$;       // One consumer at a time
+  omniwear_log_callback_t callback$;
+  void* callback_context$;
+
+  int64_t now_ns () {
+    using namespace std::chrono;
+    static const auto epoch = steady_clock::now ();
+    return duration_cast<nanoseconds> (steady_clock::now () - epoch).count (); }
+
+  // Format one conversion, spec is the text from '%' to the
+  // conversion character inclusive.
+  void format_one (std::string& out, std::string spec, const LogRing::Arg* arg) {
+    char conversion = spec.back ();
+    spec.pop_back ();
+    while (!spec.empty () && strchr ("hlLqjzt", spec.back ()))
+      spec.pop_back ();
+
+    char sz[128];
+    if (!arg)
+      snprintf (sz, sizeof (sz), "<?>");
+    else if (strchr ("diouxXc", conversion))
+      snprintf (sz, sizeof (sz), (spec + "ll" + conversion).c_str (),
+                arg->kind == LogRing::Arg::real ? (long long) arg->d : arg->i);
+    else if (strchr ("fFeEgGaA", conversion))
+      snprintf (sz, sizeof (sz), (spec + conversion).c_str (),
+                arg->kind == LogRing::Arg::real ? arg->d : double (arg->i));
+    else if (conversion == 's')
+      snprintf (sz, sizeof (sz), (spec + conversion).c_str (),
+                arg->kind == LogRing::Arg::string && arg->s ? arg->s
+                                                            : "(null)");
+    else if (conversion == 'p')
+      snprintf (sz, sizeof (sz), "%p", arg->p);
+    else
+      snprintf (sz, sizeof (sz), "<?>");
+    out += sz;
+  }
+
+  std::string format (const Record& record) {
+    char sz[64];
+    snprintf (sz, sizeof (sz), "[%12.6f] ", record.time_ns*1e-9);
+    std::string out (sz);
+
+    int arg = 0;
+    for (const char* p = record.site->format; *p; ++p) {
+      if (*p != '%') {
+        out += *p;
+        continue;
+      }
+      if (p[1] == '%') {
+        out += '%';
+        ++p;
+        continue;
+      }
+      const char* end = p + 1;
+      while (*end && !strchr ("diouxXcfFeEgGaAsp", *end))
+        ++end;
+      if (!*end)
+        break;
+      format_one (out, std::string (p, end + 1),
+                  arg < record.count ? &record.args[arg] : nullptr);
+      ++arg;
+      p = end;
+    }
+
+    // Messages carried the newline when they were printed directly.
+    while (!out.empty () && out.back () == '\n')
+      out.pop_back ();
+
+    if (record.suppressed) {
+      snprintf (sz, sizeof (sz), " (%u more suppressed)", record.suppressed);
+      out += sz;
+    }
+    return out;
+  }
+
+  void emit (int level, const char* message) {
+    if (callback$)
+      callback$ (callback_context$, level, message);
+    else
+      printf ("%s\n", message);
+  }
+
+}
+
+namespace LogRing {
+
+  bool admit (Site& site, int64_t& time_ns, uint32_t& suppressed) {
+    time_ns = now_ns ();
+    int64_t next = site.next_ns.load (std::memory_order_relaxed);
+    if (time_ns < next
+        || !site.next_ns.compare_exchange_strong
+        (next, time_ns + MS_INTERVAL*1000000, std::memory_order_relaxed)) {
+      site.suppressed.fetch_add (1, std::memory_order_relaxed);
+      Telemetry::count (Telemetry::log_suppressed);
+      return false;
+    }
+    suppressed = site.suppressed.exchange (0, std::memory_order_relaxed);
+    return true;
+  }
+
+  void write (const Site& site, int64_t time_ns, uint32_t suppressed,
+              const Arg* args, int count) {
+    Record record;
+    record.site = &site;
+    record.time_ns = time_ns;
+    record.suppressed = suppressed;
+    record.count = count;
+    for (int i = 0; i < count; ++i)
+      record.args[i] = args[i];
+    if (!ring ().push (record)) {
+      dropped$.fetch_add (1, std::memory_order_relaxed);
+      Telemetry::count (Telemetry::log_dropped);
+    }
+  }
+
+}
+
+void set_omniwear_log_callback (omniwear_log_callback_t callback,
+                                void* context) {
+  std::lock_guard<std::mutex> guard (flush_lock$);
+  callback$ = callback;
+  callback_context$ = context;
+}
+
+int flush_omniwear_log (int max_records) {
+  std::lock_guard<std::mutex> guard (flush_lock$);
+
+  int count = 0;
+  Record record;
+  while ((max_records <= 0 || count < max_records) && ring ().pop (record)) {
+    emit (record.site->level, format (record).c_str ());
+    ++count;
+  }
+
+  uint32_t dropped = dropped$.exchange (0, std::memory_order_relaxed);
+  if (dropped) {
+    char sz[CB_MESSAGE_MAX];
+    snprintf (sz, sizeof (sz),
+              "WARNING: log ring full, %u messages dropped.", dropped);
+    emit (OMNI_LOG_WARNING, sz);
+  }
+  return count;
+}
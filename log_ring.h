@@ -0,0 +1,103 @@
+/** @file log_ring.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Diagnostics for the SDK without I/O on the frame path.  OMNI_LOG
+   writes a small binary record, the call site and the raw
+   arguments, into a fixed-size in-memory ring.  The records are
+   formatted later, when the application drains the ring with
+   flush_omniwear_log().
+
+   NOTES
+   =====
+
+   o Rate limit.  Each call site logs at most once per
+     LogRing::MS_INTERVAL.  Calls in between are counted and the
+     count is reported with the next record from the site.
+
+   o Arguments.  Up to LogRing::C_ARGS integers, floating point
+     values, pointers, or pointers to strings that live as long as
+     the program, i.e. literals.  The format string is a printf
+     format and must also be a literal.
+
+   o Full ring.  When the ring is full the record is dropped and
+     counted; the count is reported by the next flush.
+
+*/
+
+#if !defined (LOG_RING_H_INCLUDED)
+#    define   LOG_RING_H_INCLUDED
+
+/* ----- Includes */
+
+#include "omniwear_SDK.h"
+#include <atomic>
+#include <stdint.h>
+
+/* ----- Macros */
+
+#define OMNI_LOG(level, format, ...)                                     \
+  do {                                                                   \
+    static LogRing::Site site$ (level, format);                          \
+    LogRing::log (site$, ##__VA_ARGS__);                                 \
+  } while (0)
+
+/* ----- Types */
+
+namespace LogRing {
+
+  constexpr int C_ARGS = 4;
+  constexpr int64_t MS_INTERVAL = 1000;
+
+  struct Site {
+    int level;
+    const char* format;
+    std::atomic<int64_t> next_ns;     // Earliest time of the next record
+    std::atomic<uint32_t> suppressed;
+
+    constexpr Site (int level, const char* format)
+      : level (level), format (format), next_ns (0), suppressed (0) {}
+  };
+
+  struct Arg {
+    enum Kind : uint8_t { integer, real, string, pointer };
+    Kind kind;
+    union {
+      long long i;
+      double d;
+      const char* s;
+      const void* p;
+    };
+
+    Arg () : kind (integer), i (0) {}
+    Arg (int v) : kind (integer), i (v) {}
+    Arg (unsigned v) : kind (integer), i (v) {}
+    Arg (long v) : kind (integer), i (v) {}
+    Arg (unsigned long v) : kind (integer), i ((long long) v) {}
+    Arg (long long v) : kind (integer), i (v) {}
+    Arg (double v) : kind (real), d (v) {}
+    Arg (const char* v) : kind (string), s (v) {}
+    Arg (const void* v) : kind (pointer), p (v) {}
+  };
+
+  // Returns true when the site may log now and claims the slot.
+  bool admit (Site&, int64_t& time_ns, uint32_t& suppressed);
+  void write (const Site&, int64_t time_ns, uint32_t suppressed,
+              const Arg* args, int count);
+
+  template<typename... Args_>
+  void log (Site& site, Args_... args) {
+    static_assert (sizeof... (Args_) <= C_ARGS, "too many log arguments");
+    int64_t time_ns;
+    uint32_t suppressed;
+    if (!admit (site, time_ns, suppressed))
+      return;
+    const Arg packed[sizeof... (Args_) + 1] = { Arg (args)... };
+    write (site, time_ns, suppressed, packed, int (sizeof... (Args_)));
+  }
+
+}
+
+#endif  /* LOG_RING_H_INCLUDED */
@@ -0,0 +1,168 @@
+/** @file main-async.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Pipelined stream to a cap through the coroutine interface of
+   omniwear_async.h.  Opens the cap, uploads the packed mapping and
+   keeps a number of packed frames in flight for a time, one
+   coroutine per frame, measuring the report rate and the latency from
+   submitting a frame to its coroutine resuming.
+
+   Built only with CONFIG_ASYNC=y.  Like omni-bench, it links with the
+   HID implementation for the platform, or with the null sink when
+   built with CONFIG_NULL_HID=y as well.
+
+*/
+
+#include "omniwear_async.h"
+#include "telemetry.h"
+#include <algorithm>
+#include <array>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+using namespace Omniwear::Async;
+
+namespace {
+
+  constexpr int C_MOTORS = 13;
+
+  int option_seconds = 5;
+  int option_in_flight = 256;
+  int option_duty = 10;
+  int option_timeout_ms = 1000;
+  bool option_talk;
+
+  struct Stream {
+    int64_t end_ns;
+    uint64_t reports = 0;
+    uint64_t failures = 0;
+    std::vector<int64_t> samples;
+  };
+
+  // One lane of the pipeline, sending frames back to back until the
+  // stream ends.
+  Task<int> lane (const Omniwear::Device* d, Stream& s, int motor) {
+    std::array<int,C_MOTORS> duties {};
+    duties[motor % C_MOTORS] = option_duty;
+    while (Telemetry::now_ns () < s.end_ns) {
+      auto start = Telemetry::now_ns ();
+      auto status = co_await send_frame
+        (d, &duties[0], duties.size (),
+         Options::within (std::chrono::milliseconds (option_timeout_ms)));
+      s.samples.push_back (Telemetry::now_ns () - start);
+      ++s.reports;
+      if (status != Status::ok)
+        ++s.failures;
+    }
+    co_return 0;
+  }
+
+  int64_t percentile (const std::vector<int64_t>& sorted, double q) {
+    if (sorted.empty ())
+      return 0;
+    size_t i = size_t (q*sorted.size ());
+    return sorted[i < sorted.size () ? i : sorted.size () - 1]; }
+
+}
+
+void usage () {
+  printf (
+          "usage: omni-async [OPTIONS]\n"
+          "\n"
+          "  -s SECONDS      - Stream frames for SECONDS (5)\n"
+          "  -n COUNT        - Keep COUNT frames in flight (256)\n"
+          "  -i DUTY         - Drive motors at DUTY (0-100) (10)\n"
+          "  -m MS           - Give up on a frame after MS (1000)\n"
+          "  -t              - Enable talking\n"
+          "  -h|?            - Show usage\n"
+          );
+  exit (0);
+}
+
+int main (int argc, const char** argv)
+{
+  for (--argc, ++argv; argc > 0; --argc, ++argv) {
+    std::string arg (*argv);
+    if (arg[0] != '-')
+      usage ();
+    switch (arg[1]) {
+    case 's':
+    case 'n':
+    case 'i':
+    case 'm':
+      if (argc < 2)
+        usage ();
+      {
+        int value = strtol (argv[1], nullptr, 0);
+        if (value < 0 || (arg[1] == 'i' && value > 100))
+          usage ();
+        (arg[1] == 's' ? option_seconds
+         : arg[1] == 'n' ? option_in_flight
+         : arg[1] == 'i' ? option_duty : option_timeout_ms) = value;
+      }
+      --argc, ++argv;
+      break;
+    case 't':
+      option_talk = true;
+      break;
+    default:
+      usage ();
+      break;
+    }
+  }
+
+  auto opening = Omniwear::Async::open (option_talk);
+  opening.start ();
+  while (service ())
+    ;
+  auto d = std::move (opening.result ());
+  if (!d) {
+    printf ("unable to find omniwear device\n");
+    return 1;
+  }
+
+  // The linear ramp from 128 to 255 of omni-bench.
+  std::array<uint8_t,16> mapping {};
+  for (int i = 1; i < int (mapping.size ()); ++i)
+    mapping[i] = (i*127 + 15/2)/15 + 128;
+  auto uploading = upload_mapping (d.get (), mapping);
+  uploading.start ();
+  while (service ())
+    ;
+  if (uploading.result () != Status::ok) {
+    printf ("unable to upload the packed mapping\n");
+    return 1;
+  }
+
+  Stream s;
+  s.samples.reserve (1 << 20);
+  auto start = Telemetry::now_ns ();
+  s.end_ns = start + option_seconds*1000000000LL;
+  std::vector<Task<int>> lanes;
+  for (int i = 0; i < option_in_flight; ++i)
+    lanes.push_back (lane (d.get (), s, i));
+  for (auto& l : lanes)
+    l.start ();
+  while (service ())
+    ;
+  auto elapsed = Telemetry::now_ns () - start;
+
+  Omniwear::reset_motors (d.get ());
+
+  std::sort (s.samples.begin (), s.samples.end ());
+  printf ("async %4d in flight %8llu ops %4llu failed %9.1f/s"
+          "  p50 %9.1f  p99 %9.1f  max %9.1f us\n",
+          option_in_flight,
+          (unsigned long long) s.reports,
+          (unsigned long long) s.failures,
+          elapsed ? s.reports*1e9/elapsed : 0,
+          percentile (s.samples, 0.50)*1e-3,
+          percentile (s.samples, 0.99)*1e-3,
+          (s.samples.empty () ? 0 : s.samples.back ())*1e-3);
+  return 0;
+}
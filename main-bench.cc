@@ -0,0 +1,246 @@
+/** @file main-bench.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Device benchmark.  Opens a cap and streams reports to it as fast
+   as it accepts them, measuring the sustained report rate and the
+   latency from submitting a report to its completion.  Single motor
+   (0x10) reports and packed (0xf1) frames are measured separately.
+   Cold opens, including enumeration and the preamble, are timed as
+   well.
+
+   Linked like omni, with the HID implementation for the platform.
+   Build with 'make CONFIG_NULL_HID=y' to link with the null sink
+   instead and measure the host side alone.
+
+   NOTES
+   =====
+
+   o Latency.  Writes are synchronous on every platform, so the time
+     that HID::write takes is the time from submission to
+     completion.  Every sample is kept and the percentiles are exact.
+
+   o Motors.  The reports drive the motors at a low intensity by
+     default, and the motors are reset when the benchmark ends.
+
+*/
+
+#include "hid.h"
+#include "omniwear.h"
+#include "telemetry.h"
+#include <algorithm>
+#include <array>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+  constexpr int C_MOTORS = 13;
+
+  int option_seconds = 5;       // Duration of each stream
+  int option_opens = 5;         // Number of cold opens
+  int option_duty = 10;
+  bool option_talk;
+  bool option_json;
+
+  struct Result {
+    const char* bench;
+    uint64_t reports = 0;         // Or opens
+    uint64_t failures = 0;
+    int64_t elapsed_ns = 0;
+    std::vector<int64_t> samples;
+  };
+
+  int64_t percentile (const std::vector<int64_t>& sorted, double q) {
+    if (sorted.empty ())
+      return 0;
+    size_t i = size_t (q*sorted.size ());
+    return sorted[i < sorted.size () ? i : sorted.size () - 1]; }
+
+  void report (Result& r) {
+    std::sort (r.samples.begin (), r.samples.end ());
+    double rate = r.elapsed_ns ? r.reports*1e9/r.elapsed_ns : 0;
+    auto& s = r.samples;
+
+    if (option_json) {
+      printf ("{\"bench\":\"%s\",\"count\":%llu,\"failures\":%llu,"
+              "\"per_s\":%.1f,\"p50_ns\":%lld,\"p90_ns\":%lld,"
+              "\"p99_ns\":%lld,\"p999_ns\":%lld,\"max_ns\":%lld}\n",
+              r.bench,
+              (unsigned long long) r.reports,
+              (unsigned long long) r.failures, rate,
+              (long long) percentile (s, 0.50),
+              (long long) percentile (s, 0.90),
+              (long long) percentile (s, 0.99),
+              (long long) percentile (s, 0.999),
+              (long long) (s.empty () ? 0 : s.back ()));
+      return;
+    }
+
+    printf ("%-8s %8llu ops %4llu failed %9.1f/s"
+            "  p50 %9.1f  p90 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f us\n",
+            r.bench,
+            (unsigned long long) r.reports,
+            (unsigned long long) r.failures, rate,
+            percentile (s, 0.50)*1e-3,
+            percentile (s, 0.90)*1e-3,
+            percentile (s, 0.99)*1e-3,
+            percentile (s, 0.999)*1e-3,
+            (s.empty () ? 0 : s.back ())*1e-3);
+  }
+
+  /** Call send, which writes one report and returns true on
+      success, as fast as it completes for option_seconds. */
+  template<typename Send>
+  Result stream (const char* bench, Send send) {
+    Result r;
+    r.bench = bench;
+    r.samples.reserve (1 << 16);
+
+    int64_t start = Telemetry::now_ns ();
+    int64_t end = start + option_seconds*1000000000LL;
+    int64_t now = start;
+    for (uint64_t i = 0; now < end; ++i) {
+      bool success = send (i);
+      int64_t completed = Telemetry::now_ns ();
+      r.samples.push_back (completed - now);
+      ++r.reports;
+      if (!success)
+        ++r.failures;
+      now = completed;
+    }
+    r.elapsed_ns = now - start;
+    return r;
+  }
+
+  Omniwear::DeviceP open_cap () {
+    auto d = Omniwear::open (option_talk);
+    if (!d) {
+      printf ("unable to find omniwear device\n");
+      exit (1);
+    }
+    return d;
+  }
+
+  void bench_open () {
+    Result first;
+    first.bench = "open1";
+    Result r;
+    r.bench = "open";
+    for (int i = 0; i < option_opens; ++i) {
+      int64_t start = Telemetry::now_ns ();
+      auto d = open_cap ();
+      int64_t elapsed = Telemetry::now_ns () - start;
+      auto& result = i ? r : first;
+      result.samples.push_back (elapsed);
+      result.elapsed_ns += elapsed;
+      ++result.reports;
+    }
+    // The first open also initializes the HID layer.
+    report (first);
+    if (r.reports)
+      report (r);
+  }
+
+  void bench_motor (Omniwear::Device* d) {
+    auto r = stream ("motor", [&] (uint64_t i) {
+        return Omniwear::configure_motor (d, int (i % C_MOTORS),
+                                          option_duty);
+      });
+    Omniwear::reset_motors (d);
+    report (r);
+  }
+
+  void bench_packed (Omniwear::Device* d) {
+    Omniwear::define_packed_linear (d, 127, 15, 128);
+    std::array<int,C_MOTORS> duties;
+    auto r = stream ("packed", [&] (uint64_t i) {
+        for (int motor = 0; motor < C_MOTORS; ++motor)
+          duties[motor] = (motor == int (i % C_MOTORS)) ? option_duty : 0;
+        return Omniwear::configure_motors_packed (d, &duties[0],
+                                                  duties.size ());
+      });
+    Omniwear::reset_motors (d);
+    report (r);
+  }
+
+}
+
+void usage () {
+  printf (
+          "usage: omni-bench [OPTIONS] [BENCH...]\n"
+          "\n"
+          "  BENCH           - open, motor or packed.  All when none given\n"
+          "  -s SECONDS      - Stream reports for SECONDS (5)\n"
+          "  -o COUNT        - Time COUNT cold opens (5)\n"
+          "  -i DUTY         - Drive motors at DUTY (0-100) (10)\n"
+          "  -t              - Enable talking\n"
+          "  -j              - Print results as JSON lines\n"
+          "  -h|?            - Show usage\n"
+          );
+  exit (0);
+}
+
+int main (int argc, const char** argv)
+{
+  std::vector<std::string> benches;
+
+  for (--argc, ++argv; argc > 0; --argc, ++argv) {
+    std::string arg (*argv);
+    if (arg[0] != '-') {
+      if (arg != "open" && arg != "motor" && arg != "packed")
+        usage ();
+      benches.push_back (arg);
+      continue;
+    }
+    switch (arg[1]) {
+    case 's':
+    case 'o':
+    case 'i':
+      if (argc < 2)
+        usage ();
+      {
+        int value = strtol (argv[1], nullptr, 0);
+        if (value < 0 || (arg[1] == 'i' && value > 100))
+          usage ();
+        (arg[1] == 's' ? option_seconds
+         : arg[1] == 'o' ? option_opens : option_duty) = value;
+      }
+      --argc, ++argv;
+      break;
+    case 't':
+      option_talk = true;
+      break;
+    case 'j':
+      option_json = true;
+      break;
+    default:
+      usage ();
+      break;
+    }
+  }
+
+  if (benches.empty ())
+    benches = { "open", "motor", "packed" };
+
+  auto want = [&] (const char* bench) {
+    return std::find (benches.begin (), benches.end (), bench)
+      != benches.end (); };
+
+  if (want ("open") && option_opens)
+    bench_open ();
+
+  if (want ("motor") || want ("packed")) {
+    auto d = open_cap ();
+    if (want ("motor"))
+      bench_motor (d.get ());
+    if (want ("packed"))
+      bench_packed (d.get ());
+  }
+
+  return 0;
+}
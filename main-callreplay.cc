@@ -0,0 +1,317 @@
+/** @file main-callreplay.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Replays a log of SDK calls, made with start_omniwear_call_log,
+   against the engine.  The SDK is linked statically with the null
+   HID sink, so no cap is needed, and the game_time of every call
+   comes from the log, so a replay is deterministic.  The harness
+   prints a digest of the reports the engine sent; two replays of
+   the same log on the same build must agree.  Engine latencies from
+   get_omniwear_stats are printed as well, so that the engine can be
+   profiled on real gameplay.
+
+   With -n, the log is replayed several times, each time into fresh
+   states, and the digests of the replays are compared.
+
+*/
+
+#include "call_log.h"
+#include "hid-null.h"
+#include "omniwear_SDK.h"
+#include "telemetry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+  int option_loops = 1;
+  bool option_verbose;
+
+  struct Replay {
+    uint64_t calls = 0;
+    uint64_t reports = 0;
+    uint64_t digest = 0;
+    int64_t elapsed_ns = 0;
+  };
+
+  haptic_device_state_t* get_state (std::vector<haptic_device_state_t*>&
+                                    states, int id) {
+    if (id >= int (states.size ()))
+      states.resize (id + 1, nullptr);
+    if (!states[id]) {
+      states[id] = new haptic_device_state_t;
+      memset (states[id], 0, sizeof (*states[id]));
+    }
+    return states[id];
+  }
+
+  // Patterns are loaded from the paths they were played from, once
+  // a replay.
+  std::map<std::string,haptic_pattern_t*> patterns;
+
+  haptic_pattern_t* get_pattern (const std::string& path) {
+    auto& pattern = patterns[path];
+    if (!pattern)
+      pattern = load_haptic_pattern (path.c_str ());
+    return pattern; }
+
+  void apply (haptic_device_state_t* state, CallLog::Record& r) {
+    state->haptic_volume = r.volume;
+
+    switch (r.op) {
+    case CallLog::op_init:
+      init_haptic_state (state);
+      break;
+    case CallLog::op_open:
+      open_omniwear_device (state);
+      break;
+    case CallLog::op_close:
+      close_omniwear_device (state);
+      break;
+    case CallLog::op_reset:
+      reset_omniwear_device (state);
+      break;
+    case CallLog::op_radar:
+      update_haptic_radar (state, r.targets.empty () ? nullptr
+                                                     : &r.targets[0],
+                           int (r.targets.size ()), r.origin,
+                           r.viewangles_deg);
+      break;
+    case CallLog::op_stop_radar:
+      stop_haptic_radar (state);
+      break;
+    case CallLog::op_effect:
+      set_haptic_effect (state, r.ints[0], haptic_effect_t (r.ints[1]),
+                         r.floats[0]);
+      break;
+    case CallLog::op_clear_effect:
+      if (r.ints.size () == 1)
+        clear_haptic_effect (state, r.ints[0]);
+      break;
+    case CallLog::op_mixing:
+      if (r.ints.size () == 3)
+        set_haptic_mixing (state, haptic_combine_t (r.ints[0]),
+                           haptic_falloff_t (r.ints[1]),
+                           haptic_falloff_t (r.ints[2]));
+      break;
+    case CallLog::op_spatialization:
+      if (r.ints.size () == 1)
+        set_haptic_spatialization (state, haptic_spatial_t (r.ints[0]));
+      break;
+    case CallLog::op_falloff_curve:
+      define_haptic_falloff_curve (state, haptic_curve_t (r.ints[0]),
+                                   r.floats.empty () ? nullptr
+                                                     : &r.floats[0],
+                                   int (r.floats.size ()));
+      break;
+    case CallLog::op_throb:
+      do_throb (state, unsigned (r.ints[0]), r.floats[0], r.game_time);
+      break;
+    case CallLog::op_stop_throbbing:
+      stop_throbbing (state);
+      break;
+    case CallLog::op_execute:
+      execute_haptic_effects (state, r.game_time);
+      break;
+    case CallLog::op_motor:
+      if (r.ints.size () == 2)
+        command_haptic_motor (state, r.ints[0], r.ints[1]);
+      break;
+    case CallLog::op_motors:
+      command_haptic_motors (state, r.configs.empty () ? nullptr
+                                                       : &r.configs[0],
+                             int (r.configs.size ()));
+      break;
+    case CallLog::op_motors_packed:
+      command_haptic_motors_packed (state, r.ints.empty () ? nullptr
+                                                           : &r.ints[0],
+                                    int (r.ints.size ()));
+      break;
+    case CallLog::op_packed_mapping:
+      define_packed_mapping (state, r.bytes.empty () ? nullptr
+                                                     : &r.bytes[0],
+                             int (r.bytes.size ()));
+      break;
+    case CallLog::op_linear_packed_mapping:
+      if (r.ints.size () == 3)
+        define_linear_packed_mapping (state, r.ints[0], r.ints[1],
+                                      r.ints[2]);
+      break;
+    case CallLog::op_oscillator:
+      set_haptic_oscillator (state, r.ints[0], haptic_waveform_t (r.ints[1]),
+                             r.floats[0], r.ints[2], r.floats[1]);
+      break;
+    case CallLog::op_waveform:
+      define_haptic_waveform (state, r.floats.empty () ? nullptr
+                                                       : &r.floats[0],
+                              int (r.floats.size ()));
+      break;
+    case CallLog::op_priority:
+      if (r.ints.size () == 2)
+        set_haptic_priority (state, r.ints[0], r.ints[1]);
+      break;
+    case CallLog::op_report_budget:
+      if (r.ints.size () == 1)
+        set_haptic_report_budget (state, r.ints[0]);
+      break;
+    case CallLog::op_prediction:
+      set_haptic_prediction (state, r.ints[0], r.floats[0]);
+      break;
+    case CallLog::op_add_target:
+      add_haptic_target (state, &r.targets[0]);
+      break;
+    case CallLog::op_move_target:
+      move_haptic_target (state, r.targets[0].index, r.targets[0].location,
+                          r.targets[0].viewangles_deg);
+      break;
+    case CallLog::op_remove_target:
+      if (r.ints.size () == 1)
+        remove_haptic_target (state, r.ints[0]);
+      break;
+    case CallLog::op_player_pose:
+      if (r.floats.size () == 6)
+        set_haptic_player_pose (state, &r.floats[0], &r.floats[3]);
+      break;
+    case CallLog::op_delta_threshold:
+      if (r.floats.size () == 1)
+        set_haptic_delta_threshold (state, r.floats[0]);
+      break;
+    case CallLog::op_play_pattern:
+      play_haptic_pattern (state, get_pattern (std::string (r.bytes.begin (),
+                                                            r.bytes.end ())),
+                           r.game_time);
+      break;
+    case CallLog::op_stop_pattern:
+      stop_haptic_pattern (state);
+      break;
+    }
+  }
+
+  Replay replay (CallLog::Reader& reader) {
+    Replay result;
+    std::vector<haptic_device_state_t*> states;
+    CallLog::Record record;
+
+    HID::Null::reset ();
+    reader.rewind ();
+    int64_t start = Telemetry::now_ns ();
+    while (reader.next (record)) {
+      apply (get_state (states, record.state), record);
+      ++result.calls;
+    }
+    result.elapsed_ns = Telemetry::now_ns () - start;
+    result.reports = HID::Null::reports ();
+    result.digest = HID::Null::digest ();
+
+    for (auto state : states) {
+      if (!state)
+        continue;
+      close_omniwear_device (state);
+      delete state;
+    }
+    for (auto& pattern : patterns)
+      unload_haptic_pattern (pattern.second);
+    patterns.clear ();
+    flush_omniwear_log (0);
+    return result;
+  }
+
+  void print_histogram (const char* name, const omniwear_histogram_t& h) {
+    printf ("%-13s %8llu calls  p50 %9.1f  p99 %9.1f  p99.9 %9.1f"
+            "  max %9.1f us\n",
+            name, (unsigned long long) h.count,
+            h.p50_ns*1e-3, h.p99_ns*1e-3, h.p999_ns*1e-3, h.max_ns*1e-3);
+  }
+
+}
+
+void usage () {
+  printf (
+          "usage: omni-callreplay [OPTIONS] CALL_LOG\n"
+          "\n"
+          "  -n LOOPS        - Replay the log LOOPS times and compare (1)\n"
+          "  -v              - Print each replay\n"
+          "  -h|?            - Show usage\n"
+          );
+  exit (0);
+}
+
+int main (int argc, const char** argv)
+{
+  std::string path;
+
+  for (--argc, ++argv; argc > 0; --argc, ++argv) {
+    std::string arg (*argv);
+    if (arg[0] != '-') {
+      path = arg;
+      continue;
+    }
+    switch (arg[1]) {
+    case 'n':
+      if (argc < 2)
+        usage ();
+      option_loops = strtol (argv[1], nullptr, 0);
+      if (option_loops < 1)
+        usage ();
+      --argc, ++argv;
+      break;
+    case 'v':
+      option_verbose = true;
+      break;
+    default:
+      usage ();
+      break;
+    }
+  }
+
+  if (path.empty ())
+    usage ();
+
+  CallLog::Reader reader;
+  if (!reader.open (path)) {
+    printf ("unable to read call log '%s'\n", path.c_str ());
+    exit (1);
+  }
+
+  Replay first;
+  int64_t elapsed_ns = 0;
+  bool mismatch = false;
+  for (int loop = 0; loop < option_loops; ++loop) {
+    auto result = replay (reader);
+    elapsed_ns += result.elapsed_ns;
+    if (option_verbose)
+      printf ("replay %d: %llu calls  %llu reports  digest %016llx"
+              "  %.3f ms\n", loop,
+              (unsigned long long) result.calls,
+              (unsigned long long) result.reports,
+              (unsigned long long) result.digest, result.elapsed_ns*1e-6);
+    if (!loop)
+      first = result;
+    else if (result.digest != first.digest
+             || result.reports != first.reports) {
+      printf ("replay %d differs from replay 0\n", loop);
+      mismatch = true;
+    }
+  }
+
+  printf ("%llu calls  %llu reports  digest %016llx  %.3f ms/replay\n",
+          (unsigned long long) first.calls,
+          (unsigned long long) first.reports,
+          (unsigned long long) first.digest,
+          elapsed_ns*1e-6/option_loops);
+
+  omniwear_stats_t stats;
+  get_omniwear_stats (&stats);
+  print_histogram ("radar_update", stats.radar_update);
+  print_histogram ("execute", stats.execute);
+  print_histogram ("encode", stats.encode);
+
+  return mismatch ? 1 : 0;
+}
@@ -0,0 +1,348 @@
+/** @file main-daemon.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Daemon that owns the cap so that several processes can drive it
+   at once, a game and a notifier for example.  Clients link
+   hid-shm.cc in place of the platform HID implementation and write
+   their reports to a ring in shared memory, see hid-shm.h.  The
+   daemon takes them out, arbitrates between the clients, see
+   haptic_arbiter.h, and writes the result to the cap.
+
+   Runs in the foreground, as a service manager expects, until
+   SIGINT or SIGTERM, when it turns the motors off and removes the
+   hub.  Linked like omni-replay, with the HID implementation for the
+   platform, or with the null sink when built with CONFIG_NULL_HID=y.
+
+   NOTES
+   =====
+
+   o Latency.  Every report carries the time the client wrote it, and
+     the daemon measures from then until the reports it caused have
+     been written to the cap.  With -v it prints the percentiles every
+     few seconds.
+
+   o Sleep.  When every ring is empty the daemon sleeps on the
+     doorbell, for no longer than a second so that it still notices
+     clients that died.
+
+*/
+
+#include "haptic_arbiter.h"
+#include "hid.h"
+#include "hid-shm.h"
+#include "omniwear.h"
+#include "telemetry.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <new>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+  bool option_talk;
+  bool option_verbose;
+  int option_interval = 10;
+
+  constexpr int64_t SLEEP_NS = 1000000000;
+
+  volatile sig_atomic_t stopping;
+
+  void stop (int) {
+    stopping = 1; }
+
+  int64_t percentile (const std::vector<int64_t>& sorted, double q) {
+    if (sorted.empty ())
+      return 0;
+    size_t i = size_t (q*sorted.size ());
+    return sorted[i < sorted.size () ? i : sorted.size () - 1]; }
+
+  // Pid of the daemon that owns the hub, or 0 when there is no hub or
+  // its daemon is gone.
+  pid_t running () {
+    int fd = shm_open (HID::Shm::NAME, O_RDONLY, 0);
+    if (fd < 0)
+      return 0;
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (fstat (fd, &st) == 0 && size_t (st.st_size) >= sizeof (HID::Shm::Hub))
+      p = mmap (nullptr, sizeof (HID::Shm::Hub), PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (p == MAP_FAILED)
+      return 0;
+    auto hub = static_cast<const HID::Shm::Hub*> (p);
+    pid_t pid = hub->daemon_pid.load (std::memory_order_acquire);
+    if (hub->magic != HID::Shm::MAGIC || hub->version != HID::Shm::VERSION
+        || pid <= 0 || (kill (pid, 0) && errno == ESRCH))
+      pid = 0;
+    munmap (p, sizeof (HID::Shm::Hub));
+    return pid; }
+
+  // Create the hub, replacing one left by a daemon that crashed.
+  HID::Shm::Hub* create_hub () {
+    if (running ())
+      return nullptr;
+    shm_unlink (HID::Shm::NAME);
+    int fd = shm_open (HID::Shm::NAME, O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (fd < 0)
+      return nullptr;
+    fchmod (fd, 0666);                  // Despite the umask
+    void* p = MAP_FAILED;
+    if (ftruncate (fd, sizeof (HID::Shm::Hub)) == 0)
+      p = mmap (nullptr, sizeof (HID::Shm::Hub), PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+    close (fd);
+    if (p == MAP_FAILED) {
+      shm_unlink (HID::Shm::NAME);
+      return nullptr;
+    }
+    auto hub = new (p) HID::Shm::Hub ();
+    hub->magic = HID::Shm::MAGIC;
+    hub->version = HID::Shm::VERSION;
+    hub->daemon_pid.store (getpid (), std::memory_order_release);
+    return hub; }
+
+  void remove_hub (HID::Shm::Hub* hub) {
+    hub->daemon_pid.store (0, std::memory_order_release);
+    shm_unlink (HID::Shm::NAME);
+    munmap (hub, sizeof (HID::Shm::Hub)); }
+
+  struct Daemon {
+    HID::Shm::Hub* hub;
+    Omniwear::Device* d;
+    HapticArbiter::Arbiter arbiter { HID::Shm::C_CLIENTS };
+    HapticArbiter::Output output
+      { Omniwear::linear_mapping (127, 15, 128) };
+    std::array<uint32_t,HID::Shm::C_CLIENTS> generations {};
+    std::vector<int64_t> pending;       // Write times of reports taken
+    std::vector<int64_t> latency;
+    uint64_t reports_in = 0;
+    uint64_t reports_out = 0;
+    uint64_t failures = 0;
+
+    Daemon (HID::Shm::Hub* hub, Omniwear::Device* d) : hub (hub), d (d) {}
+
+    // Take the reports out of the rings.  Returns true if any changed
+    // what a client wants.
+    bool drain () {
+      bool changed = false;
+      for (int i = 0; i < HID::Shm::C_CLIENTS; ++i) {
+        auto& slot = hub->slots[i];
+        if (slot.state.load (std::memory_order_acquire) != HID::Shm::slot_live) {
+          if (arbiter.present (i)) {
+            arbiter.leave (i);
+            changed = true;
+          }
+          continue;
+        }
+        auto head = slot.head.load (std::memory_order_relaxed);
+        auto tail = slot.tail.load (std::memory_order_acquire);
+        auto generation = slot.generation.load (std::memory_order_relaxed);
+        if (!arbiter.present (i) || generation != generations[i]) {
+          arbiter.join (i, slot.priority.load (std::memory_order_relaxed));
+          generations[i] = generation;
+          changed = true;
+
+          // Skip what the last owner left.
+          auto start = slot.start.load (std::memory_order_relaxed);
+          if (int32_t (start - head) > 0 && tail - start <= HID::Shm::C_RING)
+            head = start;
+        }
+        if (tail - head > HID::Shm::C_RING) {
+          if (option_verbose)
+            printf ("client %d broken\n",
+                    slot.pid.load (std::memory_order_relaxed));
+          slot.head.store (tail, std::memory_order_relaxed);
+          slot.state.store (HID::Shm::slot_free, std::memory_order_release);
+          arbiter.leave (i);
+          changed = true;
+          continue;
+        }
+        for (; head != tail; ++head) {
+          auto& entry = slot.ring[head & (HID::Shm::C_RING - 1)];
+          if (arbiter.apply (i, entry.report)) {
+            pending.push_back (entry.time_ns);
+            changed = true;
+          }
+          ++reports_in;
+        }
+        slot.head.store (head, std::memory_order_release);
+      }
+      return changed; }
+
+    bool idle () const {
+      for (auto& slot : hub->slots)
+        if (slot.state.load (std::memory_order_acquire) == HID::Shm::slot_live
+            && slot.head.load (std::memory_order_relaxed)
+               != slot.tail.load (std::memory_order_acquire))
+          return false;
+      return true; }
+
+    void send () {
+      HapticArbiter::Duties duties;
+      arbiter.resolve (duties);
+      Omniwear::Report reports[HapticArbiter::C_SINGLE + 1];
+      int count = output.plan (duties, reports);
+      for (int i = 0; i < count; ++i) {
+        if (HID::write (d, &reports[i][0], reports[i].size ())
+            != int (reports[i].size ())) {
+          ++failures;
+          output.forget ();
+        }
+      }
+      reports_out += count;
+      auto now = Telemetry::now_ns ();
+      for (auto t : pending)
+        latency.push_back (now - t);
+      pending.clear ();
+      HID::service (); }
+
+    // Free the slots of clients that died without closing.
+    void reap () {
+      for (auto& slot : hub->slots) {
+        if (slot.state.load (std::memory_order_acquire) != HID::Shm::slot_live)
+          continue;
+        auto pid = slot.pid.load (std::memory_order_relaxed);
+        if (kill (pid, 0) && errno == ESRCH) {
+          if (option_verbose)
+            printf ("client %d gone\n", pid);
+          slot.state.store (HID::Shm::slot_free, std::memory_order_release);
+        }
+      }
+    }
+
+    void report (double seconds) {
+      std::sort (latency.begin (), latency.end ());
+      int clients = 0;
+      for (int i = 0; i < HID::Shm::C_CLIENTS; ++i)
+        clients += arbiter.present (i);
+      printf ("%d clients  %llu in  %llu out  %llu failed  %.1f/s"
+              "  latency us p50 %.1f  p99 %.1f  max %.1f\n",
+              clients, (unsigned long long) reports_in,
+              (unsigned long long) reports_out,
+              (unsigned long long) failures, reports_out/seconds,
+              percentile (latency, 0.5)*1e-3,
+              percentile (latency, 0.99)*1e-3,
+              (latency.empty () ? 0 : latency.back ())*1e-3);
+      fflush (stdout);
+      latency.clear ();
+      reports_in = reports_out = failures = 0; }
+
+    void run () {
+      int64_t reaped = Telemetry::now_ns ();
+      int64_t reported = reaped;
+      while (!stopping) {
+        if (drain ())
+          send ();
+
+        int64_t now = Telemetry::now_ns ();
+        if (now - reaped >= SLEEP_NS) {
+          reap ();
+          reaped = now;
+        }
+        if (option_verbose && now - reported >= option_interval*1000000000LL) {
+          report ((now - reported)*1e-9);
+          reported = now;
+        }
+
+        // Reading the doorbell before the last look at the rings
+        // means a report published after it changes the doorbell and
+        // the wait returns at once.
+        hub->sleeping.store (1, std::memory_order_relaxed);
+        std::atomic_thread_fence (std::memory_order_seq_cst);
+        auto bell = hub->doorbell.load (std::memory_order_relaxed);
+        if (idle ())
+          HID::Shm::wait (hub->doorbell, bell, SLEEP_NS);
+        hub->sleeping.store (0, std::memory_order_relaxed);
+      }
+    }
+  };
+
+}
+
+void usage () {
+  printf (
+          "usage: omni-daemon [OPTIONS]\n"
+          "\n"
+          "  Owns the cap and shares it between the processes that open\n"
+          "  it through the hub, by the priority each sets in\n"
+          "  OMNIWEAR_PRIORITY.\n"
+          "\n"
+          "  -v              - Print clients, reports and latency\n"
+          "  -i SECONDS      - Print every SECONDS (10)\n"
+          "  -t              - Enable talking\n"
+          "  -h|?            - Show usage\n"
+          );
+  exit (0);
+}
+
+int main (int argc, const char** argv)
+{
+  for (--argc, ++argv; argc > 0; --argc, ++argv) {
+    std::string arg (*argv);
+    if (arg[0] != '-')
+      usage ();
+    switch (arg[1]) {
+    case 'i':
+      if (argc < 2)
+        usage ();
+      option_interval = strtol (argv[1], nullptr, 0);
+      if (option_interval <= 0)
+        usage ();
+      --argc, ++argv;
+      break;
+    case 'v':
+      option_verbose = true;
+      break;
+    case 't':
+      option_talk = true;
+      break;
+    default:
+      usage ();
+      break;
+    }
+  }
+
+  // Before the cap is touched, which the running daemon drives.
+  if (auto pid = running ()) {
+    printf ("omni-daemon already running, pid %d\n", int (pid));
+    return 1;
+  }
+
+  auto d = Omniwear::open (option_talk);
+  if (!d) {
+    printf ("unable to find omniwear device\n");
+    return 1;
+  }
+  auto mapping = Omniwear::linear_mapping (127, 15, 128);
+  Omniwear::define_packed (d.get (), &mapping[0], mapping.size ());
+  Omniwear::reset_motors (d.get ());
+
+  auto hub = create_hub ();
+  if (!hub) {
+    printf ("unable to create the hub '%s'\n", HID::Shm::NAME);
+    return 1;
+  }
+
+  struct sigaction action {};
+  action.sa_handler = stop;
+  sigaction (SIGINT, &action, nullptr);
+  sigaction (SIGTERM, &action, nullptr);
+
+  Daemon daemon (hub, d.get ());
+  daemon.run ();
+
+  Omniwear::reset_motors (d.get ());
+  remove_hub (hub);
+  return 0;
+}
@@ -0,0 +1,555 @@
+/** @file main-microbench.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Microbenchmarks of the haptic engine and the report encoder,
+   statically linked to the null HID sink in hid-null.cc.  Built and
+   run by 'make bench'.
+
+   Each benchmark prints one JSON object per line,
+
+     {"bench":"execute_haptic_effects","mix":"nearest","targets":16,
+      "iterations":...,"ns_per_op":...,"ops_per_s":...,
+      "allocs_per_op":...}
+
+   so that the output of two releases can be compared with a script.
+   Fields that don't apply to a benchmark are omitted.  On Linux,
+   when the kernel allows it, each line also carries
+   "l1d_misses_per_op" and "llc_misses_per_op", the cache misses of
+   the benchmark's reads counted by perf_event_open.
+
+   NOTES
+   =====
+
+   o Targets.  The benchmark is built with MAX_TARGETS raised to 256
+     so that it can measure radar updates beyond the default limit of
+     64.  The state is larger than in the library, but no loop in the
+     engine runs past the number of targets in use.
+
+   o Scenes.  Targets orbit the player at different ranges, heights
+     and speeds and the player turns slowly, so that every frame sees
+     different ranges and bearings.  Frames are generated before
+     timing starts and cycled through while timing.
+
+   o Allocations.  Global operator new is replaced to count
+     allocations.  The counts include the SDK because it is linked
+     into the benchmark.
+
+   o Fixed point.  Before the benchmarks, each scene is run through
+     both the float and the fixed point engine, see haptic_fixed.h,
+     and the motor intensities are compared.  Each scene prints a
+     line with "check":"fixed_point" and the program exits with 1
+     when a scene is out of tolerance.
+
+*/
+
+#include "omniwear_SDK.h"
+#include "haptic_fixed.h"
+#include "haptic_oscillator.h"
+#include "omniwear.h"
+#include "telemetry.h"
+#include <array>
+#include <atomic>
+#if defined (__linux__)
+# include <linux/perf_event.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif
+#include <math.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+  std::atomic<uint64_t> allocations$;
+
+  int64_t ms_min = 200;           // Minimum time for each benchmark
+  std::string filter;
+
+  constexpr int C_FRAMES = 64;    // Frames in a scene
+  constexpr int C_TYPES = 4;      // Target types in a scene
+  constexpr int C_CHECK_FRAMES = 600;   // Frames compared by the check
+
+  // The fixed point engine passes when no more than TOLERANCE_OVER
+  // of the motors differ from the float engine by more than
+  // TOLERANCE.
+  constexpr int TOLERANCE = 1;
+  constexpr double TOLERANCE_OVER = 0.01;
+  const int target_counts[] = { 1, 16, 64, MAX_TARGETS };
+
+  struct Frame {
+    std::vector<haptic_target_t> targets;
+    vec3_t origin;
+    vec3_t viewangles_deg;
+  };
+
+  /** Generate a scene of count targets moving around the player. */
+  std::vector<Frame> make_scene (int count) {
+    std::vector<Frame> frames (C_FRAMES);
+    for (int f = 0; f < C_FRAMES; ++f) {
+      auto& frame = frames[f];
+      float t = f/60.0f;
+      frame.origin[0] = 10*t;
+      frame.origin[1] = 0;
+      frame.origin[2] = 0;
+      frame.viewangles_deg[0] = 5*sinf (t);
+      frame.viewangles_deg[1] = fmodf (90*t, 360);
+      frame.viewangles_deg[2] = 0;
+      frame.targets.resize (count);
+      for (int i = 0; i < count; ++i) {
+        auto& target = frame.targets[i];
+        memset (&target, 0, sizeof (target));
+        float range = 200 + (i*997) % (MAX_RANGE - 400);
+        float speed = 0.2f + (i % 7)*0.15f;
+        float phase = i*2.39996f;   // Golden angle spreads them out
+        float azimuth = phase + speed*t;
+        target.type = i % C_TYPES;
+        target.index = i;
+        target.location[0] = frame.origin[0] + range*cosf (azimuth);
+        target.location[1] = frame.origin[1] + range*sinf (azimuth);
+        target.location[2] = (i % 5 - 2)*150*cosf (t + phase);
+        target.viewangles_deg[1] = fmodf (azimuth*57.29578f + 180, 360);
+        target.healthvalue = 100;
+      }
+    }
+    return frames;
+  }
+
+  /** An entity as a game might store it, with the fields the radar
+      needs among many it doesn't. */
+  struct Entity {
+    int number;
+    char classname[64];
+    vec3_t origin;
+    vec3_t velocity;
+    vec3_t angles;
+    int health;
+    int flags;
+    int kind;
+    char model[64];
+    float think_time;
+    void* owner;
+  };
+
+  std::vector<Entity> make_entities (const Frame& frame) {
+    std::vector<Entity> entities (frame.targets.size ());
+    for (size_t i = 0; i < entities.size (); ++i) {
+      auto& entity = entities[i];
+      auto& target = frame.targets[i];
+      memset (&entity, 0, sizeof (entity));
+      entity.number = target.index;
+      entity.kind = target.type;
+      entity.health = target.healthvalue;
+      memcpy (entity.origin, target.location, sizeof (vec3_t));
+      memcpy (entity.angles, target.viewangles_deg, sizeof (vec3_t));
+    }
+    return entities;
+  }
+
+  enum Mix {
+    mix_nearest,
+    mix_loudness_panning,
+  };
+
+  const char* mix_name (Mix mix) {
+    return mix == mix_nearest ? "nearest" : "loudness_panning"; }
+
+  void init_state (haptic_device_state_t& state, Mix mix) {
+    memset (&state, 0, sizeof (state));
+    init_haptic_state (&state);
+    if (open_omniwear_device (&state) != OMNI_SUCCESS) {
+      printf ("unable to open null device\n");
+      exit (1);
+    }
+    set_haptic_effect (&state, 0, BUZZ_CONTINUOUSLY, 0);
+    set_haptic_effect (&state, 1, PULSE_BY_RANGE, 0);
+    set_haptic_effect (&state, 2, PULSE_BY_PERIOD, 0.5f);
+    set_haptic_effect (&state, 3, BUZZ_IF_TARGET_IS_LOOKING_AT_PLAYER, 0);
+    if (mix == mix_loudness_panning) {
+      set_haptic_mixing (&state, COMBINE_LOUDNESS,
+                         FALLOFF_SMOOTH, FALLOFF_LINEAR);
+      set_haptic_spatialization (&state, SPATIAL_PANNING);
+    }
+  }
+
+  /** Hardware counters of cache misses for the calling thread.  A
+      counter that can't be opened, as in most virtual machines or
+      with perf_event_paranoid above 2, reads as -1. */
+  struct Counters {
+    enum { l1d, llc, c_counters };
+    int fds[c_counters];
+
+    Counters () {
+      for (auto& fd : fds)
+        fd = -1;
+#if defined (__linux__)
+      const uint64_t configs[c_counters] = {
+        PERF_COUNT_HW_CACHE_L1D
+        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_LL
+        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+      };
+      for (int i = 0; i < c_counters; ++i) {
+        perf_event_attr attr;
+        memset (&attr, 0, sizeof (attr));
+        attr.size = sizeof (attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = configs[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fds[i] = int (syscall (SYS_perf_event_open, &attr, 0, -1, -1, 0));
+      }
+#endif
+    }
+
+    void read (int64_t values[c_counters]) const {
+      for (int i = 0; i < c_counters; ++i) {
+        values[i] = -1;
+#if defined (__linux__)
+        uint64_t v;
+        if (fds[i] >= 0 && ::read (fds[i], &v, sizeof (v)) == sizeof (v))
+          values[i] = int64_t (v);
+#endif
+      }
+    }
+  };
+
+  const Counters& counters () {
+    static Counters counters;
+    return counters; }
+
+  struct Case {
+    const char* bench;
+    const char* mix;              // Omitted when null
+    int targets;                  // Omitted when negative
+  };
+
+  /** Run op, which performs one operation given its iteration number,
+      for at least ms_min and print the result. */
+  template<typename Op>
+  void run (const Case& c, Op op) {
+    std::string name (c.bench);
+    if (c.mix)
+      name += std::string ("/") + c.mix;
+    if (c.targets >= 0)
+      name += "/" + std::to_string (c.targets);
+    if (!filter.empty () && name.find (filter) == std::string::npos)
+      return;
+
+    // Warm the caches and size the batches so that the clock is read
+    // rarely.
+    uint64_t i = 0;
+    uint64_t batch = 1;
+    int64_t start = Telemetry::now_ns ();
+    while (Telemetry::now_ns () - start < 10*1000000LL) {
+      for (uint64_t j = 0; j < batch; ++j)
+        op (i++);
+      batch *= 2;
+    }
+    batch = batch/16 + 1;
+
+    uint64_t iterations = 0;
+    auto allocations = allocations$.load ();
+    int64_t misses[Counters::c_counters];
+    counters ().read (misses);
+    start = Telemetry::now_ns ();
+    int64_t elapsed;
+    do {
+      for (uint64_t j = 0; j < batch; ++j)
+        op (i++);
+      iterations += batch;
+      elapsed = Telemetry::now_ns () - start;
+    } while (elapsed < ms_min*1000000LL);
+    allocations = allocations$.load () - allocations;
+    int64_t misses_end[Counters::c_counters];
+    counters ().read (misses_end);
+
+    double ns_per_op = double (elapsed)/iterations;
+    printf ("{\"bench\":\"%s\"", c.bench);
+    if (c.mix)
+      printf (",\"mix\":\"%s\"", c.mix);
+    if (c.targets >= 0)
+      printf (",\"targets\":%d", c.targets);
+    printf (",\"iterations\":%llu,\"ns_per_op\":%.1f,\"ops_per_s\":%.0f"
+            ",\"allocs_per_op\":%.3f",
+            (unsigned long long) iterations, ns_per_op, 1e9/ns_per_op,
+            double (allocations)/iterations);
+    if (misses[Counters::l1d] >= 0 && misses_end[Counters::l1d] >= 0)
+      printf (",\"l1d_misses_per_op\":%.2f",
+              double (misses_end[Counters::l1d] - misses[Counters::l1d])
+              /iterations);
+    if (misses[Counters::llc] >= 0 && misses_end[Counters::llc] >= 0)
+      printf (",\"llc_misses_per_op\":%.2f",
+              double (misses_end[Counters::llc] - misses[Counters::llc])
+              /iterations);
+    printf ("}\n");
+    fflush (stdout);
+  }
+
+  void bench_engine (Mix mix) {
+    for (auto count : target_counts) {
+      auto frames = make_scene (count);
+      haptic_device_state_t state;
+
+      init_state (state, mix);
+      run ({ "update_haptic_radar", mix_name (mix), count }, [&] (uint64_t i) {
+          auto& frame = frames[i % C_FRAMES];
+          update_haptic_radar (&state, &frame.targets[0], count,
+                               frame.origin, frame.viewangles_deg);
+        });
+      close_omniwear_device (&state);
+
+      init_state (state, mix);
+      {
+        auto& frame = frames[0];
+        update_haptic_radar (&state, &frame.targets[0], count,
+                             frame.origin, frame.viewangles_deg);
+      }
+      run ({ "execute_haptic_effects", mix_name (mix), count },
+           [&] (uint64_t i) {
+             execute_haptic_effects (&state, i/60.0);
+           });
+      close_omniwear_device (&state);
+
+      init_state (state, mix);
+      run ({ "frame", mix_name (mix), count }, [&] (uint64_t i) {
+          auto& frame = frames[i % C_FRAMES];
+          update_haptic_radar (&state, &frame.targets[0], count,
+                               frame.origin, frame.viewangles_deg);
+          execute_haptic_effects (&state, i/60.0);
+        });
+      close_omniwear_device (&state);
+
+      // Ingesting the game's entities, copied into haptic_target_t
+      // first and read in place.
+      std::vector<std::vector<Entity>> entities;
+      for (auto& frame : frames)
+        entities.push_back (make_entities (frame));
+      std::vector<haptic_target_t> copies (count);
+      init_state (state, mix);
+      run ({ "ingest_copy", mix_name (mix), count }, [&] (uint64_t i) {
+          auto& frame = frames[i % C_FRAMES];
+          for (int t = 0; t < count; ++t) {
+            auto& entity = entities[i % C_FRAMES][t];
+            auto& target = copies[t];
+            memset (&target, 0, sizeof (target));
+            target.index = entity.number;
+            target.type = entity.kind;
+            target.healthvalue = entity.health;
+            memcpy (target.location, entity.origin, sizeof (vec3_t));
+            memcpy (target.viewangles_deg, entity.angles, sizeof (vec3_t));
+          }
+          update_haptic_radar (&state, &copies[0], count,
+                               frame.origin, frame.viewangles_deg);
+        });
+      close_omniwear_device (&state);
+
+      init_state (state, mix);
+      run ({ "ingest_strided", mix_name (mix), count }, [&] (uint64_t i) {
+          auto& frame = frames[i % C_FRAMES];
+          auto& first = entities[i % C_FRAMES][0];
+          haptic_target_view_t view;
+          view.location = first.origin;
+          view.location_stride = sizeof (Entity);
+          view.viewangles_deg = first.angles;
+          view.viewangles_stride = sizeof (Entity);
+          view.type = &first.kind;
+          view.type_stride = sizeof (Entity);
+          view.index = &first.number;
+          view.index_stride = sizeof (Entity);
+          update_haptic_radar_strided (&state, &view, nullptr, count,
+                                       frame.origin, frame.viewangles_deg);
+        });
+      close_omniwear_device (&state);
+
+      // The scene published through a snapshot and applied before
+      // each frame, as by a haptic thread.
+      init_state (state, mix);
+      {
+        auto snapshot = create_haptic_snapshot (&state);
+        run ({ "snapshot_frame", mix_name (mix), count }, [&] (uint64_t i) {
+            auto& frame = frames[i % C_FRAMES];
+            publish_haptic_snapshot (snapshot, &frame.targets[0], count,
+                                     frame.origin, frame.viewangles_deg,
+                                     nullptr, 0);
+            apply_haptic_snapshot (snapshot);
+            execute_haptic_effects (&state, i/60.0);
+          });
+        destroy_haptic_snapshot (snapshot);
+      }
+      close_omniwear_device (&state);
+
+      // The delta API with one target in sixteen moving each frame
+      // and the player standing still.
+      init_state (state, mix);
+      for (int t = 0; t < count; ++t)
+        add_haptic_target (&state, &frames[0].targets[t]);
+      set_haptic_player_pose (&state, frames[0].origin,
+                              frames[0].viewangles_deg);
+      run ({ "delta_frame", mix_name (mix), count }, [&] (uint64_t i) {
+          auto& frame = frames[i % C_FRAMES];
+          for (int t = int (i % 16); t < count; t += 16)
+            move_haptic_target (&state, t, frame.targets[t].location,
+                                frame.targets[t].viewangles_deg);
+          execute_haptic_effects (&state, i/60.0);
+        });
+      close_omniwear_device (&state);
+    }
+  }
+
+  /** Run the scenes through the float and the fixed point engines
+      and compare the intensities of the motors.  Prints one line
+      for each scene and returns false when the scene is out of
+      tolerance. */
+  bool check_fixed_point (Mix mix) {
+    bool ok = true;
+    for (auto count : target_counts) {
+      std::string name = std::string ("fixed_point/") + mix_name (mix)
+        + "/" + std::to_string (count);
+      if (!filter.empty () && name.find (filter) == std::string::npos)
+        continue;
+
+      auto frames = make_scene (count);
+      haptic_device_state_t state;
+      init_state (state, mix);
+
+      uint64_t motors = 0;
+      uint64_t over = 0;
+      uint64_t error_sum = 0;
+      int error_max = 0;
+      for (int i = 0; i < C_CHECK_FRAMES; ++i) {
+        auto& frame = frames[i % C_FRAMES];
+        double game_time = i/60.0;
+        update_haptic_radar (&state, &frame.targets[0], count,
+                             frame.origin, frame.viewangles_deg);
+        int float_frame[C_MOTORS];
+        int fixed_frame[C_MOTORS];
+        HapticFixed::compare (&state, game_time, float_frame, fixed_frame);
+        execute_haptic_effects (&state, game_time);
+
+        for (int m = 0; m < C_MOTORS; ++m) {
+          int error = abs (float_frame[m] - fixed_frame[m]);
+          error_sum += error;
+          error_max = error > error_max ? error : error_max;
+          over += error > TOLERANCE;
+          ++motors;
+        }
+      }
+      close_omniwear_device (&state);
+
+      bool pass = over <= motors*TOLERANCE_OVER;
+      ok = ok && pass;
+      printf ("{\"check\":\"fixed_point\",\"mix\":\"%s\",\"targets\":%d"
+              ",\"motors\":%llu,\"mean_error\":%.3f,\"max_error\":%d"
+              ",\"over_tolerance\":%llu,\"pass\":%s}\n",
+              mix_name (mix), count, (unsigned long long) motors,
+              double (error_sum)/motors, error_max,
+              (unsigned long long) over, pass ? "true" : "false");
+      fflush (stdout);
+    }
+    return ok;
+  }
+
+  void bench_oscillators () {
+    HapticOscillator::Bank bank;
+    for (int m = 0; m < C_MOTORS; ++m)
+      bank.set (m, haptic_waveform_t (WAVEFORM_TRIANGLE + m % 4),
+                0.5f + m*0.1f, 100, m/float (C_MOTORS));
+    int intensities[C_MOTORS];
+    volatile int sink = 0;
+    run ({ "oscillator_tick", nullptr, -1 }, [&] (uint64_t i) {
+        bank.tick (i/60.0, intensities);
+        sink = intensities[i % C_MOTORS];
+      });
+  }
+
+  void bench_encoder () {
+    auto d = Omniwear::open ();
+    if (!d) {
+      printf ("unable to open null device\n");
+      exit (1);
+    }
+
+    run ({ "define_packed_linear", nullptr, -1 }, [&] (uint64_t) {
+        Omniwear::define_packed_linear (d.get (), 127, 15, 128);
+      });
+
+    volatile int sink = 0;
+    run ({ "nearest_packed_code", nullptr, -1 }, [&] (uint64_t i) {
+        sink = Omniwear::nearest_packed_code (int (i % 101));
+      });
+
+    run ({ "configure_motor", nullptr, -1 }, [&] (uint64_t i) {
+        Omniwear::configure_motor (d.get (), int (i % C_MOTORS),
+                                   int (i % 101));
+      });
+
+    std::array<int,C_MOTORS> duties;
+    run ({ "configure_motors_packed", nullptr, -1 }, [&] (uint64_t i) {
+        for (int motor = 0; motor < C_MOTORS; ++motor)
+          duties[motor] = int ((i + motor*7) % 101);
+        Omniwear::configure_motors_packed (d.get (), &duties[0],
+                                           duties.size ());
+      });
+  }
+
+}
+
+void* operator new (size_t cb) {
+  allocations$.fetch_add (1, std::memory_order_relaxed);
+  if (auto p = malloc (cb ? cb : 1))
+    return p;
+  throw std::bad_alloc ();
+}
+
+void operator delete (void* p) noexcept {
+  free (p); }
+
+void operator delete (void* p, size_t) noexcept {
+  free (p); }
+
+void usage () {
+  printf (
+          "usage: omni-microbench [OPTIONS] [FILTER]\n"
+          "\n"
+          "  FILTER          - Only run benchmarks whose name contains FILTER\n"
+          "                     e.g. execute_haptic_effects/nearest/16\n"
+          "  -t MS           - Run each benchmark for at least MS ms (200)\n"
+          "  -h|?            - Show usage\n"
+          );
+  exit (0);
+}
+
+int main (int argc, const char** argv)
+{
+  for (--argc, ++argv; argc > 0; --argc, ++argv) {
+    std::string arg (*argv);
+    if (arg == "-t" && argc > 1) {
+      ms_min = strtol (argv[1], nullptr, 0);
+      --argc, ++argv;
+    }
+    else if (arg[0] == '-')
+      usage ();
+    else
+      filter = arg;
+  }
+
+  bool ok = check_fixed_point (mix_nearest);
+  ok = check_fixed_point (mix_loudness_panning) && ok;
+
+  bench_engine (mix_nearest);
+  bench_engine (mix_loudness_panning);
+  bench_oscillators ();
+  bench_encoder ();
+
+  flush_omniwear_log (0);
+  return ok ? 0 : 1;
+}
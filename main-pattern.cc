@@ -0,0 +1,204 @@
+/** @file main-pattern.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Compiler of haptic patterns.  Compiles a pattern source, see
+   haptic_pattern.h, into the file of pre-encoded reports that
+   load_haptic_pattern maps.  It also lists a compiled pattern, and
+   plays one into a cap through the same sequencer as the SDK, at
+   the frame rate of a game.
+
+   Linked like omni-replay, with the HID implementation for the
+   platform, or with the null sink when built with CONFIG_NULL_HID=y.
+
+*/
+
+#include "haptic_pattern.h"
+#include "hid.h"
+#include "omniwear.h"
+#include "telemetry.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+
+namespace {
+
+  std::string option_output;
+  int option_seconds = 10;
+  int option_frame_ms = 16;
+  bool option_list;
+  bool option_play;
+  bool option_talk;
+
+  bool read_file (const std::string& path, std::string& text) {
+    auto fp = fopen (path.c_str (), "rb");
+    if (!fp)
+      return false;
+    char rgb[4096];
+    size_t cb;
+    while ((cb = fread (rgb, 1, sizeof (rgb), fp)) > 0)
+      text.append (rgb, cb);
+    bool ok = !ferror (fp);
+    fclose (fp);
+    return ok; }
+
+  int compile (const std::string& path) {
+    std::string source;
+    if (!read_file (path, source)) {
+      printf ("unable to read '%s'\n", path.c_str ());
+      return 1;
+    }
+
+    HapticPattern::Compiled pattern;
+    std::string error;
+    if (!HapticPattern::compile (source, pattern, error)) {
+      printf ("%s: %s\n", path.c_str (), error.c_str ());
+      return 1;
+    }
+
+    auto output = option_output;
+    if (output.empty ()) {
+      auto dot = path.rfind ('.');
+      auto slash = path.rfind ('/');
+      output = path.substr (0, dot != std::string::npos
+                            && (slash == std::string::npos || dot > slash)
+                            ? dot : std::string::npos) + ".omp";
+    }
+    if (!HapticPattern::write (output, pattern)) {
+      printf ("unable to write '%s'\n", output.c_str ());
+      return 1;
+    }
+    printf ("%s: %d reports  %.3f s%s\n", output.c_str (),
+            int (pattern.steps.size ()), pattern.duration_ns*1e-9,
+            pattern.loop ? "  loop" : "");
+    return 0;
+  }
+
+  void list (const HapticPattern::File& file) {
+    printf ("mapping");
+    for (int i = 0; i < 16; ++i)
+      printf (" %d", file.mapping ()[i]);
+    printf ("\n%d reports  %.3f s%s\n", file.count (),
+            file.duration_ns ()*1e-9, file.loop () ? "  loop" : "");
+    for (int i = 0; i < file.count (); ++i) {
+      printf ("%12.6f", file.time_ns (i)*1e-9);
+      for (size_t j = 0; j < HapticPattern::CB_REPORT; ++j)
+        printf (" %02x", uint8_t (file.report (i)[j]));
+      printf ("\n");
+    }
+  }
+
+  int play (const HapticPattern::File& file) {
+    auto d = Omniwear::open (option_talk);
+    if (!d) {
+      printf ("unable to find omniwear device\n");
+      return 1;
+    }
+    Omniwear::define_packed (d.get (), file.mapping (), 16);
+
+    uint64_t reports = 0;
+    HapticPattern::Sequencer sequencer;
+    int64_t start = Telemetry::now_ns ();
+    int64_t end = start + option_seconds*1000000000LL;
+    sequencer.start (&file, 0);
+    for (int64_t now = start; now < end; now = Telemetry::now_ns ()) {
+      bool playing = sequencer.play ((now - start)*1e-9,
+                                     [&] (const char* report) {
+          HID::write (d.get (), report, HapticPattern::CB_REPORT);
+          ++reports; });
+      if (!playing)
+        break;
+      std::this_thread::sleep_for
+        (std::chrono::milliseconds (option_frame_ms));
+      HID::service ();
+    }
+
+    Omniwear::reset_motors (d.get ());
+    printf ("%llu reports  %.3f s\n", (unsigned long long) reports,
+            (Telemetry::now_ns () - start)*1e-9);
+    return 0;
+  }
+
+}
+
+void usage () {
+  printf (
+          "usage: omni-pattern [OPTIONS] PATTERN\n"
+          "\n"
+          "  Compiles the PATTERN source into PATTERN.omp, or with -l or\n"
+          "  -p, reads the compiled PATTERN.\n"
+          "\n"
+          "  -o FILE         - Write the compiled pattern to FILE\n"
+          "  -l              - List the reports of a compiled pattern\n"
+          "  -p              - Play a compiled pattern into the cap\n"
+          "  -s SECONDS      - Stop playing a pattern after SECONDS (10)\n"
+          "  -f MS           - Play with a frame every MS (16)\n"
+          "  -t              - Enable talking\n"
+          "  -h|?            - Show usage\n"
+          );
+  exit (0);
+}
+
+int main (int argc, const char** argv)
+{
+  std::string path;
+
+  for (--argc, ++argv; argc > 0; --argc, ++argv) {
+    std::string arg (*argv);
+    if (arg[0] != '-') {
+      path = arg;
+      continue;
+    }
+    switch (arg[1]) {
+    case 'o':
+      if (argc < 2)
+        usage ();
+      option_output = argv[1];
+      --argc, ++argv;
+      break;
+    case 's':
+    case 'f':
+      if (argc < 2)
+        usage ();
+      {
+        int value = strtol (argv[1], nullptr, 0);
+        if (value < 0)
+          usage ();
+        (arg[1] == 's' ? option_seconds : option_frame_ms) = value;
+      }
+      --argc, ++argv;
+      break;
+    case 'l':
+      option_list = true;
+      break;
+    case 'p':
+      option_play = true;
+      break;
+    case 't':
+      option_talk = true;
+      break;
+    default:
+      usage ();
+      break;
+    }
+  }
+
+  if (path.empty ())
+    usage ();
+
+  if (!option_list && !option_play)
+    return compile (path);
+
+  HapticPattern::File file;
+  if (!file.open (path)) {
+    printf ("unable to read compiled pattern '%s'\n", path.c_str ());
+    return 1;
+  }
+  if (option_list)
+    list (file);
+  return option_play ? play (file) : 0;
+}
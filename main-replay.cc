@@ -0,0 +1,182 @@
+/** @file main-replay.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Replays a capture of HID reports, made with
+   start_omniwear_capture, into a cap.  Reports are sent at the times
+   they were captured, or scaled by a speed factor, or as fast as the
+   device accepts them.  Lateness, the time from when a report was
+   due to when it was submitted, shows whether the transport kept up
+   with the game.
+
+   Linked like omni, with the HID implementation for the platform.
+   Build with 'make CONFIG_NULL_HID=y' to link with the null sink
+   instead.
+
+*/
+
+#include "capture.h"
+#include "hid.h"
+#include "telemetry.h"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+  bool option_fast;
+  bool option_dump;
+  double option_speed = 1;
+  int option_loops = 1;
+
+  int64_t percentile (const std::vector<int64_t>& sorted, double q) {
+    if (sorted.empty ())
+      return 0;
+    size_t i = size_t (q*sorted.size ());
+    return sorted[i < sorted.size () ? i : sorted.size () - 1]; }
+
+  void dump (Capture::Reader& reader) {
+    Capture::Report report;
+    while (reader.next (report)) {
+      printf ("%12.6f %02x", report.time_ns*1e-9, report.rgb[0]);
+      for (size_t i = 1; i < report.cb; ++i)
+        printf (" %02x", report.rgb[i]);
+      printf ("\n");
+    }
+  }
+
+  void replay (Capture::Reader& reader, const HID::Device* d) {
+    uint64_t reports = 0;
+    uint64_t failures = 0;
+    std::vector<int64_t> lateness;
+    std::vector<int64_t> latency;
+
+    int64_t start = Telemetry::now_ns ();
+    int64_t offset = 0;         // Start of the current loop
+    for (int loop = 0; loop < option_loops; ++loop) {
+      reader.rewind ();
+      Capture::Report report;
+      int64_t last = 0;
+      while (reader.next (report)) {
+        last = report.time_ns;
+        int64_t due = start + offset + int64_t (report.time_ns/option_speed);
+        if (!option_fast) {
+          int64_t now = Telemetry::now_ns ();
+          if (due > now)
+            std::this_thread::sleep_for (std::chrono::nanoseconds (due - now));
+        }
+        int64_t submitted = Telemetry::now_ns ();
+        auto result = HID::write (d, (const char*) report.rgb, report.cb);
+        int64_t completed = Telemetry::now_ns ();
+        if (!option_fast)
+          lateness.push_back (submitted > due ? submitted - due : 0);
+        latency.push_back (completed - submitted);
+        ++reports;
+        if (result != int (report.cb))
+          ++failures;
+      }
+      offset += int64_t (last/option_speed);
+    }
+    int64_t elapsed = Telemetry::now_ns () - start;
+
+    std::sort (lateness.begin (), lateness.end ());
+    std::sort (latency.begin (), latency.end ());
+
+    printf ("%llu reports  %llu failed  %.3f s  %.1f/s\n",
+            (unsigned long long) reports, (unsigned long long) failures,
+            elapsed*1e-9, elapsed ? reports*1e9/elapsed : 0);
+    printf ("latency   p50 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f us\n",
+            percentile (latency, 0.50)*1e-3, percentile (latency, 0.99)*1e-3,
+            percentile (latency, 0.999)*1e-3,
+            (latency.empty () ? 0 : latency.back ())*1e-3);
+    if (!option_fast)
+      printf ("lateness  p50 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f us\n",
+              percentile (lateness, 0.50)*1e-3,
+              percentile (lateness, 0.99)*1e-3,
+              percentile (lateness, 0.999)*1e-3,
+              (lateness.empty () ? 0 : lateness.back ())*1e-3);
+  }
+
+}
+
+void usage () {
+  printf (
+          "usage: omni-replay [OPTIONS] CAPTURE\n"
+          "\n"
+          "  -f              - Send reports as fast as possible\n"
+          "  -x SPEED        - Replay at SPEED times real time (1)\n"
+          "  -n LOOPS        - Replay the capture LOOPS times (1)\n"
+          "  -d              - Print the reports instead of sending them\n"
+          "  -h|?            - Show usage\n"
+          );
+  exit (0);
+}
+
+int main (int argc, const char** argv)
+{
+  std::string path;
+
+  for (--argc, ++argv; argc > 0; --argc, ++argv) {
+    std::string arg (*argv);
+    if (arg[0] != '-') {
+      path = arg;
+      continue;
+    }
+    switch (arg[1]) {
+    case 'f':
+      option_fast = true;
+      break;
+    case 'd':
+      option_dump = true;
+      break;
+    case 'x':
+      if (argc < 2)
+        usage ();
+      option_speed = strtod (argv[1], nullptr);
+      if (!(option_speed > 0))
+        usage ();
+      --argc, ++argv;
+      break;
+    case 'n':
+      if (argc < 2)
+        usage ();
+      option_loops = strtol (argv[1], nullptr, 0);
+      if (option_loops < 1)
+        usage ();
+      --argc, ++argv;
+      break;
+    default:
+      usage ();
+      break;
+    }
+  }
+
+  if (path.empty ())
+    usage ();
+
+  Capture::Reader reader;
+  if (!reader.open (path)) {
+    printf ("unable to read capture '%s'\n", path.c_str ());
+    exit (1);
+  }
+
+  if (option_dump) {
+    dump (reader);
+    return 0;
+  }
+
+  auto d = HID::open (0x3eb, 0x2402);
+  if (!d) {
+    printf ("unable to find omniwear device\n");
+    exit (1);
+  }
+
+  replay (reader, d.get ());
+  return 0;
+}
@@ -64,6 +64,7 @@ void usage () {
 
 void open_cap () {
   open_omniwear_device (&cap$);
+  flush_omniwear_log (0);
  }
 
 void send_reset_motors () {
@@ -153,6 +154,7 @@ void op_d_0 (ArgList& args) {
     for (auto motor = 0; motor < 14; ++motor) {
       send_reset_motors ();
       send_config_motor (motor, duty);
+      flush_omniwear_log (0);
       sleep (time);
     }
 }
@@ -182,6 +184,7 @@ void op_d_1 (ArgList& args) {
       duties.fill (0);
       duties[motor] = duty;
       send_config_motors_packed (&duties[0], duties.size ());
+      flush_omniwear_log (0);
       sleep (time);
     }
 }
@@ -263,5 +266,6 @@ int main (int argc, const char** argv)
         op_config (args);
     }
   }
+  flush_omniwear_log (0);
   exit (0);
 }
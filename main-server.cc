@@ -0,0 +1,443 @@
+/** @file main-server.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Frame server for caps on thin clients.  A game server that
+   computes the haptics sends motor frames over UDP, or a Unix
+   datagram socket, see frame_server.h.  omni-server puts them
+   through a playout buffer to absorb the jitter of the network and
+   plays them into the cap at the cap's report rate, coalescing the
+   frames that come faster.  With -c it is the sender instead,
+   sweeping a beam around the cap, with loss and jitter made up on
+   request, so the server can be tried against localhost.
+
+   Linked like omni-replay, with the HID implementation for the
+   platform, or with the null sink when built with CONFIG_NULL_HID=y.
+
+   NOTES
+   =====
+
+   o Reports.  Each played frame goes out like the arbitration of
+     omni-daemon, as a packed report and corrections when many motors
+     change and as single motor reports otherwise, and only for the
+     motors that change.
+
+   o Stale.  When no frame has arrived for STALE_NS, the server turns
+     the motors off and forgets the sender, so a game server that
+     stops, or restarts from another sequence number, doesn't leave
+     the cap buzzing.
+
+   o Sender.  The server plays the frames of one sender, the source
+     address of the first frame, and drops datagrams from any other
+     until the sender goes stale.  Senders on a Unix socket that
+     don't bind an address all look alike.
+
+   o Latency.  The clocks of the sender and the server are unrelated,
+     so the latency reported is from the arrival of a frame to its
+     report to the cap, which is the playout delay plus the wait for
+     the tick.  Jitter is that of the network.
+
+*/
+
+#include "frame_server.h"
+#include "haptic_arbiter.h"
+#include "hid.h"
+#include "omniwear.h"
+#include "telemetry.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+
+  std::string option_address;
+  std::string option_unix;
+  int option_port = 4660;
+  int option_delay_ms = 20;
+  int option_rate = 100;
+  int option_seconds = -1;
+  int option_interval = 10;
+  int option_frame_rate = 60;
+  int option_loss = 0;
+  int option_jitter_ms = 0;
+  bool option_client;
+  bool option_verbose;
+  bool option_talk;
+
+  constexpr int64_t STALE_NS = 500000000;
+
+  volatile sig_atomic_t stopping;
+
+  void stop (int) {
+    stopping = 1; }
+
+  int64_t percentile (const std::vector<int64_t>& sorted, double q) {
+    if (sorted.empty ())
+      return 0;
+    size_t i = size_t (q*sorted.size ());
+    return sorted[i < sorted.size () ? i : sorted.size () - 1]; }
+
+  struct Address {
+    sockaddr_storage storage {};
+    socklen_t cb = 0;
+    sockaddr* get () { return (sockaddr*) &storage; }
+  };
+
+  // The socket address from the options, for the server to bind or
+  // for the client to send to.
+  bool address (Address& a) {
+    if (!option_unix.empty ()) {
+      auto un = (sockaddr_un*) &a.storage;
+      if (option_unix.size () >= sizeof (un->sun_path))
+        return false;
+      un->sun_family = AF_UNIX;
+      strcpy (un->sun_path, option_unix.c_str ());
+      a.cb = sizeof (sockaddr_un);
+      return true;
+    }
+    auto in = (sockaddr_in*) &a.storage;
+    in->sin_family = AF_INET;
+    in->sin_port = htons (option_port);
+    auto host = option_address.empty ()
+      ? (option_client ? "127.0.0.1" : "0.0.0.0") : option_address.c_str ();
+    if (inet_pton (AF_INET, host, &in->sin_addr) != 1)
+      return false;
+    a.cb = sizeof (sockaddr_in);
+    return true; }
+
+  int open_socket (Address& a) {
+    if (!address (a))
+      return -1;
+    return socket (a.storage.ss_family, SOCK_DGRAM, 0); }
+
+  int client () {
+    Address a;
+    int fd = open_socket (a);
+    if (fd < 0) {
+      printf ("unable to open a socket for '%s'\n",
+              option_unix.empty () ? option_address.c_str ()
+              : option_unix.c_str ());
+      return 1;
+    }
+
+    srand (unsigned (Telemetry::now_ns ()));
+    FrameServer::Frame frame;
+    frame.sequence = uint32_t (rand ());
+    frame.count = 13;
+
+    uint64_t sent = 0;
+    uint64_t dropped = 0;
+    std::vector<std::pair<int64_t,std::vector<uint8_t>>> pending;
+    int64_t period = 1000000000LL/option_frame_rate;
+    int64_t start = Telemetry::now_ns ();
+    int64_t end = start + (option_seconds < 0 ? 5 : option_seconds)
+      *1000000000LL;
+    int64_t next = start;
+    while (!stopping && (next < end || !pending.empty ())) {
+      int64_t now = Telemetry::now_ns ();
+      if (next < end && now >= next) {
+        frame.time_ns = next;
+        frame.intensities.fill (0);
+        int beam = int ((next - start)/100000000) % 8;
+        frame.intensities[beam] = 80;
+        frame.intensities[(beam + 1) % 8] = 30;
+        std::vector<uint8_t> rgb (FrameServer::CB_FRAME_MAX);
+        rgb.resize (FrameServer::encode (frame, &rgb[0]));
+        ++frame.sequence;
+        if (option_loss && rand () % 100 < option_loss)
+          ++dropped;
+        else
+          pending.push_back ({ next + (option_jitter_ms
+                                       ? (rand () % (option_jitter_ms*1000))
+                                       *1000LL : 0), rgb });
+        next += period;
+      }
+      for (size_t i = 0; i < pending.size (); ) {
+        if (pending[i].first > now) {
+          ++i;
+          continue;
+        }
+        auto& rgb = pending[i].second;
+        if (sendto (fd, &rgb[0], rgb.size (), 0, a.get (), a.cb)
+            == ssize_t (rgb.size ()))
+          ++sent;
+        pending.erase (pending.begin () + i);
+      }
+      usleep (500);
+    }
+
+    close (fd);
+    printf ("%llu frames sent  %llu dropped\n", (unsigned long long) sent,
+            (unsigned long long) dropped);
+    return 0; }
+
+  struct Server {
+    Omniwear::Device* d;
+    FrameServer::Playout playout { option_delay_ms*1000000LL };
+    HapticArbiter::Output output
+      { Omniwear::linear_mapping (127, 15, 128) };
+    HapticArbiter::Duties duties {};
+    std::vector<int64_t> latency;
+    uint64_t reports_out = 0;
+    uint64_t failures = 0;
+    uint64_t foreign = 0;
+    int64_t last_arrival = 0;
+    bool live = false;          // A sender is driving the cap
+    Address sender;             // Where its frames come from
+    bool bound = false;
+
+    explicit Server (Omniwear::Device* d) : d (d) {}
+
+    void send () {
+      Omniwear::Report reports[HapticArbiter::C_SINGLE + 1];
+      int count = output.plan (duties, reports);
+      for (int i = 0; i < count; ++i) {
+        if (HID::write (d, &reports[i][0], reports[i].size ())
+            != int (reports[i].size ())) {
+          ++failures;
+          output.forget ();
+        }
+      }
+      reports_out += count;
+      HID::service (); }
+
+    void tick (int64_t now) {
+      FrameServer::Frame frame;
+      int64_t wait_ns;
+      if (playout.take (now, frame, wait_ns)) {
+        for (int m = 0; m < HapticArbiter::C_CHANNELS; ++m)
+          duties[m] = m < frame.count ? frame.intensities[m]*255/100 : 0;
+        latency.push_back (wait_ns);
+        live = true;
+        send ();
+      }
+      else if (live && now - last_arrival >= STALE_NS) {
+        if (option_verbose)
+          printf ("sender stale\n");
+        duties.fill (0);
+        playout.restart ();
+        live = false;
+        bound = false;
+        send ();
+      }
+    }
+
+    // Take a datagram from source, if it is from the sender, or
+    // adopt source as the sender when there is none or it went
+    // stale and the datagram is a frame.
+    void receive (const uint8_t* rgb, size_t cb, const Address& source,
+                  int64_t now) {
+      bool same = bound && source.cb == sender.cb
+        && memcmp (&source.storage, &sender.storage, source.cb) == 0;
+      if (!same) {
+        FrameServer::Frame frame;
+        if ((bound && now - last_arrival < STALE_NS)
+            || !FrameServer::decode (rgb, cb, frame)) {
+          ++foreign;
+          return;
+        }
+        if (option_verbose && bound)
+          printf ("sender replaced\n");
+        sender = source;
+        bound = true;
+        playout.restart ();
+      }
+      last_arrival = now;
+      playout.receive (rgb, cb, now); }
+
+    void report (double seconds) {
+      std::sort (latency.begin (), latency.end ());
+      auto& s = playout.stats ();
+      printf ("%llu received  %llu played  %llu coalesced  %llu lost"
+              "  %llu late  %llu duplicate  %llu invalid  %llu foreign"
+              "  %llu restarts\n",
+              (unsigned long long) s.received, (unsigned long long) s.played,
+              (unsigned long long) s.coalesced, (unsigned long long) s.lost (),
+              (unsigned long long) s.late, (unsigned long long) s.duplicate,
+              (unsigned long long) s.invalid, (unsigned long long) foreign,
+              (unsigned long long) s.restarts);
+      printf ("%llu reports  %.1f/s  %llu failed  jitter %.3f ms"
+              "  latency ms p50 %.3f  p99 %.3f  max %.3f\n",
+              (unsigned long long) reports_out, reports_out/seconds,
+              (unsigned long long) failures, s.jitter_ns*1e-6,
+              percentile (latency, 0.5)*1e-6,
+              percentile (latency, 0.99)*1e-6,
+              (latency.empty () ? 0 : latency.back ())*1e-6);
+      fflush (stdout);
+      latency.clear ();
+      playout.clear_stats ();
+      reports_out = failures = foreign = 0; }
+
+    int run (int fd) {
+      int64_t interval = 1000000000LL/option_rate;
+      int64_t start = Telemetry::now_ns ();
+      int64_t end = option_seconds < 0 ? INT64_MAX
+        : start + option_seconds*1000000000LL;
+      int64_t next = start + interval;
+      int64_t reported = start;
+      for (int64_t now = start; !stopping && now < end;
+           now = Telemetry::now_ns ()) {
+        pollfd p { fd, POLLIN, 0 };
+        int timeout_ms = next > now ? int ((next - now + 999999)/1000000) : 0;
+        poll (&p, 1, timeout_ms);
+
+        uint8_t rgb[FrameServer::CB_FRAME_MAX + 1];
+        ssize_t cb;
+        Address source;
+        while ((source.cb = sizeof (source.storage),
+                cb = recvfrom (fd, rgb, sizeof (rgb), MSG_DONTWAIT,
+                               source.get (), &source.cb)) >= 0)
+          receive (rgb, size_t (cb), source, Telemetry::now_ns ());
+
+        now = Telemetry::now_ns ();
+        if (now >= next) {
+          tick (now);
+          next += interval;
+          if (next <= now)      // Skip the ticks we missed
+            next = now + interval;
+        }
+        if ((option_verbose || option_seconds >= 0)
+            && (now - reported >= option_interval*1000000000LL
+                || now >= end)) {
+          report ((now - reported)*1e-9);
+          reported = now;
+        }
+      }
+      return 0; }
+  };
+
+  int server () {
+    auto d = Omniwear::open (option_talk);
+    if (!d) {
+      printf ("unable to find omniwear device\n");
+      return 1;
+    }
+    auto mapping = Omniwear::linear_mapping (127, 15, 128);
+    Omniwear::define_packed (d.get (), &mapping[0], mapping.size ());
+    Omniwear::reset_motors (d.get ());
+
+    Address a;
+    int fd = open_socket (a);
+    if (!option_unix.empty ())
+      unlink (option_unix.c_str ());
+    if (fd < 0 || bind (fd, a.get (), a.cb)) {
+      printf ("unable to bind '%s': %s\n",
+              option_unix.empty () ? std::to_string (option_port).c_str ()
+              : option_unix.c_str (), strerror (errno));
+      return 1;
+    }
+
+    Server server (d.get ());
+    server.run (fd);
+
+    close (fd);
+    if (!option_unix.empty ())
+      unlink (option_unix.c_str ());
+    Omniwear::reset_motors (d.get ());
+    return 0; }
+
+}
+
+void usage () {
+  printf (
+          "usage: omni-server [OPTIONS]\n"
+          "\n"
+          "  Plays motor frames received over the network into the cap,\n"
+          "  or with -c, sends test frames to a server.\n"
+          "\n"
+          "  -p PORT         - UDP port (4660)\n"
+          "  -a ADDRESS      - Address to bind, or with -c to send to\n"
+          "  -u PATH         - Unix datagram socket instead of UDP\n"
+          "  -d MS           - Playout delay (20)\n"
+          "  -r HZ           - Reports to the cap a second (100)\n"
+          "  -s SECONDS      - Stop after SECONDS, printing the stats\n"
+          "  -v              - Print the stats as the server runs\n"
+          "  -i SECONDS      - Print every SECONDS (10)\n"
+          "  -c              - Send test frames instead, for 5 s or -s\n"
+          "  -f HZ           - Frames a second sent with -c (60)\n"
+          "  -l PERCENT      - Drop PERCENT of the frames sent with -c\n"
+          "  -j MS           - Delay frames sent with -c up to MS\n"
+          "  -t              - Enable talking\n"
+          "  -h|?            - Show usage\n"
+          );
+  exit (0);
+}
+
+int main (int argc, const char** argv)
+{
+  for (--argc, ++argv; argc > 0; --argc, ++argv) {
+    std::string arg (*argv);
+    if (arg[0] != '-')
+      usage ();
+    switch (arg[1]) {
+    case 'a':
+    case 'u':
+      if (argc < 2)
+        usage ();
+      (arg[1] == 'a' ? option_address : option_unix) = argv[1];
+      --argc, ++argv;
+      break;
+    case 'p':
+    case 'd':
+    case 'r':
+    case 's':
+    case 'i':
+    case 'f':
+    case 'l':
+    case 'j':
+      if (argc < 2)
+        usage ();
+      {
+        int value = strtol (argv[1], nullptr, 0);
+        if (value < 0 || (value == 0 && strchr ("prif", arg[1]))
+            || (arg[1] == 'l' && value > 100))
+          usage ();
+        switch (arg[1]) {
+        case 'p': option_port = value;          break;
+        case 'd': option_delay_ms = value;      break;
+        case 'r': option_rate = value;          break;
+        case 's': option_seconds = value;       break;
+        case 'i': option_interval = value;      break;
+        case 'f': option_frame_rate = value;    break;
+        case 'l': option_loss = value;          break;
+        case 'j': option_jitter_ms = value;     break;
+        }
+      }
+      --argc, ++argv;
+      break;
+    case 'c':
+      option_client = true;
+      break;
+    case 'v':
+      option_verbose = true;
+      break;
+    case 't':
+      option_talk = true;
+      break;
+    default:
+      usage ();
+      break;
+    }
+  }
+
+  struct sigaction action {};
+  action.sa_handler = stop;
+  sigaction (SIGINT, &action, nullptr);
+  sigaction (SIGTERM, &action, nullptr);
+
+  return option_client ? client () : server ();
+}
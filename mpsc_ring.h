@@ -0,0 +1,110 @@
+/** @file mpsc_ring.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Bounded, lock-free, multi-producer single-consumer ring.
+
+   NOTES
+   =====
+
+   o Algorithm.  Each cell carries a sequence number.  A producer
+     claims the cell at the tail with a compare-and-swap on the tail
+     index, fills it, and publishes it by advancing the cell's
+     sequence.  The consumer takes the cell at the head once its
+     sequence shows that it was published, and hands it back to the
+     producers by advancing the sequence by the capacity.  This is
+     Dmitry Vyukov's bounded queue with the consumer side reduced to
+     a single thread.
+
+   o Never blocks.  push() fails when the ring is full and pop()
+     fails when it is empty.  Neither allocates; the cells are
+     allocated once by the constructor.
+
+   o Capacity is rounded up to a power of two.
+
+*/
+
+#if !defined (MPSC_RING_H_INCLUDED)
+#    define   MPSC_RING_H_INCLUDED
+
+/* ----- Includes */
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ----- Types */
+
+template<typename T_>
+class MpscRing {
+public:
+  explicit MpscRing (size_t capacity) {
+    size_t c = 2;
+    while (c < capacity)
+      c <<= 1;
+    mask_ = c - 1;
+    cells_ = std::make_unique<Cell[]> (c);
+    for (size_t i = 0; i < c; ++i)
+      cells_[i].sequence.store (i, std::memory_order_relaxed);
+  }
+
+  MpscRing (const MpscRing&) = delete;
+  MpscRing& operator= (const MpscRing&) = delete;
+
+  size_t capacity () const {
+    return mask_ + 1; }
+
+  // Any thread.
+  bool push (const T_& value) {
+    size_t pos = tail_.load (std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = cells_[pos & mask_];
+      size_t sequence = cell.sequence.load (std::memory_order_acquire);
+      intptr_t dif = intptr_t (sequence) - intptr_t (pos);
+      if (dif == 0) {
+        if (tail_.compare_exchange_weak (pos, pos + 1,
+                                         std::memory_order_relaxed)) {
+          cell.value = value;
+          cell.sequence.store (pos + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (dif < 0)
+        return false;           // Full
+      else
+        pos = tail_.load (std::memory_order_relaxed);
+    }
+  }
+
+  // Consumer thread only.
+  bool pop (T_& value) {
+    Cell& cell = cells_[head_ & mask_];
+    size_t sequence = cell.sequence.load (std::memory_order_acquire);
+    if (intptr_t (sequence) - intptr_t (head_ + 1) < 0)
+      return false;             // Empty or not yet published
+    value = cell.value;
+    cell.sequence.store (head_ + mask_ + 1, std::memory_order_release);
+    ++head_;
+    return true;
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T_ value;
+  };
+
+  // The tail is written by the producers and the head by the
+  // consumer, so they are kept a cache line apart.
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_;
+  char pad0_[64];
+  std::atomic<size_t> tail_ { 0 };
+  char pad1_[64];
+  size_t head_ = 0;
+};
+
+#endif  /* MPSC_RING_H_INCLUDED */
@@ -24,6 +24,8 @@
 
 #include "hid.h"
 #include "omniwear.h"
+#include "probes.h"
+#include "telemetry.h"
 #include <array>
 #include <stdlib.h>
 
@@ -33,29 +35,90 @@
 namespace {
   // Four bit mapping between duty codes and duties (0-255).
   std::array<uint8_t,16> packed_mapping;
+  bool packed_defined;
 
   void send_preamble (Omniwear::Device* d, bool option_talk) {
     // Send our version
     {
-      char option = option_talk ? 1 : 0;
-      std::array<char,8> data = { 0x03, 0x02, 0x01, option };
+      auto data = Omniwear::version_report (option_talk);
       auto result = HID::write (d, &data[0], data.size ());
       //printf ("write %d\n", result);
     }
     // Poll for version
     {
-      std::string s = "\x02\x01\x02     ";
-      auto result = HID::write (d, s.c_str (), s.length ());
+      auto data = Omniwear::poll_version_report ();
+      auto result = HID::write (d, &data[0], data.size ());
       //    printf ("write %d\n", result);
     }
   }
 
+}
+
+
+namespace Omniwear {
+
+  Report version_report (bool option_talk) {
+    return Report { 0x03, 0x02, 0x01, char (option_talk ? 1 : 0) }; }
+
+  Report poll_version_report () {
+    return Report { 0x02, 0x01, 0x02, ' ', ' ', ' ', ' ', ' ' }; }
+
+  Report reset_report () {
+    return Report { 0x1, 0x11 }; }
+
+  Report motor_report (int motor, int duty) {
+    Telemetry::Timer timer (Telemetry::encode_ns);
+    return motor_duty_report (motor, duty*255/100); }
+
+  Report motor_duty_report (int motor, uint8_t duty) {
+    return Report { 0x4, 0x10, char (motor), char (duty), char (0xff) }; }
+
+  Report packed_definition_report (int code, uint8_t duty) {
+    return Report { 0x4, 0x21, 4, char (code), char (duty) }; }
+
+  bool packed_report (Report& msg, const int* intensities, int count) {
+    return packed_report (msg, &packed_mapping[0], intensities, count); }
+
+  bool packed_report (Report& msg, const uint8_t* mapping,
+                      const int* intensities, int count) {
+    if (!intensities || count < 0 || count > 14)
+      return false;
+    Telemetry::Timer timer (Telemetry::encode_ns);
+    msg = Report { char (0xf1), 0, 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < count; ++i) {
+      msg[1 + i/2] |= (nearest_packed_code (mapping, intensities[i]) & 0xf)
+        << ((i & 1) ? 0 : 4);
+    }
+    return true; }
+
+  std::array<uint8_t,16> linear_mapping (int numerator, int denominator,
+                                         int intercept) {
+    std::array<uint8_t,16> mapping;
+    mapping[0] = 0;
+    for (size_t i = 1; i < mapping.size (); ++i) {
+      int v = (i*numerator + denominator/2)/denominator + intercept;
+      if (v < 0)
+        v = 0;
+      if (v > 255)
+        v = 255;
+      mapping[i] = v;
+    }
+    return mapping; }
+
+  void remember_packed (const uint8_t* intensities) {
+    for (size_t i = 0; i < packed_mapping.size (); ++i)
+      packed_mapping[i] = intensities[i];
+    packed_defined = true; }
+
   int nearest_packed_code (int intensity) {
+    return nearest_packed_code (&packed_mapping[0], intensity); }
+
+  int nearest_packed_code (const uint8_t* mapping, int intensity) {
     int best = 0;
     uint8_t duty = (intensity*255)/100; // Convert 0-100% to 0-255
-    int delta = abs (packed_mapping[best] - duty);
+    int delta = abs (mapping[best] - duty);
     for (size_t i = 1; i < packed_mapping.size (); ++i) {
-      int d = abs (packed_mapping[i] - duty);
+      int d = abs (mapping[i] - duty);
 //      if (intensity)
 //        printf ("%d %d %zd %d %d %d\n", intensity, duty, i, d, delta, best);
       if (d < delta) {
@@ -66,29 +129,32 @@ namespace {
     return best;
   }
 
-}
+  const uint8_t* current_packed () {
+    return packed_defined ? &packed_mapping[0] : nullptr; }
 
-
-namespace Omniwear {
+  int packed_duty (int intensity) {
+    return packed_defined
+      ? packed_mapping[nearest_packed_code (intensity)] : -1; }
 
   DeviceP open (bool option_talk) {
+    OMNI_PROBE (open_entry);
     auto d = HID::open (0x3eb, 0x2402);
     if (d)
       send_preamble (d.get (), option_talk);
     DBG ("Omniwear::open %p\n", d ? d.get () : nullptr);
+    OMNI_PROBE1 (open_return, int (d != nullptr));
     return std::move (d); }
 
   bool reset_motors (Device* d) {
-    std::array<char,8> msg = { 0x1, 0x11 };
+    auto msg = reset_report ();
     return HID::write (d, &msg[0], msg.size ()) == msg.size (); }
 
   bool configure_motor (Device* d, int motor, int duty) {
     DBG ("config %d %d\n", motor, duty);
-    std::array<char,8> msg = { 0x4, 0x10,
-                               char (motor), char (duty*255/100),
-                               char (0xff) };
-    int result = HID::write (d, &msg[0], msg.size ());
-    return result;
+    OMNI_PROBE2 (motor_command, motor, duty);
+    auto msg = motor_report (motor, duty);
+    Telemetry::count (Telemetry::motor_reports);
+    return HID::write (d, &msg[0], msg.size ()) == int (msg.size ());
   }
 
   bool define_packed (Device* d, const uint8_t* intensities, int count) {
@@ -96,12 +162,12 @@ namespace Omniwear {
       return false;
     for (size_t i = 0; i < count; ++i) {
       packed_mapping[i] = *intensities++;
-      std::array<char,8> msg = { 0x4, 0x21, 4, char (i),
-                                 char (packed_mapping[i]) };
+      auto msg = packed_definition_report (i, packed_mapping[i]);
       auto result =  HID::write (d, &msg[0], msg.size ()) == msg.size ();
       if (!result)
         return false;
     }
+    packed_defined = true;
     return true;
   }
 
@@ -109,15 +175,7 @@ namespace Omniwear {
       0th entry is always zero. */
   bool define_packed_linear (Device* d, int numerator, int denominator,
                              int intercept) {
-    packed_mapping[0] = 0;
-    for (size_t i = 1; i < 16; ++i) {
-      int v = (i*numerator + denominator/2)/denominator + intercept;
-      if (v < 0)
-        v = 0;
-      if (v > 255)
-        v = 255;
-      packed_mapping[i] = v;
-    }
+    packed_mapping = linear_mapping (numerator, denominator, intercept);
 //    printf ("mapping");
 //    for (auto v : packed_mapping)
 //      printf (" %3d", v);
@@ -130,12 +188,10 @@ namespace Omniwear {
     if (!intensities || count < 0 || count > 14)
       return false;
 
-    std::array<char,8> msg = { char (0xf1), 0, 0, 0, 0, 0, 0, 0 };
-
-    for (int i = 0; i < count; ++i) {
-      msg[1 + i/2] |= (nearest_packed_code (intensities[i]) & 0xf)
-        << ((i & 1) ? 0 : 4);
-    }
+    OMNI_PROBE1 (packed_command, count);
+    Report msg;
+    packed_report (msg, intensities, count);
+    Telemetry::count (Telemetry::packed_reports);
 
     return HID::write (d, &msg[0], msg.size ()) == msg.size (); }
 
@@ -17,6 +17,7 @@
 /* ----- Includes */
 
 #include "hid.h"
+#include <array>
 
 /* ----- Macros */
 
@@ -26,6 +27,7 @@ namespace Omniwear {
 
   using DeviceP = HID::DeviceP;
   using Device = HID::Device;
+  using Report = std::array<char,8>;
 
   DeviceP open (bool option_talk = false);
 
@@ -35,6 +37,42 @@ namespace Omniwear {
   bool define_packed_linear (Device*,
                              int numerator, int denominator, int intercept);
   bool configure_motors_packed (Device*, const int* duties, int count);
+
+  // Reports of the protocol, for callers that send them by other
+  // means than the functions above, e.g. omniwear_async.h.
+  Report version_report (bool option_talk);
+  Report poll_version_report ();
+  Report reset_report ();
+  Report motor_report (int motor, int duty);
+  Report motor_duty_report (int motor, uint8_t duty); // Duty 0-255
+  Report packed_definition_report (int code, uint8_t duty);
+  bool packed_report (Report&, const int* intensities, int count);
+
+  // The same against the 16 duties of a mapping other than the
+  // current one, e.g. that of a compiled pattern.
+  bool packed_report (Report&, const uint8_t* mapping,
+                      const int* intensities, int count);
+
+  // Mapping of define_packed_linear.
+  std::array<uint8_t,16> linear_mapping (int numerator, int denominator,
+                                         int intercept);
+
+  // Make the 16 duties the mapping that packed reports are encoded
+  // against, once the cap has been sent the definition.
+  void remember_packed (const uint8_t* intensities);
+
+  // Packed code whose duty in the current mapping is nearest to the
+  // intensity, 0-100.
+  int nearest_packed_code (int intensity);
+  int nearest_packed_code (const uint8_t* mapping, int intensity);
+
+  // The 16 duties of the current mapping, or null when none has been
+  // defined.
+  const uint8_t* current_packed ();
+
+  // Duty, 0-255, that a packed report applies for the intensity,
+  // 0-100, or -1 when no packed mapping has been defined.
+  int packed_duty (int intensity);
 }
 
 /* ----- Globals */
@@ -8,6 +8,20 @@
 #include <math.h>
 
 #include "omniwear.h"           // HID interface to omniwear device
+#include "haptic_mixer.h"
+#include "haptic_budget.h"
+#include "haptic_cap.h"
+#include "haptic_fixed.h"
+#include "haptic_layout.h"
+#include "haptic_motion.h"
+#include "haptic_oscillator.h"
+#include "haptic_pattern.h"
+#include "call_log.h"
+#include "log_ring.h"
+#include "probes.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "work_pool.h"
 
 #if defined (_WIN32)
 // This doesn't quite work.
@@ -43,6 +57,21 @@ typedef struct matrix4x4_s {
 
 struct omniwear_device_impl {
   HID::DeviceP device;
+  HapticMixer::Config mixer;
+  HapticOscillator::Bank oscillators;
+  HapticBudget::Scheduler budget;
+  HapticMotion::Tracker motion;
+  HapticLayout::Targets hot;    // Hot columns of haptic_target_list
+  haptic_target_t predicted_list[MAX_TARGETS]; // See predict_haptic_targets
+  HapticLayout::Targets predicted;
+  HapticPattern::Sequencer pattern;
+  std::array<uint8_t,16> packed_mapping; // Last defined on the device
+  bool packed_defined = false;
+  float delta_threshold = 0;    // See set_haptic_delta_threshold
+  bool deltas = false;          // The delta API has changed the targets
+  bool unsorted = false;        // The targets are out of order by range
+  bool throbbing = false;
+  float throb_period_sec = 0;
 };
 
 
@@ -147,25 +176,70 @@ static void get_angle_vectors(const vec3_t angles, vec3_t forward, vec3_t right,
     }
 }
 
-static void initialize_haptic_motors(haptic_device_state_t *state) {
+// Place the motors on the cap.  The positions are those of the cap
+// layout, see haptic_cap.h.
+static void set_motor_positions(haptic_motor_t *motors) {
 
-  int i;
+  static_assert(HapticCap::Cap13::C_COUNT == NUMBER_OF_MOTORS, "cap layout");
 
   // The motors are situated on a unit sphere around the player.
   // We're looking down at the player's head, with his nose at (0, 1, 0) or LOW_N.
-  set_vector(state->motors[LOW_N].position, 1, 0, 0);
-  set_vector(state->motors[LOW_S].position, -1, 0, 0);
-  set_vector(state->motors[LOW_W].position, 0, 1, 0);
-  set_vector(state->motors[LOW_E].position, 0, -1, 0);
-  set_vector(state->motors[LOW_NW].position, .7, .7, 0);
-  set_vector(state->motors[LOW_NE].position, .7, -.7, 0);
-  set_vector(state->motors[LOW_SE].position, -.7, -.7, 0);
-  set_vector(state->motors[LOW_SW].position, -.7, .7, 0);
-  set_vector(state->motors[MID_N].position, .7, 0, .7);
-  set_vector(state->motors[MID_S].position, -.7, 0, .7);
-  set_vector(state->motors[MID_W].position, 0, .7, .7);
-  set_vector(state->motors[MID_E].position, 0, -.7, .7);
-  set_vector(state->motors[TOP].position, 0, 0, 1);
+  int i;
+  for (i = 0; i<NUMBER_OF_MOTORS; i++) {
+    const HapticCap::Position &p = HapticCap::Cap13::positions[i];
+    set_vector(motors[i].position, p.x, p.y, p.z);
+  }
+}
+
+// Panning gains for the motor layout.  The layout is the same for
+// every cap, so the table is built once and shared.
+static const HapticPanner::Table &get_panning_table() {
+
+  static const HapticPanner::Table *table = [] {
+    haptic_motor_t motors[NUMBER_OF_MOTORS];
+    set_motor_positions(motors);
+    auto table = new HapticPanner::Table;
+    table->build(motors, NUMBER_OF_MOTORS);
+    return table;
+  }();
+  return *table;
+}
+
+// The engine computes in fixed point when the SDK is built with
+// OMNIWEAR_FIXED_POINT.  See haptic_fixed.h.
+#if defined (OMNIWEAR_FIXED_POINT)
+static const bool fixed_point_engine = true;
+#else
+static const bool fixed_point_engine = false;
+#endif
+
+typedef Fixed::q15 fixed_vec3_t[3];
+
+// Motor positions in Q1.15 for the fixed point engine, built once
+// like the panning table.
+static const fixed_vec3_t *get_fixed_motor_positions() {
+
+  static const fixed_vec3_t *positions = [] {
+    haptic_motor_t motors[NUMBER_OF_MOTORS];
+    set_motor_positions(motors);
+    auto positions = new fixed_vec3_t[NUMBER_OF_MOTORS];
+    int i, j;
+    for (i = 0; i<NUMBER_OF_MOTORS; i++)
+      for (j = 0; j<3; j++)
+        positions[i][j] = Fixed::to_q15(motors[i].position[j]);
+    return (const fixed_vec3_t *) positions;
+  }();
+  return positions;
+}
+
+static void initialize_haptic_motors(haptic_device_state_t *state) {
+
+  int i;
+
+  set_motor_positions(state->motors);
+
+  // Precompute the panning gains now rather than on the first frame.
+  get_panning_table();
 
   for (i = 0; i<NUMBER_OF_MOTORS; i++) {state->motors[i].is_running = false;}
 
@@ -177,99 +251,137 @@ static void initialize_haptic_motors(haptic_device_state_t *state) {
   state->haptic_volume = 100;
 }
 
-static void calculate_range_and_bearing(haptic_device_state_t *state) {
+// Toggle the motor of a target with a periodic effect when its period
+// has passed.
+static void toggle_haptic_target(const haptic_device_state_t *state, haptic_target_t *target, haptic_effect_t haptic_effect) {
 
-  int i;
-  for (i = 0; i<state->haptic_target_list_len; i++) {
+  // The reason we put this here rather than for a specific motor is so that the pulsing
+  // will remain with the target as it shifts from motor to motor.
+  if ((haptic_effect == PULSE_BY_PERIOD)
+      || (haptic_effect == BUZZ_ONCE_FOR_PERIOD)
+      || (haptic_effect == PULSE_BY_RANGE)) {
 
-    haptic_target_t *target = &state->haptic_target_list[i];
+    // See if we're past the toggle period.
+    if (state->last_update - target->last_toggle > target->period) {
+
+      target->turn_motor_on = !target->turn_motor_on;
+      target->last_toggle = state->last_update;
+    }
+  }
+}
 
-    // Calculate the vector to this target.
-    vec3_t vec_to_target;
-    subtract_vec3(target->location, state->player_origin, vec_to_target);
+// Calculate the range and bearing of a target at location from origin.
+static void measure_haptic_target(haptic_target_t *target, const float location[3], const float origin[3], bool fixed, Fixed::q15 fixed_vec_to_target[3]) {
+
+  // Calculate the vector to this target.
+  vec3_t vec_to_target;
+  if (fixed) {
+    target->range = HapticFixed::locate(location, origin, fixed_vec_to_target);
+    set_vector(vec_to_target, Fixed::to_float(fixed_vec_to_target[0]), Fixed::to_float(fixed_vec_to_target[1]), Fixed::to_float(fixed_vec_to_target[2]));
+  } else {
+    subtract_vec3(location, origin, vec_to_target);
 
     // Range.
     target->range = vector_length(vec_to_target);
 
-    // Normalize and save.
+    // Normalize.
     normalize_vec3(vec_to_target);
-    set_vector(target->vec_to_target, vec_to_target[0], vec_to_target[1], vec_to_target[2]);
+  }
 
-    // See what haptic effect goes with this target.
-    int j;
-    haptic_effect_t haptic_effect;
-    haptic_effect_map_t *map;
-    for (j = 0; j<state->haptic_effect_maps_len; j++) {
+  // Save.
+  set_vector(target->vec_to_target, vec_to_target[0], vec_to_target[1], vec_to_target[2]);
+}
 
-      map = &state->haptic_effect_maps[j];
-      if (map->target_type == target->type) {
-        haptic_effect = map->haptic_effect;
-        break;
-      }
-    }
+// Calculate the range and bearing of a target at location from origin,
+// and apply its effect.  Returns false when the effect is unusable.
+static bool locate_haptic_target(haptic_device_state_t *state, haptic_target_t *target, const float location[3], const float origin[3], bool fixed) {
 
-    // Set the appropriate haptic period based on the effect.
-    float angle;
-    vec3_t int_viewangles;
-    vec3_t forward, right, up;
-    switch(haptic_effect) {
+  Fixed::q15 fixed_vec_to_target[3];
+  measure_haptic_target(target, location, origin, fixed, fixed_vec_to_target);
+  const float *vec_to_target = target->vec_to_target;
 
-    case BUZZ_CONTINUOUSLY:
-      target->turn_motor_on = true;
-      break;
+  // See what haptic effect goes with this target.
+  int j;
+  haptic_effect_t haptic_effect;
+  haptic_effect_map_t *map;
+  for (j = 0; j<state->haptic_effect_maps_len; j++) {
 
-    case BUZZ_ONCE_FOR_PERIOD:
-      target->period = map->period;
-      target->is_locked_for_period = true;
+    map = &state->haptic_effect_maps[j];
+    if (map->target_type == target->type) {
+      haptic_effect = map->haptic_effect;
       break;
+    }
+  }
 
-    case BUZZ_IF_TARGET_IS_LOOKING_AT_PLAYER:
+  // Set the appropriate haptic period based on the effect.
+  float angle;
+  vec3_t int_viewangles;
+  vec3_t forward, right, up;
+  switch(haptic_effect) {
 
-      // Calculate the direction the target is looking.
-      set_vector(int_viewangles, (int)target->viewangles_deg[0], (int)target->viewangles_deg[1], (int)target->viewangles_deg[2]);
-      get_angle_vectors(int_viewangles, forward, right, up);
+  case BUZZ_CONTINUOUSLY:
+    target->turn_motor_on = true;
+    break;
 
-      // If vec_to_target and target's viewangles are close to anti-parallel, buzz.
-      angle = acosf(dot_product(vec_to_target, forward));
+  case BUZZ_ONCE_FOR_PERIOD:
+    target->period = map->period;
+    target->is_locked_for_period = true;
+    break;
 
-      if ((angle < M_PI - LOOK_ANGLE_LIMIT)) {
-        target->turn_motor_on = false;
-      } else {
-        target->turn_motor_on = true;
-      }
-      break;
+  case BUZZ_IF_TARGET_IS_LOOKING_AT_PLAYER:
 
-    case PULSE_BY_RANGE:
-      target->period = (float)MIN_PERIOD + (float)MAX_PERIOD * ((float) target->range/MAX_RANGE);
+    if (fixed) {
+      int fixed_viewangles[3] = {(int)target->viewangles_deg[0], (int)target->viewangles_deg[1], (int)target->viewangles_deg[2]};
+      target->turn_motor_on = HapticFixed::is_facing(fixed_vec_to_target, fixed_viewangles);
       break;
+    }
 
-    case PULSE_BY_PERIOD:
-      target->period = map->period;
-      break;
+    // Calculate the direction the target is looking.
+    set_vector(int_viewangles, (int)target->viewangles_deg[0], (int)target->viewangles_deg[1], (int)target->viewangles_deg[2]);
+    get_angle_vectors(int_viewangles, forward, right, up);
 
-    case NOTHING:
-      printf("WARNING in calculate_range_and_bearing: haptic_effect NOTHING reached.\n");
-      return;
+    // If vec_to_target and target's viewangles are close to anti-parallel, buzz.
+    angle = acosf(dot_product(vec_to_target, forward));
 
-    default:
-      printf("WARNING in calculate_range_and_bearing: unrecognized haptic_effect.\n");
-      return;
+    if ((angle < M_PI - LOOK_ANGLE_LIMIT)) {
+      target->turn_motor_on = false;
+    } else {
+      target->turn_motor_on = true;
     }
+    break;
 
-    // Toggle if needed.
-    // The reason we put this here rather than for a specific motor is so that the pulsing
-    // will remain with the target as it shifts from motor to motor.
-    if ((haptic_effect == PULSE_BY_PERIOD)
-        || (haptic_effect == BUZZ_ONCE_FOR_PERIOD)
-        || (haptic_effect == PULSE_BY_RANGE)) {
+  case PULSE_BY_RANGE:
+    target->period = (float)MIN_PERIOD + (float)MAX_PERIOD * ((float) target->range/MAX_RANGE);
+    break;
 
-      // See if we're past the toggle period.
-      if (state->last_update - target->last_toggle > target->period) {
+  case PULSE_BY_PERIOD:
+    target->period = map->period;
+    break;
 
-        target->turn_motor_on = !target->turn_motor_on;
-        target->last_toggle = state->last_update;
-      }
-    }
+  case NOTHING:
+    OMNI_LOG(OMNI_LOG_WARNING, "WARNING in calculate_range_and_bearing: haptic_effect NOTHING reached.");
+    return false;
+
+  default:
+    OMNI_LOG(OMNI_LOG_WARNING, "WARNING in calculate_range_and_bearing: unrecognized haptic_effect.");
+    return false;
+  }
+
+  toggle_haptic_target(state, target, haptic_effect);
+  return true;
+}
+
+// Calculate the range and bearing of every target from origin, and
+// apply its effect.  locations, if not null, replace the locations of
+// the targets.
+static void calculate_range_and_bearing(haptic_device_state_t *state, const float (*locations)[3], const float origin[3], bool fixed) {
+
+  int i;
+  for (i = 0; i<state->haptic_target_list_len; i++) {
+
+    haptic_target_t *target = &state->haptic_target_list[i];
+    if (!locate_haptic_target(state, target, locations ? locations[i] : target->location, origin, fixed))
+      return;
   }
 }
 
@@ -285,10 +397,49 @@ static int cmp_range(const void *t1, const void *t2) {
   return -1;
 }
 
+// Thread pool for execute_haptic_radar_batch, created on first use.
+// The pool is never destroyed at exit so that its threads are not
+// joined while the library is being unloaded.
+static std::mutex batch_pool_lock;
+static WorkPool::Pool *batch_pool;
+static int batch_threads;      // 0 for one per hardware thread
+
+// Return the implementation for this state, creating it if needed.
+// The implementation outlives a failed open so that configuration
+// made before the device is attached is kept.
+static omniwear_device_impl *get_device_impl(haptic_device_state_t *state) {
+
+  if (!state->device_impl) state->device_impl = new omniwear_device_impl;
+  return state->device_impl;
+}
+
+// Return the hot columns of the target list, see haptic_layout.h.  The
+// list is public, so a caller that changed its length directly gets
+// the columns reloaded.
+static HapticLayout::Targets &get_hot_targets(haptic_device_state_t *state) {
+
+  HapticLayout::Targets &hot = get_device_impl(state)->hot;
+  if (hot.count != state->haptic_target_list_len)
+    hot.load(state->haptic_target_list, state->haptic_target_list_len);
+  return hot;
+}
+
+// Mixing configuration for this state, or the defaults if the state
+// has never been configured.
+static const HapticMixer::Config &get_mixer_config(const haptic_device_state_t *state) {
+
+  static const HapticMixer::Config default_config;
+  return state->device_impl ? state->device_impl->mixer : default_config;
+}
+
 OMNI_RESULT open_omniwear_device(haptic_device_state_t *state) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_state(CallLog::op_open, state);
+
   // Error check.
   if (!state) {
-    printf("ERROR in open_omniwear_device: null pointer for state.\n");
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in open_omniwear_device: null pointer for state.");
     return OMNI_ERROR_NULL_STATE;
   }
 
@@ -297,10 +448,9 @@ OMNI_RESULT open_omniwear_device(haptic_device_state_t *state) {
        ? state->device_impl->device.get () : nullptr);
 
   // If no device is configured, try to open.
-  if (!state->device_impl) {
+  if (!state->device_impl || !state->device_impl->device) {
 
-    state->device_impl = new omniwear_device_impl;
-    auto& impl = *state->device_impl;
+    auto& impl = *get_device_impl(state);
 
     impl.device = Omniwear::open ();
 
@@ -309,9 +459,7 @@ OMNI_RESULT open_omniwear_device(haptic_device_state_t *state) {
             state->device_impl && state->device_impl->device
             ? state->device_impl->device.get () : nullptr);
     if (!impl.device) {
-      printf("ERROR in open_omniwear_device: could not open haptic device.\n");
-      delete state->device_impl;
-      state->device_impl = nullptr;
+      OMNI_LOG(OMNI_LOG_ERROR, "ERROR in open_omniwear_device: could not open haptic device.");
       return OMNI_ERROR_OPENING_DEVICE;
     }
 
@@ -325,13 +473,17 @@ OMNI_RESULT open_omniwear_device(haptic_device_state_t *state) {
 }
 
 OMNI_RESULT close_omniwear_device (haptic_device_state_t *state) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_state(CallLog::op_close, state);
+
   DBG ("==%s: state %p  impl %p\n", __FUNCTION__,
        state, state && state->device_impl && state->device_impl->device
        ? state->device_impl->device.get () : nullptr);
 
   // Error check.
   if (!state) {
-    printf("ERROR in close_omniwear_device: null pointer for state.\n");
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in close_omniwear_device: null pointer for state.");
     return OMNI_ERROR_NULL_STATE;
   }
 
@@ -349,34 +501,44 @@ OMNI_RESULT close_omniwear_device (haptic_device_state_t *state) {
 OMNI_RESULT command_haptic_motor (haptic_device_state_t* state,
                                   int motor, int duty)
 {
+  CallLog::Call call;
+  if (call.recording) {
+    int args[] = { motor, duty };
+    CallLog::write_ints(CallLog::op_motor, state, args, 2);
+  }
+
   DBG ("==%s: state %p  impl %p\n", __FUNCTION__,
        state, state && state->device_impl
        && state->device_impl->device
        ? state->device_impl->device.get () : nullptr);
 
   if (!state) {
-    printf ("***ERR: invalid state\n");
+    OMNI_LOG (OMNI_LOG_ERROR, "***ERR: invalid state");
     return OMNI_ERROR_NULL_STATE;
   }
 
   if (motor < 0 || motor > C_MOTORS) {
-    printf ("***ERR: motor number must be from 0 to %d\n", C_MOTORS - 1);
+    OMNI_LOG (OMNI_LOG_ERROR, "***ERR: motor number must be from 0 to %d", C_MOTORS - 1);
     return OMNI_ERROR_INVALID_MOTOR;
   }
 
   if (duty < 0 || duty > 100) {
-    printf ("***ERR: intensity must be from 0 to 100%%\n");
+    OMNI_LOG (OMNI_LOG_ERROR, "***ERR: intensity must be from 0 to 100%%");
     return OMNI_ERROR_INTENSITY_OUT_OF_RANGE;
   }
 
   if (state->haptic_volume == 0)
-    printf("WARNING: in command_haptic_motor: haptic_volume set to 0.\n");
+    OMNI_LOG(OMNI_LOG_WARNING, "WARNING: in command_haptic_motor: haptic_volume set to 0.");
 
   // Adjust for the global haptic volume.
   duty = (duty*state->haptic_volume + 50)/100;
 
-  if (state->device_impl && state->device_impl->device)
-    Omniwear::configure_motor (state->device_impl->device.get (), motor, duty);
+  if (state->device_impl && state->device_impl->device) {
+    if (Omniwear::configure_motor (state->device_impl->device.get (), motor,
+                                   duty))
+      state->device_impl->budget.sent_motor (motor, duty,
+                                             HapticBudget::PRIORITY_AMBIENT);
+  }
 
   return OMNI_SUCCESS;
 }
@@ -386,28 +548,35 @@ OMNI_RESULT DLL_EXPORT command_haptic_motors (haptic_device_state_t* state,
                                               const haptic_motor_config_t*
                                               configs,
                                               int config_count) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_motors(state, configs, config_count);
+
   if (!state) {
-    printf ("***ERR: invalid state\n");
+    OMNI_LOG (OMNI_LOG_ERROR, "***ERR: invalid state");
     return OMNI_ERROR_NULL_STATE;
   }
 
   for (int i = 0; i < config_count; ++i) {
     if (configs[i].motor < 0 || configs[i].motor > C_MOTORS) {
-      printf ("***ERR: motor number must be from 0 to %d\n", C_MOTORS - 1);
+      OMNI_LOG (OMNI_LOG_ERROR, "***ERR: motor number must be from 0 to %d", C_MOTORS - 1);
       return OMNI_ERROR_INVALID_MOTOR;
     }
 
     if (configs[i].intensity < 0 || configs[i].intensity > 100) {
-      printf ("***ERR: intensity must be from 0 to 100%%\n");
+      OMNI_LOG (OMNI_LOG_ERROR, "***ERR: intensity must be from 0 to 100%%");
       return OMNI_ERROR_INTENSITY_OUT_OF_RANGE;
     }
   }
 
   for (int i = 0; i < config_count; ++i) {
     auto duty = (configs[i].intensity*state->haptic_volume + 50)/100;
-    if (state->device_impl && state->device_impl->device)
-      Omniwear::configure_motor (state->device_impl->device.get (),
-                                 configs[i].motor, duty);
+    if (state->device_impl && state->device_impl->device) {
+      if (Omniwear::configure_motor (state->device_impl->device.get (),
+                                     configs[i].motor, duty))
+        state->device_impl->budget.sent_motor (configs[i].motor, duty,
+                                               HapticBudget::PRIORITY_AMBIENT);
+    }
   }
 
   return OMNI_SUCCESS;
@@ -416,8 +585,12 @@ OMNI_RESULT DLL_EXPORT command_haptic_motors (haptic_device_state_t* state,
 
 OMNI_RESULT reset_omniwear_device(haptic_device_state_t *state)
 {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_state(CallLog::op_reset, state);
+
   if (!state) {
-    printf ("***ERR: invalid state\n");
+    OMNI_LOG (OMNI_LOG_ERROR, "***ERR: invalid state");
     return OMNI_ERROR_NULL_STATE;
   }
 
@@ -426,8 +599,14 @@ OMNI_RESULT reset_omniwear_device(haptic_device_state_t *state)
   state->global_intensity_ceiling = 0;
   state->haptic_target_list_len = 0;
 
-  if (state->device_impl && state->device_impl->device)
-    Omniwear::reset_motors (state->device_impl->device.get ());
+  if (state->device_impl && state->device_impl->device) {
+    if (Omniwear::reset_motors (state->device_impl->device.get ()))
+      state->device_impl->budget.reset ();
+    else
+      state->device_impl->budget.forget ();
+  }
+  if (state->device_impl)
+    state->device_impl->pattern.stop ();
 
   // Turn off motors.
   for (auto i = 0; i < C_MOTORS; ++i)
@@ -442,18 +621,25 @@ OMNI_RESULT reset_omniwear_device(haptic_device_state_t *state)
 // packed code.
 OMNI_RESULT DLL_EXPORT define_packed_mapping(haptic_device_state_t* state,
                                              const uint8_t* duties, int count) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_packed_mapping(state, duties, count);
+
   if (!state || !state->device_impl || !state->device_impl->device) {
-    printf ("***ERR: invalid state\n");
+    OMNI_LOG (OMNI_LOG_ERROR, "***ERR: invalid state");
     return OMNI_ERROR_NULL_STATE;
   }
 
   if (duties == nullptr || count != 16)
     return OMNI_ERROR_INVALID_PACKING;
 
-  return Omniwear::define_packed (state->device_impl->device.get (),
-                                  duties, count)
-    ? OMNI_SUCCESS
-    : OMNI_ERROR_INVALID_PACKING;
+  if (!Omniwear::define_packed (state->device_impl->device.get (),
+                                duties, count))
+    return OMNI_ERROR_INVALID_PACKING;
+  memcpy (&state->device_impl->packed_mapping[0],
+          Omniwear::current_packed (), 16);
+  state->device_impl->packed_defined = true;
+  return OMNI_SUCCESS;
 }
 
 // Define a simple linear mapping between packed intensity mappings
@@ -467,15 +653,24 @@ OMNI_RESULT DLL_EXPORT define_linear_packed_mapping(haptic_device_state_t*
                                                     int numerator,
                                                     int denominator,
                                                     int intercept) {
+  CallLog::Call call;
+  if (call.recording) {
+    int args[] = { numerator, denominator, intercept };
+    CallLog::write_ints(CallLog::op_linear_packed_mapping, state, args, 3);
+  }
+
   if (!state || !state->device_impl || !state->device_impl->device) {
-    printf ("***ERR: invalid state\n");
+    OMNI_LOG (OMNI_LOG_ERROR, "***ERR: invalid state");
     return OMNI_ERROR_NULL_STATE;
   }
 
-  return Omniwear::define_packed_linear (state->device_impl->device.get (),
-                                         numerator, denominator, intercept)
-    ? OMNI_SUCCESS
-    : OMNI_ERROR_INVALID_PACKING;
+  if (!Omniwear::define_packed_linear (state->device_impl->device.get (),
+                                       numerator, denominator, intercept))
+    return OMNI_ERROR_INVALID_PACKING;
+  memcpy (&state->device_impl->packed_mapping[0],
+          Omniwear::current_packed (), 16);
+  state->device_impl->packed_defined = true;
+  return OMNI_SUCCESS;
 }
 
 // Set motor drive intensities using a packed mapping.  Intensities
@@ -485,105 +680,211 @@ OMNI_RESULT DLL_EXPORT command_haptic_motors_packed(haptic_device_state_t*
                                                     state,
                                                     const int* intensities,
                                                     int count) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_ints(CallLog::op_motors_packed, state, intensities, count);
+
   if (!state || !state->device_impl || !state->device_impl->device) {
-    printf ("***ERR: invalid state\n");
+    OMNI_LOG (OMNI_LOG_ERROR, "***ERR: invalid state");
     return OMNI_ERROR_NULL_STATE;
   }
 
-  Omniwear::configure_motors_packed (state->device_impl->device.get (),
-                                     intensities, count);
+  if (Omniwear::configure_motors_packed (state->device_impl->device.get (),
+                                         intensities, count)) {
+    int duties[NUMBER_OF_MOTORS];
+    int i;
+    for (i = 0; i<count && i<NUMBER_OF_MOTORS; i++)
+      duties[i] = Omniwear::packed_duty(intensities[i]);
+    state->device_impl->budget.sent_packed(duties, nullptr, i);
+  }
   return OMNI_SUCCESS;
 }
 
 void do_throb(haptic_device_state_t *state, unsigned int intensity_ceiling,
               float throb_period_sec, double game_time) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_throb(state, intensity_ceiling, throb_period_sec, game_time);
+
   DBG ("=== %s\n", __FUNCTION__);
 
   // Error check
   if (intensity_ceiling > 100) {
 
-    printf("ERROR in do_throb: intensity_ceiling is not 0-100.\n");
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in do_throb: intensity_ceiling is not 0-100.");
     return ;
   }
 
   if (throb_period_sec < 0) {
 
-    printf("ERROR in do_throb: period is less than zero.\n");
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in do_throb: period is less than zero.");
     return;
   }
 
   if (!state) {
-    printf("ERROR in do_throb: null pointer for state.\n");
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in do_throb: null pointer for state.");
     return;
   }
 
-  // Set amplitude of throb to max out at the intensity_ceiling.
-  state->global_intensity_ceiling = intensity_ceiling;
-
-  // Clamp the current global intensity to the (maybe new) ceiling and floor.
-  // Toggle direction if necessary.
-  if (state->current_global_intensity > state->global_intensity_ceiling) {
-
-    state->current_global_intensity = state->global_intensity_ceiling;
-    state->global_intensity_is_rising = false;
-  } else if (state->current_global_intensity <= 0) {
+  omniwear_device_impl *impl = get_device_impl(state);
+  HapticOscillator::Bank &oscillators = impl->oscillators;
+  int motor_num;
 
-    state->current_global_intensity = 0;
-    state->global_intensity_is_rising = true;
+  // A throb without a period holds the cap at the ceiling.
+  if (throb_period_sec == 0) {
+    for (motor_num = 0; motor_num<NUMBER_OF_MOTORS; motor_num++)
+      oscillators.set(motor_num, WAVEFORM_OFF, 0, 0, 0);
+    impl->throbbing = false;
+    state->global_intensity_ceiling = intensity_ceiling;
+    state->current_global_intensity = intensity_ceiling;
+    return;
   }
 
-  // Increment.
-  double time_from_last_update = game_time - state->last_update;
-
-  // Clamp to sane values.
-  if (time_from_last_update > 5) time_from_last_update = 5;
-
-  double steps = throb_period_sec / time_from_last_update;
-  double increment = (state->global_intensity_ceiling + 1) / steps; // Adding one so it actually starts.
+  // Start the throb, or restart it with a new period.  The ramp up and
+  // the ramp down each take a period.
+  if (!impl->throbbing || impl->throb_period_sec != throb_period_sec) {
+    for (motor_num = 0; motor_num<NUMBER_OF_MOTORS; motor_num++)
+      oscillators.set(motor_num, WAVEFORM_TRIANGLE, 2*throb_period_sec, intensity_ceiling, 0);
+    impl->throbbing = true;
+    impl->throb_period_sec = throb_period_sec;
+  }
 
-  // Clamp.
-  if (increment < 0) increment = 0;
-  if (increment > 100) increment = 100;
+  // A new ceiling takes effect without a jump in the phase.
+  else if (state->global_intensity_ceiling != (int) intensity_ceiling) {
+    for (motor_num = 0; motor_num<NUMBER_OF_MOTORS; motor_num++)
+      oscillators.amplitude[motor_num] = intensity_ceiling;
+  }
 
-  // Set.
-  if (state->global_intensity_is_rising) state->current_global_intensity += increment;
-  else state->current_global_intensity -= increment;
+  state->global_intensity_ceiling = intensity_ceiling;
+  state->current_global_intensity = 0;
 }
 
 void stop_throbbing(haptic_device_state_t *state) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_state(CallLog::op_stop_throbbing, state);
+
   DBG ("=== %s\n", __FUNCTION__);
 
   // Error check.
   if (!state) {
-    printf("ERROR in stop_throbbing: null pointer for state.\n");
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in stop_throbbing: null pointer for state.");
     return;
   }
 
   // Reset everything.
+  if (state->device_impl) {
+    int motor_num;
+    for (motor_num = 0; motor_num<NUMBER_OF_MOTORS; motor_num++)
+      state->device_impl->oscillators.set(motor_num, WAVEFORM_OFF, 0, 0, 0);
+    state->device_impl->throbbing = false;
+  }
   state->global_intensity_ceiling = 0;
   state->current_global_intensity = 0;
 }
 
-void update_haptic_radar(haptic_device_state_t *state, haptic_target_t updated_targets[], int updated_targets_len, vec3_t player_origin, vec3_t player_viewangles_deg) {
-  DBG ("=== %s\n", __FUNCTION__);
+OMNI_RESULT set_haptic_oscillator(haptic_device_state_t *state, int motor,
+                                  haptic_waveform_t waveform, float period_sec,
+                                  int amplitude, float phase) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_oscillator(state, motor, waveform, period_sec, amplitude, phase);
+
+  DBG ("=== %s %d %d\n", __FUNCTION__, motor, waveform);
 
-  // Error check.
   if (!state) {
-    printf("ERROR in update_haptic_radar: null pointer for state.\n");
-    return;
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_oscillator: state pointer is null.");
+    return OMNI_ERROR_NULL_STATE;
   }
 
-  if (!updated_targets) {
-    printf("ERROR in update_haptic_radar: null pointer for updated_targets.\n");
-    return;
+  if (motor < -1 || motor >= NUMBER_OF_MOTORS) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_oscillator: motor out of range.");
+    return OMNI_ERROR_INVALID_ARGUMENT;
   }
 
-  if (updated_targets_len > MAX_TARGETS) {
-    printf("ERROR in update_haptic_radar: number of targets passed to this function exceeds MAX_TARGETS.\n");
-    return;
+  // Validate once so that setting every motor is all or nothing.
+  HapticOscillator::Bank &oscillators = get_device_impl(state)->oscillators;
+  int first = motor < 0 ? 0 : motor;
+  if (!oscillators.set(first, waveform, period_sec, amplitude, phase)) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_oscillator: invalid waveform, period, amplitude or phase.");
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+  if (motor < 0) {
+    int motor_num;
+    for (motor_num = 1; motor_num<NUMBER_OF_MOTORS; motor_num++)
+      oscillators.set(motor_num, waveform, period_sec, amplitude, phase);
   }
 
-  // TODO - error check position vectors?
+  // The motors no longer follow the throb.
+  state->device_impl->throbbing = false;
+  return OMNI_SUCCESS;
+}
+
+OMNI_RESULT define_haptic_waveform(haptic_device_state_t *state,
+                                   const float *samples, int count) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_floats(CallLog::op_waveform, state, samples, count);
+
+  DBG ("=== %s %d\n", __FUNCTION__, count);
+
+  if (!state) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in define_haptic_waveform: state pointer is null.");
+    return OMNI_ERROR_NULL_STATE;
+  }
+
+  if (!get_device_impl(state)->oscillators.define(samples, count)) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in define_haptic_waveform: invalid samples.");
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+  return OMNI_SUCCESS;
+}
+
+// Targets read from an array of haptic_target_t.  The targets are
+// targets[indices[i]], or targets[i] when indices is NULL.
+struct haptic_target_array {
+  const haptic_target_t *targets;
+  const int *indices;
+
+  const haptic_target_t &at(int i) const { return targets[indices ? indices[i] : i]; }
+  int index(int i) const { return at(i).index; }
+  int type(int i) const { return at(i).type; }
+  const float *location(int i) const { return at(i).location; }
+  const float *viewangles_deg(int i) const { return at(i).viewangles_deg; }
+  int healthvalue(int i) const { return at(i).healthvalue; }
+};
+
+// Targets read in place from the game's entities.  The targets are
+// entity entities[i], or entity i when entities is NULL.
+struct haptic_target_strided {
+  const haptic_target_view_t *view;
+  const int *entities;
+
+  size_t entity(int i) const { return entities ? entities[i] : i; }
+  const void *field(const void *base, size_t stride, size_t size, int i) const {
+    return (const char *)base + entity(i)*(stride ? stride : size);
+  }
+  int index(int i) const {
+    return view->index ? *(const int *)field(view->index, view->index_stride, sizeof(int), i) : (int)entity(i);
+  }
+  int type(int i) const {
+    return view->type ? *(const int *)field(view->type, view->type_stride, sizeof(int), i) : 0;
+  }
+  const float *location(int i) const {
+    return (const float *)field(view->location, view->location_stride, sizeof(vec3_t), i);
+  }
+  const float *viewangles_deg(int i) const {
+    static const vec3_t zero = {0, 0, 0};
+    return view->viewangles_deg ? (const float *)field(view->viewangles_deg, view->viewangles_stride, sizeof(vec3_t), i) : zero;
+  }
+  int healthvalue(int) const { return 0; }
+};
+
+// Merge a new set of targets into the list of targets we're tracking.
+// The targets are updated_targets.index(i) and so on for i from 0 to
+// updated_targets_len - 1.
+template<typename Targets>
+static void merge_haptic_targets(haptic_device_state_t *state, const Targets &updated_targets, int updated_targets_len, const float player_origin[3], const float player_viewangles_deg[3]) {
 
   // Update the player origin.
   set_vector(state->player_origin, player_origin[0], player_origin[1], player_origin[2]);
@@ -591,27 +892,30 @@ void update_haptic_radar(haptic_device_state_t *state, haptic_target_t updated_t
   // Update the viewangles.
   set_vector(state->player_viewangles_deg, player_viewangles_deg[0], player_viewangles_deg[1], player_viewangles_deg[2]);
 
-  // Loop through the list of updated targets we were handed.
+  // The searches by index read only the index columns.
+  HapticLayout::Targets &hot = get_hot_targets(state);
+  int updated_index[MAX_TARGETS];
   int i, j;
+  for (i = 0; i<updated_targets_len; i++)
+    updated_index[i] = updated_targets.index(i);
+
+  // Loop through the list of updated targets we were handed.
   for (i = 0; i<updated_targets_len; i++) {
 
-    haptic_target_t *updated_target = &updated_targets[i];
+    const float *updated_location = updated_targets.location(i);
+    const float *updated_viewangles = updated_targets.viewangles_deg(i);
 
     bool target_updated = false;
-    haptic_target_t *existing_target;
-    for (j = 0; j<state->haptic_target_list_len; j++) {
+    j = hot.find(updated_index[i]);
 
-      existing_target = &state->haptic_target_list[j];
+    // If the updated target is already in our list, update its data.
+    if (j >= 0) {
 
-      // If the updated target is already in our list, update its data.
-      if (existing_target->index == updated_target->index) {
-
-        set_vector(existing_target->location, updated_target->location[0], updated_target->location[1], updated_target->location[2]);
-        set_vector(existing_target->viewangles_deg, updated_target->viewangles_deg[0], updated_target->viewangles_deg[1], updated_target->viewangles_deg[2]);
-        existing_target->healthvalue = updated_target->healthvalue;
-        target_updated = true;
-        break;
-      }
+      haptic_target_t *existing_target = &state->haptic_target_list[j];
+      set_vector(existing_target->location, updated_location[0], updated_location[1], updated_location[2]);
+      set_vector(existing_target->viewangles_deg, updated_viewangles[0], updated_viewangles[1], updated_viewangles[2]);
+      existing_target->healthvalue = updated_targets.healthvalue(i);
+      target_updated = true;
     }
 
     // If we didn't find the updated target in our existing list, add.
@@ -624,12 +928,13 @@ void update_haptic_radar(haptic_device_state_t *state, haptic_target_t updated_t
       memset(new_target, 0, sizeof(*new_target));
 
       // Record.
-      new_target->type = updated_target->type;
-      new_target->index = updated_target->index;
-      set_vector(new_target->location, updated_target->location[0], updated_target->location[1], updated_target->location[2]);
-      set_vector(new_target->viewangles_deg, updated_target->viewangles_deg[0], updated_target->viewangles_deg[1], updated_target->viewangles_deg[2]);
-      new_target->healthvalue = updated_target->healthvalue;
+      new_target->type = updated_targets.type(i);
+      new_target->index = updated_index[i];
+      set_vector(new_target->location, updated_location[0], updated_location[1], updated_location[2]);
+      set_vector(new_target->viewangles_deg, updated_viewangles[0], updated_viewangles[1], updated_viewangles[2]);
+      new_target->healthvalue = updated_targets.healthvalue(i);
       new_target->last_toggle = 0;
+      hot.store(state->haptic_target_list_len, *new_target);
 
       // Increment list length.
       state->haptic_target_list_len++;
@@ -644,9 +949,7 @@ void update_haptic_radar(haptic_device_state_t *state, haptic_target_t updated_t
 
     for (i = 0; i<updated_targets_len; i++) {
 
-      haptic_target_t *updated_target = &updated_targets[i];
-
-      if (existing_target->index == updated_target->index) {
+      if (hot.index[j] == updated_index[i]) {
         index_found = true;
         break;
       }
@@ -677,25 +980,123 @@ void update_haptic_radar(haptic_device_state_t *state, haptic_target_t updated_t
 
     // Clear the last slot.
     memset(&state->haptic_target_list[state->haptic_target_list_len - 1], 0, sizeof(*existing_target));
+    hot.erase(j);
 
     // Decrement the list length.
     state->haptic_target_list_len--;
   }
 
   // Now that we've updated the target list, calculate ranges and bearings.
-  calculate_range_and_bearing(state);
+  {
+    Trace::Span span("calculate_range_and_bearing");
+    calculate_range_and_bearing(state, nullptr, state->player_origin, fixed_point_engine);
+  }
+
+  // The next frame records the update for prediction.
+  if (state->device_impl->motion.flags)
+    state->device_impl->motion.pending = true;
 
   // Sort the list by range.
+  Trace::Span span("sort_targets");
+  span.arg(0, "targets", state->haptic_target_list_len);
   qsort(state->haptic_target_list, state->haptic_target_list_len, sizeof(state->haptic_target_list[0]), cmp_range);
+  hot.load(state->haptic_target_list, state->haptic_target_list_len);
+}
+
+void update_haptic_radar(haptic_device_state_t *state, haptic_target_t updated_targets[], int updated_targets_len, vec3_t player_origin, vec3_t player_viewangles_deg) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_radar(state, updated_targets, updated_targets_len, player_origin, player_viewangles_deg);
+
+  DBG ("=== %s\n", __FUNCTION__);
+
+  // Error check.
+  if (!state) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in update_haptic_radar: null pointer for state.");
+    return;
+  }
+
+  if (!updated_targets) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in update_haptic_radar: null pointer for updated_targets.");
+    return;
+  }
+
+  if (updated_targets_len > MAX_TARGETS) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in update_haptic_radar: number of targets passed to this function exceeds MAX_TARGETS.");
+    return;
+  }
+
+  // TODO - error check position vectors?
+
+  Telemetry::Timer timer(Telemetry::radar_update_ns);
+  Trace::Span span("update_haptic_radar");
+  span.arg(0, "targets", updated_targets_len);
+  haptic_target_array targets = {updated_targets, NULL};
+  merge_haptic_targets(state, targets, updated_targets_len, player_origin, player_viewangles_deg);
+}
+
+OMNI_RESULT update_haptic_radar_strided(haptic_device_state_t *state, const haptic_target_view_t *view, const int *entities, int count, const vec3_t player_origin, const vec3_t player_viewangles_deg) {
+  CallLog::Call call;
+
+  DBG ("=== %s %d\n", __FUNCTION__, count);
+
+  if (!state) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in update_haptic_radar_strided: null pointer for state.");
+    return OMNI_ERROR_NULL_STATE;
+  }
+
+  if (!view || (count && !view->location) || !player_origin || !player_viewangles_deg) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in update_haptic_radar_strided: null pointer.");
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+
+  if (count < 0 || count > MAX_TARGETS) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in update_haptic_radar_strided: count must be from 0 to MAX_TARGETS.");
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+
+  int i;
+  for (i = 0; entities && i<count; i++) {
+    if (entities[i] < 0) {
+      OMNI_LOG(OMNI_LOG_ERROR, "ERROR in update_haptic_radar_strided: negative entity number.");
+      return OMNI_ERROR_INVALID_ARGUMENT;
+    }
+  }
+
+  haptic_target_strided targets = {view, entities};
+
+  // The log holds the targets as update_haptic_radar would have
+  // received them, so a replay needs no view of the game's entities.
+  if (call.recording) {
+    haptic_target_t logged[MAX_TARGETS];
+    memset(logged, 0, count*sizeof(logged[0]));
+    for (i = 0; i<count; i++) {
+      logged[i].index = targets.index(i);
+      logged[i].type = targets.type(i);
+      memcpy(logged[i].location, targets.location(i), sizeof(vec3_t));
+      memcpy(logged[i].viewangles_deg, targets.viewangles_deg(i), sizeof(vec3_t));
+    }
+    CallLog::write_radar(state, logged, count, player_origin, player_viewangles_deg);
+  }
+
+  Telemetry::Timer timer(Telemetry::radar_update_ns);
+  Trace::Span span("update_haptic_radar_strided");
+  span.arg(0, "targets", count);
+  merge_haptic_targets(state, targets, count, player_origin, player_viewangles_deg);
+  return OMNI_SUCCESS;
 }
 
 void stop_haptic_radar(haptic_device_state_t *state) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_state(CallLog::op_stop_radar, state);
+
   DBG ("=== %s\n", __FUNCTION__);
 
   // Error check.
   if (!state) {
 
-    printf("ERROR in stop_haptic_radar: state pointer is null.\n");
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in stop_haptic_radar: state pointer is null.");
     return;
   }
 
@@ -703,13 +1104,254 @@ void stop_haptic_radar(haptic_device_state_t *state) {
   state->haptic_target_list_len = 0;
 }
 
+// Slot of the target with index, or -1.
+static int find_haptic_target(haptic_device_state_t *state, int index) {
+
+  return get_hot_targets(state).find(index);
+}
+
+// True when b is farther than threshold from a.
+static bool moved_beyond(const float a[3], const float b[3], float threshold) {
+
+  vec3_t d;
+  subtract_vec3(b, a, d);
+  return dot_product(d, d) > threshold * threshold;
+}
+
+// Note a change made by the delta API.  The list is sorted at the
+// next frame.
+static void touch_haptic_targets(haptic_device_state_t *state) {
+
+  omniwear_device_impl *impl = get_device_impl(state);
+  impl->deltas = true;
+  impl->unsorted = true;
+  if (impl->motion.flags) impl->motion.pending = true;
+}
+
+// Bring the targets up to date for a frame after changes by the delta
+// API: toggle the periodic effects of the targets that weren't
+// recalculated and restore the order by range.
+static void settle_haptic_targets(haptic_device_state_t *state) {
+
+  omniwear_device_impl *impl = state->device_impl;
+  if (!impl || !impl->deltas) return;
+
+  HapticLayout::Targets &hot = get_hot_targets(state);
+  int i, j;
+  for (i = 0; i<state->haptic_target_list_len; i++) {
+
+    for (j = 0; j<state->haptic_effect_maps_len; j++) {
+      if (state->haptic_effect_maps[j].target_type == hot.type[i]) {
+        haptic_target_t *target = &state->haptic_target_list[i];
+        toggle_haptic_target(state, target, state->haptic_effect_maps[j].haptic_effect);
+        hot.on[i] = target->turn_motor_on;
+        break;
+      }
+    }
+  }
+
+  if (!impl->unsorted) return;
+  impl->unsorted = false;
+
+  // Insertion sort.  Few targets move far between frames, so the list
+  // is nearly sorted already.
+  Trace::Span span("sort_targets");
+  span.arg(0, "targets", state->haptic_target_list_len);
+  for (i = 1; i<state->haptic_target_list_len; i++) {
+
+    if (state->haptic_target_list[i - 1].range <= state->haptic_target_list[i].range) continue;
+
+    haptic_target_t target = state->haptic_target_list[i];
+    for (j = i; j > 0 && state->haptic_target_list[j - 1].range > target.range; j--)
+      state->haptic_target_list[j] = state->haptic_target_list[j - 1];
+    state->haptic_target_list[j] = target;
+  }
+  hot.load(state->haptic_target_list, state->haptic_target_list_len);
+}
+
+OMNI_RESULT add_haptic_target(haptic_device_state_t *state, const haptic_target_t *target) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_target(CallLog::op_add_target, state, target);
+
+  DBG ("=== %s\n", __FUNCTION__);
+
+  if (!state) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in add_haptic_target: null pointer for state.");
+    return OMNI_ERROR_NULL_STATE;
+  }
+
+  if (!target) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in add_haptic_target: null pointer for target.");
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+
+  int slot = find_haptic_target(state, target->index);
+  if (slot < 0) {
+
+    if (state->haptic_target_list_len >= MAX_TARGETS) {
+      OMNI_LOG(OMNI_LOG_ERROR, "ERROR in add_haptic_target: the target list is full.");
+      return OMNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    slot = state->haptic_target_list_len++;
+    memset(&state->haptic_target_list[slot], 0, sizeof(state->haptic_target_list[slot]));
+    state->haptic_target_list[slot].index = target->index;
+  }
+
+  haptic_target_t *existing_target = &state->haptic_target_list[slot];
+  existing_target->type = target->type;
+  set_vector(existing_target->location, target->location[0], target->location[1], target->location[2]);
+  set_vector(existing_target->viewangles_deg, target->viewangles_deg[0], target->viewangles_deg[1], target->viewangles_deg[2]);
+  existing_target->healthvalue = target->healthvalue;
+
+  locate_haptic_target(state, existing_target, existing_target->location, state->player_origin, fixed_point_engine);
+  get_device_impl(state)->hot.store(slot, *existing_target);
+  touch_haptic_targets(state);
+  return OMNI_SUCCESS;
+}
+
+OMNI_RESULT move_haptic_target(haptic_device_state_t *state, int index, const vec3_t location, const vec3_t viewangles_deg) {
+  CallLog::Call call;
+  if (call.recording && location && viewangles_deg) {
+    haptic_target_t target;
+    memset(&target, 0, sizeof(target));
+    target.index = index;
+    set_vector(target.location, location[0], location[1], location[2]);
+    set_vector(target.viewangles_deg, viewangles_deg[0], viewangles_deg[1], viewangles_deg[2]);
+    CallLog::write_target(CallLog::op_move_target, state, &target);
+  }
+
+  if (!state) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in move_haptic_target: null pointer for state.");
+    return OMNI_ERROR_NULL_STATE;
+  }
+
+  if (!location || !viewangles_deg) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in move_haptic_target: null pointer for location or viewangles.");
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+
+  int slot = find_haptic_target(state, index);
+  if (slot < 0) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in move_haptic_target: no target with index %d.", index);
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+
+  // The engine only sees whole degrees of viewangles.
+  haptic_target_t *target = &state->haptic_target_list[slot];
+  float threshold = get_device_impl(state)->delta_threshold;
+  bool turned = false;
+  int i;
+  for (i = 0; i<3; i++)
+    turned = turned || (int)target->viewangles_deg[i] != (int)viewangles_deg[i];
+  if (!turned && !moved_beyond(target->location, location, threshold))
+    return OMNI_SUCCESS;
+
+  set_vector(target->location, location[0], location[1], location[2]);
+  set_vector(target->viewangles_deg, viewangles_deg[0], viewangles_deg[1], viewangles_deg[2]);
+  locate_haptic_target(state, target, target->location, state->player_origin, fixed_point_engine);
+  get_device_impl(state)->hot.store(slot, *target);
+  touch_haptic_targets(state);
+  return OMNI_SUCCESS;
+}
+
+OMNI_RESULT remove_haptic_target(haptic_device_state_t *state, int index) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_ints(CallLog::op_remove_target, state, &index, 1);
+
+  DBG ("=== %s %d\n", __FUNCTION__, index);
+
+  if (!state) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in remove_haptic_target: null pointer for state.");
+    return OMNI_ERROR_NULL_STATE;
+  }
+
+  int slot = find_haptic_target(state, index);
+  if (slot < 0) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in remove_haptic_target: no target with index %d.", index);
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+
+  // Shifting keeps the order by range.
+  memmove(&state->haptic_target_list[slot], &state->haptic_target_list[slot + 1],
+          (state->haptic_target_list_len - slot - 1) * sizeof(state->haptic_target_list[0]));
+  state->haptic_target_list_len--;
+  memset(&state->haptic_target_list[state->haptic_target_list_len], 0, sizeof(state->haptic_target_list[0]));
+
+  omniwear_device_impl *impl = get_device_impl(state);
+  impl->hot.erase(slot);
+  impl->deltas = true;
+  if (impl->motion.flags) impl->motion.pending = true;
+  return OMNI_SUCCESS;
+}
+
+OMNI_RESULT set_haptic_player_pose(haptic_device_state_t *state, const vec3_t origin, const vec3_t viewangles_deg) {
+  CallLog::Call call;
+  if (call.recording && origin && viewangles_deg) {
+    float args[] = { origin[0], origin[1], origin[2],
+                     viewangles_deg[0], viewangles_deg[1], viewangles_deg[2] };
+    CallLog::write_floats(CallLog::op_player_pose, state, args, 6);
+  }
+
+  if (!state) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_player_pose: null pointer for state.");
+    return OMNI_ERROR_NULL_STATE;
+  }
+
+  if (!origin || !viewangles_deg) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_player_pose: null pointer for origin or viewangles.");
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+
+  // Viewangles only matter to mixing, so turning is free.
+  set_vector(state->player_viewangles_deg, viewangles_deg[0], viewangles_deg[1], viewangles_deg[2]);
+
+  omniwear_device_impl *impl = get_device_impl(state);
+  if (impl->motion.flags) impl->motion.pending = true;
+  impl->deltas = true;
+  if (!moved_beyond(state->player_origin, origin, impl->delta_threshold))
+    return OMNI_SUCCESS;
+
+  set_vector(state->player_origin, origin[0], origin[1], origin[2]);
+  calculate_range_and_bearing(state, nullptr, state->player_origin, fixed_point_engine);
+  touch_haptic_targets(state);
+  return OMNI_SUCCESS;
+}
+
+OMNI_RESULT set_haptic_delta_threshold(haptic_device_state_t *state, float distance) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_floats(CallLog::op_delta_threshold, state, &distance, 1);
+
+  DBG ("=== %s %g\n", __FUNCTION__, distance);
+
+  if (!state) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_delta_threshold: null pointer for state.");
+    return OMNI_ERROR_NULL_STATE;
+  }
+
+  if (!(distance >= 0)) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_delta_threshold: negative distance.");
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+
+  get_device_impl(state)->delta_threshold = distance;
+  return OMNI_SUCCESS;
+}
+
 void set_haptic_effect(haptic_device_state_t *state, int target_type, haptic_effect_t haptic_effect, float period) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_effect(state, target_type, haptic_effect, period);
+
   DBG ("=== %s %d %d %g\n", __FUNCTION__, target_type,
        haptic_effect, period);
 
   // Sanity check.
   if (!state) {
-    printf("ERROR in set_haptic_effect: state pointer is null.\n");
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_effect: state pointer is null.");
     return;
   }
 
@@ -717,7 +1359,7 @@ void set_haptic_effect(haptic_device_state_t *state, int target_type, haptic_eff
 
     if (period <= 0) {
 
-      printf("ERROR in set_haptic_effect: insane value for period: %f.\n", period);
+      OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_effect: insane value for period: %f.", period);
       return;
     }
   }
@@ -751,6 +1393,10 @@ void set_haptic_effect(haptic_device_state_t *state, int target_type, haptic_eff
 
 // Remove a haptic effect map.
 void clear_haptic_effect(haptic_device_state_t *state, int target_type) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_ints(CallLog::op_clear_effect, state, &target_type, 1);
+
   int i, j;
 
   DBG ("=== %s\n", __FUNCTION__);
@@ -782,103 +1428,756 @@ void clear_haptic_effect(haptic_device_state_t *state, int target_type) {
   }
 }
 
-void execute_haptic_effects(haptic_device_state_t *state, double game_time) {
-  DBG ("=== %s\n", __FUNCTION__);
+OMNI_RESULT set_haptic_priority(haptic_device_state_t *state,
+                                int target_type, int priority) {
+  CallLog::Call call;
+  if (call.recording) {
+    int args[] = { target_type, priority };
+    CallLog::write_ints(CallLog::op_priority, state, args, 2);
+  }
 
-  // Update our clock.
-  state->last_update = game_time;
+  DBG ("=== %s %d %d\n", __FUNCTION__, target_type, priority);
+
+  if (!state) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_priority: state pointer is null.");
+    return OMNI_ERROR_NULL_STATE;
+  }
+
+  if (priority < HapticBudget::MIN_PRIORITY || priority > HapticBudget::MAX_PRIORITY) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_priority: priority must be from %d to %d.", HapticBudget::MIN_PRIORITY, HapticBudget::MAX_PRIORITY);
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+
+  get_device_impl(state)->budget.set_priority(target_type, priority);
+  return OMNI_SUCCESS;
+}
+
+OMNI_RESULT set_haptic_prediction(haptic_device_state_t *state,
+                                  int flags, float latency_sec) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_prediction(state, flags, latency_sec);
+
+  DBG ("=== %s %d %g\n", __FUNCTION__, flags, latency_sec);
+
+  if (!state) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_prediction: state pointer is null.");
+    return OMNI_ERROR_NULL_STATE;
+  }
+
+  if (flags & ~(PREDICT_TARGETS | PREDICT_ORIGIN | PREDICT_VIEWANGLES)) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_prediction: unrecognized flags.");
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+
+  if (!(latency_sec >= 0 && latency_sec <= HapticMotion::MAX_PREDICTION_SEC)) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_prediction: latency must be from 0 to %g seconds.", HapticMotion::MAX_PREDICTION_SEC);
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+
+  HapticMotion::Tracker &motion = get_device_impl(state)->motion;
+  if (!flags)
+    motion = HapticMotion::Tracker();
+  motion.flags = flags;
+  motion.latency_sec = latency_sec;
+  return OMNI_SUCCESS;
+}
+
+OMNI_RESULT set_haptic_report_budget(haptic_device_state_t *state,
+                                     int reports_per_frame) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_ints(CallLog::op_report_budget, state, &reports_per_frame, 1);
+
+  DBG ("=== %s %d\n", __FUNCTION__, reports_per_frame);
+
+  if (!state) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_report_budget: state pointer is null.");
+    return OMNI_ERROR_NULL_STATE;
+  }
+
+  if (reports_per_frame < 0) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_report_budget: negative budget.");
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+
+  get_device_impl(state)->budget.budget = reports_per_frame;
+  return OMNI_SUCCESS;
+}
+
+OMNI_RESULT set_haptic_mixing(haptic_device_state_t *state,
+                              haptic_combine_t combine,
+                              haptic_falloff_t angle_falloff,
+                              haptic_falloff_t range_falloff) {
+  CallLog::Call call;
+  if (call.recording) {
+    int args[] = { combine, angle_falloff, range_falloff };
+    CallLog::write_ints(CallLog::op_mixing, state, args, 3);
+  }
+
+  DBG ("=== %s %d %d %d\n", __FUNCTION__, combine, angle_falloff,
+       range_falloff);
+
+  if (!state) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_mixing: state pointer is null.");
+    return OMNI_ERROR_NULL_STATE;
+  }
+
+  if (combine < COMBINE_NEAREST || combine > COMBINE_LOUDNESS) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_mixing: unrecognized combine rule.");
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+
+  // Build the tables aside so that a bad falloff leaves the current
+  // configuration untouched.
+  HapticMixer::Config config = get_mixer_config(state);
+  config.combine = combine;
+  if (!HapticMixer::set_falloff(config, CURVE_ANGLE, angle_falloff)
+      || !HapticMixer::set_falloff(config, CURVE_RANGE, range_falloff)) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_mixing: unrecognized falloff.");
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+
+  get_device_impl(state)->mixer = config;
+  return OMNI_SUCCESS;
+}
+
+OMNI_RESULT set_haptic_spatialization(haptic_device_state_t *state,
+                                      haptic_spatial_t spatial) {
+  CallLog::Call call;
+  if (call.recording) {
+    int args[] = { spatial };
+    CallLog::write_ints(CallLog::op_spatialization, state, args, 1);
+  }
+
+  DBG ("=== %s %d\n", __FUNCTION__, spatial);
+
+  if (!state) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_spatialization: state pointer is null.");
+    return OMNI_ERROR_NULL_STATE;
+  }
+
+  if (spatial != SPATIAL_CONE && spatial != SPATIAL_PANNING) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_spatialization: unrecognized spatialization.");
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+
+  if (spatial == SPATIAL_PANNING) get_panning_table();
+
+  get_device_impl(state)->mixer.spatial = spatial;
+  return OMNI_SUCCESS;
+}
+
+OMNI_RESULT define_haptic_falloff_curve(haptic_device_state_t *state,
+                                        haptic_curve_t curve,
+                                        const float *samples, int count) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_falloff_curve(state, curve, samples, count);
+
+  DBG ("=== %s %d %d\n", __FUNCTION__, curve, count);
+
+  if (!state) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in define_haptic_falloff_curve: state pointer is null.");
+    return OMNI_ERROR_NULL_STATE;
+  }
+
+  HapticMixer::Config config = get_mixer_config(state);
+  if (!HapticMixer::set_curve(config, curve, samples, count)) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in define_haptic_falloff_curve: invalid curve.");
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+
+  get_device_impl(state)->mixer = config;
+  return OMNI_SUCCESS;
+}
+
+// Priorities of the targets to be mixed, or null when every type of
+// target has the default priority.
+static const int *get_target_priorities(const haptic_device_state_t *state, const HapticLayout::Targets &hot, int target_count, int priorities[MAX_TARGETS]) {
+
+  if (!state->device_impl || state->device_impl->budget.priorities.empty())
+    return nullptr;
+
+  const HapticBudget::Scheduler &budget = state->device_impl->budget;
+  int target_num;
+  for (target_num = 0; target_num<target_count; target_num++)
+    priorities[target_num] = budget.priority(hot.type[target_num]);
+  return priorities;
+}
+
+// Rotations by yaw about the z-axis and then by pitch that carry the
+// motors from the frame of the head into the world as the player
+// looks along viewangles_deg.
+static void get_view_rotations(const float viewangles_deg[3], matrix4x4_t *yaw_matrix, matrix4x4_t *pitch_matrix) {
 
   // Convert to int viewangles.
   vec3_t int_viewangles;
-  set_vector(int_viewangles, (int)state->player_viewangles_deg[0], (int)state->player_viewangles_deg[1], (int)state->player_viewangles_deg[2]);
+  set_vector(int_viewangles, (int)viewangles_deg[0], (int)viewangles_deg[1], (int)viewangles_deg[2]);
 
   // Calculate the relevant vectors from the player's perspective.
   vec3_t forward, right, up;
   get_angle_vectors(int_viewangles, forward, right, up);
 
+  create_rotation_matrix(yaw_matrix, int_viewangles[YAW], up[0], up[1], up[2]);
+  create_rotation_matrix(pitch_matrix, int_viewangles[PITCH], right[0], right[1], right[2]);
+}
+
+// The motors were carried into the world by pitch * yaw.  That is a
+// rotation, so its transpose carries the targets back into the frame
+// of the head.
+static void get_body_rotation(const matrix4x4_t *yaw_matrix, const matrix4x4_t *pitch_matrix, float to_body[3][3]) {
+
+  int r, c;
+  for (r = 0; r<3; r++)
+    for (c = 0; c<3; c++)
+      to_body[c][r] = pitch_matrix->m[r][0] * yaw_matrix->m[0][c]
+        + pitch_matrix->m[r][1] * yaw_matrix->m[1][c]
+        + pitch_matrix->m[r][2] * yaw_matrix->m[2][c];
+}
+
+// Mix the targets onto the motors with the float engine.  tracking
+// is set for the motors with at least one target, and priorities, if
+// not null, to the highest priority of those targets.
+static void mix_haptic_frame(const haptic_device_state_t *state, const HapticLayout::Targets &hot, const float viewangles_deg[3], int intensities[NUMBER_OF_MOTORS], bool tracking[NUMBER_OF_MOTORS], int priorities[NUMBER_OF_MOTORS]) {
+
+  // The rotations by yaw about the z-axis and then by pitch are the
+  // same for every motor.
+  matrix4x4_t yaw_matrix, pitch_matrix;
+  get_view_rotations(viewangles_deg, &yaw_matrix, &pitch_matrix);
+
+  // The motors were carried into the world by pitch * yaw.
+  float to_body[3][3];
+  get_body_rotation(&yaw_matrix, &pitch_matrix, to_body);
+
+  // The mixer reads the hot columns in place.  The list is sorted by
+  // range so the targets within range come first.
+  int target_num = hot.in_range();
+  int target_priority[MAX_TARGETS];
+
+  HapticMixer::Targets targets;
+  targets.count = target_num;
+  targets.x = hot.x;
+  targets.y = hot.y;
+  targets.z = hot.z;
+  targets.range = hot.range;
+  targets.on = hot.on;
+  targets.priority = get_target_priorities(state, hot, target_num, target_priority);
+
+  // Mix every target onto every motor in one pass.
+  const HapticMixer::Config &config = get_mixer_config(state);
+  if (config.spatial == SPATIAL_PANNING)
+    HapticMixer::mix_panned(config, get_panning_table(), to_body,
+                            NUMBER_OF_MOTORS, targets, intensities, tracking,
+                            priorities);
+  else
+    HapticCap::mix<HapticCap::Cap13>(config, to_body, targets, intensities, tracking, priorities);
+}
+
+// Mix the targets onto the motors with the fixed point engine.
+static void mix_haptic_frame_fixed(const haptic_device_state_t *state, const HapticLayout::Targets &hot, const float viewangles_deg[3], int intensities[NUMBER_OF_MOTORS], bool tracking[NUMBER_OF_MOTORS], int priorities[NUMBER_OF_MOTORS]) {
+
+  int viewangles[3] = {(int)viewangles_deg[0], (int)viewangles_deg[1], (int)viewangles_deg[2]};
+
+  fixed_vec3_t motor_vecs[NUMBER_OF_MOTORS];
+  fixed_vec3_t to_body[3];
+  HapticFixed::motor_vectors(viewangles, get_fixed_motor_positions(), NUMBER_OF_MOTORS, motor_vecs, to_body);
+
+  const int target_num = hot.in_range();
+  Fixed::q15 target_x[MAX_TARGETS], target_y[MAX_TARGETS], target_z[MAX_TARGETS];
+  int i;
+  for (i = 0; i<target_num; i++) {
+    target_x[i] = Fixed::to_q15(hot.x[i]);
+    target_y[i] = Fixed::to_q15(hot.y[i]);
+    target_z[i] = Fixed::to_q15(hot.z[i]);
+  }
+
+  int target_priority[MAX_TARGETS];
+
+  HapticFixed::Targets targets;
+  targets.count = target_num;
+  targets.x = target_x;
+  targets.y = target_y;
+  targets.z = target_z;
+  targets.range = hot.range;
+  targets.on = hot.on;
+  targets.priority = get_target_priorities(state, hot, target_num, target_priority);
+
+  const HapticMixer::Config &config = get_mixer_config(state);
+  if (config.spatial == SPATIAL_PANNING)
+    HapticFixed::mix_panned(config, get_panning_table(), to_body,
+                            NUMBER_OF_MOTORS, targets, intensities, tracking,
+                            priorities);
+  else
+    HapticFixed::mix(config, motor_vecs, NUMBER_OF_MOTORS,
+                     targets, intensities, tracking, priorities);
+}
+
+// Mix the targets onto the motors of a wearable's layout with the
+// kernel specialized for it, see haptic_cap.h.
+template<typename Layout>
+static OMNI_RESULT mix_haptic_layout(haptic_device_state_t *state, const vec3_t viewangles_deg, int intensities[]) {
+
+  if (!state) {
+    OMNI_LOG(OMNI_LOG_ERROR, "***ERR: invalid state");
+    return OMNI_ERROR_NULL_STATE;
+  }
+  if (!viewangles_deg || !intensities)
+    return OMNI_ERROR_INVALID_ARGUMENT;
+
+  matrix4x4_t yaw_matrix, pitch_matrix;
+  float to_body[3][3];
+  get_view_rotations(viewangles_deg, &yaw_matrix, &pitch_matrix);
+  get_body_rotation(&yaw_matrix, &pitch_matrix, to_body);
+
+  const HapticLayout::Targets &hot = get_hot_targets(state);
+  int target_priority[MAX_TARGETS];
+  HapticMixer::Targets targets;
+  targets.count = hot.in_range();
+  targets.x = hot.x;
+  targets.y = hot.y;
+  targets.z = hot.z;
+  targets.range = hot.range;
+  targets.on = hot.on;
+  targets.priority = get_target_priorities(state, hot, targets.count, target_priority);
+
+  bool tracking[Layout::C_COUNT];
+  HapticCap::mix<Layout>(get_mixer_config(state), to_body, targets, intensities, tracking);
+  return OMNI_SUCCESS;
+}
+
+template<typename Layout>
+static int encode_haptic_layout(const int intensities[], uint8_t reports[][HAPTIC_REPORT_BYTES]) {
+
+  if (!intensities || !reports)
+    return 0;
+
+  Omniwear::Report packed[Layout::C_REPORTS];
+  HapticCap::encode_packed<Layout>(intensities, packed);
+  int i;
+  for (i = 0; i<Layout::C_REPORTS; i++)
+    memcpy(reports[i], &packed[i][0], HAPTIC_REPORT_BYTES);
+  return Layout::C_REPORTS;
+}
+
+OMNI_RESULT mix_haptic_cap(haptic_device_state_t *state, const vec3_t player_viewangles_deg, int intensities[NUMBER_OF_MOTORS]) {
+  return mix_haptic_layout<HapticCap::Cap13>(state, player_viewangles_deg, intensities);
+}
+
+OMNI_RESULT mix_haptic_band(haptic_device_state_t *state, const vec3_t player_viewangles_deg, int intensities[HAPTIC_BAND_MOTORS]) {
+  return mix_haptic_layout<HapticCap::Band8>(state, player_viewangles_deg, intensities);
+}
+
+OMNI_RESULT mix_haptic_vest(haptic_device_state_t *state, const vec3_t player_viewangles_deg, int intensities[HAPTIC_VEST_MOTORS]) {
+  return mix_haptic_layout<HapticCap::Vest24>(state, player_viewangles_deg, intensities);
+}
+
+int encode_haptic_cap(const int intensities[NUMBER_OF_MOTORS], uint8_t reports[][HAPTIC_REPORT_BYTES]) {
+  return encode_haptic_layout<HapticCap::Cap13>(intensities, reports);
+}
+
+int encode_haptic_band(const int intensities[HAPTIC_BAND_MOTORS], uint8_t reports[][HAPTIC_REPORT_BYTES]) {
+  return encode_haptic_layout<HapticCap::Band8>(intensities, reports);
+}
+
+int encode_haptic_vest(const int intensities[HAPTIC_VEST_MOTORS], uint8_t reports[][HAPTIC_REPORT_BYTES]) {
+  return encode_haptic_layout<HapticCap::Vest24>(intensities, reports);
+}
+
+// Compute the intensity of every motor for this frame, 0-100 before
+// the haptic volume is applied, and update the state of the motors.
+// The player looks along viewangles_deg at the targets in hot.
+// priorities, if not null, receives the priority of what each motor
+// shows.
+static void compute_haptic_frame(haptic_device_state_t *state, double game_time, const HapticLayout::Targets &hot, const float viewangles_deg[3], int frame[NUMBER_OF_MOTORS], int priorities[NUMBER_OF_MOTORS], bool fixed) {
+
+  // Update our clock.
+  state->last_update = game_time;
+
+  int intensities[NUMBER_OF_MOTORS];
+  bool tracking[NUMBER_OF_MOTORS];
+  if (fixed)
+    mix_haptic_frame_fixed(state, hot, viewangles_deg, intensities, tracking, priorities);
+  else
+    mix_haptic_frame(state, hot, viewangles_deg, intensities, tracking, priorities);
+
+  // Advance the oscillators.
+  HapticOscillator::Bank *oscillators = nullptr;
+  int oscillator_intensities[NUMBER_OF_MOTORS];
+  if (state->device_impl && state->device_impl->oscillators.running) {
+    oscillators = &state->device_impl->oscillators;
+    oscillators->tick(game_time, oscillator_intensities);
+  }
+
   // Loop through the actuators.
   int motor_num;
   for (motor_num = 0; motor_num<NUMBER_OF_MOTORS; motor_num++) {
 
     haptic_motor_t *motor = &state->motors[motor_num];
 
-    // Calculate this motor's position in the game.
-    vec3_t motor_vec;
-    set_vector(motor_vec, motor->position[0], motor->position[1], motor->position[2]);
+    // Set the motor from the targets in its cone.
+    if (tracking[motor_num]) {
 
-    // Rotate it by yaw angle about the z-axis.
-    matrix4x4_t rotate_matrix;
-    create_rotation_matrix(&rotate_matrix, int_viewangles[YAW], up[0], up[1], up[2]);
-    vec3_t temp_vec;
-    transform_vec3(&rotate_matrix, motor_vec, temp_vec);
+      frame[motor_num] = intensities[motor_num];
+      motor->is_running = intensities[motor_num] > 0;
+      continue;
+    }
 
-    // Now rotate it by the pitch.
-    create_rotation_matrix(&rotate_matrix, int_viewangles[PITCH], right[0], right[1], right[2]);
-    transform_vec3(&rotate_matrix, temp_vec, motor_vec);
+    // If there's no eligible target, follow the oscillator, or else
+    // handle global intensities, or else turn off the motor.
+    unsigned char intensity = oscillators && oscillators->is_running(motor_num)
+      ? oscillator_intensities[motor_num] : state->current_global_intensity;
 
-    // Normalize (just in case).
-    normalize_vec3(motor_vec);
+    // Handle zero global intensity.
+    if (intensity == 0) motor->is_running = false;
 
-    // Get the closest target that is also within this motor's MAX_ANGLE.
-    bool tracking_target = false;
-    int target_num;
-    unsigned char intensity;
-    for (target_num = 0; target_num<state->haptic_target_list_len; target_num++) {
+    frame[motor_num] = intensity;
+    if (priorities) priorities[motor_num] = HapticBudget::PRIORITY_AMBIENT;
+  }
+}
 
-      haptic_target_t *target = &state->haptic_target_list[target_num];
+// Send the changes in a frame to the device within the report budget.
+static void send_haptic_frame(haptic_device_state_t *state, double game_time, const int frame[NUMBER_OF_MOTORS], const int priorities[NUMBER_OF_MOTORS]) {
 
-      // If we're out of range, break (since this list is sorted by range).
-      if (target->range >= MAX_RANGE) break;
+  if (!state->device_impl || !state->device_impl->device)
+    return;
 
-      // Calculate the angle from the motor's normal to the target.
-      float angle = acosf(dot_product(target->vec_to_target, motor_vec));
+  if (state->haptic_volume == 0)
+    OMNI_LOG(OMNI_LOG_WARNING, "WARNING: in execute_haptic_effects: haptic_volume set to 0.");
 
-      // If the angle is too big, try the next closest target.
-      if (angle > MAX_ANGLE) continue;
+  // Adjust for the global haptic volume.
+  int duties[NUMBER_OF_MOTORS];
+  int packed_duties[NUMBER_OF_MOTORS];
+  bool packed = true;
+  int motor_num;
+  for (motor_num = 0; motor_num<NUMBER_OF_MOTORS; motor_num++) {
+    duties[motor_num] = (frame[motor_num]*state->haptic_volume + 50)/100;
+    packed_duties[motor_num] = Omniwear::packed_duty(duties[motor_num]);
+    packed = packed && packed_duties[motor_num] >= 0;
+  }
 
-      // Set the tracking target flag.
-      tracking_target = true;
+  HID::Device *device = state->device_impl->device.get();
+  HapticBudget::Scheduler &budget = state->device_impl->budget;
+  int order[NUMBER_OF_MOTORS];
+  int count = budget.plan(game_time, duties, priorities,
+                          packed ? packed_duties : nullptr, order);
+
+  // A report that fails leaves the budget with what the motor had, so
+  // the change is planned again in the next frame.
+  int64_t start = Telemetry::now_ns();
+  if (count == HapticBudget::PACKED) {
+    if (Omniwear::configure_motors_packed(device, duties, NUMBER_OF_MOTORS))
+      budget.sent_packed(packed_duties, priorities, NUMBER_OF_MOTORS);
+    count = 1;
+  } else {
+    int i;
+    for (i = 0; i<count; i++) {
+      if (Omniwear::configure_motor(device, order[i], duties[order[i]]))
+        budget.sent_motor(order[i], duties[order[i]], priorities[order[i]]);
+    }
+  }
+  budget.measure(count, Telemetry::now_ns() - start);
+}
 
-      // Run motor only if the target is within it's cone.
-      if (angle < MAX_ANGLE) {
-              if (target->range > MAX_RANGE/2) {
-                      intensity = 50;
-              }
-              else {
-                      intensity = 100;
-              }
-      }
-      else {
-              intensity = 0;
-      }
-      //      intensity = 100 * (1 - (angle/MAX_ANGLE));
+// Send the reports of the pattern playing on a state that are due by
+// game_time.  Returns true while the pattern plays, in place of the
+// frame of the radar.
+static bool send_haptic_pattern(haptic_device_state_t *state, double game_time) {
 
-      // Set the motor.
-      if (target->turn_motor_on) {
+  omniwear_device_impl *impl = state->device_impl;
+  if (!impl || !impl->pattern.playing())
+    return false;
 
-        command_haptic_motor(state, motor_num, intensity);
-        motor->is_running = true;
-      } else {
+  // The hooks count a write that fails; the budget is told so that
+  // nothing assumes the cap holds what the pattern sent.
+  HID::Device *device = impl->device.get();
+  bool playing = impl->pattern.play(game_time, [impl, device](const char *report) {
+    if (!device)
+      return;
+    Telemetry::count(uint8_t(report[0]) == 0xf1
+                     ? Telemetry::packed_reports : Telemetry::motor_reports);
+    if (HID::write(device, report, HapticPattern::CB_REPORT) != int(HapticPattern::CB_REPORT))
+      impl->budget.forget();
+  });
+  if (playing)
+    return true;
+
+  // The radar takes over motors that are as the pattern left them.
+  impl->budget.forget();
+  return false;
+}
 
-        command_haptic_motor(state, motor_num, 0);
-        motor->is_running = false;
-      }
+// Extrapolate the targets and the player's pose to when this frame
+// reaches the cap and recalculate the ranges and bearings into a copy
+// of the targets, which the caller doesn't see; their effects stay as
+// the last update left them.  Returns the viewangles to mix with,
+// which may be viewangles, and points hot at the targets to mix.
+static const float *predict_haptic_targets(haptic_device_state_t *state, double game_time, float viewangles[3], const HapticLayout::Targets **hot) {
+
+  omniwear_device_impl *impl = state->device_impl;
+  HapticMotion::Tracker &motion = impl->motion;
+  if (motion.pending)
+    motion.record(game_time, state->haptic_target_list, state->haptic_target_list_len,
+                  state->player_origin, state->player_viewangles_deg);
+
+  double horizon = motion.horizon(game_time, impl->budget.send_ns*1e-9);
+  if (!motion.moving || horizon <= 0)
+    return state->player_viewangles_deg;
+
+  Trace::Span span("predict_haptic_targets");
+  vec3_t origin;
+  motion.extrapolate_pose(state->player_origin, state->player_viewangles_deg, horizon, origin, viewangles);
+
+  haptic_target_t *predicted = impl->predicted_list;
+  int target_num;
+  for (target_num = 0; target_num<state->haptic_target_list_len; target_num++) {
+    haptic_target_t *target = &predicted[target_num];
+    *target = state->haptic_target_list[target_num];
+    float location[3];
+    motion.extrapolate(target->index, target->location, horizon, location);
+    Fixed::q15 fixed_vec_to_target[3];
+    measure_haptic_target(target, location, origin, fixed_point_engine, fixed_vec_to_target);
+  }
 
-      // Now move on to next motor since this motor is tracking a target.
-      break;
+  qsort(predicted, state->haptic_target_list_len, sizeof(predicted[0]), cmp_range);
+  impl->predicted.load(predicted, state->haptic_target_list_len);
+  *hot = &impl->predicted;
+  return viewangles;
+}
+
+void execute_haptic_effects(haptic_device_state_t *state, double game_time) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_execute(state, game_time);
+
+  DBG ("=== %s\n", __FUNCTION__);
+
+  Telemetry::Timer timer(Telemetry::execute_ns);
+  Trace::Span span("execute_haptic_effects");
+  OMNI_PROBE1(execute_entry, state);
+  settle_haptic_targets(state);
+
+  // A pattern that plays has the motors, and the radar isn't mixed.
+  if (send_haptic_pattern(state, game_time)) {
+    OMNI_PROBE1(execute_return, state);
+    return;
+  }
+
+  const HapticLayout::Targets *hot = &get_hot_targets(state);
+  const float *viewangles = state->player_viewangles_deg;
+  float predicted_viewangles[3];
+  if (state->device_impl->motion.flags)
+    viewangles = predict_haptic_targets(state, game_time, predicted_viewangles, &hot);
+
+  int frame[NUMBER_OF_MOTORS];
+  int priorities[NUMBER_OF_MOTORS];
+  compute_haptic_frame(state, game_time, *hot, viewangles, frame, priorities, fixed_point_engine);
+
+  // Set the motors that changed.
+  send_haptic_frame(state, game_time, frame, priorities);
+  OMNI_PROBE1(execute_return, state);
+}
+
+struct haptic_pattern_s : HapticPattern::File {
+};
+
+haptic_pattern_t *load_haptic_pattern(const char *path) {
+  DBG ("=== %s %s\n", __FUNCTION__, path);
+
+  if (!path)
+    return nullptr;
+
+  haptic_pattern_t *pattern = new haptic_pattern_t;
+  if (!pattern->open(path)) {
+    // The ring keeps only literal strings, so the path isn't logged.
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in load_haptic_pattern: not a compiled pattern.");
+    delete pattern;
+    return nullptr;
+  }
+  return pattern;
+}
+
+void unload_haptic_pattern(haptic_pattern_t *pattern) {
+  delete pattern;
+}
+
+OMNI_RESULT play_haptic_pattern(haptic_device_state_t *state, const haptic_pattern_t *pattern, double game_time) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_pattern(state, pattern ? pattern->path().c_str() : nullptr, game_time);
+
+  DBG ("=== %s\n", __FUNCTION__);
+
+  if (!state || !state->device_impl || !state->device_impl->device) {
+    OMNI_LOG (OMNI_LOG_ERROR, "***ERR: invalid state");
+    return OMNI_ERROR_NULL_STATE;
+  }
+
+  if (!pattern)
+    return OMNI_ERROR_INVALID_ARGUMENT;
+
+  // The packed reports are only right under the pattern's mapping.
+  omniwear_device_impl &impl = *state->device_impl;
+  if (!impl.packed_defined || memcmp(&impl.packed_mapping[0], pattern->mapping(), 16) != 0) {
+    if (!Omniwear::define_packed(impl.device.get(), pattern->mapping(), 16))
+      return OMNI_ERROR_INVALID_PACKING;
+    memcpy(&impl.packed_mapping[0], pattern->mapping(), 16);
+    impl.packed_defined = true;
+  }
+
+  impl.pattern.start(pattern, game_time);
+  return OMNI_SUCCESS;
+}
+
+OMNI_RESULT stop_haptic_pattern(haptic_device_state_t *state) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_state(CallLog::op_stop_pattern, state);
+
+  if (!state) {
+    OMNI_LOG (OMNI_LOG_ERROR, "***ERR: invalid state");
+    return OMNI_ERROR_NULL_STATE;
+  }
+
+  omniwear_device_impl *impl = state->device_impl;
+  if (impl && impl->pattern.playing()) {
+    impl->pattern.stop();
+    impl->budget.forget();
+  }
+  return OMNI_SUCCESS;
+}
+
+int is_haptic_pattern_playing(const haptic_device_state_t *state) {
+  return state && state->device_impl && state->device_impl->pattern.playing();
+}
+
+OMNI_RESULT init_haptic_state(haptic_device_state_t *state) {
+  CallLog::Call call;
+  if (call.recording)
+    CallLog::write_state(CallLog::op_init, state);
+
+  DBG ("=== %s\n", __FUNCTION__);
+
+  if (!state) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in init_haptic_state: state pointer is null.");
+    return OMNI_ERROR_NULL_STATE;
+  }
+
+  state->last_update = 0;
+  state->haptic_target_list_len = 0;
+  initialize_haptic_motors(state);
+  return OMNI_SUCCESS;
+}
+
+OMNI_RESULT set_haptic_batch_threads(int threads) {
+  DBG ("=== %s %d\n", __FUNCTION__, threads);
+
+  if (threads < 0) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in set_haptic_batch_threads: negative thread count.");
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+
+  std::lock_guard<std::mutex> guard(batch_pool_lock);
+  delete batch_pool;
+  batch_pool = nullptr;
+  batch_threads = threads;
+  return OMNI_SUCCESS;
+}
+
+OMNI_RESULT execute_haptic_radar_batch(haptic_device_state_t *const states[],
+                                       int player_count,
+                                       const haptic_target_t targets[],
+                                       int targets_len,
+                                       const haptic_target_set_t target_sets[],
+                                       const vec3_t player_origins[],
+                                       const vec3_t player_viewangles_deg[],
+                                       double game_time,
+                                       haptic_motor_frame_t frames[]) {
+  DBG ("=== %s %d %d\n", __FUNCTION__, player_count, targets_len);
+
+  // Error check everything up front so that the batch either runs
+  // for every player or for none.
+  if (player_count < 0 || !states || !target_sets || !player_origins
+      || !player_viewangles_deg || !frames || (targets_len && !targets)) {
+    OMNI_LOG(OMNI_LOG_ERROR, "ERROR in execute_haptic_radar_batch: null pointer or negative count.");
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  }
+
+  int player;
+  for (player = 0; player<player_count; player++) {
+
+    if (!states[player]) {
+      OMNI_LOG(OMNI_LOG_ERROR, "ERROR in execute_haptic_radar_batch: null pointer for state %d.", player);
+      return OMNI_ERROR_NULL_STATE;
     }
 
-    // If there's no eligible target, turn off motor or else handle global intensities.
-    if (!tracking_target) {
+    const haptic_target_set_t *set = &target_sets[player];
+    if (set->len < 0 || set->len > MAX_TARGETS || (set->len && !set->indices)) {
+      OMNI_LOG(OMNI_LOG_ERROR, "ERROR in execute_haptic_radar_batch: bad target set for player %d.", player);
+      return OMNI_ERROR_INVALID_ARGUMENT;
+    }
 
-      // Handle global intensities.
-      intensity = state->current_global_intensity;
+    int i;
+    for (i = 0; i<set->len; i++) {
+      if (set->indices[i] < 0 || set->indices[i] >= targets_len) {
+        OMNI_LOG(OMNI_LOG_ERROR, "ERROR in execute_haptic_radar_batch: target index out of range for player %d.", player);
+        return OMNI_ERROR_INVALID_ARGUMENT;
+      }
+    }
+  }
 
-      // Handle zero global intensity.
-      if (intensity == 0) motor->is_running = false;
+  // Each player only touches its own state, so the players can be
+  // run in any order on any thread.
+  auto run_player = [&](int player) {
+    haptic_device_state_t *state = states[player];
+    const haptic_target_set_t *set = &target_sets[player];
 
-      // Set the motor.
-      command_haptic_motor(state, motor_num, intensity);
+    {
+      Telemetry::Timer timer(Telemetry::radar_update_ns);
+      Trace::Span span("merge_haptic_targets");
+      span.arg(0, "player", player);
+      haptic_target_array set_targets = {targets, set->indices};
+      merge_haptic_targets(state, set_targets, set->len,
+                           player_origins[player], player_viewangles_deg[player]);
     }
+    Telemetry::Timer timer(Telemetry::execute_ns);
+    Trace::Span span("compute_haptic_frame");
+    span.arg(0, "player", player);
+    compute_haptic_frame(state, game_time, get_hot_targets(state), state->player_viewangles_deg, frames[player].intensities, nullptr, fixed_point_engine);
+  };
+
+  std::lock_guard<std::mutex> guard(batch_pool_lock);
+  if (!batch_pool) {
+    int threads = batch_threads ? batch_threads : (int) std::thread::hardware_concurrency();
+    batch_pool = new WorkPool::Pool(threads);
+  }
+  batch_pool->run(player_count, run_player);
+
+  return OMNI_SUCCESS;
+}
+
+void HapticFixed::compare(const haptic_device_state_t *state, double game_time,
+                          int float_frame[], int fixed_frame[]) {
+
+  // The engines work on copies of the state and of the parts of the
+  // device they change, the oscillators and the hot columns, so the
+  // live device is left as it was.
+  omniwear_device_impl *impl = new omniwear_device_impl;
+  if (state->device_impl)
+    impl->mixer = state->device_impl->mixer;
+  haptic_device_state_t *copy = new haptic_device_state_t;
+  int pass;
+  for (pass = 0; pass<2; pass++) {
+    bool fixed = pass == 1;
+    memcpy(copy, state, sizeof(*copy));
+    copy->device_impl = impl;
+    if (state->device_impl)
+      impl->oscillators = state->device_impl->oscillators;
+    calculate_range_and_bearing(copy, nullptr, copy->player_origin, fixed);
+    qsort(copy->haptic_target_list, copy->haptic_target_list_len, sizeof(copy->haptic_target_list[0]), cmp_range);
+    impl->hot.load(copy->haptic_target_list, copy->haptic_target_list_len);
+    compute_haptic_frame(copy, game_time, impl->hot, copy->player_viewangles_deg, fixed ? fixed_frame : float_frame, nullptr, fixed);
   }
+  delete copy;
+  delete impl;
 }
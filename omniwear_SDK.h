@@ -14,6 +14,7 @@
 #define DLL_EXPORT
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
 /////////////////////////////////
@@ -45,8 +46,12 @@
 #define MIN_PERIOD .1
 #define MAX_PERIOD 2
 
-// How many targets we can track at once.
+// How many targets we can track at once.  The layout of
+// haptic_device_state_t depends on this, so an application that
+// overrides it must build the SDK with the same value.
+#if !defined (MAX_TARGETS)
 #define MAX_TARGETS 64
+#endif
 
 /////////////////////////////////
 // SETTINGS YOU PROBABLY SHOULDN'T MESS WITH
@@ -71,6 +76,17 @@
 #define NUMBER_OF_MOTORS 13
 #define C_MOTORS (NUMBER_OF_MOTORS)
 
+// Motors of the other wearables, see mix_haptic_band and
+// mix_haptic_vest.
+#define HAPTIC_BAND_MOTORS 8
+#define HAPTIC_VEST_MOTORS 24
+
+// Packed reports take the codes of up to 14 motors in 8 bytes.
+#define HAPTIC_PACKED_MOTORS 14
+#define HAPTIC_REPORT_BYTES 8
+#define HAPTIC_PACKED_REPORTS(motors) \
+  (((motors) + HAPTIC_PACKED_MOTORS - 1)/HAPTIC_PACKED_MOTORS)
+
 /* Error result codes for SDK methods */
 enum OMNI_RESULT {
   OMNI_SUCCESS                      = 0,
@@ -79,8 +95,24 @@ enum OMNI_RESULT {
   OMNI_ERROR_INVALID_MOTOR          = 3,
   OMNI_ERROR_INTENSITY_OUT_OF_RANGE = 4,
   OMNI_ERROR_INVALID_PACKING	    = 5,
+  OMNI_ERROR_INVALID_ARGUMENT       = 6,
+  OMNI_ERROR_QUEUE_FULL             = 7,
+  OMNI_ERROR_IO                     = 8, /* Reading or writing a file */
 };
 
+// Severity of a diagnostic message.
+typedef enum omniwear_log_level_e {
+
+  OMNI_LOG_ERROR,
+  OMNI_LOG_WARNING
+
+} omniwear_log_level_t;
+
+// Receives diagnostic messages from flush_omniwear_log.  The message
+// has no trailing newline.
+typedef void (*omniwear_log_callback_t)(void *context, int level,
+                                        const char *message);
+
 // Some convenience definitions.
 typedef float vec3_t[3];
 
@@ -101,6 +133,25 @@ typedef struct haptic_target_s {
 
 } haptic_target_t;
 
+// Where the fields of the game's own entities are, for
+// update_haptic_radar_strided.  Each field is a base pointer to the
+// field of the first entity and the byte stride from one entity to
+// the next; a stride of 0 means the field's own size, as in a packed
+// array.  location and viewangles_deg point to three floats, type and
+// index to an int, each aligned for its type.  viewangles_deg may be
+// NULL for targets that face nowhere, type NULL for type 0, and index
+// NULL to identify each target by its entity number.
+typedef struct haptic_target_view_s {
+  const void *location;
+  size_t location_stride;
+  const void *viewangles_deg;
+  size_t viewangles_stride;
+  const void *type;
+  size_t type_stride;
+  const void *index;
+  size_t index_stride;
+} haptic_target_view_t;
+
 // Types of haptic effects we can create.
 typedef enum haptic_effect_e {
 
@@ -122,6 +173,63 @@ typedef struct haptic_effect_map_s {
 
 } haptic_effect_map_t;
 
+// Rules for combining the contributions of several targets on one motor.
+typedef enum haptic_combine_e {
+
+  COMBINE_NEAREST,     // Closest in-cone target only (default).
+  COMBINE_MAX,         // Strongest contribution.
+  COMBINE_SUM_LIMITED, // Sum of contributions, limited to 100.
+  COMBINE_LOUDNESS     // Energy sum of contributions, limited to 100.
+
+} haptic_combine_t;
+
+// How target directions are mapped onto the motors.
+typedef enum haptic_spatial_e {
+
+  SPATIAL_CONE,   // Each motor feels the targets within MAX_ANGLE of it (default).
+  SPATIAL_PANNING // Each target is panned across its neighboring motors.
+
+} haptic_spatial_t;
+
+// Falloff curves, selecting how a contribution drops off toward the
+// edge of a motor's cone or toward MAX_RANGE.
+typedef enum haptic_curve_e {
+
+  CURVE_ANGLE,
+  CURVE_RANGE
+
+} haptic_curve_t;
+
+typedef enum haptic_falloff_e {
+
+  FALLOFF_STEP,   // Full across the cone; half beyond MAX_RANGE/2 (default).
+  FALLOFF_LINEAR,
+  FALLOFF_SMOOTH  // Smoothstep.
+
+} haptic_falloff_t;
+
+// Waveforms of the per-motor oscillators.  The built in waveforms
+// start at 0 and peak half way through a cycle.
+typedef enum haptic_waveform_e {
+
+  WAVEFORM_OFF,      // No oscillator (default).
+  WAVEFORM_TRIANGLE,
+  WAVEFORM_SINE,     // Raised cosine, 0 to 1.
+  WAVEFORM_SQUARE,   // On for the middle half of the cycle.
+  WAVEFORM_CUSTOM    // See define_haptic_waveform.
+
+} haptic_waveform_t;
+
+// What execute_haptic_effects extrapolates, see set_haptic_prediction.
+typedef enum haptic_prediction_e {
+
+  PREDICT_NONE       = 0,      // (default)
+  PREDICT_TARGETS    = 1 << 0, // Target locations, by their velocity.
+  PREDICT_ORIGIN     = 1 << 1, // The player's origin.
+  PREDICT_VIEWANGLES = 1 << 2  // The player's viewangles, by their angular velocity.
+
+} haptic_prediction_t;
+
 // Struct for each actuator.
 typedef struct haptic_motor_s {
   vec3_t position; // Position of the actuator on the cap.
@@ -157,10 +265,12 @@ typedef struct haptic_device_state_s {
   // Structures for the actual actuators.
   haptic_motor_t motors[NUMBER_OF_MOTORS];
 
-  // Global haptic effects.
+  // Global haptic effects.  Motors without a target or an oscillator
+  // run at current_global_intensity.  do_throb no longer ramps it; the
+  // throb is made by the oscillators.
   float current_global_intensity; // 0 - 100.
   int global_intensity_ceiling; // 0 - 100.
-  bool global_intensity_is_rising;
+  bool global_intensity_is_rising; // Unused.
 
 } haptic_device_state_t;
 
@@ -169,6 +279,65 @@ typedef struct {
   int intensity;                // Intensity 0..100
 } haptic_motor_config_t;
 
+// The targets seen by one player in a batch, as indices into an
+// array of targets shared by all of the players.
+typedef struct haptic_target_set_s {
+  const int *indices;
+  int len;
+} haptic_target_set_t;
+
+// Queue of commands that any thread may issue for a state.  See
+// create_haptic_command_queue.
+typedef struct haptic_command_queue_s haptic_command_queue_t;
+
+// Scene published by one thread and applied by the thread that owns a
+// state.  See create_haptic_snapshot.
+typedef struct haptic_snapshot_s haptic_snapshot_t;
+
+// Canned pattern compiled by omni-pattern.  See load_haptic_pattern.
+typedef struct haptic_pattern_s haptic_pattern_t;
+
+// Motor intensities, 0-100 before the haptic volume is applied,
+// computed for one player by a batch.
+typedef struct haptic_motor_frame_s {
+  int intensities[NUMBER_OF_MOTORS];
+} haptic_motor_frame_t;
+
+// Summary of one latency histogram.  Percentiles are accurate to
+// about 6%.
+typedef struct omniwear_histogram_s {
+  uint64_t count;
+  uint64_t sum_ns;
+  uint64_t max_ns;
+  uint64_t p50_ns;
+  uint64_t p90_ns;
+  uint64_t p99_ns;
+  uint64_t p999_ns;
+} omniwear_histogram_t;
+
+// Counters and latencies since the library was loaded.  See
+// get_omniwear_stats.
+typedef struct omniwear_stats_s {
+  uint64_t uptime_ns;
+
+  uint64_t hid_writes_submitted; // Reports handed to the OS
+  uint64_t hid_writes_completed;
+  uint64_t hid_writes_failed;
+  uint64_t hid_bytes_written;
+  uint64_t motor_reports;        // Single motor reports
+  uint64_t packed_reports;       // Packed frames of all motors
+  uint64_t log_suppressed;       // Messages held back by the rate limit
+  uint64_t log_dropped;          // Messages lost to a full log ring
+  uint64_t reports_unchanged;    // Motor reports skipped, no change
+  uint64_t reports_deferred;     // Motor reports held by the budget
+  uint64_t packed_fallbacks;     // Frames sent packed for the budget
+
+  omniwear_histogram_t hid_write;    // Submission to completion of a report
+  omniwear_histogram_t encode;       // Encoding a report
+  omniwear_histogram_t radar_update; // update_haptic_radar
+  omniwear_histogram_t execute;      // execute_haptic_effects
+} omniwear_stats_t;
+
 /////////////////////////////////
 // FUNCTION PROTOTYPES
 /////////////////////////////////
@@ -222,33 +391,364 @@ OMNI_RESULT DLL_EXPORT define_linear_packed_mapping(haptic_device_state_t*
                                                     int intercept);
 
 // Throb the entire cap.
-// Intensity and increment are 0-100.
+// The intensity ramps from 0 to intensity_ceiling (0-100) over
+// throb_period_sec and back again.  This sets a triangle oscillator
+// on every motor, see set_haptic_oscillator.  Calling it again with
+// the same arguments continues the throb, so it may be called every
+// frame as before.
 void DLL_EXPORT do_throb(haptic_device_state_t *state,
                          unsigned int intensity_ceiling,
                          float throb_period_sec, double game_time);
 
 // Should be called after you're done throbbing. Otherwise, the actuators
-// will be stuck in the last throb state.
+// will be stuck in the last throb state.  Turns off every oscillator.
 void DLL_EXPORT stop_throbbing(haptic_device_state_t *state);
 
+// Set the oscillator of a motor, or of every motor when motor is -1.
+// A motor that no target drives follows its oscillator, which cycles
+// through the waveform every period_sec seconds of game time at up to
+// amplitude (0-100).  phase, 0 to 1, is where in the cycle it starts.
+// Oscillators advance with the game_time passed to
+// execute_haptic_effects, so they keep time however often it is
+// called.  WAVEFORM_OFF turns the oscillator off.
+OMNI_RESULT DLL_EXPORT set_haptic_oscillator(haptic_device_state_t *state,
+                                             int motor,
+                                             haptic_waveform_t waveform,
+                                             float period_sec,
+                                             int amplitude,
+                                             float phase);
+
+// Define the waveform of WAVEFORM_CUSTOM.  The samples are gains from
+// 0 to 1 evenly spaced over one cycle, which wraps from the last
+// sample to the first.  Count must be at least 2.
+OMNI_RESULT DLL_EXPORT define_haptic_waveform(haptic_device_state_t *state,
+                                              const float *samples,
+                                              int count);
+
 // Update the list of targets we're tracking for the haptic radar.
 void DLL_EXPORT update_haptic_radar(haptic_device_state_t *state, haptic_target_t updated_targets[], int updated_targets_len, vec3_t player_origin, vec3_t player_viewangles);
 
+// Update the list of targets as update_haptic_radar does, reading
+// them in place from the game's entities through view instead of from
+// an array of haptic_target_t.  The targets are entities[0] to
+// entities[count - 1], or the first count entities when entities is
+// NULL.
+OMNI_RESULT DLL_EXPORT update_haptic_radar_strided(haptic_device_state_t *state,
+                                                   const haptic_target_view_t *view,
+                                                   const int *entities,
+                                                   int count,
+                                                   const vec3_t player_origin,
+                                                   const vec3_t player_viewangles_deg);
+
 // Turn off haptic radar.
 void DLL_EXPORT stop_haptic_radar(haptic_device_state_t *state);
 
+// Change the targets of the radar one at a time, instead of passing
+// every target to update_haptic_radar each frame.  Targets are
+// identified by their index and stay until they are removed or
+// update_haptic_radar replaces them.  A target's range, bearing and
+// effect are recalculated only when it moves farther than the delta
+// threshold or turns, and every target's only when the player's
+// origin moves farther than the threshold.  Smaller moves are
+// ignored, so a location may lag by up to the threshold.
+
+// Add a target, or replace the target with the same index.
+OMNI_RESULT DLL_EXPORT add_haptic_target(haptic_device_state_t *state,
+                                         const haptic_target_t *target);
+
+// Move the target with index.
+OMNI_RESULT DLL_EXPORT move_haptic_target(haptic_device_state_t *state,
+                                          int index,
+                                          const vec3_t location,
+                                          const vec3_t viewangles_deg);
+
+// Remove the target with index at once, even one locked for its period.
+OMNI_RESULT DLL_EXPORT remove_haptic_target(haptic_device_state_t *state,
+                                            int index);
+
+// Move the player.
+OMNI_RESULT DLL_EXPORT set_haptic_player_pose(haptic_device_state_t *state,
+                                              const vec3_t origin,
+                                              const vec3_t viewangles_deg);
+
+// Set the distance, in game units, that a target or the player must
+// move to be recalculated.  0, the default, recalculates on any move.
+OMNI_RESULT DLL_EXPORT set_haptic_delta_threshold(haptic_device_state_t *state,
+                                                  float distance);
+
 // Set haptic radar effect. This configures a type of haptic effect
 // to be associated with a specified target type.
 // period is only read if haptic_effect is a periodic one (ie - PULSE_BY_RANGE)
-// TODO - implement priority ranking of types of target?
+// See set_haptic_priority to rank the types of target.
 void DLL_EXPORT set_haptic_effect(haptic_device_state_t *state, int target_type, haptic_effect_t haptic_effect, float period);
 
 // Removes a haptic effect.
 void DLL_EXPORT clear_haptic_effect(haptic_device_state_t *state, int target_type);
 
+// Set the priority, -100 to 100, of a type of target.  Types default
+// to 0.  When a frame changes more motors than the report budget
+// allows, the motors showing the targets of higher priority are
+// updated first.
+OMNI_RESULT DLL_EXPORT set_haptic_priority(haptic_device_state_t *state,
+                                           int target_type, int priority);
+
+// Limit the motor reports that execute_haptic_effects sends in a
+// frame.  Only motors whose intensity changed are reported.  When
+// more motors change than reports_per_frame, the frame is sent as one
+// packed report if a packed mapping is defined.  Otherwise, the
+// motors of lower priority wait for a later frame, and only their
+// latest intensity is sent.  No change waits more than a few frames.
+// 0, the default, adapts the limit so that sending takes about half
+// the interval between frames at the measured cost of a report.
+OMNI_RESULT DLL_EXPORT set_haptic_report_budget(haptic_device_state_t *state,
+                                                int reports_per_frame);
+
+// Select how targets are mixed onto the motors.  Every in-cone target
+// contributes the product of its angle and range falloff, and the
+// contributions on each motor are combined by the combine rule.
+OMNI_RESULT DLL_EXPORT set_haptic_mixing(haptic_device_state_t *state,
+                                         haptic_combine_t combine,
+                                         haptic_falloff_t angle_falloff,
+                                         haptic_falloff_t range_falloff);
+
+// Select how target directions are mapped onto the motors.  With
+// SPATIAL_PANNING a target between two motors drives both, and the
+// angle falloff is not used.
+OMNI_RESULT DLL_EXPORT set_haptic_spatialization(haptic_device_state_t *state,
+                                                 haptic_spatial_t spatial);
+
+// Define a custom falloff curve.  The samples are gains from 0 to 1,
+// evenly spaced from the motor normal to MAX_ANGLE for CURVE_ANGLE,
+// or from zero to MAX_RANGE for CURVE_RANGE.  Count must be at least 2.
+OMNI_RESULT DLL_EXPORT define_haptic_falloff_curve(haptic_device_state_t *state,
+                                                   haptic_curve_t curve,
+                                                   const float *samples,
+                                                   int count);
+
+// Extrapolate the targets and the player's pose to the time the motor
+// reports reach the cap.  flags is a combination of
+// haptic_prediction_t.  Velocities are measured between successive
+// update_haptic_radar calls, each taken as of the game time of the
+// execute_haptic_effects that follows it.  Each frame extrapolates
+// from the last update by the game time since it, plus the measured
+// time to send the frame to the cap, plus latency_sec for latency the
+// SDK can't see, such as input.  No frame extrapolates by more than a
+// quarter second, so the radar may be updated at a low rate.  The
+// extrapolated targets are mixed from a copy; haptic_target_list keeps
+// what the game set.  execute_haptic_radar_batch doesn't extrapolate.
+OMNI_RESULT DLL_EXPORT set_haptic_prediction(haptic_device_state_t *state,
+                                             int flags, float latency_sec);
+
 // Called each frame to actually implment the haptic effects.
 void DLL_EXPORT execute_haptic_effects(haptic_device_state_t *state, double game_time);
 
+// Prepare a state for use without a device, e.g. for
+// execute_haptic_radar_batch.  open_omniwear_device does this for a
+// state with a device.
+OMNI_RESULT DLL_EXPORT init_haptic_state(haptic_device_state_t *state);
+
+// Run update_haptic_radar and execute_haptic_effects for many players
+// at once without touching any device.  Player i sees the targets
+// targets[target_sets[i].indices[...]] from the pose
+// player_origins[i], player_viewangles_deg[i].  The motor intensities
+// for player i are written to frames[i].  The players are spread
+// across a thread pool.
+OMNI_RESULT DLL_EXPORT execute_haptic_radar_batch(haptic_device_state_t *const states[],
+                                                  int player_count,
+                                                  const haptic_target_t targets[],
+                                                  int targets_len,
+                                                  const haptic_target_set_t target_sets[],
+                                                  const vec3_t player_origins[],
+                                                  const vec3_t player_viewangles_deg[],
+                                                  double game_time,
+                                                  haptic_motor_frame_t frames[]);
+
+// Mix the targets of a state onto the motors of a wearable as the
+// player looks along player_viewangles_deg.  The intensities, 0-100,
+// are those of the targets alone, before the oscillators, the global
+// intensity and the haptic volume.  Targets are mixed with the
+// state's falloff curves, combine rule and priorities, always with
+// SPATIAL_CONE.  Nothing is sent to a device.
+OMNI_RESULT DLL_EXPORT mix_haptic_cap(haptic_device_state_t *state,
+                                      const vec3_t player_viewangles_deg,
+                                      int intensities[NUMBER_OF_MOTORS]);
+OMNI_RESULT DLL_EXPORT mix_haptic_band(haptic_device_state_t *state,
+                                       const vec3_t player_viewangles_deg,
+                                       int intensities[HAPTIC_BAND_MOTORS]);
+OMNI_RESULT DLL_EXPORT mix_haptic_vest(haptic_device_state_t *state,
+                                       const vec3_t player_viewangles_deg,
+                                       int intensities[HAPTIC_VEST_MOTORS]);
+
+// Encode the intensities, 0-100, of a wearable's motors into packed
+// reports against the mapping of the last define_packed_*.  Returns
+// the number of reports, HAPTIC_PACKED_REPORTS of the wearable's
+// motors.  Report k carries motors 14*k on and starts with 0xf1 + k.
+int DLL_EXPORT encode_haptic_cap(const int intensities[NUMBER_OF_MOTORS],
+                                 uint8_t reports[][HAPTIC_REPORT_BYTES]);
+int DLL_EXPORT encode_haptic_band(const int intensities[HAPTIC_BAND_MOTORS],
+                                  uint8_t reports[][HAPTIC_REPORT_BYTES]);
+int DLL_EXPORT encode_haptic_vest(const int intensities[HAPTIC_VEST_MOTORS],
+                                  uint8_t reports[][HAPTIC_REPORT_BYTES]);
+
+// Load a pattern compiled by omni-pattern.  The file is mapped rather
+// than read where the platform allows it.  Returns NULL when the file
+// can't be read or isn't a compiled pattern.
+haptic_pattern_t* DLL_EXPORT load_haptic_pattern(const char *path);
+
+// Free a pattern.  It must not be playing on any state.
+void DLL_EXPORT unload_haptic_pattern(haptic_pattern_t *pattern);
+
+// Play a pattern on the device of a state, starting at game_time.
+// From then on, execute_haptic_effects sends the pattern's reports as
+// they fall due instead of the frames of the radar, until the pattern
+// ends or is stopped, when the radar takes the motors back.  The
+// reports were encoded when the pattern was compiled, so the haptic
+// volume doesn't apply to them.  The packed mapping the pattern was
+// compiled against is defined first if it isn't the current one, and
+// stays defined.  Playing another pattern replaces the one playing.
+OMNI_RESULT DLL_EXPORT play_haptic_pattern(haptic_device_state_t *state,
+                                           const haptic_pattern_t *pattern,
+                                           double game_time);
+
+// Stop the pattern playing on a state, if any.
+OMNI_RESULT DLL_EXPORT stop_haptic_pattern(haptic_device_state_t *state);
+
+// 1 while a pattern plays on a state, otherwise 0.
+int DLL_EXPORT is_haptic_pattern_playing(const haptic_device_state_t *state);
+
+// Set the number of threads, including the caller, used by
+// execute_haptic_radar_batch.  0, the default, uses one thread per
+// hardware thread.  1 runs batches on the calling thread alone.
+OMNI_RESULT DLL_EXPORT set_haptic_batch_threads(int threads);
+
+// Create a queue of commands for a state.  The queue_* functions may
+// be called from any thread and never block; they fail with
+// OMNI_ERROR_QUEUE_FULL when the queue is full.  The thread that owns
+// the state, the one calling execute_haptic_effects, applies the
+// queued commands with drain_haptic_command_queue.  Capacity is the
+// number of commands the queue holds, rounded up to a power of two.
+haptic_command_queue_t* DLL_EXPORT create_haptic_command_queue(haptic_device_state_t *state,
+                                                               int capacity);
+
+// Free a queue.  Commands still in the queue are discarded.
+void DLL_EXPORT destroy_haptic_command_queue(haptic_command_queue_t *queue);
+
+// Queue command_haptic_motor.
+OMNI_RESULT DLL_EXPORT queue_haptic_motor(haptic_command_queue_t *queue,
+                                          int motor_number, int intensity);
+
+// Queue set_haptic_effect.
+OMNI_RESULT DLL_EXPORT queue_haptic_effect(haptic_command_queue_t *queue,
+                                           int target_type,
+                                           haptic_effect_t haptic_effect,
+                                           float period);
+
+// Queue clear_haptic_effect.
+OMNI_RESULT DLL_EXPORT queue_clear_haptic_effect(haptic_command_queue_t *queue,
+                                                 int target_type);
+
+// Queue update_haptic_radar.  The targets are copied, so the caller
+// may reuse the array as soon as this returns.
+OMNI_RESULT DLL_EXPORT queue_haptic_radar(haptic_command_queue_t *queue,
+                                          const haptic_target_t targets[],
+                                          int targets_len,
+                                          const vec3_t player_origin,
+                                          const vec3_t player_viewangles_deg);
+
+// Apply up to max_commands queued commands, or all of them when
+// max_commands is 0.  Only the thread that owns the state may call
+// this.  Returns the number of commands applied.
+int DLL_EXPORT drain_haptic_command_queue(haptic_command_queue_t *queue,
+                                          int max_commands);
+
+// Create a snapshot of the scene for a state.  One thread, usually
+// the game's, publishes the player's pose, the targets and the effect
+// maps with publish_haptic_snapshot, typically once a frame.  The
+// thread that owns the state applies the latest of them with
+// apply_haptic_snapshot at its own rate, e.g. before each
+// execute_haptic_effects.  Neither side blocks, takes a lock or
+// allocates, and apply never sees a target list that is half
+// written.  Snapshots published between two applies replace each
+// other; only the latest is applied.
+haptic_snapshot_t* DLL_EXPORT create_haptic_snapshot(haptic_device_state_t *state);
+
+// Free a snapshot.
+void DLL_EXPORT destroy_haptic_snapshot(haptic_snapshot_t *snapshot);
+
+// Publish the scene.  Everything is copied, so the caller may reuse
+// its arrays as soon as this returns.  effect_maps may be NULL to
+// leave the state's effect maps as they are.  Only one thread at a
+// time may publish to a snapshot.
+OMNI_RESULT DLL_EXPORT publish_haptic_snapshot(haptic_snapshot_t *snapshot,
+                                               const haptic_target_t targets[],
+                                               int targets_len,
+                                               const vec3_t player_origin,
+                                               const vec3_t player_viewangles_deg,
+                                               const haptic_effect_map_t effect_maps[],
+                                               int effect_maps_len);
+
+// Apply the latest published scene with update_haptic_radar, and
+// with set_haptic_effect and clear_haptic_effect when its effect maps
+// changed.  Only the thread that owns the state may call this.
+// Returns 1 when a new scene was applied, and 0 when there was none,
+// or, rarely, when the publisher kept overwriting it while it was
+// being read, in which case it is applied by a later call.
+int DLL_EXPORT apply_haptic_snapshot(haptic_snapshot_t *snapshot);
+
+// Diagnostics are recorded into an in-memory ring instead of being
+// printed, so that they never cause I/O from the frame path.  Each
+// message is logged at most once a second; repeats are counted.
+// Call this from time to time, off the frame path, to format the
+// recorded messages and hand them to the log callback, or print them
+// to stdout when there is no callback.  At most max_records are
+// flushed, or all of them when max_records is 0.  Returns the number
+// of messages flushed.
+int DLL_EXPORT flush_omniwear_log(int max_records);
+
+// Set the function that receives flushed diagnostic messages.  NULL
+// restores printing to stdout.
+void DLL_EXPORT set_omniwear_log_callback(omniwear_log_callback_t callback,
+                                          void *context);
+
+// Fill stats with a snapshot of the counters and latency histograms
+// of the SDK, protocol and HID layers.  Recording is cheap enough to
+// stay on in release builds, and taking a snapshot doesn't stop it.
+OMNI_RESULT DLL_EXPORT get_omniwear_stats(omniwear_stats_t *stats);
+
+// Start recording spans of haptic and HID work into a ring of
+// capacity spans, 0 for the default of 65536, rounded up to a power
+// of two.  The ring is allocated by the first call and its capacity
+// is fixed from then on: a later call with another capacity fails
+// with OMNI_ERROR_INVALID_ARGUMENT, and one with the same capacity
+// starts the ring over, leaving out the spans recorded before it.
+// Spans being recorded across a restart may land in the new run.
+// Once the ring is full the oldest spans are overwritten.
+OMNI_RESULT DLL_EXPORT start_omniwear_trace(int capacity);
+
+// Stop recording spans.  The ring is kept for dump_omniwear_trace.
+void DLL_EXPORT stop_omniwear_trace(void);
+
+// Write the spans in the ring to path as Chrome trace-event JSON,
+// for chrome://tracing or Perfetto.  Timestamps are microseconds of
+// the monotonic clock.  Tracing need not be stopped first.
+OMNI_RESULT DLL_EXPORT dump_omniwear_trace(const char *path);
+
+// Start capturing every report sent to the device into the file at
+// path, for replay with omni-replay.  Only one capture may be open
+// at a time.
+OMNI_RESULT DLL_EXPORT start_omniwear_capture(const char *path);
+
+// Stop capturing and close the capture file.
+OMNI_RESULT DLL_EXPORT stop_omniwear_capture(void);
+
+// Start recording every call that changes a state, with its
+// arguments, into the file at path, for replay with omni-callreplay.
+// Only one recording may be open at a time.
+OMNI_RESULT DLL_EXPORT start_omniwear_call_log(const char *path);
+
+// Stop recording calls and close the file.
+OMNI_RESULT DLL_EXPORT stop_omniwear_call_log(void);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
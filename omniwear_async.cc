@@ -0,0 +1,183 @@
+/** @file omniwear_async.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Coroutine interface to the Omniwear protocol.  See
+   omniwear_async.h.
+
+   NOTES
+   =====
+
+   o Pending.  Each submitted write has a Pending record that is the
+     context of its HID completion.  The completion only marks the
+     record; service() resumes the waiter.  A wait that ends early
+     clears the record's waiter and leaves the record to the
+     completion, which frees it.
+
+*/
+
+#include "omniwear_async.h"
+#include "telemetry.h"
+#include <vector>
+
+#define DBG(a ...) \
+//  printf(a)
+
+namespace {
+
+  using Omniwear::Async::Clock;
+  using Omniwear::Async::Options;
+  using Omniwear::Async::Status;
+
+  struct Pending {
+    std::coroutine_handle<> waiter; // Null once the wait has ended early
+    Status* status;
+    Options options;
+    size_t cb;
+    bool completed = false;
+    int result = -1;
+  };
+
+  std::vector<Pending*> waiting$;
+  std::vector<Pending*> ready$;
+  int abandoned$;               // Ended early, not yet completed
+  bool servicing$;
+
+  // Status of a wait that hasn't completed, or ok when it may go on.
+  Status expired (const Options& options, Clock::time_point now) {
+    if (options.cancellation && options.cancellation->cancelled ())
+      return Status::cancelled;
+    if (now >= options.deadline)
+      return Status::timed_out;
+    return Status::ok; }
+
+  void complete (void* context, int result) {
+    auto p = static_cast<Pending*> (context);
+    if (!p->waiter) {
+      --abandoned$;
+      delete p;
+      return;
+    }
+    p->completed = true;
+    p->result = result;
+  }
+
+}
+
+namespace Omniwear {
+  namespace Async {
+
+    bool Write::await_suspend (std::coroutine_handle<> waiter) {
+      if (options_.deadline != Clock::time_point::max ()
+          || options_.cancellation) {
+        auto status = expired (options_, Clock::now ());
+        if (status != Status::ok) {
+          status_ = status;
+          return false;
+        }
+      }
+      auto p = new Pending { waiter, &status_, options_, report_.size () };
+      if (!HID::write_async (device_, &report_[0], report_.size (),
+                             complete, p)) {
+        delete p;
+        status_ = Status::failed;
+        return false;
+      }
+      waiting$.push_back (p);
+      return true;
+    }
+
+    Write write (const Device* d, const Report& report,
+                 const Options& options) {
+      return Write (d, report, options); }
+
+    Task<DeviceP> open (bool option_talk, Options options) {
+      auto d = HID::open (0x3eb, 0x2402);
+      if (!d)
+        co_return nullptr;
+      if (co_await write (d.get (), version_report (option_talk), options)
+          != Status::ok
+          || co_await write (d.get (), poll_version_report (), options)
+          != Status::ok)
+        co_return nullptr;
+      DBG ("Async::open %p\n", d.get ());
+      co_return std::move (d);
+    }
+
+    Write send_frame (const Device* d, const int* intensities, int count,
+                      const Options& options) {
+      Report msg;
+      if (!packed_report (msg, intensities, count))
+        return Write ();
+      Telemetry::count (Telemetry::packed_reports);
+      return Write (d, msg, options);
+    }
+
+    Write send_motor (const Device* d, int motor, int duty,
+                      const Options& options) {
+      auto msg = motor_report (motor, duty);
+      Telemetry::count (Telemetry::motor_reports);
+      return Write (d, msg, options);
+    }
+
+    Task<Status> upload_mapping (const Device* d,
+                                 std::array<uint8_t,16> intensities,
+                                 Options options) {
+      for (int i = 0; i < int (intensities.size ()); ++i) {
+        auto status = co_await write
+          (d, packed_definition_report (i, intensities[i]), options);
+        if (status != Status::ok)
+          co_return status;
+      }
+      remember_packed (&intensities[0]);
+      co_return Status::ok;
+    }
+
+    int service () {
+      if (servicing$)
+        return int (waiting$.size ()) + abandoned$;
+      servicing$ = true;
+
+      HID::service ();
+
+      // Pick the waits that are over before resuming any of them; a
+      // resumed coroutine may submit more writes.
+      auto now = Clock::now ();
+      size_t kept = 0;
+      ready$.clear ();
+      for (auto p : waiting$) {
+        if (p->completed)
+          *p->status = p->result == int (p->cb)
+            ? Status::ok : Status::failed;
+        else {
+          auto status = expired (p->options, now);
+          if (status == Status::ok) {
+            waiting$[kept++] = p;
+            continue;
+          }
+          *p->status = status;
+        }
+        ready$.push_back (p);
+      }
+      waiting$.resize (kept);
+
+      for (auto p : ready$) {
+        auto waiter = p->waiter;
+        if (p->completed)
+          delete p;
+        else {
+          p->waiter = nullptr;
+          ++abandoned$;
+        }
+        waiter.resume ();
+      }
+      ready$.clear ();
+
+      servicing$ = false;
+      return int (waiting$.size ()) + abandoned$;
+    }
+
+  }
+}
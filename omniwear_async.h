@@ -0,0 +1,231 @@
+/** @file omniwear_async.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Coroutine interface to the Omniwear protocol.  Where the functions
+   of omniwear.h block until HID::write returns, these submit the
+   report with HID::write_async and suspend the calling coroutine
+   until the write completes.  A caller can keep hundreds of reports
+   in flight from one thread without a thread or a callback per
+   report.
+
+     Task<Status> pulse (const Device* d, std::array<int,14> duties) {
+       auto status = co_await send_frame (d, &duties[0], 14,
+                                          Options::within (20ms));
+       ...
+       co_return status; }
+
+     auto task = pulse (device, duties);
+     task.start ();
+     while (Async::service ())
+       ;
+
+   NOTES
+   =====
+
+   o C++20.  The rest of the tree is C++14.  This header and
+     omniwear_async.cc are compiled with -std=c++20 and only when the
+     build is configured with CONFIG_ASYNC=y.  Nothing in the SDK
+     library depends on them.
+
+   o Resumption.  Coroutines are resumed only from Async::service(),
+     which calls HID::service() to collect completions and then
+     resumes every coroutine whose write completed, was cancelled, or
+     passed its deadline.  All of it happens on the thread that calls
+     service(), which must be the thread that submits the writes.
+
+   o Cancellation and deadlines.  A Cancellation or a deadline ends
+     the wait, not the write; a report handed to the OS can't be
+     taken back.  The coroutine resumes with Status::cancelled or
+     Status::timed_out at the next service() and the record of the
+     write lives on until the OS completes it, so a late completion
+     never touches a coroutine that has moved on.
+
+   o Tasks are lazy.  A Task doesn't run until it is awaited or
+     started, and it must outlive the wait; destroying a Task that is
+     suspended in a write is an error.  Arguments are copied into the
+     coroutine, which is why upload_mapping takes its mapping by value
+     and send_frame encodes its report before returning.
+
+*/
+
+#if !defined (OMNIWEAR_ASYNC_H_INCLUDED)
+#    define   OMNIWEAR_ASYNC_H_INCLUDED
+
+#if __cplusplus < 202002L
+# error "omniwear_async.h requires C++20, see CONFIG_ASYNC in the Makefile"
+#endif
+
+/* ----- Includes */
+
+#include "omniwear.h"
+#include <array>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+/* ----- Types */
+
+namespace Omniwear {
+  namespace Async {
+
+    using Clock = std::chrono::steady_clock;
+
+    enum class Status { ok, failed, cancelled, timed_out };
+
+    // Set by its owner to end the waits of the operations given it.
+    class Cancellation {
+    public:
+      void cancel () {
+        cancelled_ = true; }
+      void reset () {
+        cancelled_ = false; }
+      bool cancelled () const {
+        return cancelled_; }
+
+    private:
+      bool cancelled_ = false;
+    };
+
+    struct Options {
+      Clock::time_point deadline = Clock::time_point::max ();
+      const Cancellation* cancellation = nullptr;
+
+      static Options within (Clock::duration timeout,
+                             const Cancellation* cancellation = nullptr) {
+        return Options { Clock::now () + timeout, cancellation }; }
+    };
+
+    // Lazily started coroutine returning T, which must be default
+    // constructible.  Awaiting a Task runs it and resumes the awaiter
+    // when it returns.
+    template<typename T>
+    class Task {
+    public:
+      struct promise_type;
+      using Handle = std::coroutine_handle<promise_type>;
+
+      struct promise_type {
+        T value {};
+        std::coroutine_handle<> continuation;
+        bool started = false;
+
+        Task get_return_object () {
+          return Task (Handle::from_promise (*this)); }
+        std::suspend_always initial_suspend () noexcept {
+          return {}; }
+        auto final_suspend () noexcept {
+          struct Final {
+            bool await_ready () noexcept {
+              return false; }
+            std::coroutine_handle<> await_suspend (Handle h) noexcept {
+              auto continuation = h.promise ().continuation;
+              return continuation ? continuation : std::noop_coroutine (); }
+            void await_resume () noexcept {}
+          };
+          return Final {}; }
+        template<typename U>
+        void return_value (U&& v) {
+          value = std::forward<U> (v); }
+        void unhandled_exception () {
+          std::terminate (); }
+      };
+
+      Task (Task&& task) noexcept
+        : h_ (std::exchange (task.h_, nullptr)) {}
+      Task& operator= (Task&& task) noexcept {
+        if (this != &task) {
+          if (h_)
+            h_.destroy ();
+          h_ = std::exchange (task.h_, nullptr);
+        }
+        return *this; }
+      ~Task () {
+        if (h_)
+          h_.destroy (); }
+
+      // Run a task that nothing awaits up to its first suspension.
+      void start () {
+        if (h_ && !h_.promise ().started) {
+          h_.promise ().started = true;
+          h_.resume ();
+        } }
+
+      bool done () const {
+        return !h_ || h_.done (); }
+
+      T& result () {
+        return h_.promise ().value; }
+
+      bool await_ready () const noexcept {
+        return false; }
+      std::coroutine_handle<> await_suspend (std::coroutine_handle<> waiter)
+        noexcept {
+        h_.promise ().continuation = waiter;
+        h_.promise ().started = true;
+        return h_; }
+      T await_resume () {
+        return std::move (h_.promise ().value); }
+
+    private:
+      explicit Task (Handle h) : h_ (h) {}
+
+      Handle h_;
+    };
+
+    // Awaitable write of one report, resuming with its Status.
+    class Write {
+    public:
+      Write (const Device* device, const Report& report,
+             const Options& options)
+        : device_ (device), report_ (report), options_ (options) {}
+
+      // A write that fails without being submitted.
+      Write () : device_ (nullptr) {}
+
+      bool await_ready () const noexcept {
+        return !device_; }
+      bool await_suspend (std::coroutine_handle<> waiter);
+      Status await_resume () const noexcept {
+        return status_; }
+
+    private:
+      const Device* device_;
+      Report report_ {};
+      Options options_;
+      Status status_ = Status::failed;
+    };
+
+    Write write (const Device*, const Report&, const Options& = Options ());
+
+    // Open the cap and send the preamble.  HID::open itself blocks
+    // while it enumerates.  Unlike Omniwear::open, a preamble that
+    // doesn't complete fails the open.
+    Task<DeviceP> open (bool option_talk = false, Options = Options ());
+
+    // Packed report of up to 14 intensities, 0-100, like
+    // configure_motors_packed.
+    Write send_frame (const Device*, const int* intensities, int count,
+                      const Options& = Options ());
+
+    Write send_motor (const Device*, int motor, int duty,
+                      const Options& = Options ());
+
+    // Send the 16 packed duties, like define_packed.  The mapping is
+    // used to encode frames once all of it has been sent.
+    Task<Status> upload_mapping (const Device*,
+                                 std::array<uint8_t,16> intensities,
+                                 Options = Options ());
+
+    // Collect completions and resume the coroutines that are done
+    // waiting.  Returns the writes still in flight, including those
+    // whose waits were cancelled.  Not reentrant.
+    int service ();
+
+  }
+}
+
+#endif  /* OMNIWEAR_ASYNC_H_INCLUDED */
@@ -0,0 +1,79 @@
+/** @file probes.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   USDT static tracepoints for bpftrace, perf and SystemTap.  The
+   probes belong to the "omniwear" provider:
+
+     hid_write_entry  (report, bytes)          HID::write, all platforms
+     hid_write_return (report, bytes, success)
+     libusb_complete  (status, bytes)          Linux transfer completed
+     open_entry       ()                       Omniwear::open
+     open_return      (success)
+     motor_command    (motor, duty)            Single motor report
+     packed_command   (count)                  Packed frame of motors
+     execute_entry    (state)                  execute_haptic_effects
+     execute_return   (state)
+
+   For example, the distribution of write latencies on a running
+   game:
+
+     bpftrace -e '
+       usdt:./libomniwear_sdk.so:omniwear:hid_write_entry
+         { @start[tid] = nsecs; }
+       usdt:./libomniwear_sdk.so:omniwear:hid_write_return /@start[tid]/
+         { @ns = hist(nsecs - @start[tid]); delete(@start[tid]); }'
+
+   NOTES
+   =====
+
+   o Cost.  An unused probe is a single NOP in the instruction stream
+     and a note in the ELF file.  The arguments are only materialized
+     as operands of the probe, so pass values that are already at
+     hand.
+
+   o Availability.  The probes are compiled in whenever <sys/sdt.h>
+     is available, which it is on Linux once the SystemTap SDT headers
+     are installed, e.g. systemtap-sdt-dev or systemtap-sdt-devel.
+     Without those headers, or when OMNIWEAR_NO_USDT is defined, the
+     probes are no-ops and the tools above find nothing to attach to.
+     The Makefile warns when the headers are missing, and with
+     CONFIG_USDT=y, which defines OMNIWEAR_USDT_REQUIRED, the build
+     fails instead.
+
+*/
+
+#if !defined (PROBES_H_INCLUDED)
+#    define   PROBES_H_INCLUDED
+
+/* ----- Includes */
+
+#if defined (__linux__) && !defined (OMNIWEAR_NO_USDT) \
+  && defined (__has_include)
+# if __has_include (<sys/sdt.h>)
+#  include <sys/sdt.h>
+#  define OMNIWEAR_USDT
+# endif
+#endif
+
+#if defined (OMNIWEAR_USDT_REQUIRED) && !defined (OMNIWEAR_USDT)
+# error "USDT probes required but <sys/sdt.h> is not available"
+#endif
+
+/* ----- Macros */
+
+#if defined (OMNIWEAR_USDT)
+# define OMNI_PROBE(name)             DTRACE_PROBE (omniwear, name)
+# define OMNI_PROBE1(name, a)         DTRACE_PROBE1 (omniwear, name, a)
+# define OMNI_PROBE2(name, a, b)      DTRACE_PROBE2 (omniwear, name, a, b)
+# define OMNI_PROBE3(name, a, b, c)   DTRACE_PROBE3 (omniwear, name, a, b, c)
+#else
+# define OMNI_PROBE(name)             do {} while (0)
+# define OMNI_PROBE1(name, a)         do {} while (0)
+# define OMNI_PROBE2(name, a, b)      do {} while (0)
+# define OMNI_PROBE3(name, a, b, c)   do {} while (0)
+#endif
+
+#endif  /* PROBES_H_INCLUDED */
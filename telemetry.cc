@@ -0,0 +1,228 @@
+/** @file telemetry.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Counters and latency histograms.  See telemetry.h.
+
+*/
+
+#include "telemetry.h"
+#include "omniwear_SDK.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string.h>
+#include <vector>
+
+namespace {
+
+  struct Block {
+    std::atomic<uint64_t> counters[Telemetry::C_COUNTERS];
+    std::atomic<uint64_t> buckets[Telemetry::C_HISTOGRAMS][Telemetry::C_BUCKETS];
+    std::atomic<uint64_t> sums[Telemetry::C_HISTOGRAMS];
+    std::atomic<uint64_t> maxes[Telemetry::C_HISTOGRAMS];
+
+    Block () {
+      for (auto& c : counters)
+        c.store (0, std::memory_order_relaxed);
+      for (auto& h : buckets)
+        for (auto& b : h)
+          b.store (0, std::memory_order_relaxed);
+      for (auto& s : sums)
+        s.store (0, std::memory_order_relaxed);
+      for (auto& m : maxes)
+        m.store (0, std::memory_order_relaxed);
+    }
+  };
+
+  // The blocks of live threads, blocks that exited threads left for
+  // new ones, and the counts of exited threads.  Never destroyed, for
+  // threads that exit after main ().
+  struct Registry {
+    std::mutex lock;
+    std::vector<Block*> live;
+    std::vector<Block*> free;
+    Block retired;
+  };
+
+  Registry& registry () {
+    static auto r = new Registry;
+    return *r; }
+
+  // Moves the counts of a block into the totals and clears it.
+  void retire (Registry& r, Block& b) {
+    for (int i = 0; i < Telemetry::C_COUNTERS; ++i)
+      r.retired.counters[i].fetch_add
+        (b.counters[i].exchange (0, std::memory_order_relaxed),
+         std::memory_order_relaxed);
+    for (int h = 0; h < Telemetry::C_HISTOGRAMS; ++h) {
+      for (int i = 0; i < Telemetry::C_BUCKETS; ++i)
+        r.retired.buckets[h][i].fetch_add
+          (b.buckets[h][i].exchange (0, std::memory_order_relaxed),
+           std::memory_order_relaxed);
+      r.retired.sums[h].fetch_add
+        (b.sums[h].exchange (0, std::memory_order_relaxed),
+         std::memory_order_relaxed);
+      uint64_t m = b.maxes[h].exchange (0, std::memory_order_relaxed);
+      if (m > r.retired.maxes[h].load (std::memory_order_relaxed))
+        r.retired.maxes[h].store (m, std::memory_order_relaxed);
+    }
+  }
+
+  // Holds the block of a thread and gives it back when the thread
+  // exits.
+  struct Owner {
+    Block* block = nullptr;
+
+    ~Owner () {
+      if (!block)
+        return;
+      auto& r = registry ();
+      std::lock_guard<std::mutex> guard (r.lock);
+      retire (r, *block);
+      r.live.erase (std::find (r.live.begin (), r.live.end (), block));
+      r.free.push_back (block);
+      block = nullptr;
+    }
+  };
+
+  thread_local Owner owner$;
+
+  Block& block () {
+    if (!owner$.block) {
+      auto& r = registry ();
+      std::lock_guard<std::mutex> guard (r.lock);
+      if (r.free.empty ())
+        owner$.block = new Block;
+      else {
+        owner$.block = r.free.back ();
+        r.free.pop_back ();
+      }
+      r.live.push_back (owner$.block);
+    }
+    return *owner$.block;
+  }
+
+  // Only the owning thread writes to a block.
+  void add (std::atomic<uint64_t>& a, uint64_t n) {
+    a.store (a.load (std::memory_order_relaxed) + n,
+             std::memory_order_relaxed); }
+
+  const int64_t start_ns$ = Telemetry::now_ns ();
+
+  void summarize (Telemetry::Histogram h, omniwear_histogram_t& out) {
+    uint64_t buckets[Telemetry::C_BUCKETS] = {};
+    memset (&out, 0, sizeof (out));
+
+    {
+      auto& r = registry ();
+      std::lock_guard<std::mutex> guard (r.lock);
+      auto sum = [&] (const Block* b) {
+        for (int i = 0; i < Telemetry::C_BUCKETS; ++i)
+          buckets[i] += b->buckets[h][i].load (std::memory_order_relaxed);
+        out.sum_ns += b->sums[h].load (std::memory_order_relaxed);
+        uint64_t m = b->maxes[h].load (std::memory_order_relaxed);
+        if (m > out.max_ns)
+          out.max_ns = m; };
+      for (auto b : r.live)
+        sum (b);
+      sum (&r.retired);
+    }
+
+    for (auto c : buckets)
+      out.count += c;
+    if (!out.count)
+      return;
+
+    struct { double q; uint64_t* value; } quantiles[] = {
+      { 0.50,  &out.p50_ns },
+      { 0.90,  &out.p90_ns },
+      { 0.99,  &out.p99_ns },
+      { 0.999, &out.p999_ns },
+    };
+
+    uint64_t seen = 0;
+    int q = 0;
+    for (int i = 0; i < Telemetry::C_BUCKETS && q < 4; ++i) {
+      seen += buckets[i];
+      while (q < 4 && seen >= quantiles[q].q*out.count) {
+        uint64_t v = Telemetry::bucket_value (i);
+        *quantiles[q].value = v < out.max_ns ? v : out.max_ns;
+        ++q;
+      }
+    }
+  }
+
+}
+
+namespace Telemetry {
+
+  int bucket (uint64_t ns) {
+    if (ns < C_SUB)
+      return int (ns);
+    int e = 63 - __builtin_clzll (ns);
+    int i = (e - SUB_BITS + 1)*C_SUB + int ((ns >> (e - SUB_BITS)) & (C_SUB - 1));
+    return i < C_BUCKETS ? i : C_BUCKETS - 1;
+  }
+
+  uint64_t bucket_value (int i) {
+    if (i < C_SUB)
+      return i;
+    int e = i/C_SUB + SUB_BITS - 1;
+    uint64_t width = uint64_t (1) << (e - SUB_BITS);
+    return (C_SUB + i%C_SUB)*width + width/2;
+  }
+
+  void count (Counter c, uint64_t n) {
+    add (block ().counters[c], n); }
+
+  void record (Histogram h, int64_t ns) {
+    uint64_t v = ns < 0 ? 0 : uint64_t (ns);
+    auto& b = block ();
+    add (b.buckets[h][bucket (v)], 1);
+    add (b.sums[h], v);
+    if (v > b.maxes[h].load (std::memory_order_relaxed))
+      b.maxes[h].store (v, std::memory_order_relaxed);
+  }
+
+}
+
+OMNI_RESULT get_omniwear_stats (omniwear_stats_t* stats) {
+  if (!stats)
+    return OMNI_ERROR_INVALID_ARGUMENT;
+
+  memset (stats, 0, sizeof (*stats));
+  stats->uptime_ns = Telemetry::now_ns () - start_ns$;
+
+  uint64_t counters[Telemetry::C_COUNTERS] = {};
+  {
+    auto& r = registry ();
+    std::lock_guard<std::mutex> guard (r.lock);
+    for (auto b : r.live)
+      for (int i = 0; i < Telemetry::C_COUNTERS; ++i)
+        counters[i] += b->counters[i].load (std::memory_order_relaxed);
+    for (int i = 0; i < Telemetry::C_COUNTERS; ++i)
+      counters[i] += r.retired.counters[i].load (std::memory_order_relaxed);
+  }
+
+  stats->hid_writes_submitted = counters[Telemetry::hid_writes_submitted];
+  stats->hid_writes_completed = counters[Telemetry::hid_writes_completed];
+  stats->hid_writes_failed    = counters[Telemetry::hid_writes_failed];
+  stats->hid_bytes_written    = counters[Telemetry::hid_bytes_written];
+  stats->motor_reports        = counters[Telemetry::motor_reports];
+  stats->packed_reports       = counters[Telemetry::packed_reports];
+  stats->log_suppressed       = counters[Telemetry::log_suppressed];
+  stats->log_dropped          = counters[Telemetry::log_dropped];
+  stats->reports_unchanged    = counters[Telemetry::reports_unchanged];
+  stats->reports_deferred     = counters[Telemetry::reports_deferred];
+  stats->packed_fallbacks     = counters[Telemetry::packed_fallbacks];
+
+  summarize (Telemetry::hid_write_ns,    stats->hid_write);
+  summarize (Telemetry::encode_ns,       stats->encode);
+  summarize (Telemetry::radar_update_ns, stats->radar_update);
+  summarize (Telemetry::execute_ns,      stats->execute);
+
+  return OMNI_SUCCESS;
+}
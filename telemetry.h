@@ -0,0 +1,95 @@
+/** @file telemetry.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Low-overhead counters and latency histograms for the SDK, protocol
+   and HID layers.  get_omniwear_stats() in the SDK interface returns
+   a snapshot.
+
+   NOTES
+   =====
+
+   o Per-thread.  Each thread that records gets its own block of
+     counters and histograms, registered once on first use.  Recording
+     is a relaxed load and store to memory no other thread writes, so
+     there is no contention and no locked instruction on the hot path.
+     When a thread exits its counts are added to a total for exited
+     threads and its block is kept for the next new thread, so memory
+     is bounded by the threads alive at once.  A snapshot sums the
+     blocks of live threads and that total.
+
+   o Histograms.  Latencies are counted in logarithmic buckets in the
+     manner of HdrHistogram: eight linear sub-buckets per power of
+     two, so a percentile is accurate to about 6%.  Values from 1 ns
+     to about 18 minutes are resolved; longer ones land in the last
+     bucket.
+
+*/
+
+#if !defined (TELEMETRY_H_INCLUDED)
+#    define   TELEMETRY_H_INCLUDED
+
+/* ----- Includes */
+
+#include <chrono>
+#include <stdint.h>
+
+/* ----- Types */
+
+namespace Telemetry {
+
+  enum Counter {
+    hid_writes_submitted,
+    hid_writes_completed,
+    hid_writes_failed,
+    hid_bytes_written,
+    motor_reports,              // 0x10 single motor reports
+    packed_reports,             // 0xf1 packed frames
+    log_suppressed,
+    log_dropped,
+    reports_unchanged,          // Motors not reported, unchanged
+    reports_deferred,           // Motors held for a later frame
+    packed_fallbacks,           // Frames sent packed for the budget
+    C_COUNTERS,
+  };
+
+  enum Histogram {
+    hid_write_ns,
+    encode_ns,
+    radar_update_ns,
+    execute_ns,
+    C_HISTOGRAMS,
+  };
+
+  constexpr int SUB_BITS = 3;
+  constexpr int C_SUB = 1 << SUB_BITS;
+  constexpr int C_BUCKETS = (40 - SUB_BITS + 1)*C_SUB;
+
+  inline int64_t now_ns () {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>
+      (steady_clock::now ().time_since_epoch ()).count (); }
+
+  void count (Counter, uint64_t n = 1);
+  void record (Histogram, int64_t ns);
+
+  // Bucket for a value and a representative value for a bucket.
+  int bucket (uint64_t ns);
+  uint64_t bucket_value (int bucket);
+
+  // Records the time from construction to the end of the scope.
+  struct Timer {
+    Histogram histogram;
+    int64_t start_ns;
+
+    explicit Timer (Histogram histogram)
+      : histogram (histogram), start_ns (now_ns ()) {}
+    ~Timer () {
+      record (histogram, now_ns () - start_ns); }
+  };
+
+}
+
+#endif  /* TELEMETRY_H_INCLUDED */
@@ -0,0 +1,188 @@
+/** @file trace.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Span tracer and its Chrome trace-event export.  See trace.h.
+
+   NOTES
+   =====
+
+   o Export.  Spans are written as complete ("X") events with
+     timestamps and durations in microseconds.  Each thread that
+     records spans is given a small thread id, in the order that the
+     threads first record a span.
+
+*/
+
+#include "trace.h"
+#include "omniwear_SDK.h"
+#include <mutex>
+#include <stdio.h>
+
+namespace Trace {
+
+  struct Slot {
+    std::atomic<uint64_t> seq;  // Index + 1 once written, 0 while writing
+    std::atomic<const char*> name;
+    std::atomic<int64_t> start_ns;
+    std::atomic<int64_t> dur_ns;
+    std::atomic<int> tid;
+    std::atomic<const char*> arg_names[C_ARGS];
+    std::atomic<int64_t> args[C_ARGS];
+  };
+
+  // A restart doesn't clear the slots, which writers that started
+  // before it may still be writing.  It moves base to next instead,
+  // and a dump skips the slots before base by their sequence numbers.
+  struct Ring {
+    uint64_t mask;
+    std::atomic<uint64_t> next;
+    std::atomic<uint64_t> base;  // Index of the first span of this run
+    Slot* slots;
+
+    explicit Ring (uint64_t capacity)
+      : mask (capacity - 1), next (0), base (0), slots (new Slot[capacity]) {
+      for (uint64_t i = 0; i <= mask; ++i)
+        slots[i].seq.store (0, std::memory_order_relaxed); }
+
+    void restart () {
+      base.store (next.load (std::memory_order_relaxed),
+                  std::memory_order_release); }
+  };
+
+  std::atomic<Ring*> ring$;
+
+}
+
+namespace {
+
+  constexpr int C_SPANS_DEFAULT = 64*1024;
+  constexpr int C_SPANS_MAX = 16*1024*1024;
+
+  std::mutex control_lock$;     // Serializes start, stop and dump
+  Trace::Ring* storage$;        // Allocated once, kept for later dumps
+
+  std::atomic<int> next_tid$;
+  thread_local int tid$;
+
+  int tid () {
+    if (!tid$)
+      tid$ = next_tid$.fetch_add (1, std::memory_order_relaxed) + 1;
+    return tid$; }
+
+}
+
+namespace Trace {
+
+  void record (const char* name, int64_t start_ns, int64_t end_ns,
+               const char* arg0_name, int64_t arg0,
+               const char* arg1_name, int64_t arg1) {
+    auto ring = ring$.load (std::memory_order_acquire);
+    if (!ring)
+      return;
+
+    auto index = ring->next.fetch_add (1, std::memory_order_relaxed);
+    auto& slot = ring->slots[index & ring->mask];
+    constexpr auto relaxed = std::memory_order_relaxed;
+
+    slot.seq.store (0, relaxed);
+    std::atomic_thread_fence (std::memory_order_release);
+    slot.name.store (name, relaxed);
+    slot.start_ns.store (start_ns, relaxed);
+    slot.dur_ns.store (end_ns - start_ns, relaxed);
+    slot.tid.store (tid (), relaxed);
+    slot.arg_names[0].store (arg0_name, relaxed);
+    slot.args[0].store (arg0, relaxed);
+    slot.arg_names[1].store (arg1_name, relaxed);
+    slot.args[1].store (arg1, relaxed);
+    slot.seq.store (index + 1, std::memory_order_release);
+  }
+
+}
+
+OMNI_RESULT start_omniwear_trace (int capacity) {
+  if (capacity < 0 || capacity > C_SPANS_MAX)
+    return OMNI_ERROR_INVALID_ARGUMENT;
+
+  uint64_t c = 1;
+  while (c < uint64_t (capacity ? capacity : C_SPANS_DEFAULT))
+    c <<= 1;
+
+  std::lock_guard<std::mutex> guard (control_lock$);
+  if (!storage$)
+    storage$ = new Trace::Ring (c);
+  else if (c != storage$->mask + 1)
+    return OMNI_ERROR_INVALID_ARGUMENT;
+  else
+    storage$->restart ();
+  Trace::ring$.store (storage$, std::memory_order_release);
+  return OMNI_SUCCESS;
+}
+
+void stop_omniwear_trace (void) {
+  std::lock_guard<std::mutex> guard (control_lock$);
+  Trace::ring$.store (nullptr, std::memory_order_release);
+}
+
+OMNI_RESULT dump_omniwear_trace (const char* path) {
+  if (!path)
+    return OMNI_ERROR_INVALID_ARGUMENT;
+
+  std::lock_guard<std::mutex> guard (control_lock$);
+  auto ring = storage$;
+  if (!ring)
+    return OMNI_ERROR_INVALID_ARGUMENT;
+
+  auto fp = fopen (path, "w");
+  if (!fp)
+    return OMNI_ERROR_IO;
+
+  fprintf (fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+           "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+           "\"args\":{\"name\":\"omniwear\"}}");
+
+  constexpr auto relaxed = std::memory_order_relaxed;
+  uint64_t base = ring->base.load (std::memory_order_acquire);
+  uint64_t end = ring->next.load (std::memory_order_acquire);
+  uint64_t capacity = ring->mask + 1;
+  uint64_t begin = end > base + capacity ? end - capacity : base;
+  for (auto index = begin; index < end; ++index) {
+    auto& slot = ring->slots[index & ring->mask];
+    if (slot.seq.load (std::memory_order_acquire) != index + 1)
+      continue;
+    auto name = slot.name.load (relaxed);
+    auto start_ns = slot.start_ns.load (relaxed);
+    auto dur_ns = slot.dur_ns.load (relaxed);
+    auto tid = slot.tid.load (relaxed);
+    const char* arg_names[Trace::C_ARGS];
+    int64_t args[Trace::C_ARGS];
+    for (int i = 0; i < Trace::C_ARGS; ++i) {
+      arg_names[i] = slot.arg_names[i].load (relaxed);
+      args[i] = slot.args[i].load (relaxed);
+    }
+    std::atomic_thread_fence (std::memory_order_acquire);
+    if (slot.seq.load (relaxed) != index + 1)
+      continue;                 // Rewritten while we read it
+
+    fprintf (fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+             "\"ts\":%lld.%03d,\"dur\":%lld.%03d",
+             name, tid,
+             (long long) (start_ns/1000), int (start_ns%1000),
+             (long long) (dur_ns/1000), int (dur_ns%1000));
+    if (arg_names[0]) {
+      fprintf (fp, ",\"args\":{");
+      for (int i = 0; i < Trace::C_ARGS && arg_names[i]; ++i)
+        fprintf (fp, "%s\"%s\":%lld", i ? "," : "", arg_names[i],
+                 (long long) args[i]);
+      fprintf (fp, "}");
+    }
+    fprintf (fp, "}");
+  }
+
+  fprintf (fp, "\n]}\n");
+  bool ok = !ferror (fp);
+  ok = fclose (fp) == 0 && ok;
+  return ok ? OMNI_SUCCESS : OMNI_ERROR_IO;
+}
@@ -0,0 +1,79 @@
+/** @file trace.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Opt-in span tracer.  While tracing is on, spans are recorded into a
+   preallocated ring; dump_omniwear_trace() in the SDK interface
+   writes the ring as Chrome trace-event JSON that chrome://tracing
+   and Perfetto load directly.
+
+   NOTES
+   =====
+
+   o Cost.  While tracing is off, a span is one relaxed load.  While
+     it is on, a span reads the clock twice and writes one slot of the
+     ring.  Nothing allocates after start_omniwear_trace().
+
+   o Ring.  Writers claim slots with an atomic increment and overwrite
+     the oldest spans once the ring wraps, so the ring always holds
+     the most recent spans.  Each slot carries a sequence number that
+     is written last, so that a dump taken while spans are being
+     recorded skips the slots that are being rewritten.
+
+   o Clock.  Timestamps are from the monotonic clock, the same clock
+     that std::chrono::steady_clock reads on every platform we
+     support, so that the spans line up with traces the game records
+     against that clock.
+
+*/
+
+#if !defined (TRACE_H_INCLUDED)
+#    define   TRACE_H_INCLUDED
+
+/* ----- Includes */
+
+#include "telemetry.h"
+#include <atomic>
+
+/* ----- Types */
+
+namespace Trace {
+
+  constexpr int C_ARGS = 2;
+
+  struct Ring;
+  extern std::atomic<Ring*> ring$;   // Null while tracing is off
+
+  inline bool enabled () {
+    return ring$.load (std::memory_order_relaxed) != nullptr; }
+
+  // Record a span.  Names must be string literals, or otherwise
+  // outlive the ring.  Unused arguments have null names.
+  void record (const char* name, int64_t start_ns, int64_t end_ns,
+               const char* arg0_name = nullptr, int64_t arg0 = 0,
+               const char* arg1_name = nullptr, int64_t arg1 = 0);
+
+  // Records a span from construction to the end of the scope.
+  struct Span {
+    const char* name;
+    int64_t start_ns;
+    const char* arg_names[C_ARGS] = {};
+    int64_t args[C_ARGS] = {};
+
+    explicit Span (const char* name)
+      : name (name), start_ns (enabled () ? Telemetry::now_ns () : 0) {}
+    ~Span () {
+      if (start_ns && enabled ())
+        record (name, start_ns, Telemetry::now_ns (),
+                arg_names[0], args[0], arg_names[1], args[1]); }
+
+    void arg (int i, const char* name, int64_t value) {
+      arg_names[i] = name;
+      args[i] = value; }
+  };
+
+}
+
+#endif  /* TRACE_H_INCLUDED */
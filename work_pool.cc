@@ -0,0 +1,105 @@
+/** @file work_pool.cc
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Work-stealing thread pool.  See work_pool.h.
+
+*/
+
+#include "work_pool.h"
+#include <stdint.h>
+
+namespace WorkPool {
+
+  Pool::Pool (int threads) : ranges_ (threads < 1 ? 1 : threads) {
+    for (auto& range : ranges_) {
+      range.next = 0;
+      range.end = 0;
+    }
+    for (int i = 1; i < this->threads (); ++i)
+      workers_.emplace_back ([this, i] { worker (i); });
+  }
+
+  Pool::~Pool () {
+    {
+      std::lock_guard<std::mutex> guard (lock_);
+      stop_ = true;
+    }
+    start_.notify_all ();
+    for (auto& w : workers_)
+      w.join ();
+  }
+
+  void Pool::run (int count, const std::function<void (int)>& f) {
+    if (count <= 0)
+      return;
+
+    std::lock_guard<std::mutex> serial (run_lock_);
+
+    // Split the batch into one contiguous range per thread.
+    const int c = threads ();
+    for (int i = 0; i < c; ++i) {
+      ranges_[i].next.store (int (int64_t (count)*i/c),
+                             std::memory_order_relaxed);
+      ranges_[i].end = int (int64_t (count)*(i + 1)/c);
+    }
+    f_ = &f;
+
+    if (c > 1) {
+      {
+        std::lock_guard<std::mutex> guard (lock_);
+        busy_ = c - 1;
+        ++generation_;
+      }
+      start_.notify_all ();
+    }
+
+    work (0);
+
+    if (c > 1) {
+      std::unique_lock<std::mutex> guard (lock_);
+      done_.wait (guard, [this] { return busy_ == 0; });
+    }
+    f_ = nullptr;
+  }
+
+  /** Drain our own range and then steal from the others. */
+  void Pool::work (int self) {
+    const int c = threads ();
+    for (int k = 0; k < c; ++k) {
+      auto& range = ranges_[(self + k) % c];
+      while (true) {
+        int i = range.next.fetch_add (1, std::memory_order_relaxed);
+        if (i >= range.end)
+          break;
+        (*f_) (i);
+      }
+    }
+  }
+
+  void Pool::worker (int self) {
+    unsigned seen = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> guard (lock_);
+        start_.wait (guard, [&] { return stop_ || generation_ != seen; });
+        if (stop_)
+          return;
+        seen = generation_;
+      }
+
+      work (self);
+
+      bool last;
+      {
+        std::lock_guard<std::mutex> guard (lock_);
+        last = --busy_ == 0;
+      }
+      if (last)
+        done_.notify_one ();
+    }
+  }
+
+}
@@ -0,0 +1,87 @@
+/** @file work_pool.h
+
+   -----------
+   DESCRIPTION
+   -----------
+
+   Work-stealing thread pool for batches of independent work items.
+
+   NOTES
+   =====
+
+   o Stealing.  A batch of N items is split into one contiguous range
+     per thread.  Each thread claims items from the front of its own
+     range with an atomic increment and, once that range is drained,
+     claims items from the ranges of the other threads in the same
+     way.  There are no locks on the claim path, so a thread that
+     draws slow items doesn't hold up the rest of the batch.
+
+   o Caller participates.  The thread that calls run() works as
+     thread 0 of the pool, so a pool of one thread spawns no threads
+     at all and runs the batch inline.
+
+   o One batch at a time.  run() is serialized; concurrent callers
+     wait for each other.
+
+*/
+
+#if !defined (WORK_POOL_H_INCLUDED)
+#    define   WORK_POOL_H_INCLUDED
+
+/* ----- Includes */
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* ----- Types */
+
+namespace WorkPool {
+
+  class Pool {
+  public:
+    explicit Pool (int threads);
+    ~Pool ();
+
+    Pool (const Pool&) = delete;
+    Pool& operator= (const Pool&) = delete;
+
+    int threads () const {
+      return int (ranges_.size ()); }
+
+    // Call f (i) for every i from 0 to count - 1 and return when all
+    // of the calls have returned.
+    void run (int count, const std::function<void (int)>& f);
+
+  private:
+    // Ranges are padded to a cache line each so that the claims of
+    // one thread don't contend with those of its neighbors.
+    struct Range {
+      std::atomic<int> next;
+      int end;
+      char pad[64 - sizeof (std::atomic<int>) - sizeof (int)];
+    };
+
+    void work (int self);
+    void worker (int self);
+
+    std::vector<Range> ranges_;
+    std::vector<std::thread> workers_;
+    const std::function<void (int)>* f_ = nullptr;
+
+    std::mutex run_lock_;       // Serializes run ()
+    std::mutex lock_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    unsigned generation_ = 0;
+    int busy_ = 0;              // Workers still in the current batch
+    bool stop_ = false;
+  };
+
+}
+
+#endif  /* WORK_POOL_H_INCLUDED */